@@ -27,6 +27,8 @@ extern "C" __declspec(dllexport) void UnloadPlugin();
 extern "C" __declspec(dllexport) CTSTR GetPluginName();
 extern "C" __declspec(dllexport) CTSTR GetPluginDescription();
 
+OBS_PLUGIN_API_VERSION()
+
 LocaleStringLookup *pluginLocale = NULL;
 HINSTANCE hinstMain = NULL;
 
@@ -19,7 +19,7 @@
 
 #include "DShowPlugin.h"
 
-DWORD STDCALL PackPlanarThread(ConvertData *data);
+void STDCALL PackPlanarTile(ConvertData *data, UINT tile);
 
 #define NEAR_SILENT  3000
 #define NEAR_SILENTf 3000.0
@@ -63,13 +63,6 @@ bool DeviceSource::Init(XElement *data)
 
     capture->SetFiltergraph(graph);
 
-    int numThreads = MAX(OSGetTotalCores()-2, 1);
-    hConvertThreads = (HANDLE*)Allocate(sizeof(HANDLE)*numThreads);
-    convertData = (ConvertData*)Allocate(sizeof(ConvertData)*numThreads);
-
-    zero(hConvertThreads, sizeof(HANDLE)*numThreads);
-    zero(convertData, sizeof(ConvertData)*numThreads);
-
     this->data = data;
     UpdateSettings();
 
@@ -91,12 +84,6 @@ DeviceSource::~DeviceSource()
     SafeReleaseLogRef(capture);
     SafeReleaseLogRef(graph);
 
-    if(hConvertThreads)
-        Free(hConvertThreads);
-
-    if(convertData)
-        Free(convertData);
-
     if(hSampleMutex)
         OSCloseMutex(hSampleMutex);
 }
@@ -429,8 +416,6 @@ bool DeviceSource::LoadFilters()
 
     preferredOutputType = (data->GetInt(TEXT("usePreferredType")) != 0) ? data->GetInt(TEXT("preferredType")) : -1;
 
-    bFirstFrame = true;
-
     //------------------------------------------------
     // get the closest media output for the settings used
 
@@ -786,33 +771,11 @@ bool DeviceSource::LoadFilters()
         deinterlacer.isReady = false;
     }
 
-    int numThreads = MAX(OSGetTotalCores()-2, 1);
-    for(int i=0; i<numThreads; i++)
-    {
-        convertData[i].width  = lineSize;
-        convertData[i].height = renderCY;
-        convertData[i].sample = NULL;
-        convertData[i].hSignalConvert  = CreateEvent(NULL, FALSE, FALSE, NULL);
-        convertData[i].hSignalComplete = CreateEvent(NULL, FALSE, FALSE, NULL);
-        convertData[i].linePitch = linePitch;
-        convertData[i].lineShift = lineShift;
-
-        if(i == 0)
-            convertData[i].startY = 0;
-        else
-            convertData[i].startY = convertData[i-1].endY;
-
-        if(i == (numThreads-1))
-            convertData[i].endY = renderCY;
-        else
-            convertData[i].endY = ((renderCY/numThreads)*(i+1)) & 0xFFFFFFFE;
-    }
-
-    if(colorType == DeviceOutputType_YV12 || colorType == DeviceOutputType_I420)
-    {
-        for(int i=0; i<numThreads; i++)
-            hConvertThreads[i] = OSCreateThread((XTHREAD)PackPlanarThread, convertData+i);
-    }
+    zero(&convertData, sizeof(convertData));
+    convertData.width     = lineSize;
+    convertData.height    = renderCY;
+    convertData.linePitch = linePitch;
+    convertData.lineShift = lineShift;
 
     bSucceeded = true;
 
@@ -942,6 +905,17 @@ void DeviceSource::UnloadFilters()
         hStopSampleEvent = NULL;
     }
 
+    FinishConversion();
+
+    if(numConvertFrames)
+    {
+        Log(TEXT("DShowPlugin: '%s' conversion - [frames: %u] [tiles: %u] [avg wait: %g ms] [max wait: %g ms]"), strDeviceName.Array(),
+            numConvertFrames, numConvertTiles, double(convertWaitTime)*0.001/double(numConvertFrames), double(maxConvertWaitTime)*0.001);
+
+        numConvertFrames = numConvertTiles = 0;
+        convertWaitTime = maxConvertWaitTime = 0;
+    }
+
     if(texture)
     {
         delete texture;
@@ -953,33 +927,6 @@ void DeviceSource::UnloadFilters()
         previousTexture = NULL;
     }
 
-    int numThreads = MAX(OSGetTotalCores()-2, 1);
-    for(int i=0; i<numThreads; i++)
-    {
-        if(hConvertThreads[i])
-        {
-            convertData[i].bKillThread = true;
-            SetEvent(convertData[i].hSignalConvert);
-
-            OSTerminateThread(hConvertThreads[i], 10000);
-            hConvertThreads[i] = NULL;
-        }
-
-        convertData[i].bKillThread = false;
-
-        if(convertData[i].hSignalConvert)
-        {
-            CloseHandle(convertData[i].hSignalConvert);
-            convertData[i].hSignalConvert = NULL;
-        }
-
-        if(convertData[i].hSignalComplete)
-        {
-            CloseHandle(convertData[i].hSignalComplete);
-            convertData[i].hSignalComplete = NULL;
-        }
-    }
-
     if(bFiltersLoaded)
     {
         graph->RemoveFilter(captureFilter);
@@ -1271,19 +1218,34 @@ void DeviceSource::ReceiveMediaSample(IMediaSample *sample, bool bAudio)
     }
 }
 
-static DWORD STDCALL PackPlanarThread(ConvertData *data)
+//one task pool task, converts a band of tileHeight rows
+void STDCALL PackPlanarTile(ConvertData *data, UINT tile)
+{
+    UINT startY = tile*data->tileHeight;
+    UINT endY   = MIN(startY+data->tileHeight, data->height);
+
+    PackPlanar(data->output, data->input, data->width, data->height, data->pitch, startY, endY, data->linePitch, data->lineShift);
+}
+
+//waits for the previous frame's tiles and lets go of its sample
+void DeviceSource::FinishConversion()
 {
-    do {
-        WaitForSingleObject(data->hSignalConvert, INFINITE);
-        if(data->bKillThread) break;
+    if(!convertBatch)
+        return;
 
-        PackPlanar(data->output, data->input, data->width, data->height, data->pitch, data->startY, data->endY, data->linePitch, data->lineShift);
-        data->sample->Release();
+    QWORD waitStart = OSGetTimeMicroseconds();
+    convertPool->Wait(convertBatch);
+    QWORD waitTime = OSGetTimeMicroseconds()-waitStart;
 
-        SetEvent(data->hSignalComplete);
-    }while(!data->bKillThread);
+    convertWaitTime += waitTime;
+    if(waitTime > maxConvertWaitTime)
+        maxConvertWaitTime = waitTime;
 
-    return 0;
+    convertBatch = NULL;
+    convertPool = NULL;
+
+    convertSample->Release();
+    convertSample = NULL;
 }
 
 void DeviceSource::Preprocess()
@@ -1325,8 +1287,6 @@ void DeviceSource::Preprocess()
 
     //----------------------------------------
 
-    int numThreads = MAX(OSGetTotalCores()-2, 1);
-
     if(lastSample)
     {
         /*REFERENCE_TIME refTimeStart, refTimeFinish;
@@ -1355,35 +1315,39 @@ void DeviceSource::Preprocess()
         }
         else if(colorType == DeviceOutputType_I420 || colorType == DeviceOutputType_YV12)
         {
-            if(bUseThreadedConversion)
+            TaskPool *pool = bUseThreadedConversion ? API->GetTaskPool() : NULL;
+
+            if(pool && lpImageBuffer)
             {
-                if(!bFirstFrame)
+                //the previous frame's tiles finish while this one is queued, so the texture is a frame behind
+                if(convertBatch)
                 {
-                    List<HANDLE> events;
-                    for(int i=0; i<numThreads; i++)
-                        events << convertData[i].hSignalComplete;
-
-                    WaitForMultipleObjects(numThreads, events.Array(), TRUE, INFINITE);
+                    FinishConversion();
                     texture->SetImage(lpImageBuffer, GS_IMAGEFORMAT_RGBX, texturePitch);
 
                     bReadyToDraw = true;
                 }
-                else
-                    bFirstFrame = false;
-
-                for(int i=0; i<numThreads; i++)
-                    lastSample->AddRef();
 
-                for(int i=0; i<numThreads; i++)
-                {
-                    convertData[i].input     = lastSample->lpData;
-                    convertData[i].sample    = lastSample;
-                    convertData[i].pitch     = texturePitch;
-                    convertData[i].output    = lpImageBuffer;
-                    convertData[i].linePitch = linePitch;
-                    convertData[i].lineShift = lineShift;
-                    SetEvent(convertData[i].hSignalConvert);
-                }
+                //  tiles go into the same pool as the main 4:2:0 conversion and every other device, so it's
+                //split up a bit finer than the number of threads to let them balance out.  tiles have to be
+                //an even number of rows.
+                UINT numTiles = MAX(pool->NumThreads(), 1)*2;
+                convertData.tileHeight = MAX(((renderCY+numTiles-1)/numTiles + 1) & 0xFFFFFFFE, 16);
+                convertData.numTiles   = (renderCY+convertData.tileHeight-1)/convertData.tileHeight;
+
+                convertData.input     = lastSample->lpData;
+                convertData.output    = lpImageBuffer;
+                convertData.pitch     = texturePitch;
+                convertData.linePitch = linePitch;
+                convertData.lineShift = lineShift;
+
+                lastSample->AddRef();
+                convertSample = lastSample;
+                convertPool = pool;
+                convertBatch = pool->Submit((TASKPROC)PackPlanarTile, &convertData, convertData.numTiles);
+
+                numConvertFrames++;
+                numConvertTiles += convertData.numTiles;
             }
             else
             {
@@ -1406,7 +1370,7 @@ void DeviceSource::Preprocess()
 
             if(texture->Map(lpData, pitch))
             {
-                Convert422To444(lpData, lastSample->lpData, pitch, true);
+                Convert422To444(lpData, lastSample->lpData, lineSize, renderCY, pitch, linePitch, lineShift, true);
                 texture->Unmap();
             }
 
@@ -1419,7 +1383,7 @@ void DeviceSource::Preprocess()
 
             if(texture->Map(lpData, pitch))
             {
-                Convert422To444(lpData, lastSample->lpData, pitch, false);
+                Convert422To444(lpData, lastSample->lpData, lineSize, renderCY, pitch, linePitch, lineShift, false);
                 texture->Unmap();
             }
 
@@ -22,6 +22,7 @@
 #include <memory>
 
 void PackPlanar(LPBYTE convertBuffer, LPBYTE lpPlanar, UINT renderCX, UINT renderCY, UINT pitch, UINT startY, UINT endY, UINT linePitch, UINT lineShift);
+void Convert422To444(LPBYTE convertBuffer, LPBYTE lp422, UINT lineSize, UINT renderCY, UINT pitch, UINT linePitch, UINT lineShift, bool bLeadingY);
 
 enum DeviceColorType
 {
@@ -58,16 +59,14 @@ struct SampleData {
     }
 };
 
+//one frame of planar conversion, split into tiles of tileHeight rows for the shared task pool
 struct ConvertData
 {
     LPBYTE input, output;
-    SampleData *sample;
-    HANDLE hSignalConvert, hSignalComplete;
-    bool   bKillThread;
     UINT   width, height;
     UINT   pitch;
-    UINT   startY, endY;
     UINT   linePitch, lineShift;
+    UINT   tileHeight, numTiles;
 };
 
 class DeviceSource;
@@ -153,7 +152,6 @@ class DeviceSource : public ImageSource
         FuturePixelShader           pixelShader;
     } deinterlacer;
 
-    bool            bFirstFrame;
     bool            bUseThreadedConversion;
     bool            bReadyToDraw;
 
@@ -182,8 +180,13 @@ class DeviceSource : public ImageSource
     //---------------------------------
 
     LPBYTE          lpImageBuffer;
-    ConvertData     *convertData;
-    HANDLE          *hConvertThreads;
+    ConvertData     convertData;
+    TaskPool        *convertPool;
+    TaskBatch       *convertBatch;
+    SampleData      *convertSample;
+
+    UINT            numConvertFrames, numConvertTiles;
+    QWORD           convertWaitTime, maxConvertWaitTime;
 
     //---------------------------------
 
@@ -200,7 +203,7 @@ class DeviceSource : public ImageSource
     String ChooseShader();
     String ChooseDeinterlacingShader();
 
-    void Convert422To444(LPBYTE convertBuffer, LPBYTE lp422, UINT pitch, bool bLeadingY);
+    void FinishConversion();
 
     void FlushSamples()
     {
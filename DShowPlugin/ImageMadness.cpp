@@ -18,6 +18,96 @@
 
 
 #include "DShowPlugin.h"
+#include <intrin.h>
+#include <tmmintrin.h>
+
+
+//implemented in ImageMadnessAVX2.cpp, they return how many chroma columns/input DWORDs they converted
+unsigned int PackPlanarLine_AVX2(const unsigned char *lum1, const unsigned char *lum2, const unsigned char *chroma1, const unsigned char *chroma2,
+                                 unsigned int *output1, unsigned int *output2, unsigned int halfX);
+unsigned int Convert422To444Line_AVX2(const unsigned char *input, unsigned int *output, unsigned int numDWords, bool bLeadingY);
+
+static bool HasAVX2Support()
+{
+    int cpuInfo[4];
+
+    __cpuid(cpuInfo, 0);
+    if(cpuInfo[0] < 7)
+        return false;
+
+    //needs AVX, and OSXSAVE plus the OS actually saving the YMM registers
+    __cpuid(cpuInfo, 1);
+    if((cpuInfo[2] & (1<<27)) == 0 || (cpuInfo[2] & (1<<28)) == 0)
+        return false;
+    if((_xgetbv(0) & 6) != 6)
+        return false;
+
+    __cpuidex(cpuInfo, 7, 0);
+    return (cpuInfo[1] & (1<<5)) != 0;
+}
+
+static bool HasSSSE3Support()
+{
+    int cpuInfo[4];
+
+    __cpuid(cpuInfo, 1);
+    return (cpuInfo[2] & (1<<9)) != 0;
+}
+
+//not static so the conversion tests can run the SSSE3 and SSE2 paths on newer cpus
+bool bDeviceConvertWithAVX2 = HasAVX2Support();
+bool bDeviceConvertWithSSSE3 = HasSSSE3Support();
+
+//  the output is one DWORD per pixel with Y in the low byte, then U, then V.  each 8 chroma samples cover 16
+//pixels on both lines, so the chroma gets doubled up and interleaved with the luma of each line separately.
+
+static inline void PackPlanarLine_SSE2(LPBYTE lpLum1, LPBYTE lpLum2, LPBYTE lpChroma1, LPBYTE lpChroma2, LPDWORD output1, LPDWORD output2, UINT startX, UINT halfX)
+{
+    UINT alignedX = startX + ((halfX-startX) & 0xFFFFFFF8);
+    __m128i zeroVal = _mm_setzero_si128();
+
+    for(UINT x=startX; x<alignedX; x+=8)
+    {
+        __m128i u = _mm_loadl_epi64((__m128i*)(lpChroma1+x));
+        __m128i v = _mm_loadl_epi64((__m128i*)(lpChroma2+x));
+        u = _mm_unpacklo_epi8(u, u);
+        v = _mm_unpacklo_epi8(v, v);
+
+        __m128i vLo = _mm_unpacklo_epi8(v, zeroVal);
+        __m128i vHi = _mm_unpackhi_epi8(v, zeroVal);
+
+        __m128i lum = _mm_loadu_si128((__m128i*)(lpLum1+x*2));
+        __m128i yuLo = _mm_unpacklo_epi8(lum, u);
+        __m128i yuHi = _mm_unpackhi_epi8(lum, u);
+
+        __m128i *out = (__m128i*)(output1+x*2);
+        _mm_storeu_si128(out,   _mm_unpacklo_epi16(yuLo, vLo));
+        _mm_storeu_si128(out+1, _mm_unpackhi_epi16(yuLo, vLo));
+        _mm_storeu_si128(out+2, _mm_unpacklo_epi16(yuHi, vHi));
+        _mm_storeu_si128(out+3, _mm_unpackhi_epi16(yuHi, vHi));
+
+        lum = _mm_loadu_si128((__m128i*)(lpLum2+x*2));
+        yuLo = _mm_unpacklo_epi8(lum, u);
+        yuHi = _mm_unpackhi_epi8(lum, u);
+
+        out = (__m128i*)(output2+x*2);
+        _mm_storeu_si128(out,   _mm_unpacklo_epi16(yuLo, vLo));
+        _mm_storeu_si128(out+1, _mm_unpackhi_epi16(yuLo, vLo));
+        _mm_storeu_si128(out+2, _mm_unpacklo_epi16(yuHi, vHi));
+        _mm_storeu_si128(out+3, _mm_unpackhi_epi16(yuHi, vHi));
+    }
+
+    for(UINT x=alignedX; x<halfX; x++)
+    {
+        DWORD out = (lpChroma1[x] << 8) | (lpChroma2[x] << 16);
+
+        output1[x*2]   = lpLum1[x*2]   | out;
+        output1[x*2+1] = lpLum1[x*2+1] | out;
+
+        output2[x*2]   = lpLum2[x*2]   | out;
+        output2[x*2+1] = lpLum2[x*2+1] | out;
+    }
+}
 
 //now properly takes CPU cache into account - it's just so much faster than it was.
 void PackPlanar(LPBYTE convertBuffer, LPBYTE lpPlanar, UINT renderCX, UINT renderCY, UINT pitch, UINT startY, UINT endY, UINT linePitch, UINT lineShift)
@@ -40,66 +130,122 @@ void PackPlanar(LPBYTE convertBuffer, LPBYTE lpPlanar, UINT renderCX, UINT rende
         LPDWORD output1 = (LPDWORD)(output + (y*2)*pitch);
         LPDWORD output2 = (LPDWORD)(((LPBYTE)output1)+pitch);
 
-        for(UINT x=0; x<halfX; x++)
-        {
-            DWORD out = (*(lpChroma1++) << 8) | (*(lpChroma2++) << 16);
+        UINT startX = 0;
+        if(bDeviceConvertWithAVX2)
+            startX = PackPlanarLine_AVX2(lpLum1, lpLum2, lpChroma1, lpChroma2, (unsigned int*)output1, (unsigned int*)output2, halfX);
 
-            *(output1++) = *(lpLum1++) | out;
-            *(output1++) = *(lpLum1++) | out;
+        PackPlanarLine_SSE2(lpLum1, lpLum2, lpChroma1, lpChroma2, output1, output2, startX, halfX);
 
-            *(output2++) = *(lpLum2++) | out;
-            *(output2++) = *(lpLum2++) | out;
+        //odd widths have no chroma sample of their own for the last column, so it borrows the one to its left
+        if((renderCX & 1) && halfX)
+        {
+            DWORD out = output1[renderCX-2] & 0xFFFFFF00;
+            output1[renderCX-1] = lpLum1[renderCX-1] | out;
+            output2[renderCX-1] = lpLum2[renderCX-1] | out;
         }
     }
 }
 
-void DeviceSource::Convert422To444(LPBYTE convertBuffer, LPBYTE lp422, UINT pitch, bool bLeadingY)
+//  each input DWORD is two pixels sharing one U and V, and turns into two output DWORDs: the first is the
+//input as-is and the second has the luma of the second pixel moved into the luma slot.
+
+static inline void Convert422To444Line_SSE2(LPBYTE lpInput, LPDWORD output, UINT startX, UINT numDWords, bool bLeadingY)
 {
-    DWORD size = lineSize;
-    DWORD dwDWSize = size>>2;
+    UINT alignedX = startX + ((numDWords-startX) & 0xFFFFFFFC);
+
+    if(bDeviceConvertWithSSSE3)
+    {
+        __m128i shuffleLo, shuffleHi;
+        if(bLeadingY)
+        {
+            shuffleLo = _mm_setr_epi8(0, 1, 2, 3, 2, 1, 2, 3, 4, 5, 6, 7, 6, 5, 6, 7);
+            shuffleHi = _mm_setr_epi8(8, 9, 10, 11, 10, 9, 10, 11, 12, 13, 14, 15, 14, 13, 14, 15);
+        }
+        else
+        {
+            shuffleLo = _mm_setr_epi8(0, 1, 2, 3, 0, 3, 2, 3, 4, 5, 6, 7, 4, 7, 6, 7);
+            shuffleHi = _mm_setr_epi8(8, 9, 10, 11, 8, 11, 10, 11, 12, 13, 14, 15, 12, 15, 14, 15);
+        }
+
+        for(UINT x=startX; x<alignedX; x+=4)
+        {
+            __m128i in = _mm_loadu_si128((__m128i*)(lpInput+x*4));
+            __m128i *out = (__m128i*)(output+x*2);
+
+            _mm_storeu_si128(out,   _mm_shuffle_epi8(in, shuffleLo));
+            _mm_storeu_si128(out+1, _mm_shuffle_epi8(in, shuffleHi));
+        }
+    }
+    else
+    {
+        __m128i keepMask = _mm_set1_epi32(bLeadingY ? 0xFFFFFF00 : 0xFFFF00FF);
+        __m128i lumMask  = _mm_set1_epi32(bLeadingY ? 0x000000FF : 0x0000FF00);
+
+        for(UINT x=startX; x<alignedX; x+=4)
+        {
+            __m128i in = _mm_loadu_si128((__m128i*)(lpInput+x*4));
+            __m128i second = _mm_or_si128(_mm_and_si128(in, keepMask), _mm_and_si128(_mm_srli_epi32(in, 16), lumMask));
+            __m128i *out = (__m128i*)(output+x*2);
+
+            _mm_storeu_si128(out,   _mm_unpacklo_epi32(in, second));
+            _mm_storeu_si128(out+1, _mm_unpackhi_epi32(in, second));
+        }
+    }
+
+    LPDWORD inputDW = (LPDWORD)lpInput;
 
     if(bLeadingY)
     {
-        for(UINT y=0; y<renderCY; y++)
+        for(UINT x=alignedX; x<numDWords; x++)
         {
-            LPDWORD output = (LPDWORD)(convertBuffer+(y*pitch));
-            LPDWORD inputDW = (LPDWORD)(lp422+(y*linePitch)+lineShift);
-            LPDWORD inputDWEnd = inputDW+dwDWSize;
-
-            while(inputDW < inputDWEnd)
-            {
-                register DWORD dw = *inputDW;
-
-                output[0] = dw;
-                dw &= 0xFFFFFF00;
-                dw |= BYTE(dw>>16);
-                output[1] = dw;
-
-                output += 2;
-                inputDW++;
-            }
+            register DWORD dw = inputDW[x];
+
+            output[x*2] = dw;
+            dw &= 0xFFFFFF00;
+            dw |= BYTE(dw>>16);
+            output[x*2+1] = dw;
         }
     }
     else
     {
-        for(UINT y=0; y<renderCY; y++)
+        for(UINT x=alignedX; x<numDWords; x++)
+        {
+            register DWORD dw = inputDW[x];
+
+            output[x*2] = dw;
+            dw &= 0xFFFF00FF;
+            dw |= (dw>>16) & 0xFF00;
+            output[x*2+1] = dw;
+        }
+    }
+}
+
+void Convert422To444(LPBYTE convertBuffer, LPBYTE lp422, UINT lineSize, UINT renderCY, UINT pitch, UINT linePitch, UINT lineShift, bool bLeadingY)
+{
+    DWORD size = lineSize;
+    DWORD dwDWSize = size>>2;
+
+    for(UINT y=0; y<renderCY; y++)
+    {
+        LPDWORD output = (LPDWORD)(convertBuffer+(y*pitch));
+        LPBYTE input = lp422+(y*linePitch)+lineShift;
+
+        UINT startX = 0;
+        if(bDeviceConvertWithAVX2)
+            startX = Convert422To444Line_AVX2(input, (unsigned int*)output, dwDWSize, bLeadingY);
+
+        Convert422To444Line_SSE2(input, output, startX, dwDWSize, bLeadingY);
+
+        //odd widths end on a lone luma sample, which takes the chroma of the pixel pair before it
+        if((size & 2) && dwDWSize)
         {
-            LPDWORD output = (LPDWORD)(convertBuffer+(y*pitch));
-            LPDWORD inputDW = (LPDWORD)(lp422+(y*linePitch)+lineShift);
-            LPDWORD inputDWEnd = inputDW+dwDWSize;
-
-            while(inputDW < inputDWEnd)
-            {
-                register DWORD dw = *inputDW;
-
-                output[0] = dw;
-                dw &= 0xFFFF00FF;
-                dw |= (dw>>16) & 0xFF00;
-                output[1] = dw;
-
-                output += 2;
-                inputDW++;
-            }
+            BYTE lum = input[dwDWSize*4 + (bLeadingY ? 0 : 1)];
+            DWORD dw = output[dwDWSize*2-1];
+
+            if(bLeadingY)
+                output[dwDWSize*2] = (dw & 0xFFFFFF00) | lum;
+            else
+                output[dwDWSize*2] = (dw & 0xFFFF00FF) | (lum << 8);
         }
     }
 }
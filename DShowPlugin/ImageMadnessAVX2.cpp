@@ -0,0 +1,102 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+//  this file is compiled with /arch:AVX2, so it must only ever be called after checking the cpu supports
+//it (see PackPlanar in ImageMadness.cpp).  like ImageProcessingAVX2.cpp in the main program, it doesn't
+//include the plugin headers so none of their inline functions get compiled with AVX2 enabled.
+
+#include <immintrin.h>
+
+
+//  same layout as the SSE2 version, 16 chroma columns (32 pixels) at a time.  the unpacks work on each
+//128bit lane separately, so the chroma is widened with vpmovzxbw first to line its lanes up with the luma,
+//and the finished pixels get their lanes put back in order when stored.
+
+unsigned int PackPlanarLine_AVX2(const unsigned char *lum1, const unsigned char *lum2, const unsigned char *chroma1, const unsigned char *chroma2,
+                                 unsigned int *output1, unsigned int *output2, unsigned int halfX)
+{
+    unsigned int alignedX = halfX & 0xFFFFFFF0;
+    __m256i zeroVal = _mm256_setzero_si256();
+
+    for(unsigned int x=0; x<alignedX; x+=16)
+    {
+        __m256i u = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(chroma1+x)));
+        __m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(chroma2+x)));
+        u = _mm256_or_si256(u, _mm256_slli_epi16(u, 8));
+        v = _mm256_or_si256(v, _mm256_slli_epi16(v, 8));
+
+        __m256i vLo = _mm256_unpacklo_epi8(v, zeroVal);
+        __m256i vHi = _mm256_unpackhi_epi8(v, zeroVal);
+
+        for(int line=0; line<2; line++)
+        {
+            __m256i lum = _mm256_loadu_si256((const __m256i*)((line ? lum2 : lum1)+x*2));
+            __m256i yuLo = _mm256_unpacklo_epi8(lum, u);
+            __m256i yuHi = _mm256_unpackhi_epi8(lum, u);
+
+            __m256i p0 = _mm256_unpacklo_epi16(yuLo, vLo);
+            __m256i p1 = _mm256_unpackhi_epi16(yuLo, vLo);
+            __m256i p2 = _mm256_unpacklo_epi16(yuHi, vHi);
+            __m256i p3 = _mm256_unpackhi_epi16(yuHi, vHi);
+
+            __m256i *out = (__m256i*)((line ? output2 : output1)+x*2);
+            _mm256_storeu_si256(out,   _mm256_permute2x128_si256(p0, p1, 0x20));
+            _mm256_storeu_si256(out+1, _mm256_permute2x128_si256(p2, p3, 0x20));
+            _mm256_storeu_si256(out+2, _mm256_permute2x128_si256(p0, p1, 0x31));
+            _mm256_storeu_si256(out+3, _mm256_permute2x128_si256(p2, p3, 0x31));
+        }
+    }
+
+    return alignedX;
+}
+
+//  8 input DWORDs (16 pixels) at a time, with the same shuffles as the SSSE3 version
+
+unsigned int Convert422To444Line_AVX2(const unsigned char *input, unsigned int *output, unsigned int numDWords, bool bLeadingY)
+{
+    unsigned int alignedX = numDWords & 0xFFFFFFF8;
+
+    __m256i shuffleLo, shuffleHi;
+    if(bLeadingY)
+    {
+        shuffleLo = _mm256_setr_epi8(0, 1, 2, 3, 2, 1, 2, 3, 4, 5, 6, 7, 6, 5, 6, 7,
+                                     0, 1, 2, 3, 2, 1, 2, 3, 4, 5, 6, 7, 6, 5, 6, 7);
+        shuffleHi = _mm256_setr_epi8(8, 9, 10, 11, 10, 9, 10, 11, 12, 13, 14, 15, 14, 13, 14, 15,
+                                     8, 9, 10, 11, 10, 9, 10, 11, 12, 13, 14, 15, 14, 13, 14, 15);
+    }
+    else
+    {
+        shuffleLo = _mm256_setr_epi8(0, 1, 2, 3, 0, 3, 2, 3, 4, 5, 6, 7, 4, 7, 6, 7,
+                                     0, 1, 2, 3, 0, 3, 2, 3, 4, 5, 6, 7, 4, 7, 6, 7);
+        shuffleHi = _mm256_setr_epi8(8, 9, 10, 11, 8, 11, 10, 11, 12, 13, 14, 15, 12, 15, 14, 15,
+                                     8, 9, 10, 11, 8, 11, 10, 11, 12, 13, 14, 15, 12, 15, 14, 15);
+    }
+
+    for(unsigned int x=0; x<alignedX; x+=8)
+    {
+        __m256i in = _mm256_loadu_si256((const __m256i*)(input+x*4));
+        __m256i lo = _mm256_shuffle_epi8(in, shuffleLo);
+        __m256i hi = _mm256_shuffle_epi8(in, shuffleHi);
+
+        __m256i *out = (__m256i*)(output+x*2);
+        _mm256_storeu_si256(out,   _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256(out+1, _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+
+    return alignedX;
+}
@@ -39,7 +39,8 @@ inline float dbToRms(float db)
 // NoiseGateFilter class
 
 NoiseGateFilter::NoiseGateFilter(NoiseGate *parent)
-    : parent(parent)
+    : AudioBlockFilter(BLOCK_FRAMES)
+    , parent(parent)
     , attenuation(0.0f)
     , level(0.0f)
     , heldTime(0.0f)
@@ -55,7 +56,24 @@ AudioSegment *NoiseGateFilter::Process(AudioSegment *segment)
 {
     if(parent->isEnabled)
     {
-        ApplyNoiseGate(segment->audioData.Array(), segment->audioData.Num());
+        // We assume stereo input
+        if(segment->audioData.Num() % 2)
+            return segment; // Odd number of samples
+
+        const float SAMPLE_RATE_F = float(OBSGetSampleRateHz());
+        dtPerSample = 1.0f / SAMPLE_RATE_F;
+
+        // Convert configuration times into per-sample amounts
+        attackRate = 1.0f / (parent->attackTime * SAMPLE_RATE_F);
+        releaseRate = 1.0f / (parent->releaseTime * SAMPLE_RATE_F);
+
+        // Determine level decay rate. We don't want human voice (75-300Hz) to cross the close
+        // threshold if the previous peak crosses the open threshold.
+        const float thresholdDiff = parent->openThreshold - parent->closeThreshold;
+        const float minDecayPeriod = (1.0f / 75.0f) * SAMPLE_RATE_F;
+        decayRate = thresholdDiff / minDecayPeriod;
+
+        return AudioBlockFilter::Process(segment);
     }
     else
     {
@@ -68,63 +86,110 @@ AudioSegment *NoiseGateFilter::Process(AudioSegment *segment)
     return segment;
 }
 
-void NoiseGateFilter::ApplyNoiseGate(float *buffer, int totalFloats)
+void NoiseGateFilter::ProcessBlock(float *buffer, UINT numFrames)
 {
-    // We assume stereo input
-    if(totalFloats % 2)
-        return; // Odd number of samples
-
-    const float SAMPLE_RATE_F = float(OBSGetSampleRateHz());
-    const float dtPerSample = 1.0f / SAMPLE_RATE_F;
+    // The open/close state machine still steps through every frame, it's only a max and two compares
+    // and it has to see the level each frame sees: the gate only opens on a frame whose level is already
+    // above the close threshold, so a lone loud sample (a click) closes it again straight away.  What
+    // the gate does with the state is where the time goes, and that is worked out once per block from
+    // the state the block ends in, starting at the frame the gate last opened or closed on.  That leaves
+    // the attenuation of each frame as a straight ramp that can be applied with SSE.
 
-    // Convert configuration times into per-sample amounts
-    const float attackRate = 1.0f / (parent->attackTime * SAMPLE_RATE_F);
-    const float releaseRate = 1.0f / (parent->releaseTime * SAMPLE_RATE_F);
+    const float openThreshold = parent->openThreshold;
+    const float closeThreshold = parent->closeThreshold;
 
-    // Determine level decay rate. We don't want human voice (75-300Hz) to cross the close
-    // threshold if the previous peak crosses the open threshold.
-    const float thresholdDiff = parent->openThreshold - parent->closeThreshold;
-    const float minDecayPeriod = (1.0f / 75.0f) * SAMPLE_RATE_F;
-    const float decayRate = thresholdDiff / minDecayPeriod;
+    bool closed = false;
+    UINT openFrame = 0, closeFrame = 0;
 
-    // We can't use SSE as the processing of each sample depends on the processed
-    // result of the previous sample.
-    for(int i = 0; i < totalFloats; i += 2)
+    for(UINT frame = 0; frame < numFrames; frame++)
     {
         // Get current input level
-        float curLvl = abs(buffer[i] + buffer[i+1]) * 0.5f;
+        float curLvl = abs(buffer[frame*2] + buffer[frame*2+1]) * 0.5f;
 
         // Test thresholds
-        if(curLvl > parent->openThreshold && !isOpen)
-            isOpen = true;
-        if(level < parent->closeThreshold && isOpen)
+        bool wantsOpen = isOpen || curLvl > openThreshold;
+        bool aboveClose = level >= closeThreshold;
+
+        if(wantsOpen && !aboveClose)
         {
-            heldTime = 0.0f;
-            isOpen = false;
+            closed = true;
+            closeFrame = frame;
         }
+        else if(wantsOpen && !isOpen)
+            openFrame = frame;
+
+        isOpen = wantsOpen && aboveClose;
 
         // Decay level slowly so human voice (75-300Hz) doesn't cross the close threshold
         // (Essentially a peak detector with very fast decay)
         level = max(level, curLvl) - decayRate;
+    }
 
-        // Apply gate state to attenuation
-        if(isOpen)
-            attenuation = min(1.0f, attenuation + attackRate);
-        else
+    // Apply gate state to attenuation.  Frame n gets the attenuation after n+1-rampStart steps of the
+    // ramp, a closed gate doesn't start ramping until the hold time is used up
+    float slope;
+    UINT rampStart = 0;
+
+    if(isOpen)
+    {
+        slope = attackRate;
+        rampStart = openFrame;
+    }
+    else
+    {
+        slope = -releaseRate;
+
+        // The hold time starts from the frame the gate closed on
+        if(closed)
+            heldTime = -float(closeFrame)*dtPerSample;
+
+        float holdLeft = parent->holdTime - heldTime;
+        if(holdLeft > 0.0f)
+            rampStart = UINT(min(float(numFrames), floor(holdLeft / dtPerSample)));
+
+        heldTime += float(numFrames)*dtPerSample;
+    }
+
+    // Test if disabled from the config window here so that the above state calculations
+    // are still processed when playing around with the configuration
+    if(!parent->isDisabledFromConfig)
+    {
+        const __m128 four = _mm_set_ps1(4.0f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set_ps1(1.0f);
+        const __m128 startAtten = _mm_set_ps1(attenuation);
+        const __m128 rampSlope = _mm_set_ps1(slope);
+
+        __m128 steps = _mm_sub_ps(_mm_set_ps(4.0f, 3.0f, 2.0f, 1.0f), _mm_set_ps1(float(rampStart)));
+
+        UINT alignedFrames = numFrames & ~3;
+        UINT frame;
+
+        for(frame = 0; frame < alignedFrames; frame += 4)
         {
-            heldTime += dtPerSample;
-            if(heldTime > parent->holdTime)
-                attenuation = max(0.0f, attenuation - releaseRate);
-        }
+            __m128 atten = _mm_add_ps(startAtten, _mm_mul_ps(_mm_max_ps(steps, zero), rampSlope));
+            atten = _mm_min_ps(_mm_max_ps(atten, zero), one);
 
-        // Test if disabled from the config window here so that the above state calculations
-        // are still processed when playing around with the configuration
-        if(!parent->isDisabledFromConfig) {
             // Multiple input by gate multiplier (0.0f if fully closed, 1.0f if fully open)
-            buffer[i] *= attenuation;
-            buffer[i+1] *= attenuation;
+            float *pos = buffer + frame*2;
+            _mm_storeu_ps(pos,     _mm_mul_ps(_mm_loadu_ps(pos),     _mm_unpacklo_ps(atten, atten)));
+            _mm_storeu_ps(pos + 4, _mm_mul_ps(_mm_loadu_ps(pos + 4), _mm_unpackhi_ps(atten, atten)));
+
+            steps = _mm_add_ps(steps, four);
+        }
+
+        for(; frame < numFrames; frame++)
+        {
+            float atten = attenuation + float(max(0, int(frame + 1) - int(rampStart)))*slope;
+            atten = min(1.0f, max(0.0f, atten));
+
+            buffer[frame*2] *= atten;
+            buffer[frame*2+1] *= atten;
         }
     }
+
+    attenuation += float(max(0, int(numFrames) - int(rampStart)))*slope;
+    attenuation = min(1.0f, max(0.0f, attenuation));
 }
 
 //============================================================================
@@ -583,6 +648,8 @@ void NoiseGate::StreamStopped()
 //============================================================================
 // Plugin entry points
 
+OBS_PLUGIN_API_VERSION()
+
 bool LoadPlugin()
 {
     if(NoiseGate::instance != NULL)
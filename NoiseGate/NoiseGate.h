@@ -27,8 +27,15 @@ class NoiseGate;
 //============================================================================
 // NoiseGateFilter class
 
-class NoiseGateFilter : public AudioFilter
+class NoiseGateFilter : public AudioBlockFilter
 {
+    //-----------------------------------------------------------------------
+    // Constants
+
+private:
+    // The attenuation ramps are worked out per block, the gate state is still tracked per-sample
+    static const UINT   BLOCK_FRAMES = 32;
+
     //-----------------------------------------------------------------------
     // Private members
 
@@ -41,6 +48,12 @@ private:
     float   heldTime; // The amount of time we've held the gate open after it we hit the close threshold
     bool    isOpen;
 
+    // Per-sample rates, worked out once per segment
+    float   dtPerSample;
+    float   attackRate;
+    float   releaseRate;
+    float   decayRate;
+
     //-----------------------------------------------------------------------
     // Constructor/destructor
     
@@ -55,7 +68,7 @@ public:
     virtual AudioSegment *Process(AudioSegment *segment);
 
 private:
-    void ApplyNoiseGate(float *buffer, int totalFloats);
+    virtual void ProcessBlock(float *buffer, UINT numFrames);
 };
 
 //============================================================================
@@ -39,6 +39,11 @@ void OBSRegisterImageSourceClass(CTSTR lpClassName, CTSTR lpDisplayName, OBSCREA
     API->RegisterImageSourceClass(lpClassName, lpDisplayName, createProc, configProc);
 }
 
+void OBSRegisterImageSourceClassEx(CTSTR lpClassName, CTSTR lpDisplayName, OBSCREATEPROC createProc, OBSCONFIGPROC configProc, UINT flags)
+{
+    API->RegisterImageSourceClassEx(lpClassName, lpDisplayName, createProc, configProc, flags);
+}
+
 ImageSource* OBSCreateImageSource(CTSTR lpClassName, XElement *data)
 {
     return API->CreateImageSource(lpClassName, data);
@@ -151,6 +156,10 @@ void OBSGetCurMicVolumeStats(float *rms, float *max, float *peak)       {API->Ge
 void OBSAddSettingsPane(SettingsPane *pane)     {API->AddSettingsPane(pane);}
 void OBSRemoveSettingsPane(SettingsPane *pane)  {API->RemoveSettingsPane(pane);}
 
-UINT OBSGetAPIVersion()                         {return 0x0101;}
+UINT OBSGetAPIVersion()                         {return OBS_API_VERSION;}
 
 UINT OBSGetSampleRateHz()                       {return API->GetSampleRateHz();}
+
+void OBSSignalAudioAvailable()                  {API->SignalAudioAvailable();}
+
+TaskPool* OBSGetTaskPool()                      {return API->GetTaskPool();}
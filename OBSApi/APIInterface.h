@@ -189,6 +189,15 @@ public:
     virtual UINT GetBytesPerSec() const=0;
 
     virtual void SetCanOptimizeSettings(bool canOptimize) = 0;
+
+    virtual void SignalAudioAvailable() = 0;
+
+    //shared pool for per-frame conversion work, only exists while streaming/previewing with multithreaded optimizations on
+    virtual TaskPool* GetTaskPool() = 0;
+
+    //API version 0x0102: image source classes with IMAGESOURCE_* flags
+    virtual void RegisterImageSourceClassEx(CTSTR lpClassName, CTSTR lpDisplayName, OBSCREATEPROC createProc, OBSCONFIGPROC configProc, UINT flags) = 0;
+    virtual UINT GetImageSourceClassFlags(CTSTR lpClassName) = 0;
 };
 
 BASE_EXPORT extern APIInterface *API;
@@ -203,6 +212,10 @@ BASE_EXPORT void OBSLeaveSceneMutex();
 BASE_EXPORT void OBSRegisterSceneClass(CTSTR lpClassName, CTSTR lpDisplayName, OBSCREATEPROC createProc, OBSCONFIGPROC configProc);
 BASE_EXPORT void OBSRegisterImageSourceClass(CTSTR lpClassName, CTSTR lpDisplayName, OBSCREATEPROC createProc, OBSCONFIGPROC configProc);
 
+/** same as OBSRegisterImageSourceClass, with IMAGESOURCE_* flags (see Scene.h) that apply to every source
+    of the class.  added in API version 0x0102 */
+BASE_EXPORT void OBSRegisterImageSourceClassEx(CTSTR lpClassName, CTSTR lpDisplayName, OBSCREATEPROC createProc, OBSCONFIGPROC configProc, UINT flags);
+
 BASE_EXPORT ImageSource* OBSCreateImageSource(CTSTR lpClassName, XElement *data);
 
 BASE_EXPORT XElement* OBSGetSceneListElement();
@@ -311,7 +324,24 @@ BASE_EXPORT void OBSGetCurMicVolumeStats(float *rms, float *max, float *peak);
 BASE_EXPORT void OBSAddSettingsPane(SettingsPane *pane);
 BASE_EXPORT void OBSRemoveSettingsPane(SettingsPane *pane);
 
-/** gets API version.  version is formatted: 0xMMmm */
+/** API version, formatted 0xMMmm.  the major version changes whenever something plugins compile inline
+    changes layout (0x0200: List got a capacity member), and OBS won't load a plugin built against a
+    different major version */
+#define OBS_API_VERSION 0x0200
+
+/** every plugin has to export the API version it was built against or it won't be loaded.  put this in
+    one of the plugin's source files, next to LoadPlugin */
+#define OBS_PLUGIN_API_VERSION() extern "C" __declspec(dllexport) UINT GetPluginAPIVersion() {return OBS_API_VERSION;}
+
+/** gets the API version OBS was built with (OBS_API_VERSION) */
 BASE_EXPORT UINT OBSGetAPIVersion();
 
 BASE_EXPORT UINT OBSGetSampleRateHz();
+
+/** wakes up the audio mixer.  audio sources that receive data on their own thread should call
+    this after pushing new data so it can be mixed without waiting for the next mix tick */
+BASE_EXPORT void OBSSignalAudioAvailable();
+
+/** returns the pool OBS runs its own per-frame conversions on, or NULL when not running or when
+    multithreaded optimizations are off.  batches submitted to it must be waited on before the source goes away */
+BASE_EXPORT TaskPool* OBSGetTaskPool();
@@ -30,3 +30,21 @@ public:
 
     virtual AudioSegment* Process(AudioSegment *segment)=0;
 };
+
+//  a filter that would rather work on blocks of a fixed number of stereo frames than on whatever segment
+//size the device hands over.  Process cuts each segment into blocks and passes them to ProcessBlock in
+//order.  the last block of a segment can be shorter, holding samples back to fill it would delay the
+//audio.
+
+class BASE_EXPORT AudioBlockFilter : public AudioFilter
+{
+    UINT blockFrames;
+
+public:
+    inline AudioBlockFilter(UINT blockFrames) : blockFrames(blockFrames ? blockFrames : 1) {}
+
+    inline UINT GetBlockSize() const {return blockFrames;}
+
+    virtual AudioSegment* Process(AudioSegment *segment);
+    virtual void ProcessBlock(float *buffer, UINT numFrames)=0;
+};
@@ -50,11 +50,52 @@ void MultiplyAudioBuffer(float *buffer, int totalFloats, float mulVal)
         buffer[i] *= mulVal;
 }
 
+//  same as above, but the volume slides from startVal to endVal over the buffer, one step per stereo frame.
+//a volume change that lands in one step on a segment boundary is an audible click
+void RampAudioBuffer(float *buffer, int totalFloats, float startVal, float endVal)
+{
+    int totalFrames = totalFloats/2;
+    if(!totalFrames)
+        return;
+
+    float step = (endVal-startVal)/float(totalFrames);
+    float curVal = startVal;
+
+    if((UPARAM(buffer) & 0xF) == 0)
+    {
+        UINT alignedFloats = totalFloats & 0xFFFFFFFC;
+
+        //two stereo frames per vector
+        __m128 sseVal  = _mm_set_ps(curVal+step, curVal+step, curVal, curVal);
+        __m128 sseStep = _mm_set_ps1(step*2.0f);
+
+        for(UINT i=0; i<alignedFloats; i += 4)
+        {
+            _mm_store_ps(buffer+i, _mm_mul_ps(_mm_load_ps(buffer+i), sseVal));
+            sseVal = _mm_add_ps(sseVal, sseStep);
+        }
+
+        buffer      += alignedFloats;
+        totalFloats -= alignedFloats;
+        curVal      += step*float(alignedFloats/2);
+    }
+
+    for(int i=0; i<totalFloats; i += 2)
+    {
+        buffer[i] *= curVal;
+        if(i+1 < totalFloats)
+            buffer[i+1] *= curVal;
+        curVal += step;
+    }
+}
+
 /* astoundingly disgusting hack to get more variables into the class without breaking API */
 struct NotAResampler
 {
     SRC_STATE *resampler;
     QWORD     jumpRange;
+    float     lastVolume;
+    bool      bHasLastVolume;
 };
 
 #define MoreVariables static_cast<NotAResampler*>(resampler)
@@ -64,6 +105,7 @@ AudioSource::AudioSource()
     sourceVolume = 1.0f;
     resampler = (void*)new NotAResampler;
     MoreVariables->jumpRange = 70;
+    MoreVariables->bHasLastVolume = false;
 }
 
 AudioSource::~AudioSource()
@@ -78,16 +120,6 @@ AudioSource::~AudioSource()
 }
 
 
-union TripleToLong
-{
-    LONG val;
-    struct 
-    {
-        WORD wVal;
-        BYTE tripleVal;
-        BYTE lastByte;
-    };
-};
 
 void AudioSource::InitAudioData(bool bFloat, UINT channels, UINT samplesPerSec, UINT bitsPerSample, UINT blockSize, DWORD channelMask)
 {
@@ -194,10 +226,355 @@ const float surroundMix4 = dbMinus6;
 const float attn5dot1 = 1.0f / (1.0f + centerMix + surroundMix);
 const float attn4dotX = 1.0f / (1.0f + surroundMix4);
 
+//-----------------------------------------------------------------------------
+// sample conversion and downmix kernels
+//
+//  SSE2 is a hard requirement (see HasSSE2Support in Main.cpp) so there's no need for
+//runtime dispatch here.  each kernel finishes off the remainder with the scalar version
+//of the same math in the same order, so the output is identical either way.
+
+inline __m128 Int16sToFloat(__m128i words, __m128 div)
+{
+    return _mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(words, 16)), div);
+}
+
+//converts four signed 32bit ints using double precision like the scalar version
+inline __m128 Int32sToFloat(__m128i vals, __m128d div)
+{
+    __m128 lo = _mm_cvtpd_ps(_mm_div_pd(_mm_cvtepi32_pd(vals), div));
+    __m128 hi = _mm_cvtpd_ps(_mm_div_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(vals, _MM_SHUFFLE(1, 0, 3, 2))), div));
+    return _mm_movelh_ps(lo, hi);
+}
+
+inline LONG Read24BitSample(const BYTE *in)
+{
+    return LONG(UINT(in[0]) << 8 | UINT(in[1]) << 16 | UINT(in[2]) << 24) >> 8;
+}
+
+static void ConvertS8ToFloat(float *out, const char *in, UINT totalSamples)
+{
+    UINT alignedSamples = totalSamples & 0xFFFFFFF0;
+    __m128 sseDiv = _mm_set_ps1(127.0f);
+
+    for(UINT i=0; i<alignedSamples; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(in+i));
+        __m128i wordsLo = _mm_unpacklo_epi8(bytes, bytes);
+        __m128i wordsHi = _mm_unpackhi_epi8(bytes, bytes);
+
+        //duplicating the byte into both halves and shifting right by 24 sign extends it
+        _mm_storeu_ps(out+i,    _mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(wordsLo, wordsLo), 24)), sseDiv));
+        _mm_storeu_ps(out+i+4,  _mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(wordsLo, wordsLo), 24)), sseDiv));
+        _mm_storeu_ps(out+i+8,  _mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(wordsHi, wordsHi), 24)), sseDiv));
+        _mm_storeu_ps(out+i+12, _mm_div_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(wordsHi, wordsHi), 24)), sseDiv));
+    }
+
+    for(UINT i=alignedSamples; i<totalSamples; i++)
+        out[i] = float(in[i])/127.0f;
+}
+
+static void ConvertS16ToFloat(float *out, const short *in, UINT totalSamples)
+{
+    UINT alignedSamples = totalSamples & 0xFFFFFFF8;
+    __m128 sseDiv = _mm_set_ps1(32767.0f);
+
+    for(UINT i=0; i<alignedSamples; i += 8)
+    {
+        __m128i words = _mm_loadu_si128((const __m128i*)(in+i));
+
+        _mm_storeu_ps(out+i,   Int16sToFloat(_mm_unpacklo_epi16(words, words), sseDiv));
+        _mm_storeu_ps(out+i+4, Int16sToFloat(_mm_unpackhi_epi16(words, words), sseDiv));
+    }
+
+    for(UINT i=alignedSamples; i<totalSamples; i++)
+        out[i] = float(in[i])/32767.0f;
+}
+
+static void ConvertS24ToFloat(float *out, const BYTE *in, UINT totalSamples)
+{
+    UINT alignedSamples = totalSamples & 0xFFFFFFFC;
+    __m128d sseDiv = _mm_set1_pd(8388607.0);
+
+    //no byte shuffles in SSE2, so the unpacking stays scalar
+    for(UINT i=0; i<alignedSamples; i += 4)
+    {
+        __m128i vals = _mm_setr_epi32(Read24BitSample(in), Read24BitSample(in+3), Read24BitSample(in+6), Read24BitSample(in+9));
+        _mm_storeu_ps(out+i, Int32sToFloat(vals, sseDiv));
+        in += 12;
+    }
+
+    for(UINT i=alignedSamples; i<totalSamples; i++)
+    {
+        out[i] = float(double(Read24BitSample(in))/8388607.0);
+        in += 3;
+    }
+}
+
+static void ConvertS32ToFloat(float *out, const long *in, UINT totalSamples)
+{
+    UINT alignedSamples = totalSamples & 0xFFFFFFFC;
+    __m128d sseDiv = _mm_set1_pd(2147483647.0);
+
+    for(UINT i=0; i<alignedSamples; i += 4)
+        _mm_storeu_ps(out+i, Int32sToFloat(_mm_loadu_si128((const __m128i*)(in+i)), sseDiv));
+
+    for(UINT i=alignedSamples; i<totalSamples; i++)
+        out[i] = float(double(in[i])/2147483647.0);
+}
+
+//writes four frames worth of left/right vectors as interleaved stereo
+inline void StoreStereo(float *out, __m128 left, __m128 right)
+{
+    _mm_storeu_ps(out,   _mm_unpacklo_ps(left, right));
+    _mm_storeu_ps(out+4, _mm_unpackhi_ps(left, right));
+}
+
+//used for 2.1, 3.1 and basic surround, which just take front left/right
+static void DownmixFrontOnly(float *out, const float *in, UINT numFrames, UINT inputChannels)
+{
+    UINT alignedFrames = numFrames & 0xFFFFFFFE;
+    __m128 zeroVal = _mm_setzero_ps();
+
+    for(UINT i=0; i<alignedFrames; i += 2)
+    {
+        __m128 frames = _mm_loadl_pi(zeroVal, (const __m64*)in);
+        frames = _mm_loadh_pi(frames, (const __m64*)(in+inputChannels));
+        _mm_storeu_ps(out, frames);
+
+        in  += inputChannels*2;
+        out += 4;
+    }
+
+    if(numFrames & 1)
+    {
+        out[0] = in[0];
+        out[1] = in[1];
+    }
+}
+
+static void DownmixQuad(float *out, const float *in, UINT numFrames)
+{
+    UINT alignedFrames = numFrames & 0xFFFFFFFC;
+    __m128 sseSurroundMix = _mm_set_ps1(surroundMix4);
+    __m128 sseAttn = _mm_set_ps1(attn4dotX);
+
+    for(UINT i=0; i<alignedFrames; i += 4)
+    {
+        __m128 left  = _mm_loadu_ps(in);
+        __m128 right = _mm_loadu_ps(in+4);
+        __m128 rearLeft  = _mm_loadu_ps(in+8);
+        __m128 rearRight = _mm_loadu_ps(in+12);
+        _MM_TRANSPOSE4_PS(left, right, rearLeft, rearRight);
+
+        rearLeft  = _mm_mul_ps(rearLeft,  sseSurroundMix);
+        rearRight = _mm_mul_ps(rearRight, sseSurroundMix);
+
+        StoreStereo(out, _mm_mul_ps(_mm_add_ps(left, rearLeft), sseAttn), _mm_mul_ps(_mm_add_ps(right, rearRight), sseAttn));
+
+        in  += 16;
+        out += 8;
+    }
+
+    for(UINT i=alignedFrames; i<numFrames; i++)
+    {
+        float left      = in[0];
+        float right     = in[1];
+        float rearLeft  = in[2]*surroundMix4;
+        float rearRight = in[3]*surroundMix4;
+
+        // When in doubt, use only left and right .... and rear left and rear right :) 
+        // Same idea as with 5.1 downmix
+
+        *(out++) = (left  + rearLeft)  * attn4dotX;
+        *(out++) = (right + rearRight) * attn4dotX;
+
+        in += 4;
+    }
+}
+
+static void Downmix4Point1(float *out, const float *in, UINT numFrames)
+{
+    UINT alignedFrames = numFrames & 0xFFFFFFFC;
+    __m128 sseSurroundMix = _mm_set_ps1(surroundMix4);
+    __m128 sseAttn = _mm_set_ps1(attn4dotX);
+
+    for(UINT i=0; i<alignedFrames; i += 4)
+    {
+        __m128 left  = _mm_loadu_ps(in);
+        __m128 right = _mm_loadu_ps(in+5);
+        __m128 lfe   = _mm_loadu_ps(in+10);
+        __m128 rearLeft = _mm_loadu_ps(in+15);
+        _MM_TRANSPOSE4_PS(left, right, lfe, rearLeft);
+
+        __m128 rearRight = _mm_setr_ps(in[4], in[9], in[14], in[19]);
+
+        // Skip LFE , we don't really need it.
+
+        rearLeft  = _mm_mul_ps(rearLeft,  sseSurroundMix);
+        rearRight = _mm_mul_ps(rearRight, sseSurroundMix);
+
+        StoreStereo(out, _mm_mul_ps(_mm_add_ps(left, rearLeft), sseAttn), _mm_mul_ps(_mm_add_ps(right, rearRight), sseAttn));
+
+        in  += 20;
+        out += 8;
+    }
+
+    for(UINT i=alignedFrames; i<numFrames; i++)
+    {
+        float left      = in[0];
+        float right     = in[1];
+        float rearLeft  = in[3]*surroundMix4;
+        float rearRight = in[4]*surroundMix4;
+
+        // Same idea as with 5.1 downmix
+
+        *(out++) = (left  + rearLeft)  * attn4dotX;
+        *(out++) = (right + rearRight) * attn4dotX;
+
+        in += 5;
+    }
+}
+
+// According to ITU-R  BS.775-1 recommendation, the downmix from a 3/2 source to stereo
+// is the following:
+// L = FL + k0*C + k1*RL
+// R = FR + k0*C + k1*RR
+// FL = front left
+// FR = front right
+// C  = center
+// RL = rear left
+// RR = rear right
+// k0 = centerMix   = dbMinus3 = 0.7071067811865476 [for k0 we can use dbMinus6 = 0.5 too, probably it's better]
+// k1 = surroundMix = dbMinus3 = 0.7071067811865476
+
+// The output (L,R) can be out of (-1,1) domain so we attenuate it [ attn5dot1 = 1/(1 + centerMix + surroundMix) ]
+// Note: this method of downmixing is far from "perfect" (pretty sure it's not the correct way) but the resulting downmix is "okayish", at least no more bleeding ears.
+// (maybe have a look at http://forum.doom9.org/archive/index.php/t-148228.html too [ 5.1 -> stereo ] the approach seems almost the same [but different coefficients])
+
+// http://acousticsfreq.com/blog/wp-content/uploads/2012/01/ITU-R-BS775-1.pdf
+// http://ir.lib.nctu.edu.tw/bitstream/987654321/22934/1/030104001.pdf
+
+//  The LFE channel is dropped.  inputChannels is 6 for 5.1, or 8 for the obsolete 7.1 layout
+//where we also drop front left/right of center and treat the rest as 5.1.
+static void Downmix5Point1(float *out, const float *in, UINT numFrames, UINT inputChannels)
+{
+    UINT alignedFrames = numFrames & 0xFFFFFFFC;
+    __m128 sseCenterMix = _mm_set_ps1(centerMix);
+    __m128 sseSurroundMix = _mm_set_ps1(surroundMix);
+    __m128 sseAttn = _mm_set_ps1(attn5dot1);
+    __m128 zeroVal = _mm_setzero_ps();
+
+    for(UINT i=0; i<alignedFrames; i += 4)
+    {
+        const float *frame0 = in;
+        const float *frame1 = in+inputChannels;
+        const float *frame2 = in+inputChannels*2;
+        const float *frame3 = in+inputChannels*3;
+
+        __m128 left   = _mm_loadu_ps(frame0);
+        __m128 right  = _mm_loadu_ps(frame1);
+        __m128 center = _mm_loadu_ps(frame2);
+        __m128 lfe    = _mm_loadu_ps(frame3);
+        _MM_TRANSPOSE4_PS(left, right, center, lfe);
+
+        __m128 rear01 = _mm_unpacklo_ps(_mm_loadl_pi(zeroVal, (const __m64*)(frame0+4)), _mm_loadl_pi(zeroVal, (const __m64*)(frame1+4)));
+        __m128 rear23 = _mm_unpacklo_ps(_mm_loadl_pi(zeroVal, (const __m64*)(frame2+4)), _mm_loadl_pi(zeroVal, (const __m64*)(frame3+4)));
+        __m128 rearLeft  = _mm_movelh_ps(rear01, rear23);
+        __m128 rearRight = _mm_movehl_ps(rear23, rear01);
+
+        center    = _mm_mul_ps(center,    sseCenterMix);
+        rearLeft  = _mm_mul_ps(rearLeft,  sseSurroundMix);
+        rearRight = _mm_mul_ps(rearRight, sseSurroundMix);
+
+        StoreStereo(out, _mm_mul_ps(_mm_add_ps(_mm_add_ps(left,  center), rearLeft),  sseAttn),
+                         _mm_mul_ps(_mm_add_ps(_mm_add_ps(right, center), rearRight), sseAttn));
+
+        in  += inputChannels*4;
+        out += 8;
+    }
+
+    for(UINT i=alignedFrames; i<numFrames; i++)
+    {
+        float left      = in[0];
+        float right     = in[1];
+        float center    = in[2]*centerMix;
+        float rearLeft  = in[4]*surroundMix;
+        float rearRight = in[5]*surroundMix;
+
+        *(out++) = (left  + center  + rearLeft)  * attn5dot1;
+        *(out++) = (right + center  + rearRight) * attn5dot1;
+
+        in += inputChannels;
+    }
+}
+
+//downmix to 5.1 (easy stuff) then downmix to stereo as done in Downmix5Point1
+static void Downmix7Point1Surround(float *out, const float *in, UINT numFrames)
+{
+    UINT alignedFrames = numFrames & 0xFFFFFFFC;
+    __m128 sseCenterMix = _mm_set_ps1(centerMix);
+    __m128 sseSurroundMix = _mm_set_ps1(surroundMix);
+    __m128 sseAttn = _mm_set_ps1(attn5dot1);
+    __m128 sseHalf = _mm_set_ps1(0.5f);
+
+    for(UINT i=0; i<alignedFrames; i += 4)
+    {
+        __m128 left   = _mm_loadu_ps(in);
+        __m128 right  = _mm_loadu_ps(in+8);
+        __m128 center = _mm_loadu_ps(in+16);
+        __m128 lfe    = _mm_loadu_ps(in+24);
+        _MM_TRANSPOSE4_PS(left, right, center, lfe);
+
+        __m128 rearLeft  = _mm_loadu_ps(in+4);
+        __m128 rearRight = _mm_loadu_ps(in+12);
+        __m128 sideLeft  = _mm_loadu_ps(in+20);
+        __m128 sideRight = _mm_loadu_ps(in+28);
+        _MM_TRANSPOSE4_PS(rearLeft, rearRight, sideLeft, sideRight);
+
+        center    = _mm_mul_ps(center, sseCenterMix);
+
+        // combine the rear/side channels first , baaam! 5.1
+        rearLeft  = _mm_mul_ps(_mm_add_ps(rearLeft,  sideLeft),  sseHalf);
+        rearRight = _mm_mul_ps(_mm_add_ps(rearRight, sideRight), sseHalf);
+
+        StoreStereo(out, _mm_mul_ps(_mm_add_ps(_mm_add_ps(left,  center), _mm_mul_ps(rearLeft,  sseSurroundMix)), sseAttn),
+                         _mm_mul_ps(_mm_add_ps(_mm_add_ps(right, center), _mm_mul_ps(rearRight, sseSurroundMix)), sseAttn));
+
+        in  += 32;
+        out += 8;
+    }
+
+    for(UINT i=alignedFrames; i<numFrames; i++)
+    {
+        float left      = in[0];
+        float right     = in[1];
+        float center    = in[2] * centerMix;
+
+        float rearLeft  = (in[4] + in[6]) * 0.5f;
+        float rearRight = (in[5] + in[7]) * 0.5f;
+
+        *(out++) = (left  + center + rearLeft  * surroundMix) * attn5dot1;
+        *(out++) = (right + center + rearRight * surroundMix) * attn5dot1;
+
+        in += 8;
+    }
+}
+
 void AudioSource::AddAudioSegment(AudioSegment *newSegment, float curVolume)
 {
     if (newSegment)
-        MultiplyAudioBuffer(newSegment->audioData.Array(), newSegment->audioData.Num(), curVolume*sourceVolume);
+    {
+        float newVolume = curVolume*sourceVolume;
+        float lastVolume = MoreVariables->bHasLastVolume ? MoreVariables->lastVolume : newVolume;
+
+        if (lastVolume == newVolume)
+            MultiplyAudioBuffer(newSegment->audioData.Array(), newSegment->audioData.Num(), newVolume);
+        else
+            RampAudioBuffer(newSegment->audioData.Array(), newSegment->audioData.Num(), lastVolume, newVolume);
+
+        MoreVariables->lastVolume = newVolume;
+        MoreVariables->bHasLastVolume = true;
+    }
 
     for (UINT i=0; i<audioFilters.Num(); i++)
     {
@@ -274,54 +651,13 @@ UINT AudioSource::QueryAudio2(float curVolume, bool bCanBurstHack)
                 convertBuffer.SetSize(totalSamples);
 
             if(inputBitsPerSample == 8)
-            {
-                float *tempConvert = convertBuffer.Array();
-                char *tempSByte = (char*)buffer;
-
-                while(totalSamples--)
-                {
-                    *(tempConvert++) = float(*(tempSByte++))/127.0f;
-                }
-            }
+                ConvertS8ToFloat(convertBuffer.Array(), (const char*)buffer, totalSamples);
             else if(inputBitsPerSample == 16)
-            {
-                float *tempConvert = convertBuffer.Array();
-                short *tempShort = (short*)buffer;
-
-                while(totalSamples--)
-                {
-                    *(tempConvert++) = float(*(tempShort++))/32767.0f;
-                }
-            }
+                ConvertS16ToFloat(convertBuffer.Array(), (const short*)buffer, totalSamples);
             else if(inputBitsPerSample == 24)
-            {
-                float *tempConvert = convertBuffer.Array();
-                BYTE *tempTriple = (BYTE*)buffer;
-                TripleToLong valOut;
-
-                while(totalSamples--)
-                {
-                    TripleToLong &valIn  = (TripleToLong&)tempTriple;
-
-                    valOut.wVal = valIn.wVal;
-                    valOut.tripleVal = valIn.tripleVal;
-                    if(valOut.tripleVal > 0x7F)
-                        valOut.lastByte = 0xFF;
-
-                    *(tempConvert++) = float(double(valOut.val)/8388607.0);
-                    tempTriple += 3;
-                }
-            }
+                ConvertS24ToFloat(convertBuffer.Array(), (const BYTE*)buffer, totalSamples);
             else if(inputBitsPerSample == 32)
-            {
-                float *tempConvert = convertBuffer.Array();
-                long *tempShort = (long*)buffer;
-
-                while(totalSamples--)
-                {
-                    *(tempConvert++) = float(double(*(tempShort++))/2147483647.0);
-                }
-            }
+                ConvertS32ToFloat(convertBuffer.Array(), (const long*)buffer, totalSamples);
 
             captureBuffer = convertBuffer.Array();
         }
@@ -377,224 +713,45 @@ UINT AudioSource::QueryAudio2(float curVolume, bool bCanBurstHack)
         }
         else
         {
-            //todo: downmix optimization, also support for other speaker configurations than ones I can merely "think" of.  ugh.
+            //todo: support for other speaker configurations than ones I can merely "think" of.  ugh.
             float *inputTemp  = (float*)captureBuffer;
-            float *outputTemp = dataOutputBuffer;
 
-            if(inputChannelMask == KSAUDIO_SPEAKER_QUAD)
+            switch(inputChannelMask)
             {
-                UINT numFloats = numAudioFrames*4;
-                float *endTemp = inputTemp+numFloats;
-
-                while(inputTemp < endTemp)
-                {
-                    float left      = inputTemp[0];
-                    float right     = inputTemp[1];
-                    float rearLeft  = inputTemp[2]*surroundMix4;
-                    float rearRight = inputTemp[3]*surroundMix4;
-
-                    // When in doubt, use only left and right .... and rear left and rear right :) 
-                    // Same idea as with 5.1 downmix
-
-                    *(outputTemp++) = (left  + rearLeft)  * attn4dotX;
-                    *(outputTemp++) = (right + rearRight) * attn4dotX;
-
-                    inputTemp  += 4;
-                }
-            }
-            else if(inputChannelMask == KSAUDIO_SPEAKER_2POINT1)
-            {
-                UINT numFloats = numAudioFrames*3;
-                float *endTemp = inputTemp+numFloats;
-
-                while(inputTemp < endTemp)
-                {
-                    float left      = inputTemp[0];
-                    float right     = inputTemp[1];
-                   
-                    // Drop LFE since we don't need it
-                    //float lfe       = inputTemp[2]*lowFreqMix;
-
-                    *(outputTemp++) = left;
-                    *(outputTemp++) = right;
-
-                    inputTemp  += 3;
-                }
-            }
-            else if(inputChannelMask == KSAUDIO_SPEAKER_3POINT1)
-            {
-                UINT numFloats = numAudioFrames*4;
-                float *endTemp = inputTemp+numFloats;
-
-                while(inputTemp < endTemp)
-                {
-                    float left          = inputTemp[0];
-                    float right         = inputTemp[1];
-                    float frontCenter   = inputTemp[2];
-                    float lowFreq       = inputTemp[3];
-
-                    *(outputTemp++) = left;
-                    *(outputTemp++) = right;
-
-                    inputTemp  += 4;
-                }
-            }
-            else if(inputChannelMask == KSAUDIO_SPEAKER_4POINT1)
-            {
-                UINT numFloats = numAudioFrames*5;
-                float *endTemp = inputTemp+numFloats;
-
-                while(inputTemp < endTemp)
-                {
-                    float left      = inputTemp[0];
-                    float right     = inputTemp[1];
-
-                    // Skip LFE , we don't really need it.
-                    //float lfe       = inputTemp[2];
-
-                    float rearLeft  = inputTemp[3]*surroundMix4;
-                    float rearRight = inputTemp[4]*surroundMix4;
-
-                    // Same idea as with 5.1 downmix
-
-                    *(outputTemp++) = (left  + rearLeft)  * attn4dotX;
-                    *(outputTemp++) = (right + rearRight) * attn4dotX;
-
-                    inputTemp  += 5;
-                }
-            }
-            else if(inputChannelMask == KSAUDIO_SPEAKER_SURROUND)
-            {
-                UINT numFloats = numAudioFrames*4;
-                float *endTemp = inputTemp+numFloats;
-
-                while(inputTemp < endTemp)
-                {
-                    float left      = inputTemp[0];
-                    float right     = inputTemp[1];
-                    float frontCenter    = inputTemp[2];
-                    float rearCenter     = inputTemp[3];
-                    
-                    // When in doubt, use only left and right :) Seriously.
-                    // THIS NEEDS TO BE PROPERLY IMPLEMENTED!
-
-                    *(outputTemp++) = left;
-                    *(outputTemp++) = right;
-
-                    inputTemp  += 4;
-                }
-            }
-            // Both speakers configs share the same format, the difference is in rear speakers position 
-            // See: http://msdn.microsoft.com/en-us/library/windows/hardware/ff537083(v=vs.85).aspx
-            // Probably for KSAUDIO_SPEAKER_5POINT1_SURROUND we will need a different coefficient for rear left/right
-            else if(inputChannelMask == KSAUDIO_SPEAKER_5POINT1 || inputChannelMask == KSAUDIO_SPEAKER_5POINT1_SURROUND)
-            {
-                UINT numFloats = numAudioFrames*6;
-                float *endTemp = inputTemp+numFloats;
-
-                while(inputTemp < endTemp)
-                {
-                    float left      = inputTemp[0];
-                    float right     = inputTemp[1];
-                    float center    = inputTemp[2]*centerMix;
-                    
-                    //We don't need LFE channel so skip it (see below)
-                    //float lowFreq   = inputTemp[3]*lowFreqMix;
-                    
-                    float rearLeft  = inputTemp[4]*surroundMix;
-                    float rearRight = inputTemp[5]*surroundMix;
-                    
-                    // According to ITU-R  BS.775-1 recommendation, the downmix from a 3/2 source to stereo
-                    // is the following:
-                    // L = FL + k0*C + k1*RL
-                    // R = FR + k0*C + k1*RR
-                    // FL = front left
-                    // FR = front right
-                    // C  = center
-                    // RL = rear left
-                    // RR = rear right
-                    // k0 = centerMix   = dbMinus3 = 0.7071067811865476 [for k0 we can use dbMinus6 = 0.5 too, probably it's better]
-                    // k1 = surroundMix = dbMinus3 = 0.7071067811865476
-
-                    // The output (L,R) can be out of (-1,1) domain so we attenuate it [ attn5dot1 = 1/(1 + centerMix + surroundMix) ]
-                    // Note: this method of downmixing is far from "perfect" (pretty sure it's not the correct way) but the resulting downmix is "okayish", at least no more bleeding ears.
-                    // (maybe have a look at http://forum.doom9.org/archive/index.php/t-148228.html too [ 5.1 -> stereo ] the approach seems almost the same [but different coefficients])
-
-                    
-                    // http://acousticsfreq.com/blog/wp-content/uploads/2012/01/ITU-R-BS775-1.pdf
-                    // http://ir.lib.nctu.edu.tw/bitstream/987654321/22934/1/030104001.pdf
-
-                    *(outputTemp++) = (left  + center  + rearLeft) * attn5dot1;
-                    *(outputTemp++) = (right + center  + rearRight) * attn5dot1;
-
-                    inputTemp  += 6;
-                }
-            }
-
-            // According to http://msdn.microsoft.com/en-us/library/windows/hardware/ff537083(v=vs.85).aspx
-            // KSAUDIO_SPEAKER_7POINT1 is obsolete and no longer supported in Windows Vista and later versions of Windows
-            // Not sure what to do about it, meh , drop front left of center/front right of center -> 5.1 -> stereo; 
-
-            else if(inputChannelMask == KSAUDIO_SPEAKER_7POINT1)
-            {
-                UINT numFloats = numAudioFrames*8;
-                float *endTemp = inputTemp+numFloats;
-
-                while(inputTemp < endTemp)
-                {
-                    float left          = inputTemp[0];
-                    float right         = inputTemp[1];
-                    
-                    float center        = inputTemp[2] * centerMix;
-                    
-                    // Drop LFE since we don't need it
-                    //float lowFreq       = inputTemp[3]*lowFreqMix;
-                    
-                    float rearLeft      = inputTemp[4] * surroundMix;
-                    float rearRight     = inputTemp[5] * surroundMix;
-
-                    // Drop SPEAKER_FRONT_LEFT_OF_CENTER , SPEAKER_FRONT_RIGHT_OF_CENTER
-                    //float centerLeft    = inputTemp[6];
-                    //float centerRight   = inputTemp[7];
-                    
-                    // Downmix from 5.1 to stereo
-                    *(outputTemp++) = (left  + center  + rearLeft)  * attn5dot1;
-                    *(outputTemp++) = (right + center  + rearRight) * attn5dot1;
-
-                    inputTemp  += 8;
-                }
-            }
-
-            // Downmix to 5.1 (easy stuff) then downmix to stereo as done in KSAUDIO_SPEAKER_5POINT1
-            else if(inputChannelMask == KSAUDIO_SPEAKER_7POINT1_SURROUND)
-            {
-                UINT numFloats = numAudioFrames*8;
-                float *endTemp = inputTemp+numFloats;
-
-                while(inputTemp < endTemp)
-                {
-                    float left      = inputTemp[0];
-                    float right     = inputTemp[1];
-                    float center    = inputTemp[2] * centerMix;
-
-                    // Skip LFE we don't need it
-                    //float lowFreq   = inputTemp[3]*lowFreqMix;
-
-                    float rearLeft  = inputTemp[4];
-                    float rearRight = inputTemp[5];
-                    float sideLeft  = inputTemp[6];
-                    float sideRight = inputTemp[7];
-
-                    // combine the rear/side channels first , baaam! 5.1
-                    rearLeft  = (rearLeft  + sideLeft)  * 0.5f;
-                    rearRight = (rearRight + sideRight) * 0.5f;
-
-                    // downmix to stereo as in 5.1 case
-                    *(outputTemp++) = (left  + center + rearLeft  * surroundMix) * attn5dot1;
-                    *(outputTemp++) = (right + center + rearRight * surroundMix) * attn5dot1;
-
-                    inputTemp  += 8;
-                }
+                case KSAUDIO_SPEAKER_QUAD:
+                    DownmixQuad(dataOutputBuffer, inputTemp, numAudioFrames);
+                    break;
+
+                // Drop LFE/center since we don't need them.  When in doubt, use only left and right :) Seriously.
+                // THIS NEEDS TO BE PROPERLY IMPLEMENTED! (for KSAUDIO_SPEAKER_SURROUND at least)
+                case KSAUDIO_SPEAKER_2POINT1:
+                case KSAUDIO_SPEAKER_3POINT1:
+                case KSAUDIO_SPEAKER_SURROUND:
+                    DownmixFrontOnly(dataOutputBuffer, inputTemp, numAudioFrames, inputChannels);
+                    break;
+
+                case KSAUDIO_SPEAKER_4POINT1:
+                    Downmix4Point1(dataOutputBuffer, inputTemp, numAudioFrames);
+                    break;
+
+                // Both speakers configs share the same format, the difference is in rear speakers position 
+                // See: http://msdn.microsoft.com/en-us/library/windows/hardware/ff537083(v=vs.85).aspx
+                // Probably for KSAUDIO_SPEAKER_5POINT1_SURROUND we will need a different coefficient for rear left/right
+                case KSAUDIO_SPEAKER_5POINT1:
+                case KSAUDIO_SPEAKER_5POINT1_SURROUND:
+                    Downmix5Point1(dataOutputBuffer, inputTemp, numAudioFrames, 6);
+                    break;
+
+                // According to http://msdn.microsoft.com/en-us/library/windows/hardware/ff537083(v=vs.85).aspx
+                // KSAUDIO_SPEAKER_7POINT1 is obsolete and no longer supported in Windows Vista and later versions of Windows
+                // Not sure what to do about it, meh , drop front left of center/front right of center -> 5.1 -> stereo; 
+                case KSAUDIO_SPEAKER_7POINT1:
+                    Downmix5Point1(dataOutputBuffer, inputTemp, numAudioFrames, 8);
+                    break;
+
+                case KSAUDIO_SPEAKER_7POINT1_SURROUND:
+                    Downmix7Point1Surround(dataOutputBuffer, inputTemp, numAudioFrames);
+                    break;
             }
         }
 
@@ -783,7 +940,7 @@ bool AudioSource::GetNewestFrame(float **buffer)
     {
         if(audioSegments.Num())
         {
-            List<float> &data = audioSegments.Last()->audioData;
+            List<float, 16> &data = audioSegments.Last()->audioData;
             *buffer = data.Array();
             return true;
         }
@@ -812,6 +969,17 @@ void AudioSource::SetTimeOffset(int newOffset) {timeOffset = newOffset;}
 void AudioSource::SetVolume(float fVal) {sourceVolume = fabsf(fVal);}
 float AudioSource::GetVolume() const {return sourceVolume;}
 
+AudioSegment* AudioBlockFilter::Process(AudioSegment *segment)
+{
+    float *buffer = segment->audioData.Array();
+    UINT totalFrames = segment->audioData.Num()/2;
+
+    for (UINT frame=0; frame<totalFrames; frame += blockFrames)
+        ProcessBlock(buffer+frame*2, MIN(blockFrames, totalFrames-frame));
+
+    return segment;
+}
+
 UINT AudioSource::NumAudioFilters() const {return audioFilters.Num();}
 AudioFilter* AudioSource::GetAudioFilter(UINT id) {if(audioFilters.Num() > id) return audioFilters[id]; return NULL;}
 
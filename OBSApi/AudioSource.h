@@ -28,7 +28,7 @@ enum
 
 struct AudioSegment
 {
-    List<float> audioData;
+    List<float, 16> audioData;
     QWORD timestamp;
 
     inline AudioSegment(float *data, UINT numFloats, QWORD timestamp) : timestamp(timestamp)
@@ -67,10 +67,11 @@ class BASE_EXPORT AudioSource
 
     //-----------------------------------------
 
-    List<float> outputBuffer;
-    List<float> convertBuffer;
-    List<float> tempBuffer;
-    List<float> tempResampleBuffer;
+    //aligned so the sse paths in the conversion, mixing and volume code don't fall back to scalar loops
+    List<float, 16> outputBuffer;
+    List<float, 16> convertBuffer;
+    List<float, 16> tempBuffer;
+    List<float, 16> tempResampleBuffer;
 
     //-----------------------------------------
 
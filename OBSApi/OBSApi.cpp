@@ -425,3 +425,110 @@ void MixAudio(float *bufferDest, float *bufferSrc, UINT totalFloats, bool bForce
         }
     }
 }
+
+template<bool bAligned> inline __m128 LoadMixInput(const AudioMixInput &input, UINT pos, __m128 halfVal)
+{
+    __m128 val = bAligned ? _mm_load_ps(input.buffer+pos) : _mm_loadu_ps(input.buffer+pos);
+    if(input.bForceMono)
+        val = _mm_mul_ps(_mm_add_ps(val, _mm_shuffle_ps(val, val, _MM_SHUFFLE(2, 3, 0, 1))), halfVal);
+    return val;
+}
+
+template<bool bAligned> inline void StoreMix(float *dest, __m128 mix, __m128 minVal, __m128 maxVal, __m128 &sseSum, __m128 &sseMax)
+{
+    mix = _mm_min_ps(mix, maxVal);
+    mix = _mm_max_ps(mix, minVal);
+    if(bAligned)
+        _mm_store_ps(dest, mix);
+    else
+        _mm_storeu_ps(dest, mix);
+
+    __m128 squares = _mm_mul_ps(mix, mix);
+    sseSum = _mm_add_ps(sseSum, squares);
+    sseMax = _mm_max_ps(sseMax, squares);
+}
+
+//16 floats at a time, summed across every input in registers and written once
+template<bool bAligned> void MixInputBlocks(float *bufferDest, const AudioMixInput *inputs, UINT numInputs, UINT blockFloats, __m128 &sseSum, __m128 &sseMax)
+{
+    __m128 maxVal = _mm_set_ps1(1.0f);
+    __m128 minVal = _mm_set_ps1(-1.0f);
+    __m128 halfVal = _mm_set_ps1(0.5f);
+
+    for(UINT i=0; i<blockFloats; i += 16)
+    {
+        __m128 mix0 = _mm_setzero_ps();
+        __m128 mix1 = _mm_setzero_ps();
+        __m128 mix2 = _mm_setzero_ps();
+        __m128 mix3 = _mm_setzero_ps();
+
+        for(UINT j=0; j<numInputs; j++)
+        {
+            const AudioMixInput &input = inputs[j];
+            mix0 = _mm_add_ps(mix0, LoadMixInput<bAligned>(input, i,    halfVal));
+            mix1 = _mm_add_ps(mix1, LoadMixInput<bAligned>(input, i+4,  halfVal));
+            mix2 = _mm_add_ps(mix2, LoadMixInput<bAligned>(input, i+8,  halfVal));
+            mix3 = _mm_add_ps(mix3, LoadMixInput<bAligned>(input, i+12, halfVal));
+        }
+
+        StoreMix<bAligned>(bufferDest+i,    mix0, minVal, maxVal, sseSum, sseMax);
+        StoreMix<bAligned>(bufferDest+i+4,  mix1, minVal, maxVal, sseSum, sseMax);
+        StoreMix<bAligned>(bufferDest+i+8,  mix2, minVal, maxVal, sseSum, sseMax);
+        StoreMix<bAligned>(bufferDest+i+12, mix3, minVal, maxVal, sseSum, sseMax);
+    }
+}
+
+void MixAudioInputs(float *bufferDest, const AudioMixInput *inputs, UINT numInputs, UINT totalFloats, float *lpRMS, float *lpMax)
+{
+    bool bAligned = (UPARAM(bufferDest) & 0xF) == 0;
+    for(UINT i=0; i<numInputs && bAligned; i++)
+        bAligned = (UPARAM(inputs[i].buffer) & 0xF) == 0;
+
+    //the mixer's own buffers are all 16 byte aligned.  anything else still goes through SSE, just
+    //with unaligned loads and stores
+    UINT blockFloats = totalFloats & 0xFFFFFFF0;
+
+    __m128 sseSum = _mm_setzero_ps();
+    __m128 sseMax = _mm_setzero_ps();
+
+    if(bAligned)
+        MixInputBlocks<true>(bufferDest, inputs, numInputs, blockFloats, sseSum, sseMax);
+    else
+        MixInputBlocks<false>(bufferDest, inputs, numInputs, blockFloats, sseSum, sseMax);
+
+    float sum = sseSum.m128_f32[0] + sseSum.m128_f32[1] + sseSum.m128_f32[2] + sseSum.m128_f32[3];
+    float maxSquare = max(max(sseMax.m128_f32[0], sseMax.m128_f32[1]), max(sseMax.m128_f32[2], sseMax.m128_f32[3]));
+
+    //whatever's left over
+    for(UINT i=blockFloats; i<totalFloats; i++)
+    {
+        float val = 0.0f;
+
+        for(UINT j=0; j<numInputs; j++)
+        {
+            const float *buffer = inputs[j].buffer;
+
+            if(inputs[j].bForceMono)
+            {
+                UINT pairedFloat = ((i^1) < totalFloats) ? (i^1) : i;
+                val += (buffer[i] + buffer[pairedFloat]) * 0.5f;
+            }
+            else
+                val += buffer[i];
+        }
+
+        if(val < -1.0f)     val = -1.0f;
+        else if(val > 1.0f) val = 1.0f;
+
+        bufferDest[i] = val;
+
+        float pow2Val = val*val;
+        sum += pow2Val;
+        maxSquare = max(maxSquare, pow2Val);
+    }
+
+    if(lpRMS)
+        *lpRMS = totalFloats ? sqrt(sum / totalFloats) : 0.0f;
+    if(lpMax)
+        *lpMax = sqrt(maxSquare);
+}
@@ -84,6 +84,16 @@ BASE_EXPORT QWORD GetQPCTime100NS();
 BASE_EXPORT QWORD GetQPCTimeMS();
 BASE_EXPORT void MixAudio(float *bufferDest, float *bufferSrc, UINT totalFloats, bool bForceMono);
 
+struct AudioMixInput
+{
+    float *buffer;
+    bool bForceMono;
+};
+
+//  mixes all the inputs into bufferDest (overwriting it) in one pass, clamping once at the end instead of
+//after every source.  if lpRMS and lpMax are given, the RMS and peak of the mix are calculated on the way
+BASE_EXPORT void MixAudioInputs(float *bufferDest, const AudioMixInput *inputs, UINT numInputs, UINT totalFloats, float *lpRMS=NULL, float *lpMax=NULL);
+
 //-------------------------------------------
 
 #include "GraphicsSystem.h"
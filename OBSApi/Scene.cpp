@@ -20,6 +20,49 @@
 #include "OBSApi.h"
 
 
+struct TickSourcesData
+{
+    ImageSource **sources;
+    float fSeconds;
+};
+
+static void STDCALL TickSourceTask(TickSourcesData *data, UINT taskID)
+{
+    data->sources[taskID]->Tick(data->fSeconds);
+}
+
+void TickImageSources(ImageSource **sources, const UINT *classFlags, UINT numSources, float fSeconds)
+{
+    TaskPool *pool = API->GetTaskPool();
+    List<ImageSource*> threadSafeSources;
+
+    if(pool)
+    {
+        for(UINT i=0; i<numSources; i++)
+        {
+            if(classFlags[i] & IMAGESOURCE_THREADSAFE_TICK)
+                threadSafeSources << sources[i];
+        }
+    }
+
+    TickSourcesData data;
+    data.sources = threadSafeSources.Array();
+    data.fSeconds = fSeconds;
+
+    TaskBatch *batch = pool ? pool->Submit((TASKPROC)TickSourceTask, &data, threadSafeSources.Num()) : NULL;
+
+    for(UINT i=0; i<numSources; i++)
+    {
+        if(!batch || !(classFlags[i] & IMAGESOURCE_THREADSAFE_TICK))
+            sources[i]->Tick(fSeconds);
+    }
+
+    if(batch)
+        pool->Wait(batch);
+}
+
+//====================================================================================
+
 SceneItem::~SceneItem()
 {
     delete source;
@@ -42,6 +85,7 @@ void SceneItem::SetRender(bool render)
         } else {
             XElement *data = element->GetElement(TEXT("data"));
             source = API->CreateImageSource(lpClass, data);
+            classFlags = API->GetImageSourceClassFlags(lpClass);
             if(!source) {
                 AppWarning(TEXT("Could not create image source '%s' in scene '%s'"), element->GetName(), API->GetSceneElement()->GetName());
             } else {
@@ -231,6 +275,7 @@ SceneItem* Scene::InsertImageSource(UINT pos, XElement *sourceElement)
     item->crop.x = sourceElement->GetFloat(TEXT("crop.left"));
     item->crop.y = sourceElement->GetFloat(TEXT("crop.top"));
     item->crop.z = sourceElement->GetFloat(TEXT("crop.bottom"));
+    item->classFlags = 0;
     item->SetRender(render);
 
     API->EnterSceneMutex();
@@ -275,12 +320,23 @@ void Scene::Preprocess()
 
 void Scene::Tick(float fSeconds)
 {
+    //shrinking keeps the memory, so after the first frame this doesn't allocate
+    tickSources.SetSize(sceneItems.Num());
+    tickClassFlags.SetSize(sceneItems.Num());
+
+    UINT numSources = 0;
     for(UINT i=0; i<sceneItems.Num(); i++)
     {
         SceneItem *item = sceneItems[i];
         if(item->source)
-            item->source->Tick(fSeconds);
+        {
+            tickSources[numSources]    = item->source;
+            tickClassFlags[numSources] = item->classFlags;
+            numSources++;
+        }
     }
+
+    TickImageSources(tickSources.Array(), tickClassFlags.Array(), numSources, fSeconds);
 }
 
 void Scene::Render()
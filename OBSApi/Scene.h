@@ -22,6 +22,14 @@
 
 //-------------------------------------------------------------------
 
+//image source class flags, given to OBSRegisterImageSourceClassEx for every source of the class
+
+//  Tick can be called on a task pool thread at the same time as other sources' Tick.  it must not use
+//the graphics system or any other source -- anything that has to be uploaded should be left for
+//Preprocess, which is always called on the render thread.  the scene mutex is held by the render thread
+//the whole time, so Tick must not try to enter it either.
+#define IMAGESOURCE_THREADSAFE_TICK 0x1
+
 class BASE_EXPORT ImageSource
 {
 public:
@@ -69,6 +77,9 @@ public:
     virtual bool GetMatrix(CTSTR lpName, Matrix &mat)    const {return false;}
 };
 
+//ticks the sources whose class flags have IMAGESOURCE_THREADSAFE_TICK on the task pool, and the rest on the calling thread at the same time
+BASE_EXPORT void TickImageSources(ImageSource **sources, const UINT *classFlags, UINT numSources, float fSeconds);
+
 
 //====================================================================================
 
@@ -89,6 +100,8 @@ class BASE_EXPORT SceneItem
     bool bSelected;
     bool bRender;
 
+    UINT classFlags;    //flags of the source's class, looked up when the source is created
+
 public:
     ~SceneItem();
 
@@ -141,6 +154,10 @@ class BASE_EXPORT Scene
 
     UINT hotkeyID;
 
+    //kept around so ticking doesn't allocate every frame
+    List<ImageSource*> tickSources;
+    List<UINT> tickClassFlags;
+
     inline void DeselectAll()
     {
         for(UINT i=0; i<sceneItems.Num(); i++)
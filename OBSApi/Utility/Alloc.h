@@ -31,6 +31,8 @@ public:
     virtual void   _Free(LPVOID lpData)=0;
     virtual void   ErrorTermination()=0;
 
+    virtual void   LogStats() {}
+
     inline void  *operator new(size_t dwSize)
     {
         return malloc(dwSize);
@@ -32,6 +32,26 @@
     Config
 ===========================================================*/
 
+struct ConfigIndexEntry
+{
+    DWORD hash;
+    ConfigSection *section;
+    ConfigKey *key;
+};
+
+//  plugins embed ConfigFile in their own classes (and construct it with the inline constructor), so
+//it has to keep the size and members they were built with.  the key index lives in this header,
+//allocated in front of the file text, rather than in a member of its own.
+struct ConfigFileHeader
+{
+    List<ConfigIndexEntry> Index;
+};
+
+static inline ConfigFileHeader* GetFileHeader(TSTR lpFileData)
+{
+    return ((ConfigFileHeader*)lpFileData)-1;
+}
+
 BOOL ConfigFile::Create(CTSTR lpConfigFile)
 {
     strFileName = lpConfigFile;
@@ -77,10 +97,17 @@ BOOL ConfigFile::LoadFile(DWORD dwOpenMode)
     lpTempFileData[dwLength+4] = 0;
     file.Close();
 
-    lpFileData = utf8_createTstr(lpTempFileData);
-    dwLength = slen(lpFileData);
+    TSTR lpText = utf8_createTstr(lpTempFileData);
+    dwLength = slen(lpText);
     Free(lpTempFileData);
 
+    ConfigFileHeader *header = (ConfigFileHeader*)Allocate(sizeof(ConfigFileHeader) + (dwLength+1)*sizeof(TCHAR));
+    zero(header, sizeof(ConfigFileHeader));
+
+    lpFileData = (TSTR)(header+1);
+    mcpy(lpFileData, lpText, (dwLength+1)*sizeof(TCHAR));
+    Free(lpText);
+
     bOpen = 1;
 
     return 1;
@@ -103,10 +130,26 @@ void ConfigFile::LoadData()
 
         if((*lpCurLine == '[') && (*(lpNextLine-1) == ']'))
         {
-            lpCurSection = Sections.CreateNew();
+            *(lpNextLine-1) = 0;
+
+            //a section that shows up more than once gets its keys merged into the first one
+            lpCurSection = NULL;
+            for(i=0; i<Sections.Num(); i++)
+            {
+                if(scmpi(lpCurLine+1, Sections[i].name) == 0)
+                {
+                    lpCurSection = &Sections[i];
+                    break;
+                }
+            }
 
-            lpCurSection->name = sfix(sdup(lpCurLine+1));
-            lpCurSection->name[lpNextLine-lpCurLine-2] = 0;
+            if(!lpCurSection)
+            {
+                lpCurSection = Sections.CreateNew();
+                lpCurSection->name = sfix(sdup(lpCurLine+1));
+            }
+
+            *(lpNextLine-1) = ']';
         }
         else if(lpCurSection && *lpCurLine && (*(LPWORD)lpCurLine != '//'))
         {
@@ -146,8 +189,115 @@ void ConfigFile::LoadData()
 
         *lpNextLine = '\r';
     }
+
+    BuildIndex();
 }
 
+//----------------------------------------------------------------------------
+
+//  lookups go through an open addressed hash table of every key, rebuilt each time the file is loaded.
+//anything that changes the file (SetKey, AddKey, Remove) reloads it, so the table never goes stale.
+//names are hashed with the same ascii-only case folding scmpi uses.
+//
+//  the int/float value of each key is parsed here too, so the getters only ever read the keys and
+//stay safe to call from several threads at once.
+
+static inline DWORD HashConfigName(DWORD hash, CTSTR lpName)
+{
+    TCHAR ch;
+    while((ch = *(lpName++)) != 0)
+    {
+        if((ch >= 'A') && (ch <= 'Z'))
+            ch += 0x20;
+
+        hash = (hash ^ DWORD(ch)) * 16777619;
+    }
+
+    return hash;
+}
+
+static inline DWORD HashConfigKey(CTSTR lpSection, CTSTR lpKey)
+{
+    DWORD hash = HashConfigName(2166136261, lpSection);
+    hash = (hash ^ DWORD('\n')) * 16777619;
+    return HashConfigName(hash, lpKey);
+}
+
+void ConfigFile::BuildIndex()
+{
+    UINT numKeys = 0;
+    for(UINT i=0; i<Sections.Num(); i++)
+        numKeys += Sections[i].Keys.Num();
+
+    //kept at most half full so probes stay short
+    UINT indexSize = 16;
+    while(indexSize < numKeys*2)
+        indexSize <<= 1;
+
+    List<ConfigIndexEntry> &Index = GetFileHeader(lpFileData)->Index;
+    Index.Clear();
+    Index.SetSize(indexSize);
+
+    UINT mask = indexSize-1;
+
+    for(UINT i=0; i<Sections.Num(); i++)
+    {
+        ConfigSection &section = Sections[i];
+
+        for(UINT j=0; j<section.Keys.Num(); j++)
+        {
+            ConfigKey &key = section.Keys[j];
+            TSTR strValue = key.ValueList[0];
+
+            key.bIntValid = true;
+            if(scmpi(strValue, TEXT("true")) == 0)
+                key.intValue = 1;
+            else if(scmpi(strValue, TEXT("false")) == 0)
+                key.intValue = 0;
+            else if(ValidIntString(strValue))
+                key.intValue = tstring_base_to_int(strValue, NULL, 0);
+            else
+                key.bIntValid = false;
+
+            key.floatValue = (float)tstof(strValue);
+
+            DWORD hash = HashConfigKey(section.name, key.name);
+
+            UINT pos = hash & mask;
+            while(Index[pos].key)
+                pos = (pos+1) & mask;
+
+            Index[pos].hash    = hash;
+            Index[pos].section = &section;
+            Index[pos].key     = &key;
+        }
+    }
+}
+
+ConfigKey* ConfigFile::FindKey(CTSTR lpSection, CTSTR lpKey)
+{
+    if(!lpFileData)
+        return NULL;
+
+    List<ConfigIndexEntry> &Index = GetFileHeader(lpFileData)->Index;
+    if(!Index.Num())
+        return NULL;
+
+    DWORD hash = HashConfigKey(lpSection, lpKey);
+    UINT mask = Index.Num()-1;
+
+    for(UINT pos = hash & mask; Index[pos].key; pos = (pos+1) & mask)
+    {
+        ConfigIndexEntry &entry = Index[pos];
+        if(entry.hash == hash && scmpi(lpKey, entry.key->name) == 0 && scmpi(lpSection, entry.section->name) == 0)
+            return entry.key;
+    }
+
+    return NULL;
+}
+
+//----------------------------------------------------------------------------
+
 void ConfigFile::Close()
 {
     DWORD i,j,k;
@@ -173,7 +323,10 @@ void ConfigFile::Close()
 
     if(lpFileData)
     {
-        Free(lpFileData);
+        ConfigFileHeader *header = GetFileHeader(lpFileData);
+        header->Index.Clear();
+
+        Free(header);
         lpFileData      = NULL;
     }
 
@@ -202,21 +355,9 @@ String ConfigFile::GetString(CTSTR lpSection, CTSTR lpKey, CTSTR def)
     assert(lpSection);
     assert(lpKey);
 
-    DWORD i,j;
-
-    for(i=0; i<Sections.Num(); i++)
-    {
-        ConfigSection &section = Sections[i];
-        if(scmpi(lpSection, section.name) == 0)
-        {
-            for(j=0; j<section.Keys.Num(); j++)
-            {
-                ConfigKey &key = section.Keys[j];
-                if(scmpi(lpKey, key.name) == 0)
-                    return String(key.ValueList[0]);
-            }
-        }
-    }
+    ConfigKey *key = FindKey(lpSection, lpKey);
+    if(key)
+        return String(key->ValueList[0]);
 
     if(def)
         return String(def);
@@ -229,21 +370,9 @@ CTSTR ConfigFile::GetStringPtr(CTSTR lpSection, CTSTR lpKey, CTSTR def)
     assert(lpSection);
     assert(lpKey);
 
-    DWORD i,j;
-
-    for(i=0; i<Sections.Num(); i++)
-    {
-        ConfigSection &section = Sections[i];
-        if(scmpi(lpSection, section.name) == 0)
-        {
-            for(j=0; j<section.Keys.Num(); j++)
-            {
-                ConfigKey &key = section.Keys[j];
-                if(scmpi(lpKey, key.name) == 0)
-                    return key.ValueList[0];
-            }
-        }
-    }
+    ConfigKey *key = FindKey(lpSection, lpKey);
+    if(key)
+        return key->ValueList[0];
 
     if(def)
         return def;
@@ -256,33 +385,11 @@ int ConfigFile::GetInt(CTSTR lpSection, CTSTR lpKey, int def)
     assert(lpSection);
     assert(lpKey);
 
-    DWORD i,j;
-
-    for(i=0; i<Sections.Num(); i++)
-    {
-        ConfigSection &section = Sections[i];
-        if(scmpi(lpSection, section.name) == 0)
-        {
-            for(j=0; j<section.Keys.Num(); j++)
-            {
-                ConfigKey &key = section.Keys[j];
-                if(scmpi(lpKey, key.name) == 0)
-                {
-                    if(scmpi(key.ValueList[0], TEXT("true")) == 0)
-                        return 1;
-                    else if(scmpi(key.ValueList[0], TEXT("false")) == 0)
-                        return 0;
-                    else
-                    {
-                        if(ValidIntString(key.ValueList[0]))
-                            return tstring_base_to_int(key.ValueList[0], NULL, 0);
-                    }
-                }
-            }
-        }
-    }
+    ConfigKey *key = FindKey(lpSection, lpKey);
+    if(!key)
+        return def;
 
-    return def;
+    return key->bIntValid ? key->intValue : def;
 }
 
 DWORD ConfigFile::GetHex(CTSTR lpSection, CTSTR lpKey, DWORD def)
@@ -290,21 +397,9 @@ DWORD ConfigFile::GetHex(CTSTR lpSection, CTSTR lpKey, DWORD def)
     assert(lpSection);
     assert(lpKey);
 
-    DWORD i,j;
-
-    for(i=0; i<Sections.Num(); i++)
-    {
-        ConfigSection &section = Sections[i];
-        if(scmpi(lpSection, section.name) == 0)
-        {
-            for(j=0; j<section.Keys.Num(); j++)
-            {
-                ConfigKey &key = section.Keys[j];
-                if(scmpi(lpKey, key.name) == 0)
-                    return tstring_base_to_int(key.ValueList[0], NULL, 0);
-            }
-        }
-    }
+    ConfigKey *key = FindKey(lpSection, lpKey);
+    if(key)
+        return tstring_base_to_int(key->ValueList[0], NULL, 0);
 
     return def;
 }
@@ -314,23 +409,11 @@ float ConfigFile::GetFloat(CTSTR lpSection, CTSTR lpKey, float def)
     assert(lpSection);
     assert(lpKey);
 
-    DWORD i,j;
-
-    for(i=0; i<Sections.Num(); i++)
-    {
-        ConfigSection &section = Sections[i];
-        if(scmpi(lpSection, section.name) == 0)
-        {
-            for(j=0; j<section.Keys.Num(); j++)
-            {
-                ConfigKey &key = section.Keys[j];
-                if(scmpi(lpKey, key.name) == 0)
-                    return (float)tstof(key.ValueList[0]);
-            }
-        }
-    }
+    ConfigKey *key = FindKey(lpSection, lpKey);
+    if(!key)
+        return def;
 
-    return def;
+    return key->floatValue;
 }
 
 Color4 ConfigFile::GetColor(CTSTR lpSection, CTSTR lpKey)
@@ -338,72 +421,60 @@ Color4 ConfigFile::GetColor(CTSTR lpSection, CTSTR lpKey)
     assert(lpSection);
     assert(lpKey);
 
-    DWORD i,j;
-
-    for(i=0; i<Sections.Num(); i++)
+    ConfigKey *key = FindKey(lpSection, lpKey);
+    if(key)
     {
-        ConfigSection &section = Sections[i];
-        if(scmpi(lpSection, section.name) == 0)
+        TSTR strValue = key->ValueList[0];
+        if(*strValue == '{')
         {
-            for(j=0; j<section.Keys.Num(); j++)
-            {
-                ConfigKey &key = section.Keys[j];
-                if(scmpi(lpKey, key.name) == 0)
-                {
-                    TSTR strValue = key.ValueList[0];
-                    if(*strValue == '{')
-                    {
-                        Color4 ret;
+            Color4 ret;
 
-                        ret.x = float(tstof(++strValue));
+            ret.x = float(tstof(++strValue));
 
-                        if(!(strValue = schr(strValue, ',')))
-                            break;
-                        ret.y = float(tstof(++strValue));
+            if(!(strValue = schr(strValue, ',')))
+                return Color4(0.0f, 0.0f, 0.0f, 0.0f);
+            ret.y = float(tstof(++strValue));
 
-                        if(!(strValue = schr(strValue, ',')))
-                            break;
-                        ret.z = float(tstof(++strValue));
+            if(!(strValue = schr(strValue, ',')))
+                return Color4(0.0f, 0.0f, 0.0f, 0.0f);
+            ret.z = float(tstof(++strValue));
 
-                        if(!(strValue = schr(strValue, ',')))
-                        {
-                            ret.w = 1.0f;
-                            return ret;
-                        }
-                        ret.w = float(tstof(++strValue));
-
-                        return ret;
-                    }
-                    else if(*strValue == '[')
-                    {
-                        Color4 ret;
+            if(!(strValue = schr(strValue, ',')))
+            {
+                ret.w = 1.0f;
+                return ret;
+            }
+            ret.w = float(tstof(++strValue));
 
-                        ret.x = (float(tstoi(++strValue))/255.0f)+0.001f;
+            return ret;
+        }
+        else if(*strValue == '[')
+        {
+            Color4 ret;
 
-                        if(!(strValue = schr(strValue, ',')))
-                            break;
-                        ret.y = (float(tstoi(++strValue))/255.0f)+0.001f;
+            ret.x = (float(tstoi(++strValue))/255.0f)+0.001f;
 
-                        if(!(strValue = schr(strValue, ',')))
-                            break;
-                        ret.z = (float(tstoi(++strValue))/255.0f)+0.001f;
+            if(!(strValue = schr(strValue, ',')))
+                return Color4(0.0f, 0.0f, 0.0f, 0.0f);
+            ret.y = (float(tstoi(++strValue))/255.0f)+0.001f;
 
-                        if(!(strValue = schr(strValue, ',')))
-                        {
-                            ret.w = 1.0f;
-                            return ret;
-                        }
-                        ret.w = (float(tstoi(++strValue))/255.0f)+0.001f;
+            if(!(strValue = schr(strValue, ',')))
+                return Color4(0.0f, 0.0f, 0.0f, 0.0f);
+            ret.z = (float(tstoi(++strValue))/255.0f)+0.001f;
 
-                        return ret;
-                    }
-                    else if( (*LPWORD(strValue) == 'x0') ||
-                        (*LPWORD(strValue) == 'X0') )
-                    {
-                        return RGBA_to_Vect4(tstring_base_to_int(strValue+2, NULL, 16));
-                    }
-                }
+            if(!(strValue = schr(strValue, ',')))
+            {
+                ret.w = 1.0f;
+                return ret;
             }
+            ret.w = (float(tstoi(++strValue))/255.0f)+0.001f;
+
+            return ret;
+        }
+        else if( (*LPWORD(strValue) == 'x0') ||
+            (*LPWORD(strValue) == 'X0') )
+        {
+            return RGBA_to_Vect4(tstring_base_to_int(strValue+2, NULL, 16));
         }
     }
 
@@ -415,30 +486,14 @@ BOOL ConfigFile::GetStringList(CTSTR lpSection, CTSTR lpKey, StringList &StrList
     assert(lpSection);
     assert(lpKey);
 
-    BOOL bFoundKey = 0;
-
-    DWORD i,j,k;
-
-    for(i=0; i<Sections.Num(); i++)
-    {
-        ConfigSection &section = Sections[i];
-        if(scmpi(lpSection, section.name) == 0)
-        {
-            for(j=0; j<section.Keys.Num(); j++)
-            {
-                ConfigKey &key = section.Keys[j];
-                if(scmpi(lpKey, key.name) == 0)
-                {
-                    for(k=0; k<key.ValueList.Num(); k++)
-                        StrList << key.ValueList[k];
+    ConfigKey *key = FindKey(lpSection, lpKey);
+    if(!key)
+        return 0;
 
-                    bFoundKey = 1;
-                }
-            }
-        }
-    }
+    for(UINT i=0; i<key->ValueList.Num(); i++)
+        StrList << key->ValueList[i];
 
-    return bFoundKey;
+    return 1;
 }
 
 BOOL ConfigFile::GetIntList(CTSTR lpSection, CTSTR lpKey, List<int> &IntList)
@@ -446,39 +501,24 @@ BOOL ConfigFile::GetIntList(CTSTR lpSection, CTSTR lpKey, List<int> &IntList)
     assert(lpSection);
     assert(lpKey);
 
-    DWORD i,j,k;
-    BOOL bFoundKey = 0;
+    ConfigKey *key = FindKey(lpSection, lpKey);
+    if(!key)
+        return 0;
 
-    for(i=0; i<Sections.Num(); i++)
+    for(UINT i=0; i<key->ValueList.Num(); i++)
     {
-        ConfigSection &section = Sections[i];
-        if(scmpi(lpSection, section.name) == 0)
+        if(scmpi(key->ValueList[i], TEXT("true")) == 0)
+            IntList << 1;
+        else if(scmpi(key->ValueList[i], TEXT("false")) == 0)
+            IntList << 0;
+        else
         {
-            for(j=0; j<section.Keys.Num(); j++)
-            {
-                ConfigKey &key = section.Keys[j];
-                if(scmpi(lpKey, key.name) == 0)
-                {
-                    for(k=0; k<key.ValueList.Num(); k++)
-                    {
-                        if(scmpi(key.ValueList[k], TEXT("true")) == 0)
-                            IntList << 1;
-                        else if(scmpi(key.ValueList[k], TEXT("false")) == 0)
-                            IntList << 0;
-                        else
-                        {
-                            if(ValidIntString(key.ValueList[k]))
-                                IntList << tstring_base_to_int(key.ValueList[k], NULL, 0);
-                        }
-                    }
-
-                    bFoundKey = 1;
-                }
-            }
+            if(ValidIntString(key->ValueList[i]))
+                IntList << tstring_base_to_int(key->ValueList[i], NULL, 0);
         }
     }
 
-    return bFoundKey;
+    return 1;
 }
 
 BOOL ConfigFile::GetFloatList(CTSTR lpSection, CTSTR lpKey, List<float> &FloatList)
@@ -486,29 +526,14 @@ BOOL ConfigFile::GetFloatList(CTSTR lpSection, CTSTR lpKey, List<float> &FloatLi
     assert(lpSection);
     assert(lpKey);
 
-    DWORD i,j,k;
-    BOOL bFoundKey = 0;
-
-    for(i=0; i<Sections.Num(); i++)
-    {
-        ConfigSection &section = Sections[i];
-        if(scmpi(lpSection, section.name) == 0)
-        {
-            for(j=0; j<section.Keys.Num(); j++)
-            {
-                ConfigKey &key = section.Keys[j];
-                if(scmpi(lpKey, key.name) == 0)
-                {
-                    for(k=0; k<key.ValueList.Num(); k++)
-                        FloatList << (float)tstof(key.ValueList[k]);
+    ConfigKey *key = FindKey(lpSection, lpKey);
+    if(!key)
+        return 0;
 
-                    bFoundKey = 1;
-                }
-            }
-        }
-    }
+    for(UINT i=0; i<key->ValueList.Num(); i++)
+        FloatList << (float)tstof(key->ValueList[i]);
 
-    return bFoundKey;
+    return 1;
 }
 
 BOOL ConfigFile::GetColorList(CTSTR lpSection, CTSTR lpKey, List<Color4> &ColorList)
@@ -516,77 +541,62 @@ BOOL ConfigFile::GetColorList(CTSTR lpSection, CTSTR lpKey, List<Color4> &ColorL
     assert(lpSection);
     assert(lpKey);
 
-    DWORD i,j,k;
-    BOOL bFoundKey = 0;
+    ConfigKey *key = FindKey(lpSection, lpKey);
+    if(!key)
+        return 0;
 
-    for(i=0; i<Sections.Num(); i++)
+    for(UINT i=0; i<key->ValueList.Num(); i++)
     {
-        ConfigSection &section = Sections[i];
-        if(scmpi(lpSection, section.name) == 0)
+        TSTR strValue = key->ValueList[i];
+        if(*strValue == '{')
         {
-            for(j=0; j<section.Keys.Num(); j++)
-            {
-                ConfigKey &key = section.Keys[j];
-                if(scmpi(lpKey, key.name) == 0)
-                {
-                    for(k=0; k<key.ValueList.Num(); k++)
-                    {
-                        TSTR strValue = key.ValueList[k];
-                        if(*strValue == '{')
-                        {
-                            Color4 ret;
-
-                            ret.x = float(tstof(++strValue));
-
-                            if(!(strValue = schr(strValue, ',')))
-                                break;
-                            ret.y = float(tstof(++strValue));
-
-                            if(!(strValue = schr(strValue, ',')))
-                                break;
-                            ret.z = float(tstof(++strValue));
-
-                            if(!(strValue = schr(strValue, ',')))
-                                ret.w = 0.0f;
-                            else
-                                ret.w = float(tstof(++strValue));
-                            ColorList << ret;
-                        }
-                        else if(*strValue == '[')
-                        {
-                            Color4 ret;
-
-                            ret.x = float(tstoi(++strValue))/255.0f;
-
-                            if(!(strValue = schr(strValue, ',')))
-                                break;
-                            ret.y = float(tstoi(++strValue))/255.0f;
-
-                            if(!(strValue = schr(strValue, ',')))
-                                break;
-                            ret.z = float(tstoi(++strValue))/255.0f;
-
-                            if(!(strValue = schr(strValue, ',')))
-                                ret.w = 0.0f;
-                            else
-                                ret.w = float(tstoi(++strValue))/255.0f;
-
-                            ColorList << ret;
-                        }
-                        else if( (*LPWORD(strValue) == 'x0') ||
-                            (*LPWORD(strValue) == 'X0') )
-                        {
-                            ColorList << RGBA_to_Vect4(tstring_base_to_int(strValue+2, NULL, 16));
-                        }
-                    }
+            Color4 ret;
 
-                    bFoundKey = 1;
-                }
-            }
+            ret.x = float(tstof(++strValue));
+
+            if(!(strValue = schr(strValue, ',')))
+                break;
+            ret.y = float(tstof(++strValue));
+
+            if(!(strValue = schr(strValue, ',')))
+                break;
+            ret.z = float(tstof(++strValue));
+
+            if(!(strValue = schr(strValue, ',')))
+                ret.w = 0.0f;
+            else
+                ret.w = float(tstof(++strValue));
+            ColorList << ret;
+        }
+        else if(*strValue == '[')
+        {
+            Color4 ret;
+
+            ret.x = float(tstoi(++strValue))/255.0f;
+
+            if(!(strValue = schr(strValue, ',')))
+                break;
+            ret.y = float(tstoi(++strValue))/255.0f;
+
+            if(!(strValue = schr(strValue, ',')))
+                break;
+            ret.z = float(tstoi(++strValue))/255.0f;
+
+            if(!(strValue = schr(strValue, ',')))
+                ret.w = 0.0f;
+            else
+                ret.w = float(tstoi(++strValue))/255.0f;
+
+            ColorList << ret;
+        }
+        else if( (*LPWORD(strValue) == 'x0') ||
+            (*LPWORD(strValue) == 'X0') )
+        {
+            ColorList << RGBA_to_Vect4(tstring_base_to_int(strValue+2, NULL, 16));
         }
     }
 
-    return bFoundKey;
+    return 1;
 }
 
 void ConfigFile::SetString(CTSTR lpSection, CTSTR lpKey, CTSTR lpString)
@@ -728,20 +738,7 @@ void ConfigFile::SetColorList(CTSTR lpSection, CTSTR lpKey, List<Color4> &ColorL
 
 BOOL  ConfigFile::HasKey(CTSTR lpSection, CTSTR lpKey)
 {
-    for(unsigned int i=0; i<Sections.Num(); i++)
-    {
-        ConfigSection &section = Sections[i];
-        if(scmpi(section.name, lpSection) == 0)
-        {
-            for(unsigned int j=0; j<section.Keys.Num(); j++)
-            {
-                if(scmpi(section.Keys[j].name, lpKey) == 0)
-                    return TRUE;
-            }
-        }
-    }
-
-    return FALSE;
+    return FindKey(lpSection, lpKey) != NULL;
 }
 
 
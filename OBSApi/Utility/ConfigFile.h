@@ -27,6 +27,11 @@ struct ConfigKey
 {
     TSTR name;
     List<TSTR> ValueList;
+
+    //first value as GetInt/GetFloat return it, parsed when the file is loaded
+    int intValue;
+    float floatValue;
+    bool bIntValid;
 };
 
 struct ConfigSection
@@ -99,6 +104,9 @@ private:
     void  SetKey(CTSTR lpSection, CTSTR lpKey, CTSTR newvalue);
     void  AddKey(CTSTR lpSection, CTSTR lpKey, CTSTR newvalue);
 
+    void  BuildIndex();
+    ConfigKey* FindKey(CTSTR lpSection, CTSTR lpKey);
+
     List<ConfigSection> Sections;
 
     BOOL  bOpen;
@@ -17,6 +17,11 @@
 ********************************************************************************/
 
 
+#define WINVER         0x0600
+#define _WIN32_WINDOWS 0x0600
+#define _WIN32_WINNT   0x0600
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
 #include "XT.h"
 
 
@@ -50,14 +55,41 @@ struct MemInfo
     size_t minBlockSize;
     size_t maxBlockSize;
     DWORD maxBlocks;
+    DWORD cacheBatchSize;   //number of blocks moved between a thread cache and the pools at once
+
+    //stats, protected by the allocation mutex
+    DWORD numPools;
+    QWORD numAllocs, numFrees;
+    QWORD numRefills, numFlushes;
+};
+
+#define NUM_SIZE_CLASSES 12
+
+struct CachedBlock
+{
+    CachedBlock *next;
+};
+
+struct ThreadCache
+{
+    FastAlloc   *allocator;
+    ThreadCache *prev, *next;   //list of live caches, protected by the allocation mutex
+
+    CachedBlock *blocks[NUM_SIZE_CLASSES];
+    DWORD       numBlocks[NUM_SIZE_CLASSES];
+
+    //only ever written by the owning thread
+    QWORD       numAllocs[NUM_SIZE_CLASSES];
+    QWORD       numFrees[NUM_SIZE_CLASSES];
 };
 
-MemInfo MemInfoList[12],*SizeToMemInfo[0x8001];
+MemInfo MemInfoList[NUM_SIZE_CLASSES],*SizeToMemInfo[0x8001];
 
 size_t stPageSize=0;
 
 Pool *PoolList[256];
 #define GetMemInfo(size)    SizeToMemInfo[size]
+#define GetPool(address)    (&PoolList[PtrTo32(address)>>24][(PtrTo32(address)>>16)&0xFF])
 #define align(address)      ((address+stPageSize-1)&(~(stPageSize-1)))
 
 void STDCALL OpenLogFile();
@@ -69,7 +101,7 @@ FastAlloc::FastAlloc()
 
     DWORD from=1,to;
 
-    for(int i=1; i<12; i++)
+    for(int i=1; i<NUM_SIZE_CLASSES; i++)
     {
         to   = (8<<(i+1))+1;
 
@@ -77,6 +109,12 @@ FastAlloc::FastAlloc()
         MemInfoList[i].minBlockSize = from;
         MemInfoList[i].maxBlocks = 0x10000/(DWORD)MemInfoList[i].maxBlockSize;
         MemInfoList[i].nextFree = NULL;
+        MemInfoList[i].numPools = 0;
+        MemInfoList[i].numAllocs = MemInfoList[i].numFrees = 0;
+        MemInfoList[i].numRefills = MemInfoList[i].numFlushes = 0;
+
+        //move up to 16k worth of blocks at a time, so a cache never holds much more than 32k of any one size
+        MemInfoList[i].cacheBatchSize = MAX(1, MIN(32, 0x4000/(DWORD)MemInfoList[i].maxBlockSize));
 
         for(DWORD j=from; j<to; j++)
             SizeToMemInfo[j] = &MemInfoList[i];
@@ -85,10 +123,25 @@ FastAlloc::FastAlloc()
     }
 
     hAllocationMutex = OSCreateMutex();
+
+    cacheList = NULL;
+    numLocks = numContendedLocks = 0;
+    numLargeAllocs = 0;
+    largeBytesInUse = largeBytesPeak = 0;
+
+    cacheSlot = FlsAlloc((PFLS_CALLBACK_FUNCTION)DestroyThreadCache);
 }
 
 FastAlloc::~FastAlloc()
 {
+    //returns the caches of all threads that still have one
+    if(cacheSlot != FLS_OUT_OF_INDEXES)
+        FlsFree(cacheSlot);
+
+    //caches created on threads that had already run their fiber cleanup
+    while(cacheList)
+        ReleaseCache(cacheList);
+
     OSCloseMutex(hAllocationMutex);
 
     Pool *pool;
@@ -137,122 +190,282 @@ void   FastAlloc::ErrorTermination()
     }
 }
 
-void * __restrict FastAlloc::_Allocate(size_t dwSize)
+inline void FastAlloc::LockPools()
 {
-    OSEnterMutex(hAllocationMutex);
+    if(!OSTryEnterMutex(hAllocationMutex))
+    {
+        OSEnterMutex(hAllocationMutex);
+        ++numContendedLocks;
+    }
 
-    //assert(dwSize);
-    if(!dwSize) dwSize = 1;
+    ++numLocks;
+}
 
-    LPVOID lpMemory;
-    Pool *pool;
+inline ThreadCache *FastAlloc::GetThreadCache()
+{
+    if(cacheSlot == FLS_OUT_OF_INDEXES)
+        return NULL;
 
-    if(dwSize < 0x8001)
+    ThreadCache *cache = (ThreadCache*)FlsGetValue(cacheSlot);
+    if(!cache)
     {
-        MemInfo *meminfo = GetMemInfo(dwSize);
+        cache = (ThreadCache*)malloc(sizeof(ThreadCache));
+        if(!cache)
+            return NULL;
 
-        if(!meminfo->nextFree) //no pools have been created for this section
-        {
-            lpMemory = OSVirtualAlloc(0x10000);
-            if(!lpMemory) CrashError(TEXT("Out of memory while trying to allocate %d bytes at %p"), dwSize, ReturnAddress());
+        zero(cache, sizeof(ThreadCache));
+        cache->allocator = this;
 
-            Pool *&poollist = PoolList[PtrTo32(lpMemory)>>24];
-            if(!poollist)
-            {
-                poollist = (Pool*)OSVirtualAlloc(sizeof(Pool)*256);
-                if(!poollist) CrashError(TEXT("Out of memory while trying to allocate %d bytes at %p"), dwSize, ReturnAddress());
-                zero(poollist, sizeof(Pool)*256);
-            }
-            pool = &poollist[(PtrTo32(lpMemory)>>16)&0xFF];
-
-            pool->lpMem = lpMemory;
-            pool->bytesTotal = 0x10000;
-            pool->meminfo = meminfo;
-            pool->firstFreeMem = (FreeMemInfo*)lpMemory;
-            pool->lastFreeMem = (FreeMemInfo*)lpMemory;
-
-            meminfo->nextFree = (FreeMemInfo*)lpMemory;
-            meminfo->nextFree->num = meminfo->maxBlocks;
-            meminfo->nextFree->lpPool = pool;
-            meminfo->nextFree->lpPrev = meminfo->nextFree->lpNext = NULL;
+        if(!FlsSetValue(cacheSlot, cache))
+        {
+            free(cache);
+            return NULL;
         }
-        else
-            pool = meminfo->nextFree->lpPool;
 
-        assert(pool);
+        LockPools();
+        cache->next = cacheList;
+        if(cacheList)
+            cacheList->prev = cache;
+        cacheList = cache;
+        OSLeaveMutex(hAllocationMutex);
+    }
 
-        assert(pool->bytesTotal);
-    
-        lpMemory = meminfo->nextFree;
+    return cache;
+}
 
-        assert(meminfo->nextFree->num);
+void FastAlloc::RefillCache(ThreadCache *cache, MemInfo *meminfo)
+{
+    UINT sizeClass = UINT(meminfo-MemInfoList);
+
+    LockPools();
+
+    for(DWORD i=0; i<meminfo->cacheBatchSize; i++)
+    {
+        CachedBlock *block = (CachedBlock*)AllocateBlock(meminfo);
+        block->next = cache->blocks[sizeClass];
+        cache->blocks[sizeClass] = block;
+    }
+
+    cache->numBlocks[sizeClass] += meminfo->cacheBatchSize;
+    ++meminfo->numRefills;
+
+    OSLeaveMutex(hAllocationMutex);
+}
+
+void FastAlloc::FlushCache(ThreadCache *cache, MemInfo *meminfo, DWORD numToKeep)
+{
+    UINT sizeClass = UINT(meminfo-MemInfoList);
 
-        ++pool->blocksUsed;
+    LockPools();
 
-        if(pool->blocksUsed == meminfo->maxBlocks)
+    while(cache->numBlocks[sizeClass] > numToKeep)
+    {
+        CachedBlock *block = cache->blocks[sizeClass];
+        cache->blocks[sizeClass] = block->next;
+        --cache->numBlocks[sizeClass];
+
+        FreeBlock(block);
+    }
+
+    ++meminfo->numFlushes;
+
+    OSLeaveMutex(hAllocationMutex);
+}
+
+void FastAlloc::ReleaseCache(ThreadCache *cache)
+{
+    LockPools();
+
+    for(int i=1; i<NUM_SIZE_CLASSES; i++)
+    {
+        while(cache->blocks[i])
         {
-            pool->firstFreeMem = NULL;
-            pool->lastFreeMem = NULL;
+            CachedBlock *block = cache->blocks[i];
+            cache->blocks[i] = block->next;
+            FreeBlock(block);
         }
-        else if(meminfo->nextFree->num == 1)
-            pool->firstFreeMem = meminfo->nextFree->lpNext;
 
+        MemInfoList[i].numAllocs += cache->numAllocs[i];
+        MemInfoList[i].numFrees  += cache->numFrees[i];
+    }
 
-        if(meminfo->nextFree->num > 1)
-        {
-            FreeMemInfo *next = (FreeMemInfo*)(((LPBYTE)meminfo->nextFree)+meminfo->maxBlockSize);
-            if(pool->firstFreeMem == meminfo->nextFree)
-                pool->firstFreeMem = next;
-            if(pool->lastFreeMem == meminfo->nextFree)
-                pool->lastFreeMem = next;
+    if(cache->prev)
+        cache->prev->next = cache->next;
+    else
+        cacheList = cache->next;
+    if(cache->next)
+        cache->next->prev = cache->prev;
 
-            mcpy(next, meminfo->nextFree, sizeof(FreeMemInfo));
+    OSLeaveMutex(hAllocationMutex);
 
-            if(next->lpPrev)
-                next->lpPrev->lpNext = next;
-            if(next->lpNext)
-                next->lpNext->lpPrev = next;
+    free(cache);
+}
 
-            --next->num;
-            meminfo->nextFree = next;
-        }
-        else
+void STDCALL FastAlloc::DestroyThreadCache(LPVOID param)
+{
+    ThreadCache *cache = (ThreadCache*)param;
+    cache->allocator->ReleaseCache(cache);
+}
+
+void * __restrict FastAlloc::_Allocate(size_t dwSize)
+{
+    //assert(dwSize);
+    if(!dwSize) dwSize = 1;
+
+    LPVOID lpMemory;
+
+    if(dwSize < 0x8001)
+    {
+        MemInfo *meminfo = GetMemInfo(dwSize);
+
+        ThreadCache *cache = GetThreadCache();
+        if(cache)
         {
-            FreeMemInfo *freemem = meminfo->nextFree;
-            if(freemem->lpNext)
-                freemem->lpNext->lpPrev = freemem->lpPrev;
-            if(freemem->lpPrev)
-                freemem->lpPrev->lpNext = freemem->lpNext;
-            meminfo->nextFree = freemem->lpNext;
+            UINT sizeClass = UINT(meminfo-MemInfoList);
+
+            if(!cache->blocks[sizeClass])
+                RefillCache(cache, meminfo);
+
+            CachedBlock *block = cache->blocks[sizeClass];
+            cache->blocks[sizeClass] = block->next;
+            --cache->numBlocks[sizeClass];
+            ++cache->numAllocs[sizeClass];
+
+            return block;
         }
 
-        //zero(lpMemory, dwSize);
+        LockPools();
+        lpMemory = AllocateBlock(meminfo);
+        ++meminfo->numAllocs;
+        OSLeaveMutex(hAllocationMutex);
     }
     else
     {
-        dwSize = align(dwSize);
-        lpMemory = OSVirtualAlloc(dwSize);
-        if(!lpMemory) CrashError(TEXT("Out of memory while trying to allocate %d bytes at %p"), dwSize, ReturnAddress());
+        LockPools();
+        lpMemory = AllocateLarge(dwSize);
+        OSLeaveMutex(hAllocationMutex);
+    }
+
+    return lpMemory;
+}
 
-        //zero(lpMemory, dwSize);
+LPVOID FastAlloc::AllocateBlock(MemInfo *meminfo)
+{
+    LPVOID lpMemory;
+    Pool *pool;
+
+    if(!meminfo->nextFree) //no pools have been created for this section
+    {
+        lpMemory = OSVirtualAlloc(0x10000);
+        if(!lpMemory) CrashError(TEXT("Out of memory while trying to allocate %d bytes at %p"), meminfo->maxBlockSize, ReturnAddress());
 
         Pool *&poollist = PoolList[PtrTo32(lpMemory)>>24];
         if(!poollist)
         {
             poollist = (Pool*)OSVirtualAlloc(sizeof(Pool)*256);
-            if(!poollist) CrashError(TEXT("Out of memory while trying to allocate %d bytes at %p"), dwSize, ReturnAddress());
+            if(!poollist) CrashError(TEXT("Out of memory while trying to allocate %d bytes at %p"), meminfo->maxBlockSize, ReturnAddress());
             zero(poollist, sizeof(Pool)*256);
         }
         pool = &poollist[(PtrTo32(lpMemory)>>16)&0xFF];
 
-        pool->blocksUsed = 1;
-        pool->bytesTotal = dwSize;
         pool->lpMem = lpMemory;
-        pool->meminfo = NULL;
-        pool->firstFreeMem = pool->lastFreeMem = NULL;
+        pool->bytesTotal = 0x10000;
+        pool->meminfo = meminfo;
+        pool->firstFreeMem = (FreeMemInfo*)lpMemory;
+        pool->lastFreeMem = (FreeMemInfo*)lpMemory;
+
+        meminfo->nextFree = (FreeMemInfo*)lpMemory;
+        meminfo->nextFree->num = meminfo->maxBlocks;
+        meminfo->nextFree->lpPool = pool;
+        meminfo->nextFree->lpPrev = meminfo->nextFree->lpNext = NULL;
+
+        ++meminfo->numPools;
     }
+    else
+        pool = meminfo->nextFree->lpPool;
+
+    assert(pool);
+
+    assert(pool->bytesTotal);
+
+    lpMemory = meminfo->nextFree;
+
+    assert(meminfo->nextFree->num);
+
+    ++pool->blocksUsed;
+
+    if(pool->blocksUsed == meminfo->maxBlocks)
+    {
+        pool->firstFreeMem = NULL;
+        pool->lastFreeMem = NULL;
+    }
+    else if(meminfo->nextFree->num == 1)
+        pool->firstFreeMem = meminfo->nextFree->lpNext;
 
-    OSLeaveMutex(hAllocationMutex);
+
+    if(meminfo->nextFree->num > 1)
+    {
+        FreeMemInfo *next = (FreeMemInfo*)(((LPBYTE)meminfo->nextFree)+meminfo->maxBlockSize);
+        if(pool->firstFreeMem == meminfo->nextFree)
+            pool->firstFreeMem = next;
+        if(pool->lastFreeMem == meminfo->nextFree)
+            pool->lastFreeMem = next;
+
+        mcpy(next, meminfo->nextFree, sizeof(FreeMemInfo));
+
+        if(next->lpPrev)
+            next->lpPrev->lpNext = next;
+        if(next->lpNext)
+            next->lpNext->lpPrev = next;
+
+        --next->num;
+        meminfo->nextFree = next;
+    }
+    else
+    {
+        FreeMemInfo *freemem = meminfo->nextFree;
+        if(freemem->lpNext)
+            freemem->lpNext->lpPrev = freemem->lpPrev;
+        if(freemem->lpPrev)
+            freemem->lpPrev->lpNext = freemem->lpNext;
+        meminfo->nextFree = freemem->lpNext;
+    }
+
+    //zero(lpMemory, dwSize);
+
+    return lpMemory;
+}
+
+LPVOID FastAlloc::AllocateLarge(size_t dwSize)
+{
+    LPVOID lpMemory;
+    Pool *pool;
+
+    dwSize = align(dwSize);
+    lpMemory = OSVirtualAlloc(dwSize);
+    if(!lpMemory) CrashError(TEXT("Out of memory while trying to allocate %d bytes at %p"), dwSize, ReturnAddress());
+
+    //zero(lpMemory, dwSize);
+
+    Pool *&poollist = PoolList[PtrTo32(lpMemory)>>24];
+    if(!poollist)
+    {
+        poollist = (Pool*)OSVirtualAlloc(sizeof(Pool)*256);
+        if(!poollist) CrashError(TEXT("Out of memory while trying to allocate %d bytes at %p"), dwSize, ReturnAddress());
+        zero(poollist, sizeof(Pool)*256);
+    }
+    pool = &poollist[(PtrTo32(lpMemory)>>16)&0xFF];
+
+    pool->blocksUsed = 1;
+    pool->bytesTotal = dwSize;
+    pool->lpMem = lpMemory;
+    pool->meminfo = NULL;
+    pool->firstFreeMem = pool->lastFreeMem = NULL;
+
+    ++numLargeAllocs;
+    largeBytesInUse += dwSize;
+    if(largeBytesInUse > largeBytesPeak)
+        largeBytesPeak = largeBytesInUse;
 
     return lpMemory;
 }
@@ -271,7 +484,7 @@ void * FastAlloc::_ReAllocate(LPVOID lpMemory, size_t dwSize)
         return NULL;
     }
 
-    Pool *pool = &PoolList[PtrTo32(lpMemory)>>24][(PtrTo32(lpMemory)>>16)&0xFF];
+    Pool *pool = GetPool(lpMemory);
 
     if(pool->meminfo)
     {
@@ -296,79 +509,157 @@ void * FastAlloc::_ReAllocate(LPVOID lpMemory, size_t dwSize)
 
 void FastAlloc::_Free(LPVOID lpMemory)
 {
-    OSEnterMutex(hAllocationMutex);
+    if(!lpMemory)
+        return;
 
-    if(lpMemory)
-    {
-        Pool *pool = &PoolList[PtrTo32(lpMemory)>>24][(PtrTo32(lpMemory)>>16)&0xFF];
-        MemInfo *meminfo = pool->meminfo;
+    //the pool entry of a live block never changes, so it's safe to look at without the mutex
+    MemInfo *meminfo = GetPool(lpMemory)->meminfo;
 
-        if(meminfo && pool->blocksUsed == 1)
+    if(meminfo)
+    {
+        ThreadCache *cache = GetThreadCache();
+        if(cache)
         {
-            FreeMemInfo *prevPoolFreeMem = pool->firstFreeMem->lpPrev;
-            FreeMemInfo *nextPoolFreeMem = pool->lastFreeMem->lpNext;
+            UINT sizeClass = UINT(meminfo-MemInfoList);
+
+            CachedBlock *block = (CachedBlock*)lpMemory;
+            block->next = cache->blocks[sizeClass];
+            cache->blocks[sizeClass] = block;
+            ++cache->numFrees[sizeClass];
 
-            if(prevPoolFreeMem)
-                prevPoolFreeMem->lpNext = nextPoolFreeMem;
-            if(nextPoolFreeMem)
-                nextPoolFreeMem->lpPrev = prevPoolFreeMem;
+            if(++cache->numBlocks[sizeClass] > meminfo->cacheBatchSize*2)
+                FlushCache(cache, meminfo, meminfo->cacheBatchSize);
 
-            if(meminfo->nextFree && (meminfo->nextFree->lpPool == pool))
-                meminfo->nextFree = nextPoolFreeMem;
+            return;
         }
+    }
 
-        assert(pool->blocksUsed);
+    LockPools();
+    if(meminfo)
+        ++meminfo->numFrees;
+    FreeBlock(lpMemory);
+    OSLeaveMutex(hAllocationMutex);
+}
 
-        FreeMemInfo *freemem = (FreeMemInfo*)lpMemory;
+void FastAlloc::FreeBlock(LPVOID lpMemory)
+{
+    Pool *pool = GetPool(lpMemory);
+    MemInfo *meminfo = pool->meminfo;
 
-        if(--pool->blocksUsed)
-        {
-            freemem->lpPool = pool;
-            freemem->num = 1;
+    if(meminfo && pool->blocksUsed == 1)
+    {
+        FreeMemInfo *prevPoolFreeMem = pool->firstFreeMem->lpPrev;
+        FreeMemInfo *nextPoolFreeMem = pool->lastFreeMem->lpNext;
+
+        if(prevPoolFreeMem)
+            prevPoolFreeMem->lpNext = nextPoolFreeMem;
+        if(nextPoolFreeMem)
+            nextPoolFreeMem->lpPrev = prevPoolFreeMem;
+
+        if(meminfo->nextFree && (meminfo->nextFree->lpPool == pool))
+            meminfo->nextFree = nextPoolFreeMem;
+    }
+
+    assert(pool->blocksUsed);
+
+    FreeMemInfo *freemem = (FreeMemInfo*)lpMemory;
 
-            if(pool->blocksUsed == (meminfo->maxBlocks-1))
+    if(--pool->blocksUsed)
+    {
+        freemem->lpPool = pool;
+        freemem->num = 1;
+
+        if(pool->blocksUsed == (meminfo->maxBlocks-1))
+        {
+            pool->firstFreeMem = pool->lastFreeMem = (FreeMemInfo*)lpMemory;
+            if(meminfo->nextFree)
             {
-                pool->firstFreeMem = pool->lastFreeMem = (FreeMemInfo*)lpMemory;
-                if(meminfo->nextFree)
-                {
-                    freemem->lpNext = meminfo->nextFree;
-                    freemem->lpPrev = meminfo->nextFree->lpPrev;
+                freemem->lpNext = meminfo->nextFree;
+                freemem->lpPrev = meminfo->nextFree->lpPrev;
 
-                    if(freemem->lpPrev)
-                        freemem->lpPrev->lpNext = freemem;
+                if(freemem->lpPrev)
+                    freemem->lpPrev->lpNext = freemem;
 
-                    meminfo->nextFree->lpPrev = freemem;
-                    meminfo->nextFree = freemem;
-                }
-                else
-                {
-                    freemem->lpPrev = freemem->lpNext = NULL;
-                    meminfo->nextFree = freemem;
-                }
+                meminfo->nextFree->lpPrev = freemem;
+                meminfo->nextFree = freemem;
             }
             else
             {
-                freemem->lpNext = pool->firstFreeMem;
-                freemem->lpPrev = pool->firstFreeMem->lpPrev;
+                freemem->lpPrev = freemem->lpNext = NULL;
+                meminfo->nextFree = freemem;
+            }
+        }
+        else
+        {
+            freemem->lpNext = pool->firstFreeMem;
+            freemem->lpPrev = pool->firstFreeMem->lpPrev;
 
-                pool->firstFreeMem->lpPrev = freemem;
-                pool->firstFreeMem = freemem;
+            pool->firstFreeMem->lpPrev = freemem;
+            pool->firstFreeMem = freemem;
 
-                if(freemem->lpPrev)
-                    freemem->lpPrev->lpNext = freemem;
+            if(freemem->lpPrev)
+                freemem->lpPrev->lpNext = freemem;
 
-                if(!meminfo->nextFree || (pool <= meminfo->nextFree->lpPool))
-                    meminfo->nextFree = freemem;
-            }
+            if(!meminfo->nextFree || (pool <= meminfo->nextFree->lpPool))
+                meminfo->nextFree = freemem;
         }
+    }
+    else
+    {
+        assert(pool->bytesTotal);
+        assert(pool->lpMem);
+
+        if(meminfo)
+            --meminfo->numPools;
         else
+            largeBytesInUse -= pool->bytesTotal;
+
+        OSVirtualFree(pool->lpMem);
+        zero(pool, sizeof(Pool));
+    }
+}
+
+void FastAlloc::LogStats()
+{
+    MemInfo classStats[NUM_SIZE_CLASSES];
+    DWORD numCached[NUM_SIZE_CLASSES];
+    UINT numCaches = 0;
+
+    LockPools();
+
+    mcpy(classStats, MemInfoList, sizeof(classStats));
+    zero(numCached, sizeof(numCached));
+
+    //counters of live caches are read while their threads are still running, so they're approximate
+    for(ThreadCache *cache = cacheList; cache; cache = cache->next)
+    {
+        for(int i=1; i<NUM_SIZE_CLASSES; i++)
         {
-            assert(pool->bytesTotal);
-            assert(pool->lpMem);
-            OSVirtualFree(pool->lpMem);
-            zero(pool, sizeof(Pool));
+            classStats[i].numAllocs += cache->numAllocs[i];
+            classStats[i].numFrees  += cache->numFrees[i];
+            numCached[i] += cache->numBlocks[i];
         }
+
+        ++numCaches;
     }
 
+    QWORD locks = numLocks, contendedLocks = numContendedLocks, largeAllocs = numLargeAllocs;
+    size_t largeInUse = largeBytesInUse, largePeak = largeBytesPeak;
+
     OSLeaveMutex(hAllocationMutex);
+
+    //logging allocates, so don't hold the mutex while doing it
+    Log(TEXT("Allocator stats - [lock acquisitions: %llu] [contended: %llu] [thread caches: %u]"), locks, contendedLocks, numCaches);
+
+    for(int i=1; i<NUM_SIZE_CLASSES; i++)
+    {
+        MemInfo &meminfo = classStats[i];
+        if(!meminfo.numAllocs && !meminfo.numPools)
+            continue;
+
+        Log(TEXT("| %u byte blocks - [allocs: %llu] [frees: %llu] [pool memory: %u KB] [cached blocks: %u] [refills: %llu] [flushes: %llu]"),
+            (UINT)meminfo.maxBlockSize, meminfo.numAllocs, meminfo.numFrees, meminfo.numPools*64, numCached[i], meminfo.numRefills, meminfo.numFlushes);
+    }
+
+    Log(TEXT("| large blocks - [allocs: %llu] [in use: %u KB] [peak: %u KB]"), largeAllocs, UINT(largeInUse/1024), UINT(largePeak/1024));
 }
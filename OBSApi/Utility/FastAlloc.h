@@ -19,6 +19,12 @@
 
 #pragma once
 
+struct MemInfo;
+struct ThreadCache;
+
+//blocks up to 32k come from 64k pools split into power-of-two size classes.  each thread keeps a small cache
+//of free blocks per size class and only takes the allocation mutex to move a batch of blocks to or from the
+//pools, so threads allocating small blocks rarely contend with each other.
 class BASE_EXPORT FastAlloc : public Alloc
 {
 public:
@@ -33,6 +39,27 @@ public:
 
     virtual void   ErrorTermination();
 
+    virtual void   LogStats();
+
 private:
     HANDLE hAllocationMutex;
+
+    DWORD cacheSlot;
+    ThreadCache *cacheList;
+
+    QWORD numLocks, numContendedLocks;
+    QWORD numLargeAllocs;
+    size_t largeBytesInUse, largeBytesPeak;
+
+    void LockPools();
+
+    ThreadCache *GetThreadCache();
+    void RefillCache(ThreadCache *cache, MemInfo *meminfo);
+    void FlushCache(ThreadCache *cache, MemInfo *meminfo, DWORD numToKeep);
+    void ReleaseCache(ThreadCache *cache);
+    static void STDCALL DestroyThreadCache(LPVOID param);
+
+    LPVOID AllocateBlock(MemInfo *meminfo);
+    LPVOID AllocateLarge(size_t dwSize);
+    void   FreeBlock(LPVOID lpMemory);
 };
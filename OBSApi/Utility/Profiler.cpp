@@ -33,6 +33,31 @@ inline double MicroToMS(DWORD microseconds)
 float minPercentage, minTime;
 HANDLE hProfilerMutex = NULL;
 
+//log-linear latency buckets: exact below 16us, then 8 buckets per power of two (~12% wide) up to the full DWORD range
+#define PROFILE_HISTOGRAM_BUCKETS 240
+
+inline UINT GetHistogramBucket(DWORD microseconds)
+{
+    if(microseconds < 16)
+        return microseconds;
+
+    DWORD msb;
+    _BitScanReverse(&msb, microseconds);
+
+    UINT shift = msb-3;
+    return shift*8 + (microseconds>>shift);
+}
+
+inline DWORD GetHistogramBucketMax(UINT bucket)
+{
+    if(bucket < 16)
+        return bucket;
+
+    UINT shift = bucket/8 - 1;
+    QWORD mantissa = bucket - shift*8;
+    return (DWORD)MIN(((mantissa+1)<<shift)-1, 0xFFFFFFFF);
+}
+
 
 struct BASE_EXPORT ProfileNodeInfo
 {
@@ -46,6 +71,12 @@ struct BASE_EXPORT ProfileNodeInfo
         for(UINT i = 0; i < Children.Num(); i++)
             Children[i].FreeData();
         Children.Clear();
+
+        if(histogram)
+        {
+            Free(histogram);
+            histogram = NULL;
+        }
     }
 
     CTSTR lpName;
@@ -67,6 +98,12 @@ struct BASE_EXPORT ProfileNodeInfo
 
     DWORD lastCall;
 
+    //samples are recorded into the per-call tree owned by the calling thread, and only summed into
+    //the global tree when the root node merges, so recording never touches the profiler mutex
+    DWORD *histogram;
+    QWORD numSamples;
+    DWORD maxTimeElapsed;
+
     ProfileNodeInfo *parent;
     List<ProfileNodeInfo> Children;
 
@@ -177,6 +214,75 @@ struct BASE_EXPORT ProfileNodeInfo
             Children[i].dumpLastData(callNum, indent+1);
     }
 
+    void dumpLatencyData(int indent=0)
+    {
+        String indentStr;
+        for(int i=0; i<indent; i++)
+            indentStr << TEXT("| ");
+
+        CTSTR lpIndent = indent == 0 ? TEXT("") : indentStr.Array();
+
+        if(numSamples && avgPercentage >= minPercentage && MicroToMS(avgTimeElapsed) >= minTime)
+        {
+            Log(TEXT("%s%s - [p50: %g ms] [p99: %g ms] [p99.9: %g ms] [max: %g ms] [samples: %llu]"), lpIndent, lpName,
+                MicroToMS(GetPercentile(0.5)), MicroToMS(GetPercentile(0.99)), MicroToMS(GetPercentile(0.999)), MicroToMS(maxTimeElapsed), numSamples);
+        }
+
+        for(unsigned int i=0; i<Children.Num(); i++)
+            Children[i].dumpLatencyData(indent+1);
+    }
+
+    void writeHistogramCSV(String &strOut, CTSTR lpParentPath)
+    {
+        String strPath;
+        if(lpParentPath)
+            strPath << lpParentPath << TEXT("/");
+        strPath << lpName;
+
+        if(numSamples)
+        {
+            strOut << FormattedString(TEXT("\"%s\",%u,%llu,%g,%g,%g,%g,%g,%g\r\n"), strPath.Array(), numParallelCalls, numSamples,
+                MicroToMS(avgTimeElapsed), MicroToMS(GetPercentile(0.5)), MicroToMS(GetPercentile(0.9)),
+                MicroToMS(GetPercentile(0.99)), MicroToMS(GetPercentile(0.999)), MicroToMS(maxTimeElapsed));
+        }
+
+        for(unsigned int i=0; i<Children.Num(); i++)
+            Children[i].writeHistogramCSV(strOut, strPath);
+    }
+
+    inline void AddSample(DWORD microseconds)
+    {
+        if(!histogram)
+        {
+            histogram = (DWORD*)Allocate(sizeof(DWORD)*PROFILE_HISTOGRAM_BUCKETS);
+            zero(histogram, sizeof(DWORD)*PROFILE_HISTOGRAM_BUCKETS);
+        }
+
+        histogram[GetHistogramBucket(microseconds)]++;
+        numSamples++;
+        if(microseconds > maxTimeElapsed)
+            maxTimeElapsed = microseconds;
+    }
+
+    //returns the upper edge of the bucket holding the given fraction of samples
+    DWORD GetPercentile(double fraction) const
+    {
+        if(!histogram || !numSamples)
+            return 0;
+
+        QWORD rank = MAX((QWORD)ceil(double(numSamples)*fraction), 1);
+        QWORD count = 0;
+
+        for(UINT i=0; i<PROFILE_HISTOGRAM_BUCKETS; i++)
+        {
+            count += histogram[i];
+            if(count >= rank)
+                return MIN(GetHistogramBucketMax(i), maxTimeElapsed);
+        }
+
+        return maxTimeElapsed;
+    }
+
     ProfileNodeInfo* FindSubProfile(CTSTR lpName)
     {
         for(unsigned int i=0; i<Children.Num(); i++)
@@ -222,6 +328,25 @@ struct BASE_EXPORT ProfileNodeInfo
         cpuTimeElapsed += info->cpuTimeElapsed;
         lastCpuTimeElapsed = info->lastCpuTimeElapsed;
         numParallelCalls = info->numParallelCalls;
+
+        if(info->histogram)
+        {
+            if(!histogram)
+            {
+                histogram = info->histogram;
+                info->histogram = NULL;
+            }
+            else
+            {
+                for(UINT i=0; i<PROFILE_HISTOGRAM_BUCKETS; i++)
+                    histogram[i] += info->histogram[i];
+            }
+
+            numSamples += info->numSamples;
+            if(info->maxTimeElapsed > maxTimeElapsed)
+                maxTimeElapsed = info->maxTimeElapsed;
+        }
+
         for(UINT i = 0; i < info->Children.Num(); i++)
         {
             ProfileNodeInfo &child = info->Children[i];
@@ -267,7 +392,42 @@ void STDCALL DumpProfileData()
         for(unsigned int i=0; i<ProfileNodeInfo::profilerData.Num(); i++)
             ProfileNodeInfo::profilerData[i].dumpCPUData(ProfileNodeInfo::profilerData[i].numCalls);
         Log(TEXT("==============================================================\r\n"));
+        Log(TEXT("\r\nProfiler latency results:\r\n"));
+        Log(TEXT("=============================================================="));
+        for(unsigned int i=0; i<ProfileNodeInfo::profilerData.Num(); i++)
+            ProfileNodeInfo::profilerData[i].dumpLatencyData();
+        Log(TEXT("==============================================================\r\n"));
+    }
+}
+
+BOOL STDCALL DumpProfileHistograms(CTSTR lpFile)
+{
+    if(!ProfileNodeInfo::profilerData.Num())
+        return FALSE;
+
+    String strOut;
+    strOut << TEXT("node,parallel calls,samples,avg ms,p50 ms,p90 ms,p99 ms,p99.9 ms,max ms\r\n");
+
+    OSEnterMutex(hProfilerMutex);
+    for(unsigned int i=0; i<ProfileNodeInfo::profilerData.Num(); i++)
+    {
+        ProfileNodeInfo &root = ProfileNodeInfo::profilerData[i];
+        root.calculateProfileData((int)floor(root.numCalls/(double)root.numParallelCalls+0.5));
+        root.writeHistogramCSV(strOut, NULL);
     }
+    OSLeaveMutex(hProfilerMutex);
+
+    XFile file;
+    if(!file.Open(lpFile, XFILE_WRITE, XFILE_CREATEALWAYS))
+    {
+        Log(TEXT("DumpProfileHistograms: could not open '%s' for writing"), lpFile);
+        return FALSE;
+    }
+
+    file.WriteAsUTF8(strOut, strOut.Length());
+    file.Close();
+
+    return TRUE;
 }
 
 void STDCALL DumpLastProfileData()
@@ -355,6 +515,7 @@ ProfilerNode::~ProfilerNode()
         DWORD curTime = (DWORD)(newTime-startTime);
         info->totalTimeElapsed += curTime;
         info->lastTimeElapsed = curTime;
+        info->AddSample(curTime);
         if(thread)
         {
             DWORD cpuTime = DWORD(OSGetThreadTime(thread) - cpuStartTime);
@@ -0,0 +1,349 @@
+/********************************************************************************
+ Copyright (C) 2001-2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#define WINVER         0x0600
+#define _WIN32_WINDOWS 0x0600
+#define _WIN32_WINNT   0x0600
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include "XT.h"
+
+
+struct TaskBatch
+{
+    TASKPROC proc;
+    LPVOID param;
+    volatile LONG tasksLeft;
+    HANDLE hComplete;
+};
+
+struct TaskRange
+{
+    TaskBatch *batch;
+    UINT start, end;
+};
+
+struct TaskWorker
+{
+    TaskPool *pool;
+    HANDLE hThread;
+    UINT id;
+
+    //  the owner takes tasks from the front of its newest range, thieves take from the back of the
+    //oldest one, so the owner keeps working on rows that are close together
+    HANDLE hMutex;
+    List<TaskRange> ranges;
+
+    //stats, only written by the worker thread itself
+    QWORD tasksRun;
+    QWORD tasksStolen;
+    QWORD numSteals;
+    QWORD idleTime;
+};
+
+
+TaskPool::TaskPool(UINT numThreads)
+{
+    numWorkers = numThreads;
+    nextWorker = 0;
+    bKillThreads = false;
+    numBatches = 0;
+    numTasksRunWaiting = 0;
+
+    hWakeSemaphore = CreateSemaphore(NULL, 0, numWorkers ? numWorkers : 1, NULL);
+    hBatchMutex = OSCreateMutex();
+
+    workers = (TaskWorker*)Allocate(sizeof(TaskWorker)*numWorkers);
+    zero(workers, sizeof(TaskWorker)*numWorkers);
+
+    for(UINT i=0; i<numWorkers; i++)
+    {
+        workers[i].pool = this;
+        workers[i].id = i;
+        workers[i].hMutex = OSCreateMutex();
+    }
+
+    for(UINT i=0; i<numWorkers; i++)
+        workers[i].hThread = OSCreateThread((XTHREAD)TaskPool::WorkerThread, workers+i);
+}
+
+TaskPool::~TaskPool()
+{
+    bKillThreads = true;
+
+    for(UINT i=0; i<numWorkers; i++)
+        ReleaseSemaphore(hWakeSemaphore, 1, NULL);
+
+    //all the threads have to be gone before any of the queues go away, they steal from each other
+    for(UINT i=0; i<numWorkers; i++)
+    {
+        if(workers[i].hThread)
+            OSTerminateThread(workers[i].hThread, 10000);
+    }
+
+    for(UINT i=0; i<numWorkers; i++)
+    {
+        //any ranges left over belong to batches nobody waited on, which is a bug in the caller
+        assert(workers[i].ranges.Num() == 0);
+        workers[i].ranges.Clear();
+        OSCloseMutex(workers[i].hMutex);
+    }
+
+    Free(workers);
+
+    for(UINT i=0; i<freeBatches.Num(); i++)
+    {
+        CloseHandle(freeBatches[i]->hComplete);
+        delete freeBatches[i];
+    }
+
+    OSCloseMutex(hBatchMutex);
+    CloseHandle(hWakeSemaphore);
+}
+
+DWORD STDCALL TaskPool::WorkerThread(TaskWorker *worker)
+{
+    TaskPool *pool = worker->pool;
+
+    while(true)
+    {
+        TaskBatch *batch;
+        UINT taskID;
+
+        if(pool->TakeTask(worker, batch, taskID) || (pool->StealTasks(worker) && pool->TakeTask(worker, batch, taskID)))
+        {
+            pool->RunTask(batch, taskID);
+            worker->tasksRun++;
+            continue;
+        }
+
+        if(pool->bKillThreads)
+            break;
+
+        QWORD idleStart = OSGetTimeMicroseconds();
+        WaitForSingleObject(pool->hWakeSemaphore, INFINITE);
+        worker->idleTime += OSGetTimeMicroseconds()-idleStart;
+    }
+
+    return 0;
+}
+
+bool TaskPool::TakeTask(TaskWorker *worker, TaskBatch *&batch, UINT &taskID)
+{
+    bool bFound = false;
+
+    OSEnterMutex(worker->hMutex);
+
+    if(worker->ranges.Num())
+    {
+        UINT lastID = worker->ranges.Num()-1;
+        TaskRange &range = worker->ranges[lastID];
+
+        batch = range.batch;
+        taskID = range.start++;
+        if(range.start == range.end)
+            worker->ranges.Remove(lastID);
+
+        bFound = true;
+    }
+
+    OSLeaveMutex(worker->hMutex);
+
+    return bFound;
+}
+
+bool TaskPool::StealTasks(TaskWorker *thief)
+{
+    TaskRange stolen;
+    bool bStole = false;
+
+    for(UINT i=1; i<numWorkers && !bStole; i++)
+    {
+        TaskWorker &victim = workers[(thief->id+i) % numWorkers];
+
+        OSEnterMutex(victim.hMutex);
+
+        if(victim.ranges.Num())
+        {
+            TaskRange &range = victim.ranges[0];
+            UINT numToSteal = (range.end-range.start+1)/2;
+
+            stolen.batch = range.batch;
+            stolen.start = range.end-numToSteal;
+            stolen.end   = range.end;
+
+            range.end = stolen.start;
+            if(range.start == range.end)
+                victim.ranges.Remove(0);
+
+            bStole = true;
+        }
+
+        OSLeaveMutex(victim.hMutex);
+    }
+
+    if(bStole)
+    {
+        OSEnterMutex(thief->hMutex);
+        thief->ranges << stolen;
+        OSLeaveMutex(thief->hMutex);
+
+        thief->tasksStolen += stolen.end-stolen.start;
+        thief->numSteals++;
+    }
+
+    return bStole;
+}
+
+//used by threads waiting on a batch.  only takes tasks from that batch so the wait doesn't get held up
+//by someone else's work
+bool TaskPool::TakeTaskFromBatch(TaskBatch *batch, UINT &taskID)
+{
+    bool bFound = false;
+
+    for(UINT i=0; i<numWorkers && !bFound; i++)
+    {
+        TaskWorker &worker = workers[i];
+
+        OSEnterMutex(worker.hMutex);
+
+        for(UINT j=0; j<worker.ranges.Num(); j++)
+        {
+            TaskRange &range = worker.ranges[j];
+            if(range.batch == batch)
+            {
+                taskID = --range.end;
+                if(range.start == range.end)
+                    worker.ranges.Remove(j);
+
+                bFound = true;
+                break;
+            }
+        }
+
+        OSLeaveMutex(worker.hMutex);
+    }
+
+    return bFound;
+}
+
+void TaskPool::RunTask(TaskBatch *batch, UINT taskID)
+{
+    batch->proc(batch->param, taskID);
+
+    //nothing can touch the batch after this, the waiting thread is free to reuse it
+    if(InterlockedDecrement(&batch->tasksLeft) == 0)
+        SetEvent(batch->hComplete);
+}
+
+TaskBatch* TaskPool::Submit(TASKPROC proc, LPVOID param, UINT numTasks)
+{
+    if(!numTasks)
+        return NULL;
+
+    TaskBatch *batch;
+
+    OSEnterMutex(hBatchMutex);
+    if(freeBatches.Num())
+    {
+        batch = freeBatches.Last();
+        freeBatches.Remove(freeBatches.Num()-1);
+    }
+    else
+    {
+        batch = new TaskBatch;
+        batch->hComplete = CreateEvent(NULL, TRUE, FALSE, NULL);
+    }
+    numBatches++;
+    OSLeaveMutex(hBatchMutex);
+
+    batch->proc = proc;
+    batch->param = param;
+    batch->tasksLeft = numTasks;
+    ResetEvent(batch->hComplete);
+
+    if(!numWorkers)
+    {
+        for(UINT i=0; i<numTasks; i++)
+            RunTask(batch, i);
+        return batch;
+    }
+
+    //split into one contiguous range per worker, starting at a different worker each time so several
+    //small batches don't all land on the first thread
+    UINT numRanges = MIN(numTasks, numWorkers);
+    UINT firstWorker = UINT(InterlockedIncrement(&nextWorker));
+
+    for(UINT i=0; i<numRanges; i++)
+    {
+        TaskRange range;
+        range.batch = batch;
+        range.start = UINT(QWORD(numTasks)*i/numRanges);
+        range.end   = UINT(QWORD(numTasks)*(i+1)/numRanges);
+
+        TaskWorker &worker = workers[(firstWorker+i) % numWorkers];
+
+        OSEnterMutex(worker.hMutex);
+        worker.ranges << range;
+        OSLeaveMutex(worker.hMutex);
+    }
+
+    //released one at a time, a release past the maximum count fails without releasing anything
+    for(UINT i=0; i<numRanges; i++)
+        ReleaseSemaphore(hWakeSemaphore, 1, NULL);
+
+    return batch;
+}
+
+void TaskPool::Wait(TaskBatch *batch)
+{
+    if(!batch)
+        return;
+
+    UINT taskID;
+    while(batch->tasksLeft && TakeTaskFromBatch(batch, taskID))
+    {
+        RunTask(batch, taskID);
+        InterlockedIncrement(&numTasksRunWaiting);
+    }
+
+    WaitForSingleObject(batch->hComplete, INFINITE);
+
+    OSEnterMutex(hBatchMutex);
+    freeBatches << batch;
+    OSLeaveMutex(hBatchMutex);
+}
+
+void TaskPool::LogStats(CTSTR lpName)
+{
+    QWORD totalRun = numTasksRunWaiting, totalStolen = 0;
+    for(UINT i=0; i<numWorkers; i++)
+    {
+        totalRun += workers[i].tasksRun;
+        totalStolen += workers[i].tasksStolen;
+    }
+
+    Log(TEXT("%s - [threads: %u] [batches: %llu] [tasks: %llu] [run by waiting threads: %d] [stolen: %llu]"), lpName, numWorkers, numBatches, totalRun, numTasksRunWaiting, totalStolen);
+
+    for(UINT i=0; i<numWorkers; i++)
+    {
+        TaskWorker &worker = workers[i];
+        Log(TEXT("| worker %u - [tasks: %llu] [stolen: %llu in %llu steals] [idle time: %g ms]"), i, worker.tasksRun, worker.tasksStolen, worker.numSteals, double(worker.idleTime)*0.001);
+    }
+}
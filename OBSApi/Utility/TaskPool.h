@@ -0,0 +1,70 @@
+/********************************************************************************
+ Copyright (C) 2001-2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#pragma once
+
+
+typedef void (STDCALL *TASKPROC)(LPVOID param, UINT taskID);
+
+struct TaskBatch;
+struct TaskWorker;
+
+//  Work-stealing pool for splitting up per-frame CPU work (conversions, scaling, etc) into small tasks.
+//Submit splits a batch of tasks between the worker queues and returns right away; when a worker runs
+//out of its own tasks it steals half of what's left in someone else's queue.  Wait helps run whatever
+//is left of the batch on the calling thread and then blocks until the rest is done.
+
+class BASE_EXPORT TaskPool
+{
+    friend struct TaskWorker;
+
+    TaskWorker *workers;
+    UINT numWorkers;
+
+    HANDLE hWakeSemaphore;
+    HANDLE hBatchMutex;
+    List<TaskBatch*> freeBatches;
+
+    volatile LONG nextWorker;
+    volatile bool bKillThreads;
+
+    //stats
+    QWORD numBatches;
+    volatile LONG numTasksRunWaiting;
+
+    static DWORD STDCALL WorkerThread(TaskWorker *worker);
+
+    bool TakeTask(TaskWorker *worker, TaskBatch *&batch, UINT &taskID);
+    bool StealTasks(TaskWorker *thief);
+    bool TakeTaskFromBatch(TaskBatch *batch, UINT &taskID);
+    void RunTask(TaskBatch *batch, UINT taskID);
+
+public:
+    TaskPool(UINT numThreads);
+    ~TaskPool();
+
+    inline UINT NumThreads() const {return numWorkers;}
+
+    TaskBatch* Submit(TASKPROC proc, LPVOID param, UINT numTasks);
+    void Wait(TaskBatch *batch);
+
+    inline void Run(TASKPROC proc, LPVOID param, UINT numTasks) {Wait(Submit(proc, param, numTasks));}
+
+    void LogStats(CTSTR lpName);
+};
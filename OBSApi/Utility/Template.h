@@ -19,7 +19,22 @@
 
 #pragma once
 
-template<typename T> class List
+//  the array keeps a capacity separate from the number of items and at least doubles it when it runs out,
+//so adding items one at a time doesn't reallocate every time.  removing items or making the list smaller
+//keeps the memory around for the next time it fills up, but an empty list still owns nothing: removing the
+//last item frees the array the same as Clear/SetSize(0) do.  ShrinkToFit gives back whatever is unused.
+//
+//  items are moved around with plain memory copies and are never constructed or destroyed by the list, the
+//same as always.
+//
+//  alignment, if set, is the byte alignment of the array (a power of two), for sample and pixel buffers
+//that get processed with aligned SSE/AVX loads.  aligned lists can't hand their array off as a raw pointer
+//(TransferTo/TransferFrom with a T*), since it can't be freed with Free.
+//
+//  List is compiled into plugins, so changing its members changes the plugin ABI and needs a major
+//OBS_API_VERSION bump, which keeps plugins built against the old layout from being loaded.
+
+template<typename T, unsigned int alignment> class List
 {
 private:
     List(List const&) = delete;
@@ -29,10 +44,56 @@ private:
 protected:
     T *array;
     unsigned int num;
+    unsigned int capacity;
+
+    //everything that allocates or frees the array goes through these
+    inline void SetCapacity(unsigned int newCapacity)
+    {
+        if(!newCapacity)
+        {
+            FreeArray();
+            return;
+        }
+
+        if(alignment)
+        {
+            //the block to free is stored just in front of the array
+            LPBYTE lpBlock = (LPBYTE)Allocate(sizeof(T)*newCapacity + alignment-1 + sizeof(void*));
+            T *newArray = (T*)((UPARAM(lpBlock)+sizeof(void*)+alignment-1) & ~UPARAM(alignment-1));
+            ((void**)newArray)[-1] = lpBlock;
+
+            if(array)
+            {
+                mcpy(newArray, array, sizeof(T)*MIN(num, newCapacity));
+                Free(((void**)array)[-1]);
+            }
+
+            array = newArray;
+        }
+        else
+            array = (T*)ReAllocate(array, sizeof(T)*newCapacity);
+
+        capacity = newCapacity;
+    }
+
+    inline void FreeArray()
+    {
+        if(array)
+            Free(alignment ? ((void**)array)[-1] : array);
+
+        array = NULL;
+        capacity = 0;
+    }
+
+    inline void Grow(unsigned int n)
+    {
+        if(n > capacity)
+            SetCapacity(MAX(capacity*2, n));
+    }
 
 public:
 
-    inline List() : array(NULL), num(0) {}
+    inline List() : array(NULL), num(0), capacity(0) {}
     inline ~List()
     {
         Clear();
@@ -40,11 +101,25 @@ public:
 
     inline T* Array() const             {return array;}
     inline unsigned int Num() const     {return num;}
+    inline unsigned int Capacity() const{return capacity;}
+
+    //makes room for n items without changing the number of items
+    inline void Reserve(unsigned int n)
+    {
+        if(n > capacity)
+            SetCapacity(n);
+    }
+
+    inline void ShrinkToFit()
+    {
+        if(num < capacity)
+            SetCapacity(num);
+    }
 
     inline unsigned int Add(const T& val)
     {
-        array = (T*)ReAllocate(array, sizeof(T)*++num);
-        mcpy(&array[(num-1)], (void*)&val, sizeof(T));
+        Grow(num+1);
+        mcpy(&array[num++], (void*)&val, sizeof(T));
         return num-1;
     }
 
@@ -76,7 +151,7 @@ public:
         mcpy(temp, &val, sizeof(T));
 
         UINT moveCount = num-index;
-        array = (T*)ReAllocate(array, sizeof(T)*++num);
+        Grow(++num);
         if(moveCount)
             mcpyrev(array+(index+1), array+index, moveCount*sizeof(T));
         mcpy(&array[index], temp, sizeof(T));
@@ -89,11 +164,9 @@ public:
         assert(index < num);
         if(index >= num) return;
 
-        if(!--num) {Free(array); array=NULL; return;}
+        if(!--num) {FreeArray(); return;}
 
         mcpy(&array[index], &array[index+1], sizeof(T)*(num-index));
-
-        array = (T*)ReAllocate(array, sizeof(T)*num);
     }
 
     inline void RemoveItem(const T& obj)
@@ -133,7 +206,6 @@ public:
         UINT cutoffCount = num-start;
         if(cutoffCount)
             mcpy(array+start, array+end, cutoffCount*sizeof(T));
-        array = (T*)ReAllocate(array, num*sizeof(T));
     }
 
     inline void CopyArray(const T *new_array, unsigned int n)
@@ -146,7 +218,7 @@ public:
 
         SetSize(n);
 
-        if(!num) {array=NULL; return;}
+        if(!num) return;
 
         mcpy(array, (void*)new_array, sizeof(T)*num);
     }
@@ -173,7 +245,7 @@ public:
 
         assert(num);
 
-        if(!num) {array=NULL; return;}
+        if(!num) return;
 
         mcpyrev(array+index+n, array+index, sizeof(T)*(oldnum-index));
         mcpy(array+index, new_array, sizeof(T)*n);
@@ -196,7 +268,7 @@ public:
 
         assert(num);
 
-        if(!num) {array=NULL; return;}
+        if(!num) return;
 
         mcpy(&array[oldnum], (void*)new_array, sizeof(T)*n);
     }
@@ -214,8 +286,8 @@ public:
         BOOL bClear=(n>num);
         UINT oldNum=num;
 
+        Grow(n);
         num = n;
-        array = (T*)ReAllocate(array, sizeof(T)*num);
 
         if(bClear)
             zero(&array[oldNum], sizeof(T)*(num-oldNum));
@@ -288,58 +360,58 @@ public:
         }
     }
 
-    inline void CopyList(const List<T>& list)
+    template<unsigned int listAlignment> inline void CopyList(const List<T, listAlignment>& list)
     {
         CopyArray(list.Array(), list.Num());
     }
 
-    inline void InsertList(unsigned int index, const List<T>& list)
+    template<unsigned int listAlignment> inline void InsertList(unsigned int index, const List<T, listAlignment>& list)
     {
         InsertArray(index, list.Array(), list.Num());
     }
 
-    inline void AppendList(const List<T>& list)
+    template<unsigned int listAlignment> inline void AppendList(const List<T, listAlignment>& list)
     {
         AppendArray(list.Array(), list.Num());
     }
 
-    inline void TransferFrom(List<T>& list)
+    inline void TransferFrom(List& list)
     {
         if(array) Clear();
-        array = list.Array();
-        num   = list.Num();
-        zero(&list, sizeof(List<T>));
+        array    = list.array;
+        num      = list.num;
+        capacity = list.capacity;
+        zero(&list, sizeof(List));
     }
 
     inline void TransferFrom(T *arrayIn, UINT numIn)
     {
+        static_assert(!alignment, "aligned lists can't take ownership of a raw array");
+
         if(array) Clear();
-        array = arrayIn;
-        num   = numIn;
+        array    = arrayIn;
+        num      = numIn;
+        capacity = numIn;
     }
 
-    inline void TransferTo(List<T>& list)
+    inline void TransferTo(List& list)
     {
         list.TransferFrom(*this);
     }
 
     inline void TransferTo(T *&arrayIn, UINT &numIn)
     {
+        static_assert(!alignment, "an aligned list's array can't be freed with Free");
+
         arrayIn = array;
         numIn = num;
-        zero(this, sizeof(List<T>));
+        zero(this, sizeof(List));
     }
 
     inline void Clear()
     {
-        if(array)
-        {
-            /*if(IsBadWritePtr(array, sizeof(T)*num))
-                CrashError(TEXT("what the.."));*/
-            Free(array);
-            array = NULL;
-            num = 0;
-        }
+        FreeArray();
+        num = 0;
     }
 
     inline T* CreateNew()
@@ -362,7 +434,7 @@ public:
         return &array[index];
     }
 
-    inline List<T>& operator<<(const T& val)
+    inline List& operator<<(const T& val)
     {
         Add(val);
         return *this;
@@ -449,7 +521,7 @@ public:
         return array[num-1];
     }
 
-    inline friend Serializer& operator<<(Serializer &s, List<T> &list)
+    inline friend Serializer& operator<<(Serializer &s, List &list)
     {
         if(s.IsLoading())
         {
@@ -681,9 +753,7 @@ public:
             while(CheckAndCleanAvail());
 
             if(!num)
-                {Free(array); array = NULL;}
-            else
-                array = (T*)ReAllocate(array, sizeof(T)*num);
+                FreeArray();
         }
         else
         {
@@ -706,8 +776,9 @@ public:
 
     inline void operator=(const SafeList<T>& list)
     {
-        array = list.Array();
-        num   = list.Num();
+        array    = list.Array();
+        num      = list.Num();
+        capacity = list.capacity;
         AvailableItems = list.AvailableItems;
     }
 
@@ -255,7 +255,6 @@ public:
 
     inline QWORD GetTotalWritten() {return totalWritten;}
 
-private:
     void Flush()
     {
         if(bufferPos)
@@ -265,6 +264,7 @@ private:
         }
     }
 
+private:
     XFile file;
 
     DWORD bufferPos;
@@ -273,3 +273,71 @@ private:
     QWORD totalWritten;
     LPBYTE Buffer;
 };
+
+
+//writes through a fixed set of large buffers that are written out on a separate thread, so a slow or busy disk
+//doesn't stall the thread producing the data.  the producer only waits when every buffer is still queued.
+class BASE_EXPORT XFileAsyncOutputSerializer : public Serializer
+{
+public:
+    XFileAsyncOutputSerializer();
+    ~XFileAsyncOutputSerializer() {Close();}
+
+    BOOL IsLoading() {return FALSE;}
+
+    //bUnbuffered bypasses the system file cache.  if syncIntervalMS is nonzero, written data is flushed to the
+    //disk at most that often and again on close.
+    BOOL Open(CTSTR lpFile, DWORD dwCreationDisposition, DWORD bufferSize=(1024*1024*2), UINT numBuffers=8, BOOL bUnbuffered=FALSE, DWORD syncIntervalMS=0);
+    void Close();
+
+    void Serialize(LPCVOID lpData, DWORD length);
+
+    //only the current position is supported
+    UINT64 Seek(INT64 offset, DWORD seekType=SERIALIZE_SEEK_START);
+
+    UINT64 GetPos() const {return bytesQueued+bufferPos;}
+
+    //queues whatever is buffered without waiting for it to be written
+    void Flush();
+
+    void LogStats(CTSTR lpName);
+
+private:
+    static DWORD STDCALL WriterThread(LPVOID param);
+    void QueueBuffer(DWORD size);
+    void WriteBuffer(LPBYTE lpData, DWORD size);
+
+    HANDLE hFile;
+    HANDLE hWriterThread;
+    HANDLE hQueueMutex, hDataEvent, hFreeEvent;
+
+    LPBYTE *buffers;
+    DWORD *bufferSizes;
+    UINT numBuffers;
+    DWORD bufferSize;
+
+    //producer side
+    UINT curBuffer;
+    DWORD bufferPos;
+    UINT64 bytesQueued;
+
+    //writer side
+    UINT writeBuffer;
+    DWORD syncInterval;
+    QWORD lastSyncTime;
+    bool bWriteFailed;
+
+    //protected by hQueueMutex
+    UINT numQueued;
+    bool bStopWriting;
+
+    BOOL bUnbuffered;
+
+    //stats
+    UINT maxQueued;
+    UINT numStalls;
+    QWORD stallTime, maxStallTime;
+    UINT numWrites, numSyncs;
+    QWORD writeTime, maxWriteTime;
+    QWORD bytesWritten, bytesDropped;
+};
@@ -375,4 +375,325 @@ BOOL CreatePath(CTSTR lpPath)
     return OSCreateDirectory(lpPath);
 }
 
+
+//-----------------------------------------------------------------------
+
+//unbuffered writes have to be whole sectors at sector-aligned offsets
+#define ASYNC_WRITE_ALIGN 4096
+
+XFileAsyncOutputSerializer::XFileAsyncOutputSerializer()
+{
+    hFile = INVALID_HANDLE_VALUE;
+    hWriterThread = NULL;
+    hQueueMutex = hDataEvent = hFreeEvent = NULL;
+
+    buffers = NULL;
+    bufferSizes = NULL;
+    numBuffers = 0;
+
+    bufferPos = 0;
+    bytesQueued = 0;
+}
+
+BOOL XFileAsyncOutputSerializer::Open(CTSTR lpFile, DWORD dwCreationDisposition, DWORD bufferSize, UINT numBuffers, BOOL bUnbuffered, DWORD syncIntervalMS)
+{
+    assert(lpFile);
+
+    Close();
+
+    DWORD dwFlags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN;
+    if(bUnbuffered)
+        dwFlags |= FILE_FLAG_NO_BUFFERING;
+
+    if((hFile = CreateFile(lpFile, GENERIC_WRITE, 0, NULL, dwCreationDisposition, dwFlags, NULL)) == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    //whole 64k blocks keep every full buffer sector aligned
+    this->bufferSize = MAX((bufferSize+0xFFFF) & ~0xFFFF, 0x10000);
+    this->numBuffers = MAX(numBuffers, 2);
+    this->bUnbuffered = bUnbuffered;
+    syncInterval = syncIntervalMS;
+
+    buffers = (LPBYTE*)Allocate(sizeof(LPBYTE)*this->numBuffers);
+    bufferSizes = (DWORD*)Allocate(sizeof(DWORD)*this->numBuffers);
+    zero(buffers, sizeof(LPBYTE)*this->numBuffers);
+
+    for(UINT i=0; i<this->numBuffers; i++)
+    {
+        if(!(buffers[i] = (LPBYTE)OSVirtualAlloc(this->bufferSize)))
+        {
+            Close();
+            return FALSE;
+        }
+    }
+
+    curBuffer = writeBuffer = 0;
+    bufferPos = 0;
+    bytesQueued = 0;
+    numQueued = 0;
+    bStopWriting = false;
+    bWriteFailed = false;
+    lastSyncTime = OSGetTimeMicroseconds();
+
+    maxQueued = numStalls = numWrites = numSyncs = 0;
+    stallTime = maxStallTime = writeTime = maxWriteTime = 0;
+    bytesWritten = bytesDropped = 0;
+
+    hQueueMutex = OSCreateMutex();
+    hDataEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    hFreeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+    hWriterThread = OSCreateThread((XTHREAD)WriterThread, this);
+
+    return TRUE;
+}
+
+void XFileAsyncOutputSerializer::Close()
+{
+    if(hFile == INVALID_HANDLE_VALUE)
+        return;
+
+    UINT64 fileSize = GetPos();
+
+    if(hWriterThread)
+    {
+        if(bufferPos)
+        {
+            //pad the last write out to a whole sector, the file is truncated back to its real size below
+            if(bUnbuffered)
+            {
+                DWORD alignedSize = (bufferPos+ASYNC_WRITE_ALIGN-1) & ~(ASYNC_WRITE_ALIGN-1);
+                zero(buffers[curBuffer]+bufferPos, alignedSize-bufferPos);
+                bufferPos = alignedSize;
+            }
+
+            QueueBuffer(bufferPos);
+        }
+
+        OSEnterMutex(hQueueMutex);
+        bStopWriting = true;
+        OSLeaveMutex(hQueueMutex);
+        SetEvent(hDataEvent);
+
+        OSWaitForThread(hWriterThread, NULL);
+        OSCloseThread(hWriterThread);
+        hWriterThread = NULL;
+    }
+
+    if(bUnbuffered)
+    {
+        LONG sizeHigh = LONG(fileSize>>32);
+        SetFilePointer(hFile, LONG(fileSize & 0xFFFFFFFF), &sizeHigh, FILE_BEGIN);
+        SetEndOfFile(hFile);
+    }
+
+    if(syncInterval)
+    {
+        ::FlushFileBuffers(hFile);
+        numSyncs++;
+    }
+
+    CloseHandle(hFile);
+    hFile = INVALID_HANDLE_VALUE;
+
+    if(buffers)
+    {
+        for(UINT i=0; i<numBuffers; i++)
+        {
+            if(buffers[i])
+                OSVirtualFree(buffers[i]);
+        }
+
+        Free(buffers);
+        Free(bufferSizes);
+        buffers = NULL;
+        bufferSizes = NULL;
+    }
+
+    if(hQueueMutex)
+    {
+        OSCloseMutex(hQueueMutex);
+        CloseHandle(hDataEvent);
+        CloseHandle(hFreeEvent);
+        hQueueMutex = hDataEvent = hFreeEvent = NULL;
+    }
+
+    bytesQueued = fileSize;
+    bufferPos = 0;
+}
+
+void XFileAsyncOutputSerializer::Serialize(LPCVOID lpData, DWORD length)
+{
+    assert(lpData);
+
+    LPBYTE lpTemp = (LPBYTE)lpData;
+
+    while(length)
+    {
+        if(bufferPos == bufferSize)
+            QueueBuffer(bufferSize);
+
+        DWORD dwWriteSize = MIN(length, (bufferSize-bufferPos));
+
+        mcpy(buffers[curBuffer]+bufferPos, lpTemp, dwWriteSize);
+
+        lpTemp += dwWriteSize;
+        bufferPos += dwWriteSize;
+
+        length -= dwWriteSize;
+    }
+}
+
+UINT64 XFileAsyncOutputSerializer::Seek(INT64 offset, DWORD seekType)
+{
+    UINT64 curPos = GetPos();
+
+    if((seekType == SERIALIZE_SEEK_START && UINT64(offset) != curPos) || (seekType != SERIALIZE_SEEK_START && offset != 0))
+        AppWarning(TEXT("XFileAsyncOutputSerializer::Seek: can only seek to the current position"));
+
+    return curPos;
+}
+
+void XFileAsyncOutputSerializer::Flush()
+{
+    //anything past the last whole sector has to stay behind for unbuffered writes
+    DWORD size = bUnbuffered ? (bufferPos & ~(ASYNC_WRITE_ALIGN-1)) : bufferPos;
+    if(size)
+        QueueBuffer(size);
+}
+
+void XFileAsyncOutputSerializer::QueueBuffer(DWORD size)
+{
+    UINT prevBuffer = curBuffer;
+    bool bAllQueued;
+
+    OSEnterMutex(hQueueMutex);
+    bufferSizes[curBuffer] = size;
+    bAllQueued = (++numQueued == numBuffers);
+    if(numQueued > maxQueued)
+        maxQueued = numQueued;
+    OSLeaveMutex(hQueueMutex);
+
+    SetEvent(hDataEvent);
+
+    bytesQueued += size;
+    curBuffer = (curBuffer+1) % numBuffers;
+
+    //every buffer is waiting on the disk, so there's nowhere to put new data until one is written
+    if(bAllQueued)
+    {
+        QWORD startTime = OSGetTimeMicroseconds();
+
+        while(true)
+        {
+            OSEnterMutex(hQueueMutex);
+            bAllQueued = (numQueued == numBuffers);
+            OSLeaveMutex(hQueueMutex);
+
+            if(!bAllQueued)
+                break;
+
+            WaitForSingleObject(hFreeEvent, INFINITE);
+        }
+
+        QWORD waitTime = OSGetTimeMicroseconds()-startTime;
+        numStalls++;
+        stallTime += waitTime;
+        if(waitTime > maxStallTime)
+            maxStallTime = waitTime;
+    }
+
+    //carry over anything that wasn't queued
+    DWORD leftover = bufferPos-size;
+    if(leftover)
+        mcpy(buffers[curBuffer], buffers[prevBuffer]+size, leftover);
+    bufferPos = leftover;
+}
+
+DWORD STDCALL XFileAsyncOutputSerializer::WriterThread(LPVOID param)
+{
+    XFileAsyncOutputSerializer *file = (XFileAsyncOutputSerializer*)param;
+
+    while(true)
+    {
+        WaitForSingleObject(file->hDataEvent, INFINITE);
+
+        while(true)
+        {
+            OSEnterMutex(file->hQueueMutex);
+            UINT queued = file->numQueued;
+            bool bStop = file->bStopWriting;
+            OSLeaveMutex(file->hQueueMutex);
+
+            if(!queued)
+            {
+                if(bStop)
+                    return 0;
+                break;
+            }
+
+            file->WriteBuffer(file->buffers[file->writeBuffer], file->bufferSizes[file->writeBuffer]);
+            file->writeBuffer = (file->writeBuffer+1) % file->numBuffers;
+
+            OSEnterMutex(file->hQueueMutex);
+            file->numQueued--;
+            OSLeaveMutex(file->hQueueMutex);
+
+            SetEvent(file->hFreeEvent);
+        }
+    }
+}
+
+void XFileAsyncOutputSerializer::WriteBuffer(LPBYTE lpData, DWORD size)
+{
+    //once a write fails the file offsets are off, so the rest is counted as dropped rather than written
+    if(bWriteFailed)
+    {
+        bytesDropped += size;
+        return;
+    }
+
+    QWORD startTime = OSGetTimeMicroseconds();
+
+    DWORD dwWritten = 0;
+    BOOL bSuccess = WriteFile(hFile, lpData, size, &dwWritten, NULL);
+
+    QWORD curTime = OSGetTimeMicroseconds();
+    QWORD elapsedTime = curTime-startTime;
+
+    numWrites++;
+    writeTime += elapsedTime;
+    if(elapsedTime > maxWriteTime)
+        maxWriteTime = elapsedTime;
+
+    bytesWritten += dwWritten;
+
+    if(!bSuccess || dwWritten != size)
+    {
+        Log(TEXT("XFileAsyncOutputSerializer::WriteBuffer: write failed (error %u), the rest of the file will be dropped"), GetLastError());
+        bytesDropped += size-dwWritten;
+        bWriteFailed = true;
+        return;
+    }
+
+    if(syncInterval && (curTime-lastSyncTime) >= QWORD(syncInterval)*1000)
+    {
+        ::FlushFileBuffers(hFile);
+        numSyncs++;
+        lastSyncTime = curTime;
+    }
+}
+
+void XFileAsyncOutputSerializer::LogStats(CTSTR lpName)
+{
+    double avgWriteTime = numWrites ? double(writeTime)/double(numWrites)*0.001 : 0.0;
+
+    Log(TEXT("%s - [written: %llu KB in %u writes] [avg write: %g ms] [max write: %g ms] [most buffers queued: %u/%u] [syncs: %u]"),
+        lpName, bytesWritten/1024, numWrites, avgWriteTime, double(maxWriteTime)*0.001, maxQueued, numBuffers, numSyncs);
+
+    if(numStalls || bytesDropped)
+        Log(TEXT("%s - [stalls: %u] [stall time: %g ms] [max stall: %g ms] [dropped: %llu KB]"),
+            lpName, numStalls, double(stallTime)*0.001, double(maxStallTime)*0.001, bytesDropped/1024);
+}
+
 #endif
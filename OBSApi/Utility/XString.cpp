@@ -46,6 +46,63 @@
 #endif
 
 
+//  string characters are allocated with a small header in front of them that holds the capacity, so
+//appending can grow the buffer geometrically instead of reallocating it to the exact length each time.
+//lpString still points straight at the characters and String itself is laid out the same as always, so
+//plugins built against the old header still work.
+
+struct StringBufferHeader
+{
+    UINT capacity;  //in characters, including the terminator
+    UINT reserved;  //keeps the characters 8 byte aligned
+};
+
+#define STRING_MIN_CAPACITY 16
+
+static inline UINT GetStringCapacity(CTSTR lpString)
+{
+    return lpString ? ((const StringBufferHeader*)lpString-1)->capacity : 0;
+}
+
+static TSTR ResizeStringBuffer(TSTR lpString, UINT capacity)
+{
+    StringBufferHeader *header = lpString ? (StringBufferHeader*)lpString-1 : NULL;
+    header = (StringBufferHeader*)ReAllocate(header, sizeof(StringBufferHeader)+capacity*sizeof(TCHAR));
+    header->capacity = capacity;
+
+    return (TSTR)(header+1);
+}
+
+static inline void FreeStringBuffer(TSTR lpString)
+{
+    if(lpString)
+        Free((StringBufferHeader*)lpString-1);
+}
+
+//makes room for length characters plus the terminator, exactly
+static inline void ReserveStringBuffer(TSTR &lpString, UINT length)
+{
+    if(length >= GetStringCapacity(lpString))
+        lpString = ResizeStringBuffer(lpString, length+1);
+}
+
+//same, but at least doubles the capacity when it grows, for anything that appends
+static inline void GrowStringBuffer(TSTR &lpString, UINT length)
+{
+    UINT capacity = GetStringCapacity(lpString);
+    if(length >= capacity)
+        lpString = ResizeStringBuffer(lpString, MAX(MAX(capacity*2, length+1), STRING_MIN_CAPACITY));
+}
+
+//  a buffer that was sized with SetLength and then filled in by something else can hold less text than
+//curLength says.  appending has always gone after the actual text, so pick that back up first
+static inline void FixStringLength(CTSTR lpString, UINT &curLength)
+{
+    if(curLength && !lpString[curLength-1])
+        curLength = slen(lpString);
+}
+
+
 String::String()
 {
     curLength = 0;
@@ -67,7 +124,7 @@ String::String(LPCSTR str)
 
     if(curLength)
     {
-        lpString = (TSTR)Allocate((curLength+1)*sizeof(wchar_t));
+        lpString = ResizeStringBuffer(NULL, curLength+1);
         utf8_to_wchar(str, utf8Len+1, lpString, curLength+1, 0);
     }
     else
@@ -84,7 +141,7 @@ String::String(LPCSTR str)
 
     if(curLength)
     {
-        lpString = (TSTR)Allocate(curLength+1);
+        lpString = ResizeStringBuffer(NULL, curLength+1);
         scpy(lpString, str);
     }
     else
@@ -106,7 +163,7 @@ String::String(CWSTR str)
 
     if(curLength)
     {
-        lpString = (TSTR)Allocate((curLength+1)*sizeof(TCHAR));
+        lpString = ResizeStringBuffer(NULL, curLength+1);
         scpy(lpString, str);
     }
     else
@@ -124,7 +181,7 @@ String::String(CWSTR str)
 
     if(curLength)
     {
-        lpString = (TSTR)Allocate(curLength+1);
+        lpString = ResizeStringBuffer(NULL, curLength+1);
         wchar_to_utf8(str, wideLen+1, lpString, curLength+1, 0);
     }
     else
@@ -137,18 +194,26 @@ String::String(const String &str)
     curLength = str.curLength;
     if(curLength)
     {
-        lpString = (TSTR)Allocate((curLength+1)*sizeof(TCHAR));
+        lpString = ResizeStringBuffer(NULL, curLength+1);
         scpy(lpString, str.lpString);
     }
     else
         lpString = NULL;
 }
 
+String::String(String &&str)
+{
+    lpString = str.lpString;
+    curLength = str.curLength;
+
+    str.lpString = NULL;
+    str.curLength = 0;
+}
+
 
 String::~String()
 {
-    if(lpString)
-        Free(lpString);
+    FreeStringBuffer(lpString);
 }
 
 
@@ -161,13 +226,12 @@ String& String::operator=(CTSTR str)
 
     if(curLength)
     {
-        lpString = (TSTR)ReAllocate(lpString, (curLength+1)*sizeof(TCHAR));
+        ReserveStringBuffer(lpString, curLength);
         scpy(lpString, str);
     }
     else
     {
-        if(lpString)
-            Free(lpString);
+        FreeStringBuffer(lpString);
         lpString = NULL;
     }
 
@@ -186,27 +250,12 @@ String& String::operator+=(CTSTR str)
     if(!strLength)
         return *this;
 
-    curLength += strLength;
+    FixStringLength(lpString, curLength);
+    GrowStringBuffer(lpString, curLength+strLength);
 
-    if(curLength)
-    {
-        if(lpString)
-        {
-            lpString = (TSTR)ReAllocate(lpString, (curLength+1)*sizeof(TCHAR));
-            scat(lpString, str);
-        }
-        else
-        {
-            lpString = (TSTR)Allocate((curLength+1)*sizeof(TCHAR));
-            scpy(lpString, str);
-        }
-    }
-    else
-    {
-        if(lpString)
-            Free(lpString);
-        lpString = NULL;
-    }
+    mcpy(lpString+curLength, str, strLength*sizeof(TCHAR));
+    curLength += strLength;
+    lpString[curLength] = 0;
 
     return *this;
 }
@@ -220,7 +269,7 @@ String  String::operator+(CTSTR str) const
 String& String::operator=(TCHAR ch)
 {
     curLength = 1;
-    lpString = (TSTR)ReAllocate(lpString, 2);
+    ReserveStringBuffer(lpString, 1);
     *lpString = ch;
     lpString[1] = 0;
 
@@ -230,7 +279,7 @@ String& String::operator=(TCHAR ch)
 String& String::operator+=(TCHAR ch)
 {
     ++curLength;
-    lpString = (TSTR)ReAllocate(lpString, (curLength+1)*sizeof(TCHAR));
+    GrowStringBuffer(lpString, curLength);
     lpString[curLength-1] = ch;
     lpString[curLength]   = 0;
 
@@ -298,45 +347,48 @@ String& String::operator=(const String &str)
 
     if(curLength)
     {
-        lpString = (TSTR)ReAllocate(lpString, (curLength+1)*sizeof(TCHAR));
+        ReserveStringBuffer(lpString, curLength);
         scpy(lpString, str.lpString);
     }
     else
     {
-        if(lpString)
-            Free(lpString);
+        FreeStringBuffer(lpString);
         lpString = NULL;
     }
 
     return *this;
 }
 
+String& String::operator=(String &&str)
+{
+    if(this != &str)
+    {
+        FreeStringBuffer(lpString);
+
+        lpString = str.lpString;
+        curLength = str.curLength;
+
+        str.lpString = NULL;
+        str.curLength = 0;
+    }
+
+    return *this;
+}
+
 String& String::operator+=(const String &str)
 {
     if(!str.curLength)
         return *this;
 
-    curLength += str.curLength;
+    FixStringLength(lpString, curLength);
 
-    if(curLength)
-    {
-        if(lpString)
-        {
-            lpString = (TSTR)ReAllocate(lpString, (curLength+1)*sizeof(TCHAR));
-            scat(lpString, str.lpString);
-        }
-        else
-        {
-            lpString = (TSTR)Allocate((curLength+1)*sizeof(TCHAR));
-            scpy(lpString, str.lpString);
-        }
-    }
-    else
-    {
-        if(lpString)
-            Free(lpString);
-        lpString = NULL;
-    }
+    //str can be this string, so get its length before it changes
+    UINT strLength = str.curLength;
+    GrowStringBuffer(lpString, curLength+strLength);
+
+    mcpy(lpString+curLength, str.lpString, strLength*sizeof(TCHAR));
+    curLength += strLength;
+    lpString[curLength] = 0;
 
     return *this;
 }
@@ -476,7 +528,8 @@ String& String::FindReplace(CTSTR strFind, CTSTR strReplace)
         {
             curLength += (replaceLen-findLen)*nOccurences;
 
-            lpTemp = lpString = (TSTR)ReAllocate(lpString, (curLength+1)*sizeof(TCHAR));
+            GrowStringBuffer(lpString, curLength);
+            lpTemp = lpString;
 
             while(lpTemp = sstr(lpTemp, strFind))
             {
@@ -516,7 +569,7 @@ void String::InsertString(UINT dwPos, CTSTR str)
 
     if(strLength)
     {
-        lpString = (TSTR)ReAllocate(lpString, (curLength+strLength+1)*sizeof(TCHAR));
+        GrowStringBuffer(lpString, curLength+strLength);
 
         TSTR lpPos = lpString+dwPos;
         mcpyrev(lpPos+strLength, lpPos, ((curLength+1)-dwPos)*sizeof(TCHAR));
@@ -546,13 +599,12 @@ String& String::AppendString(CTSTR str, UINT count)
 
     if(curLength)
     {
-        lpString = (TSTR)ReAllocate(lpString, (curLength+1)*sizeof(TCHAR));
+        GrowStringBuffer(lpString, curLength);
         scpy_n(lpString+oldLen, str, strLength);
     }
     else
     {
-        if(lpString)
-            Free(lpString);
+        FreeStringBuffer(lpString);
         lpString = NULL;
     }
 
@@ -584,8 +636,7 @@ UINT String::GetLinePos(UINT dwLine)
 
 String& String::Clear()
 {
-    if(lpString)
-        Free(lpString);
+    FreeStringBuffer(lpString);
     lpString = NULL;
     curLength = 0;
 
@@ -737,7 +788,8 @@ String& String::SetLength(UINT length)
     curLength = length;
     if(curLength)
     {
-        lpString = (TSTR)ReAllocate(lpString, (curLength+1)*sizeof(TCHAR));
+        //shrinking keeps the buffer, so cutting a string down and building it back up doesn't reallocate
+        ReserveStringBuffer(lpString, curLength);
 
         if(oldLength < curLength)
             zero(&lpString[oldLength], ((curLength+1)-oldLength)*sizeof(TCHAR));
@@ -746,14 +798,27 @@ String& String::SetLength(UINT length)
     }
     else
     {
-        if(lpString)
-            Free(lpString);
+        FreeStringBuffer(lpString);
         lpString = NULL;
     }
 
     return *this;
 }
 
+String& String::Reserve(UINT length)
+{
+    if(length > curLength)
+    {
+        bool bWasEmpty = (lpString == NULL);
+        ReserveStringBuffer(lpString, length);
+
+        if(bWasEmpty)
+            *lpString = 0;
+    }
+
+    return *this;
+}
+
 
 void String::RemoveRange(unsigned int from, unsigned int to)
 {
@@ -771,7 +836,6 @@ void String::RemoveRange(unsigned int from, unsigned int to)
     unsigned int remainderLength = (curLength+1)-to;
     curLength -= delLength;
     mcpy(lpString+from, lpString+to, remainderLength*sizeof(TCHAR));
-    lpString = (TSTR)ReAllocate(lpString, (curLength+1)*sizeof(TCHAR));
 }
 
 
@@ -789,7 +853,7 @@ String& String::InsertChar(UINT pos, TCHAR chr)
     }
     
     ++curLength;
-    lpString = (TSTR)ReAllocate(lpString, (curLength+1)*sizeof(TCHAR));
+    GrowStringBuffer(lpString, curLength);
     if(curLength > 1)
         mcpyrev(lpString+pos+1, lpString+pos, (curLength-pos)*sizeof(TCHAR));
 
@@ -813,7 +877,6 @@ String& String::RemoveChar(UINT pos)
     {
         if(pos < curLength)
             mcpy(lpString+pos, lpString+pos+1, (curLength-pos)*sizeof(TCHAR));
-        lpString = (TSTR)ReAllocate(lpString, (curLength)*sizeof(TCHAR));
         --curLength;
     }
 
@@ -864,9 +927,11 @@ String FormattedStringva(CTSTR lpFormat, va_list arglist)
 
     int retVal = vtsprintf_s(newString, iSize+1, lpFormat, arglist);
     if(retVal == -1)
-        return newString.Clear();
+        newString.Clear();
     else
-        return newString.SetLength(retVal);
+        newString.SetLength(retVal);
+
+    return newString;
 }
 
 String FormattedString(CTSTR lpFormat, ...)
@@ -883,9 +948,11 @@ String FormattedString(CTSTR lpFormat, ...)
 
     int retVal = vtsprintf_s(newString, iSize+1, lpFormat, args);
     if(retVal == -1)
-        return newString.Clear();
+        newString.Clear();
     else
-        return newString.SetLength(retVal);
+        newString.SetLength(retVal);
+
+    return newString;
 }
 
 int STDCALL GetStringLine(const TCHAR *lpStart, const TCHAR *lpOffset)
@@ -84,6 +84,7 @@ public:
     String(LPCSTR str);
     String(CWSTR str);
     String(const String &str);
+    String(String &&str);
 
     ~String();
 
@@ -104,6 +105,7 @@ public:
     String  operator+(unsigned int unumber) const;
 
     String& operator=(const String &str);
+    String& operator=(String &&str);
     String& operator+=(const String &str);
     String  operator+(const String &str) const;
 
@@ -178,6 +180,10 @@ public:
 
     String& SetLength(UINT length);
 
+    //makes room for a string of this length ahead of time.  doesn't change the contents, but an empty
+    //string becomes an empty buffer instead of NULL
+    String& Reserve(UINT length);
+
     inline UINT    Length() const               {return curLength;}
     inline UINT    DataLength() const           {return curLength ? ssize(lpString) : 0;}
 
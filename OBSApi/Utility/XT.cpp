@@ -17,6 +17,8 @@
 ********************************************************************************/
 
 
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
 #include "XT.h"
 
 #include <memory>
@@ -44,6 +46,71 @@ namespace
         std::unique_ptr<void, MutexDeleter> append_mutex, process_mutex, read_mutex;
         bool stopped;
     };
+
+    //  log lines are formatted on the calling thread and pushed into a fixed ring, a writer thread picks
+    //them up in batches and does the file write and the StringLog append.  pushing is lock-free (it's a
+    //bounded multi-producer queue, each slot has a sequence number that says whether it's free or filled),
+    //so the encode/send/audio threads never wait on the disk.  if the ring is full the caller waits for
+    //the writer to catch up rather than losing lines or writing them out of order.
+    //
+    //  the same message logged over and over in a row is only written once, followed by a "repeated n
+    //times" line when something else gets logged or every LOG_REPEAT_INTERVAL ms.  only identical lines
+    //(after the timestamp) count as repeats, not lines from the same format string: plenty of the app's
+    //output goes through generic formats like "%s" (encoder info, x264's own log), and a dropped frame
+    //count that changes every line is worth seeing.
+    //
+    //  stopping hands the file back to the calling threads.  lines keep going into the ring until the
+    //writer has written its last batch, only then do the loggers write for themselves, so nothing is
+    //written out of order or from two threads at once.
+
+    #define LOG_RING_SIZE       1024    //has to be a power of two
+    #define LOG_REPEAT_INTERVAL 5000
+
+    struct LogRecord
+    {
+        volatile LONG sequence;
+        TSTR lpText;
+        UINT len;
+        UINT bodyOffset;    //skips the timestamp when comparing for repeats
+        bool bCollapse;
+    };
+
+    enum {LogWriter_NotStarted, LogWriter_Starting, LogWriter_Running, LogWriter_Stopping, LogWriter_Draining, LogWriter_Stopped};
+
+    struct XLogWriter
+    {
+        XLogWriter() {ResetRing();}
+
+        bool Push(CTSTR lpText, UINT len, UINT bodyOffset, bool bCollapse);
+        bool Stop(DWORD waitMS=INFINITE);
+        void Reset();
+    private:
+        bool Start();
+        void ResetRing();
+        bool Pop(LogRecord &record);
+        bool ProcessRecords();
+        void FlushRepeats();
+        void Drain();
+        void AddLine(CTSTR lpText, UINT len);
+
+        static DWORD STDCALL WriterThread(LPVOID param);
+
+        LogRecord ring[LOG_RING_SIZE];
+        volatile LONG enqueuePos;
+        LONG dequeuePos;
+
+        volatile LONG state;
+        volatile LONG numPushing;
+        volatile LONG bWriterIdle;
+        HANDLE hThread, hWakeEvent;
+        DWORD threadID;
+
+        //writer thread only
+        String batch;
+        String lastMessage;
+        UINT numRepeats;
+        DWORD firstRepeatTime;
+    };
 }
 
 ////////////////
@@ -56,6 +123,7 @@ BOOL                    bDebugBreak     = TRUE;
 TCHAR                   lpLogFileName[260] = TEXT("XT.log");
 XFile                   LogFile;
 XStringLog              StringLog;
+XLogWriter              LogWriter;
 LogUpdateCallback       LogUpdateProc;
 StringList              TraceFuncList;
 
@@ -94,6 +162,10 @@ void STDCALL InitXTLog(CTSTR logFile)
 
 void STDCALL ResetXTAllocator(CTSTR lpAllocator)
 {
+    //the queued lines and the writer's buffers belong to the old allocator
+    LogWriter.Stop();
+    LogWriter.Reset();
+
     StringLog.Stop();
     StringLog.Clear();
 
@@ -118,6 +190,7 @@ void STDCALL TerminateXT()
 {
     if(bBaseLoaded)
     {
+        LogWriter.Stop();
         StringLog.Stop();
 
         FreeProfileData();
@@ -153,7 +226,8 @@ void STDCALL CriticalExit()
     {
         bBaseLoaded = 0;
 
-        if(LogFile.IsOpen())
+        //if the writer's stuck the file stays open, closing it under the writer is worse
+        if(LogWriter.Stop(2000) && LogFile.IsOpen())
             LogFile.Close();
 
         OSCriticalExit();
@@ -186,10 +260,18 @@ void STDCALL TraceCrashEnd()
 
     String strOut = FormattedString(TEXT("%s\r\n"), strStackTrace.Array());
 
-    OpenLogFile();
-    LogFile.WriteAsUTF8(strOut, strOut.Length());
-    LogFile.WriteAsUTF8(TEXT("\r\n"));
-    CloseLogFile();
+    //  get everything that was logged before the crash out first.  other threads may still be running, so
+    //don't wait forever on them.  if the writer doesn't finish in time it still owns the file, the trace
+    //only goes to the debug output then
+    if(LogWriter.Stop(2000))
+    {
+        OpenLogFile();
+        LogFile.WriteAsUTF8(strOut, strOut.Length());
+        LogFile.WriteAsUTF8(TEXT("\r\n"));
+        CloseLogFile();
+    }
+    else
+        OSDebugOut(TEXT("%s"), strOut.Array());
 
     OSMessageBox(TEXT("Error: Exception fault - More info in the log file.\r\n\r\nMake sure you're using the latest verison, otherwise send your log to obs.jim@gmail.com"));
 
@@ -231,6 +313,9 @@ void __cdecl LogRaw(const TCHAR *text, UINT len)
         len = slen(text);
 
     OpenLogFile();
+    if(LogWriter.Push(text, len, 0, false))
+        return;
+
     LogFile.WriteAsUTF8(text, len);
     LogFile.WriteAsUTF8(TEXT("\r\n"));
     CloseLogFile();
@@ -250,6 +335,9 @@ void __cdecl Logva(const TCHAR *format, va_list argptr)
     strOut.FindReplace(TEXT("\n"), String() << TEXT("\n") << strCurTime);
 
     OpenLogFile();
+    if(LogWriter.Push(strOut, strOut.Length(), strCurTime.Length(), true))
+        return;
+
     LogFile.WriteAsUTF8(strOut, strOut.Length());
     LogFile.WriteAsUTF8(TEXT("\r\n"));
     CloseLogFile();
@@ -280,12 +368,19 @@ void __cdecl AppWarning(const TCHAR *format, ...)
     String strOut(L"Warning -- ");
     strOut << FormattedStringva(format, arglist);
 
+    bool bQueued = false;
+
     if(bLogStarted)
     {
         OpenLogFile();
-        LogFile.WriteAsUTF8(strOut, strOut.Length());
-        LogFile.WriteAsUTF8(TEXT("\r\n"));
-        CloseLogFile();
+        bQueued = LogWriter.Push(strOut, strOut.Length(), 0, true);
+
+        if(!bQueued)
+        {
+            LogFile.WriteAsUTF8(strOut, strOut.Length());
+            LogFile.WriteAsUTF8(TEXT("\r\n"));
+            CloseLogFile();
+        }
     }
 
     OSDebugOut(TEXT("Warning -- "));
@@ -306,7 +401,8 @@ void __cdecl AppWarning(const TCHAR *format, ...)
     }
 #endif
 
-    StringLog.Append(strOut);
+    if(!bQueued)
+        StringLog.Append(strOut);
 }
 
 
@@ -322,10 +418,16 @@ void __cdecl CrashError(const TCHAR *format, ...)
     String strOut(L"\r\nError: ");
     strOut << FormattedStringva(format, arglist);
 
-    OpenLogFile();
-    LogFile.WriteAsUTF8(strOut);
-    LogFile.WriteStr(TEXT("\r\n"));
-    CloseLogFile();
+    //same as TraceCrashEnd, the file can only be written once the writer's done with it
+    if(LogWriter.Stop(2000))
+    {
+        OpenLogFile();
+        LogFile.WriteAsUTF8(strOut);
+        LogFile.WriteStr(TEXT("\r\n"));
+        CloseLogFile();
+    }
+    else
+        OSDebugOut(TEXT("%s"), strOut.Array());
 
     OSMessageBoxva(format, arglist);
 
@@ -468,4 +570,307 @@ void XStringLog::Reset()
     append_mutex.reset(OSCreateMutex());
     process_mutex.reset(OSCreateMutex());
     read_mutex.reset(OSCreateMutex());
-}
\ No newline at end of file
+}
+void XLogWriter::ResetRing()
+{
+    for(LONG i=0; i<LOG_RING_SIZE; i++)
+        ring[i].sequence = i;
+
+    enqueuePos = dequeuePos = 0;
+}
+
+void XLogWriter::Reset()
+{
+    ResetRing();
+    state = LogWriter_NotStarted;
+}
+
+//returns true if lines can go into the ring
+bool XLogWriter::Start()
+{
+    if(InterlockedCompareExchange(&state, LogWriter_Starting, LogWriter_NotStarted) != LogWriter_NotStarted)
+    {
+        while(state == LogWriter_Starting)
+            OSSleep(0);
+
+        return state == LogWriter_Running || state == LogWriter_Stopping;
+    }
+
+    bWriterIdle = 0;
+    numRepeats = 0;
+    threadID = 0;
+
+    hWakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    hThread = OSCreateThread((XTHREAD)WriterThread, this);
+
+    if(!hThread)
+    {
+        CloseHandle(hWakeEvent);
+        hWakeEvent = NULL;
+
+        InterlockedExchange(&state, LogWriter_Stopped);
+        return false;
+    }
+
+    InterlockedExchange(&state, LogWriter_Running);
+    return true;
+}
+
+//returns false if the line has to be written on the calling thread instead
+bool XLogWriter::Push(CTSTR lpText, UINT len, UINT bodyOffset, bool bCollapse)
+{
+    InterlockedIncrement(&numPushing);
+
+    if(state != LogWriter_Running && state != LogWriter_Stopping && !Start())
+    {
+        InterlockedDecrement(&numPushing);
+
+        //the writer is still writing out the last of the ring, the file is ours once it's done
+        while(state == LogWriter_Draining)
+            OSSleep(0);
+
+        return false;
+    }
+
+    TSTR lpCopy = (TSTR)Allocate((len+1)*sizeof(TCHAR));
+    mcpy(lpCopy, lpText, len*sizeof(TCHAR));
+    lpCopy[len] = 0;
+
+    //claim a slot.  a slot is free when its sequence matches the position, if it's behind then the
+    //writer hasn't gotten to it yet and the ring is full
+    LogRecord *record;
+    LONG pos = enqueuePos;
+
+    while(true)
+    {
+        record = ring+(pos & (LOG_RING_SIZE-1));
+        LONG diff = record->sequence - pos;
+
+        if(diff == 0)
+        {
+            LONG prevPos = InterlockedCompareExchange(&enqueuePos, pos+1, pos);
+            if(prevPos == pos)
+                break;
+
+            pos = prevPos;
+        }
+        else if(diff < 0)
+        {
+            //the writer can't wait on itself
+            if(GetCurrentThreadId() == threadID)
+            {
+                Free(lpCopy);
+                InterlockedDecrement(&numPushing);
+                return false;
+            }
+
+            SetEvent(hWakeEvent);
+            OSSleep(1);
+
+            pos = enqueuePos;
+        }
+        else
+            pos = enqueuePos;
+    }
+
+    record->lpText = lpCopy;
+    record->len = len;
+    record->bodyOffset = bodyOffset;
+    record->bCollapse = bCollapse;
+    InterlockedExchange(&record->sequence, pos+1);
+
+    if(InterlockedExchange(&bWriterIdle, 0))
+        SetEvent(hWakeEvent);
+
+    InterlockedDecrement(&numPushing);
+    return true;
+}
+
+bool XLogWriter::Pop(LogRecord &record)
+{
+    LogRecord &slot = ring[dequeuePos & (LOG_RING_SIZE-1)];
+    if(slot.sequence != dequeuePos+1)
+        return false;
+
+    record.lpText = slot.lpText;
+    record.len = slot.len;
+    record.bodyOffset = slot.bodyOffset;
+    record.bCollapse = slot.bCollapse;
+
+    InterlockedExchange(&slot.sequence, dequeuePos+LOG_RING_SIZE);
+    dequeuePos++;
+
+    return true;
+}
+
+void XLogWriter::AddLine(CTSTR lpText, UINT len)
+{
+    if(len)
+        batch.AppendString(lpText, len);
+    batch << TEXT("\r\n");
+}
+
+void XLogWriter::FlushRepeats()
+{
+    if(!numRepeats)
+        return;
+
+    String strLine = FormattedString(TEXT("%s: Last message repeated %u times"), CurrentTimeString().Array(), numRepeats);
+    AddLine(strLine, strLine.Length());
+
+    numRepeats = 0;
+}
+
+//takes everything that's in the ring (up to a ring's worth) and writes it out in one go
+bool XLogWriter::ProcessRecords()
+{
+    LogRecord record;
+    UINT numRecords = 0;
+
+    while(numRecords < LOG_RING_SIZE && Pop(record))
+    {
+        numRecords++;
+
+        CTSTR lpBody = record.lpText+record.bodyOffset;
+        UINT bodyLen = record.len-record.bodyOffset;
+
+        if(record.bCollapse && lastMessage.IsValid() && bodyLen == lastMessage.Length() && scmp(lpBody, lastMessage) == 0)
+        {
+            if(!numRepeats++)
+                firstRepeatTime = OSGetTime();
+        }
+        else
+        {
+            FlushRepeats();
+            AddLine(record.lpText, record.len);
+
+            if(record.bCollapse)
+                lastMessage = lpBody;
+            else
+                lastMessage.Clear();
+        }
+
+        Free(record.lpText);
+    }
+
+    //still repeating, write how many so far and keep counting
+    if(numRepeats && OSGetTime()-firstRepeatTime >= LOG_REPEAT_INTERVAL)
+        FlushRepeats();
+
+    if(batch.IsValid())
+    {
+        LogFile.WriteAsUTF8(batch, batch.Length());
+        StringLog.Append(batch, false);
+        batch.Clear();
+    }
+
+    return numRecords != 0;
+}
+
+DWORD STDCALL XLogWriter::WriterThread(LPVOID param)
+{
+    XLogWriter *writer = (XLogWriter*)param;
+    writer->threadID = GetCurrentThreadId();
+
+    while(true)
+    {
+        bool bWroteRecords = writer->ProcessRecords();
+
+        //Drain takes care of whatever comes in after this
+        if(writer->state == LogWriter_Stopping)
+            break;
+
+        if(bWroteRecords)
+            continue;
+
+        //  let the loggers know they have to wake us up, then check once more in case something got
+        //pushed before they could see it
+        InterlockedExchange(&writer->bWriterIdle, 1);
+
+        LogRecord &next = writer->ring[writer->dequeuePos & (LOG_RING_SIZE-1)];
+        if(next.sequence != writer->dequeuePos+1 && writer->state != LogWriter_Stopping)
+        {
+            DWORD timeout = INFINITE;
+            if(writer->numRepeats)
+            {
+                DWORD repeatTime = OSGetTime()-writer->firstRepeatTime;
+                timeout = (repeatTime < LOG_REPEAT_INTERVAL) ? LOG_REPEAT_INTERVAL-repeatTime : 0;
+            }
+
+            WaitForSingleObject(writer->hWakeEvent, timeout);
+        }
+
+        InterlockedExchange(&writer->bWriterIdle, 0);
+    }
+
+    writer->Drain();
+    return 0;
+}
+
+//  from here on new lines are written by the loggers themselves (once the state is stopped), but anyone
+//who got into Push before this still goes into the ring and has to be written first
+void XLogWriter::Drain()
+{
+    InterlockedExchange(&state, LogWriter_Draining);
+
+    while(numPushing)
+    {
+        if(!ProcessRecords())
+            OSSleep(0);
+    }
+
+    ProcessRecords();
+    FlushRepeats();
+    if(batch.IsValid())
+    {
+        LogFile.WriteAsUTF8(batch, batch.Length());
+        StringLog.Append(batch, false);
+    }
+
+    batch.Clear();
+    lastMessage.Clear();
+
+    InterlockedExchange(&state, LogWriter_Stopped);
+}
+
+//  writes out everything that's queued and goes back to writing on the calling thread.  on the crash
+//paths waitMS keeps it from hanging on a thread that's never going to finish.  returns false if the
+//writer is still going when the wait runs out, the log file isn't safe to touch in that case
+bool XLogWriter::Stop(DWORD waitMS)
+{
+    while(state == LogWriter_Starting)
+        OSSleep(0);
+
+    if(InterlockedCompareExchange(&state, LogWriter_Stopping, LogWriter_Running) != LogWriter_Running)
+    {
+        if(state == LogWriter_NotStarted || state == LogWriter_Stopped)
+            return true;
+
+        //someone else is already stopping it
+        DWORD startTime = OSGetTime();
+        while(state != LogWriter_Stopped && OSGetTime()-startTime < waitMS)
+            OSSleep(1);
+
+        return state == LogWriter_Stopped;
+    }
+
+    if(GetCurrentThreadId() == threadID)
+    {
+        //crashed on the writer thread itself
+        Drain();
+        return true;
+    }
+
+    SetEvent(hWakeEvent);
+
+    if(WaitForSingleObject(hThread, waitMS) != WAIT_OBJECT_0)
+        return false;
+
+    OSCloseThread(hThread);
+    hThread = NULL;
+
+    CloseHandle(hWakeEvent);
+    hWakeEvent = NULL;
+
+    return true;
+}
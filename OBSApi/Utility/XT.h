@@ -309,6 +309,7 @@ BASE_EXPORT extern BOOL bDebugBreak;
 #include "ConfigFile.h"
 #include "XFile.h"
 #include "Profiler.h"
+#include "TaskPool.h"
 #include "XTLocalization.h"
 #include "XConfig.h"
 
@@ -87,4 +87,4 @@ typedef DWORD (STDCALL* XTHREAD)(LPVOID);
 //forwards
 //-----------------------------------------
 struct DISPLAYMODE;
-template<typename T> class List;
+template<typename T, unsigned int alignment=0> class List;
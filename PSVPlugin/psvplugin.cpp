@@ -201,6 +201,8 @@ void ConfigPlugin(HWND hWnd)
     OBSDialogBox(hInstance, MAKEINTRESOURCE(IDD_CONFIGPSV), hWnd, ConfigDlgProc);
 }
 
+OBS_PLUGIN_API_VERSION()
+
 bool LoadPlugin()
 {
     pluginLocale = new LocaleStringLookup;
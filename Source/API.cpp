@@ -52,7 +52,7 @@ void OBS::RegisterSceneClass(CTSTR lpClassName, CTSTR lpDisplayName, OBSCREATEPR
     classInfo->bDeprecated = bDeprecated;
 }
 
-void OBS::RegisterImageSourceClass(CTSTR lpClassName, CTSTR lpDisplayName, OBSCREATEPROC createProc, OBSCONFIGPROC configProc, bool bDeprecated)
+void OBS::RegisterImageSourceClass(CTSTR lpClassName, CTSTR lpDisplayName, OBSCREATEPROC createProc, OBSCONFIGPROC configProc, bool bDeprecated, UINT flags)
 {
     if(!lpClassName || !*lpClassName)
     {
@@ -78,6 +78,7 @@ void OBS::RegisterImageSourceClass(CTSTR lpClassName, CTSTR lpDisplayName, OBSCR
     classInfo->createProc  = createProc;
     classInfo->configProc  = configProc;
     classInfo->bDeprecated = bDeprecated;
+    classInfo->flags       = flags;
 }
 
 Scene* OBS::CreateScene(CTSTR lpClassName, XElement *data)
@@ -618,6 +619,21 @@ public:
     virtual UINT GetFramesDropped() const     {return App->curFramesDropped;}
     virtual UINT GetTotalStreamTime() const   {return App->totalStreamTime;}
     virtual UINT GetBytesPerSec() const       {return App->bytesPerSec;}
+
+    virtual void SignalAudioAvailable()       {SetEvent(App->hAudioEvent);}
+
+    virtual TaskPool* GetTaskPool()           {return App->taskPool;}
+
+    virtual void RegisterImageSourceClassEx(CTSTR lpClassName, CTSTR lpDisplayName, OBSCREATEPROC createProc, OBSCONFIGPROC configProc, UINT flags)
+    {
+        App->RegisterImageSourceClass(lpClassName, lpDisplayName, createProc, configProc, false, flags);
+    }
+
+    virtual UINT GetImageSourceClassFlags(CTSTR lpClassName)
+    {
+        ClassInfo *classInfo = App->GetImageSourceClass(lpClassName);
+        return classInfo ? classInfo->flags : 0;
+    }
 };
 
 APIInterface* CreateOBSApiInterface()
@@ -0,0 +1,68 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+//  paces the audio thread.  Wait blocks on the audio event until either a source
+//signals new data (OBSSignalAudioAvailable) or the next 10ms mix tick comes due,
+//whichever is first.  pull-based sources like WASAPI don't signal anything, they
+//just get picked up on the tick.
+//
+//  only depends on OBSApi so the test harness can drive it with synthetic sources.
+
+class AudioMixClock
+{
+    HANDLE hEvent;
+    QWORD  nextMixTime;
+    UINT   numWakeups, numSignaledWakeups;
+
+public:
+    inline AudioMixClock(HANDLE hEvent) : hEvent(hEvent), numWakeups(0), numSignaledWakeups(0)
+    {
+        nextMixTime = GetQPCTimeMS();
+    }
+
+    //returns true if a source signaled, false if the tick came due
+    inline bool Wait()
+    {
+        QWORD curTime = GetQPCTimeMS();
+        DWORD timeout = (nextMixTime > curTime) ? DWORD(nextMixTime-curTime) : 0;
+
+        bool bSignaled = (WaitForSingleObject(hEvent, timeout) == WAIT_OBJECT_0);
+        if(bSignaled)
+            numSignaledWakeups++;
+        numWakeups++;
+
+        curTime = GetQPCTimeMS();
+        if(curTime >= nextMixTime)
+        {
+            nextMixTime += 10;
+
+            //if we fell behind, don't try to catch up with a string of zero-length waits
+            if(nextMixTime <= curTime)
+                nextMixTime = curTime+10;
+        }
+
+        return bSignaled;
+    }
+
+    inline UINT NumWakeups() const          {return numWakeups;}
+    inline UINT NumSignaledWakeups() const  {return numSignaledWakeups;}
+};
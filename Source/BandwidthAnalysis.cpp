@@ -55,11 +55,11 @@ public:
         App->SetStreamReport(strReport);
     }
 
-    void SendPacket(BYTE *data, UINT size, DWORD timestamp, PacketType type)
+    void SendPacket(PacketBuffer *packet, DWORD timestamp, PacketType type)
     {
         DWORD curTime = OSGetTime();
 
-        curBytes += size+8;  //just assume a header of 8 bytes
+        curBytes += packet->Size()+8;  //just assume a header of 8 bytes
 
         if((curTime-lastTime) > 1000)
         {
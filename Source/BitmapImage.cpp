@@ -1,34 +1,12 @@
 #include "BitmapImage.h"
 
-void *BI_def_bitmap_create(int width, int height)          {return Allocate(width * height * 4);}
-void  BI_def_bitmap_set_opaque(void *bitmap, BOOL opaque)  {}
-BOOL  BI_def_bitmap_test_opaque(void *bitmap)              {return false;}
-unsigned char *BI_def_bitmap_get_buffer(void *bitmap)      {return (unsigned char*)bitmap;}
-void BI_def_bitmap_destroy(void *bitmap)                   {Free(bitmap);}
-void BI_def_bitmap_modified(void *bitmap)                  {}
-
-
 BitmapImage::BitmapImage()
 {
-    bitmap_callbacks.bitmap_create = BI_def_bitmap_create;
-    bitmap_callbacks.bitmap_destroy = BI_def_bitmap_destroy;
-    bitmap_callbacks.bitmap_get_buffer = BI_def_bitmap_get_buffer;
-    bitmap_callbacks.bitmap_modified = BI_def_bitmap_modified;
-    bitmap_callbacks.bitmap_set_opaque = BI_def_bitmap_set_opaque;
-    bitmap_callbacks.bitmap_test_opaque = BI_def_bitmap_test_opaque;
 }
 
 BitmapImage::~BitmapImage()
 {
-    if(bIsAnimatedGif)
-    {
-        gif_finalise(&gif);
-        Free(animationFrameCache);
-        Free(animationFrameData);
-    }
-
-    if(lpGifData)
-        Free(lpGifData);
+    ReleaseGifAnimation(animation);
 
     EnableFileMonitor(false);
 
@@ -70,25 +48,12 @@ void BitmapImage::EnableFileMonitor(bool bMonitor)
 
 void BitmapImage::Init(void)
 {
-    if(bIsAnimatedGif)
+    if(animation)
     {
-        bIsAnimatedGif = false;
-        gif_finalise(&gif);
-
-        Free(animationFrameCache);
-        animationFrameCache = NULL;
-        Free(animationFrameData);
-        animationFrameData = NULL;
+        ReleaseGifAnimation(animation);
+        animation = NULL;
     }
 
-    if(lpGifData)
-    {
-        Free(lpGifData);
-        lpGifData = NULL;
-    }
-
-    animationTimes.Clear();
-
     delete texture;
     texture = NULL;
 
@@ -102,95 +67,45 @@ void BitmapImage::Init(void)
 
     //------------------------------------
 
+    //  the decoded frames are shared with any other source using the same file and are decoded in the
+    //background, only the first one is ready right away
     if(GetPathExtension(lpBitmap).CompareI(TEXT("gif")))
     {
-        bool bFail = false;
-
-        gif_create(&gif, &bitmap_callbacks);
-
-        XFile gifFile;
-        if(!gifFile.Open(lpBitmap, XFILE_READ, XFILE_OPENEXISTING))
+        animation = AcquireGifAnimation(lpBitmap);
+        if(animation)
         {
-            AppWarning(TEXT("BitmapImage::Init: could not open gif file '%s'"), lpBitmap);
-            CreateErrorTexture();
-            return;
-        }
-
-
-        DWORD fileSize = (DWORD)gifFile.GetFileSize();
-        lpGifData = (LPBYTE)Allocate(fileSize);
-        gifFile.Read(lpGifData, fileSize);
-
-        gif_result result;
-        do
-        {
-            result = gif_initialise(&gif, fileSize, lpGifData);
-            if(result != GIF_OK && result != GIF_WORKING)
-            {
-                bFail = true;
-                break;
-            }
-        }while(result != GIF_OK);
-
-        if(gif.frame_count > 1)
-        {
-            if(result == GIF_OK || result == GIF_WORKING)
-                bIsAnimatedGif = true;
-        }
-
-        if(bIsAnimatedGif)
-        {
-            gif_decode_frame(&gif, 0);
-            texture = CreateTexture(gif.width, gif.height, GS_RGBA, gif.frame_image, FALSE, FALSE);
-
-            animationFrameCache = (BYTE **)Allocate(gif.frame_count * sizeof(BYTE *));
-            memset(animationFrameCache, 0, gif.frame_count * sizeof(BYTE *));
-
-            animationFrameData = (BYTE *)Allocate(gif.frame_count * gif.width * gif.height * 4);
-            memset(animationFrameData, 0, gif.frame_count * gif.width * gif.height * 4);
-
-            for(UINT i=0; i<gif.frame_count; i++)
+            texture = animation->CreateFrameTexture();
+            if(!texture)
             {
-                float frameTime = float(gif.frames[i].frame_delay)*0.01f;
-                if (frameTime == 0.0f)
-                    frameTime = 0.1f;
-                animationTimes << frameTime;
+                AppWarning(TEXT("BitmapImage::Init: could not decode the first frame of '%s'"), lpBitmap);
+                ReleaseGifAnimation(animation);
+                animation = NULL;
 
-                if (gif_decode_frame(&gif, i) != GIF_OK)
-                    Log (TEXT("BitmapImage: Warning, couldn't decode frame %d of %s"), i, lpBitmap);
+                CreateErrorTexture();
+                return;
             }
 
-            gif_decode_frame(&gif, 0);
-
-            fullSize.x = float(gif.width);
-            fullSize.y = float(gif.height);
+            fullSize.x = float(animation->Width());
+            fullSize.y = float(animation->Height());
 
             curTime = 0.0f;
             curFrame = 0;
-            lastDecodedFrame = 0;
-        }
-        else
-        {
-            gif_finalise(&gif);
-            Free(lpGifData);
-            lpGifData = NULL;
+            curLoop = 0;
+            shownFrame = 0;
+            return;
         }
     }
 
-    if(!bIsAnimatedGif)
+    texture = GS->CreateTextureFromFile(lpBitmap, TRUE);
+    if(!texture)
     {
-        texture = GS->CreateTextureFromFile(lpBitmap, TRUE);
-        if(!texture)
-        {
-            AppWarning(TEXT("BitmapImage::Init: could not create texture '%s'"), lpBitmap);
-            CreateErrorTexture();
-            return;
-        }
-
-        fullSize.x = float(texture->Width());
-        fullSize.y = float(texture->Height());
+        AppWarning(TEXT("BitmapImage::Init: could not create texture '%s'"), lpBitmap);
+        CreateErrorTexture();
+        return;
     }
 
+    fullSize.x = float(texture->Width());
+    fullSize.y = float(texture->Height());
 }
 
 Vect2 BitmapImage::GetSize(void) const
@@ -205,9 +120,9 @@ Texture* BitmapImage::GetTexture(void) const
 
 void BitmapImage::Tick(float fSeconds)
 {
-    if(bIsAnimatedGif)
+    if(animation)
     {
-        UINT totalLoops = (UINT)gif.loop_count;
+        UINT totalLoops = animation->GetLoopCount();
         if(totalLoops >= 0xFFFF)
             totalLoops = 0;
 
@@ -216,10 +131,10 @@ void BitmapImage::Tick(float fSeconds)
             UINT newFrame = curFrame;
 
             curTime += fSeconds;
-            while(curTime > animationTimes[newFrame])
+            while(curTime > animation->GetFrameTime(newFrame))
             {
-                curTime -= animationTimes[newFrame];
-                if(++newFrame == animationTimes.Num())
+                curTime -= animation->GetFrameTime(newFrame);
+                if(++newFrame == animation->NumFrames())
                 {
                     if(!totalLoops || ++curLoop < totalLoops)
                         newFrame = 0;
@@ -231,41 +146,7 @@ void BitmapImage::Tick(float fSeconds)
                 }
             }
 
-            if(newFrame != curFrame)
-            {
-                UINT lastFrame;
-
-                if (!animationFrameCache[newFrame])
-                {
-                    //animation might have looped, if so make sure we decode from frame 0
-                    if (newFrame < lastDecodedFrame)
-                        lastFrame = 0;
-                    else
-                        lastFrame = lastDecodedFrame + 1;
-
-                    //we need to decode any frames we missed for consistency
-                    for (UINT i = lastFrame; i < newFrame; i++)
-                    {
-                        if (gif_decode_frame(&gif, i) != GIF_OK)
-                            return;
-                    }
-
-                    //now decode and display the actual frame we want
-                    int ret = gif_decode_frame(&gif, newFrame);
-                    if (ret == GIF_OK)
-                    {
-                        animationFrameCache[newFrame] = animationFrameData + (newFrame * (gif.width * gif.height * 4));
-                        memcpy(animationFrameCache[newFrame], gif.frame_image, gif.width * gif.height * 4);
-                    }
-
-                    lastDecodedFrame = newFrame;
-                }
-
-                if (animationFrameCache[newFrame])
-                    texture->SetImage(animationFrameCache[newFrame], GS_IMAGEFORMAT_RGBA, gif.width*4);
-
-                curFrame = newFrame;
-            }
+            curFrame = newFrame;
         }
     }
 
@@ -275,10 +156,24 @@ void BitmapImage::Tick(float fSeconds)
         if (updateImageTime <= 0.0f)
         {
             updateImageTime = 0.0f;
-            Init();
+            bReloadImage = true;
         }
     }
 
     if (changeMonitor && OSFileHasChanged(changeMonitor))
         updateImageTime = 1.0f;
 }
+
+void BitmapImage::Preprocess()
+{
+    if(bReloadImage)
+    {
+        bReloadImage = false;
+        Init();
+    }
+
+    //  frames come from the cache's background decoder.  if the current one isn't ready yet the last
+    //one stays up instead of stalling the render thread, and it's tried again next frame
+    if(animation && curFrame != shownFrame && animation->UploadFrame(curFrame, texture))
+        shownFrame = curFrame;
+}
@@ -1,28 +1,22 @@
 #pragma once
 
 #include "Main.h"
-#include "libnsgif.h"
+#include "GifFrameCache.h"
 
 
 class BitmapImage{
     Texture *texture;
     Vect2 fullSize;
 
-    bool bIsAnimatedGif;
-    gif_animation gif;
-    LPBYTE lpGifData;
-    List<float> animationTimes;
-    BYTE **animationFrameCache;
-    BYTE *animationFrameData;
-    UINT curFrame, curLoop, lastDecodedFrame;
+    GifAnimation *animation;
+    UINT curFrame, curLoop, shownFrame;
     float curTime;
     float updateImageTime;
+    bool bReloadImage;
 
     String filePath;
     OSFileChangeData *changeMonitor;
 
-    gif_bitmap_callback_vt bitmap_callbacks;
-
     void CreateErrorTexture(void);
 
 public:
@@ -36,5 +30,7 @@ public:
     Vect2 GetSize(void) const;
     Texture* GetTexture(void) const;
 
+    //Tick doesn't use the graphics system, Preprocess does the uploads and reloads it asks for
     void Tick(float fSeconds);
+    void Preprocess();
 };
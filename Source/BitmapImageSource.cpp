@@ -150,6 +150,11 @@ public:
         delete alphaIgnoreShader;
     }
 
+    void Preprocess()
+    {
+        bitmapImage.Preprocess();
+    }
+
     void Tick(float fSeconds)
     {
         bitmapImage.Tick(fSeconds);
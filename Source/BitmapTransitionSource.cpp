@@ -71,6 +71,12 @@ public:
             delete bitmapImages[i];
     }
 
+    void Preprocess()
+    {
+        for(UINT i=0; i<bitmapImages.Num(); i++)
+            bitmapImages[i]->Preprocess();
+    }
+
     void Tick(float fSeconds)
     {
         for(UINT i=0; i<bitmapImages.Num(); i++)
@@ -0,0 +1,171 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "Main.h"
+#include "BitrateController.h"
+
+
+BitrateController::BitrateController(int maxBitRate, int audioBitRate)
+{
+    this->maxBitRate = maxBitRate;
+    this->audioBitRate = audioBitRate;
+    currentBitRate = lowestBitRate = maxBitRate;
+
+    lastAdjustmentTime = lastDecreaseTime = calmStartTime = 0;
+    lastFramesDropped = 0;
+    numDecreases = numIncreases = 0;
+    streamInfoID = 0;
+    bWantsKeyframe = false;
+
+    minBitRate          = AppConfig->GetInt(TEXT("Video Encoding"), TEXT("CongestionMinBitrate"), MAX(maxBitRate/10, 100));
+    highStrain          = AppConfig->GetFloat(TEXT("Video Encoding"), TEXT("CongestionHighStrain"), 25.0f);
+    lowStrain           = AppConfig->GetFloat(TEXT("Video Encoding"), TEXT("CongestionLowStrain"), 5.0f);
+    headroom            = AppConfig->GetInt(TEXT("Video Encoding"), TEXT("CongestionHeadroom"), 85);
+    rampDownInterval    = (DWORD)AppConfig->GetInt(TEXT("Video Encoding"), TEXT("CongestionRampDownInterval"), 1500);
+    rampUpInterval      = (DWORD)AppConfig->GetInt(TEXT("Video Encoding"), TEXT("CongestionRampUpInterval"), 5000);
+    rampUpPercent       = AppConfig->GetInt(TEXT("Video Encoding"), TEXT("CongestionRampUpPercent"), 5);
+    holdTime            = (DWORD)AppConfig->GetInt(TEXT("Video Encoding"), TEXT("CongestionHoldTime"), rampUpInterval);
+    keyframeDropPercent = AppConfig->GetInt(TEXT("Video Encoding"), TEXT("CongestionKeyframeDropPercent"), 30);
+    bTrace              = AppConfig->GetInt(TEXT("Video Encoding"), TEXT("CongestionTrace"), 0) != 0;
+
+    minBitRate    = MIN(MAX(minBitRate, 1), maxBitRate);
+    headroom      = MIN(MAX(headroom, 10), 100);
+    rampUpPercent = MIN(MAX(rampUpPercent, 1), 100);
+    if(lowStrain > highStrain)
+        lowStrain = highStrain;
+
+    Log(TEXT("Congestion control: bitrate %d - %d kbps, strain %g%% / %g%%, headroom %d%%, ramp down every %u ms, ramp up %d%% every %u ms"),
+        minBitRate, maxBitRate, lowStrain, highStrain, headroom, rampDownInterval, rampUpPercent, rampUpInterval);
+}
+
+BitrateController::~BitrateController()
+{
+    if(numDecreases || numIncreases)
+        Log(TEXT("Congestion control: %u decreases, %u increases, lowest bitrate %d kbps, final bitrate %d kbps"),
+            numDecreases, numIncreases, lowestBitRate, currentBitRate);
+
+    if(streamInfoID)
+        API->RemoveStreamInfo(streamInfoID);
+}
+
+void BitrateController::SetBitRate(VideoEncoder *encoder, int newBitRate, CTSTR lpReason, double strain, DWORD estimate, bool bLinkLimited)
+{
+    if(bTrace)
+        Log(TEXT("Congestion control: %s, %d -> %d kbps (strain %.1f%%, throughput %u kbps%s)"),
+            lpReason, currentBitRate, newBitRate, strain, estimate, bLinkLimited ? TEXT("") : TEXT(" or more"));
+
+    encoder->SetBitRate(newBitRate, -1);
+
+    if(newBitRate < currentBitRate)
+    {
+        String strInfo = FormattedString(TEXT("Congestion detected, dropping bitrate to %d kbps"), newBitRate);
+        if(!streamInfoID)
+            streamInfoID = API->AddStreamInfo(strInfo.Array(), StreamInfoPriority_Low);
+        else
+            API->SetStreamInfo(streamInfoID, strInfo.Array());
+    }
+    else if(streamInfoID)
+    {
+        API->RemoveStreamInfo(streamInfoID);
+        streamInfoID = 0;
+    }
+
+    currentBitRate = newBitRate;
+    if(currentBitRate < lowestBitRate)
+        lowestBitRate = currentBitRate;
+}
+
+bool BitrateController::Update(NetworkStream *network, VideoEncoder *encoder, DWORD curTime)
+{
+    bWantsKeyframe = false;
+
+    double strain = network->GetPacketStrain();
+
+    bool bLinkLimited;
+    DWORD estimate = network->GetSendThroughput(bLinkLimited);
+
+    DWORD framesDropped = network->NumDroppedFrames();
+    bool bDroppedFrames = (framesDropped > lastFramesDropped);
+    lastFramesDropped = framesDropped;
+
+    //the video bitrate that fits in the measured throughput alongside the audio
+    int estimateTarget = 0;
+    if(estimate)
+        estimateTarget = int(QWORD(estimate)*headroom/100) - audioBitRate;
+
+    if(strain > highStrain || bDroppedFrames)
+    {
+        calmStartTime = 0;
+
+        if(curTime-lastAdjustmentTime < rampDownInterval || currentBitRate <= minBitRate)
+            return false;
+
+        //always at least 10% down, and straight down to the measured limit if there is one
+        int newBitRate = int(currentBitRate*(1.0 - MIN(strain, 100.0)/400.0));
+        newBitRate = MIN(newBitRate, currentBitRate*9/10);
+        if(bLinkLimited && estimateTarget > 0 && estimateTarget < newBitRate)
+            newBitRate = estimateTarget;
+        newBitRate = MAX(newBitRate, minBitRate);
+
+        //a big drop makes the buffered frames out of date fast, the caller asks for a keyframe
+        bWantsKeyframe = (keyframeDropPercent > 0 && (currentBitRate-newBitRate)*100 >= currentBitRate*keyframeDropPercent);
+
+        SetBitRate(encoder, newBitRate, bDroppedFrames ? TEXT("frames dropped") : TEXT("congested"), strain, estimate, bLinkLimited);
+
+        lastAdjustmentTime = lastDecreaseTime = curTime;
+        numDecreases++;
+        return true;
+    }
+
+    if(currentBitRate >= maxBitRate)
+    {
+        calmStartTime = 0;
+        return false;
+    }
+
+    //  calm means nothing congested for the whole interval.  keyframes push the strain up for a moment
+    //every couple of seconds even on a good link, so the low strain only has to hold when going up
+    if(!calmStartTime)
+        calmStartTime = curTime;
+
+    if(strain >= lowStrain || curTime-calmStartTime < rampUpInterval || curTime-lastDecreaseTime < holdTime)
+        return false;
+
+    int newBitRate = MIN(currentBitRate + maxBitRate*rampUpPercent/100, maxBitRate);
+
+    //don't go back up past what the connection was measured to carry
+    if(bLinkLimited && estimateTarget > 0 && newBitRate > estimateTarget)
+        newBitRate = MAX(estimateTarget, currentBitRate);
+
+    //either way it has to stay calm for another interval before the next try
+    calmStartTime = curTime;
+
+    if(newBitRate == currentBitRate)
+    {
+        if(bTrace)
+            Log(TEXT("Congestion control: holding at %d kbps, throughput is only %u kbps"), currentBitRate, estimate);
+        return false;
+    }
+
+    SetBitRate(encoder, newBitRate, TEXT("calm"), strain, estimate, bLinkLimited);
+
+    lastAdjustmentTime = curTime;
+    numIncreases++;
+    return true;
+}
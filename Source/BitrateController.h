@@ -0,0 +1,78 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#pragma once
+
+
+//  congestion control for the video bitrate.  drops the bitrate when the send buffer fills up or frames
+//start getting dropped, aiming under the throughput the publisher measured, and slowly raises it back up
+//once things have been calm for a while.  everything is configured in [Video Encoding], the defaults
+//are in brackets:
+//
+//    CongestionMinBitrate          - never goes below this, kbps (a tenth of the max, at least 100)
+//    CongestionHighStrain          - buffer strain that counts as congested, % (25)
+//    CongestionLowStrain           - buffer strain it has to be under to go up, % (5)
+//    CongestionHeadroom            - percentage of the measured throughput to aim for (85)
+//    CongestionRampDownInterval    - minimum time between decreases, ms (1500)
+//    CongestionRampUpInterval      - how long it has to go without congestion before each increase, ms (5000)
+//    CongestionRampUpPercent       - size of each increase, in percent of the max bitrate (5)
+//    CongestionHoldTime            - no increases for this long after a decrease, ms (same as the ramp
+//                                    up interval)
+//    CongestionKeyframeDropPercent - decreases bigger than this ask for a keyframe, 0 to disable (30)
+//    CongestionTrace               - logs every decision (0)
+//
+//  the ramp intervals and step are what the old inline heuristic used.  it also waited out its ramp up
+//interval after any change, which is what the default hold time keeps.
+//
+//  only depends on OBSApi and the NetworkStream/VideoEncoder interfaces, so the test harness can run it
+//against a simulated link.
+
+class BitrateController
+{
+    int maxBitRate, minBitRate, audioBitRate;
+    int currentBitRate, lowestBitRate;
+
+    double highStrain, lowStrain;
+    int headroom;
+    DWORD rampDownInterval, rampUpInterval, holdTime;
+    int rampUpPercent;
+    int keyframeDropPercent;
+    bool bTrace;
+    bool bWantsKeyframe;
+
+    DWORD lastAdjustmentTime, lastDecreaseTime, calmStartTime;
+    DWORD lastFramesDropped;
+    UINT numDecreases, numIncreases;
+
+    UINT streamInfoID;
+
+    void SetBitRate(VideoEncoder *encoder, int newBitRate, CTSTR lpReason, double strain, DWORD estimate, bool bLinkLimited);
+
+public:
+    BitrateController(int maxBitRate, int audioBitRate);
+    ~BitrateController();
+
+    //call once a frame, returns true if the bitrate changed
+    bool Update(NetworkStream *network, VideoEncoder *encoder, DWORD curTime);
+
+    //set when the last change was a drop big enough that the caller should ask for a keyframe
+    inline bool WantsKeyframe() const {return bWantsKeyframe;}
+
+    inline int GetBitRate() const {return currentBitRate;}
+};
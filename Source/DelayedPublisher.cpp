@@ -21,7 +21,7 @@
 #include "RTMPStuff.h"
 #include "RTMPPublisher.h"
 
-NetworkStream* CreateRTMPPublisher();
+NetworkStream* CreateRTMPPublisher(PublisherHost *host);
 
 
 class DelayedPublisher : public RTMPPublisher
@@ -85,8 +85,8 @@ class DelayedPublisher : public RTMPPublisher
                     NetworkPacket &packet = delayedPackets[i];
                     if(packet.timestamp <= sendTime)
                     {
-                        RTMPPublisher::SendPacket(packet.data.Array(), packet.data.Num(), packet.timestamp, packet.type);
-                        packet.data.Clear();
+                        RTMPPublisher::SendPacket(packet.data, packet.timestamp, packet.type);
+                        packet.data->Release();
                         delayedPackets.Remove(i--);
                     }
                 }
@@ -95,7 +95,7 @@ class DelayedPublisher : public RTMPPublisher
     }
 
 public:
-    inline DelayedPublisher(DWORD delayTime) : RTMPPublisher()
+    inline DelayedPublisher(DWORD delayTime, PublisherHost *host) : RTMPPublisher(host)
     {
         this->delayTime = delayTime;
     }
@@ -151,15 +151,17 @@ public:
         }
 
         for(UINT i=0; i<delayedPackets.Num(); i++)
-            delayedPackets[i].data.Clear();
+            delayedPackets[i].data->Release();
     }
 
-    void SendPacket(BYTE *data, UINT size, DWORD timestamp, PacketType type)
+    void SendPacket(PacketBuffer *data, DWORD timestamp, PacketType type)
     {
         ProcessDelayedPackets(timestamp);
 
+        data->AddRef();
+
         NetworkPacket *newPacket = delayedPackets.CreateNew();
-        newPacket->data.CopyArray(data, size);
+        newPacket->data = data;
         newPacket->timestamp = timestamp;
         newPacket->type = type;
 
@@ -171,7 +173,7 @@ public:
 };
 
 
-NetworkStream* CreateDelayedPublisher(DWORD delayTime)
+NetworkStream* CreateDelayedPublisher(DWORD delayTime, PublisherHost *host)
 {
-    return new DelayedPublisher(delayTime*1000);
+    return new DelayedPublisher(delayTime*1000, host);
 }
@@ -24,7 +24,7 @@
 
 class FLVFileStream : public VideoFileStream
 {
-    XFileOutputSerializer fileOut;
+    XFileAsyncOutputSerializer fileOut;
     String strFile;
 
     UINT64 metaDataPos;
@@ -74,7 +74,10 @@ public:
         strFile = lpFile;
         initialTimestamp = -1;
 
-        if(!fileOut.Open(lpFile, XFILE_CREATEALWAYS, 1024*1024))
+        BOOL bUnbuffered = AppConfig->GetInt(TEXT("Publish"), TEXT("UnbufferedFileWrites")) != 0;
+        DWORD syncInterval = (DWORD)AppConfig->GetInt(TEXT("Publish"), TEXT("FileSyncInterval"));
+
+        if(!fileOut.Open(lpFile, XFILE_CREATEALWAYS, 1024*1024*2, 8, bUnbuffered, syncInterval))
             return false;
 
         fileOut.OutputByte('F');
@@ -103,6 +106,7 @@ public:
     {
         UINT64 fileSize = fileOut.GetPos();
         fileOut.Close();
+        fileOut.LogStats(TEXT("FLV file writer"));
 
         XFile file;
         if(file.Open(strFile, XFILE_WRITE, XFILE_OPENEXISTING))
@@ -0,0 +1,651 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "GifFrameCache.h"
+
+
+void *GFC_bitmap_create(int width, int height)          {return Allocate(width * height * 4);}
+void  GFC_bitmap_set_opaque(void *bitmap, BOOL opaque)  {}
+BOOL  GFC_bitmap_test_opaque(void *bitmap)              {return false;}
+unsigned char *GFC_bitmap_get_buffer(void *bitmap)      {return (unsigned char*)bitmap;}
+void GFC_bitmap_destroy(void *bitmap)                   {Free(bitmap);}
+void GFC_bitmap_modified(void *bitmap)                  {}
+
+
+struct GifCachedFrame
+{
+    LPBYTE data;
+    DWORD size;
+    bool bCompressed;
+    bool bFailed;
+    QWORD lastUsed;
+};
+
+//----------------------------------------------------------------------------
+
+//  run-length encoding of whole pixels.  each run starts with a DWORD header: with the top bit set, the
+//next pixel is repeated (header & 0x7FFFFFFF) times, otherwise that many literal pixels follow.  returns
+//the number of DWORDs written, or 0 if it wouldn't fit in maxOutput.
+
+static DWORD CompressFrame(const DWORD *pixels, UINT numPixels, DWORD *output, DWORD maxOutput)
+{
+    DWORD outPos = 0;
+    UINT i = 0;
+
+    while(i < numPixels)
+    {
+        UINT run = 1;
+        while(i+run < numPixels && pixels[i+run] == pixels[i])
+            run++;
+
+        if(run >= 3)
+        {
+            if(outPos+2 > maxOutput)
+                return 0;
+
+            output[outPos++] = 0x80000000 | run;
+            output[outPos++] = pixels[i];
+            i += run;
+        }
+        else
+        {
+            UINT start = i;
+            while(i < numPixels && !(i+2 < numPixels && pixels[i] == pixels[i+1] && pixels[i] == pixels[i+2]))
+                i++;
+
+            UINT count = i-start;
+            if(outPos+1+count > maxOutput)
+                return 0;
+
+            output[outPos++] = count;
+            mcpy(output+outPos, pixels+start, count*4);
+            outPos += count;
+        }
+    }
+
+    return outPos;
+}
+
+static void ExpandFrame(const DWORD *input, DWORD inputSize, DWORD *pixels)
+{
+    const DWORD *inputEnd = input+inputSize;
+
+    while(input < inputEnd)
+    {
+        DWORD header = *(input++);
+        DWORD count = header & 0x7FFFFFFF;
+
+        if(header & 0x80000000)
+        {
+            DWORD pixel = *(input++);
+            for(DWORD i=0; i<count; i++)
+                *(pixels++) = pixel;
+        }
+        else
+        {
+            mcpy(pixels, input, count*4);
+            pixels += count;
+            input += count;
+        }
+    }
+}
+
+//----------------------------------------------------------------------------
+
+class GifFrameCache
+{
+    HANDLE hMutex;
+    HANDLE hWorkerThread, hWorkEvent;
+    volatile bool bStopWorker;
+
+    List<GifAnimation*> animations;
+    gif_bitmap_callback_vt bitmapCallbacks;
+
+    QWORD budget;
+    bool bCompressFrames;
+
+    QWORD bytesUsed, useCounter;
+    List<DWORD> expandBuffer;
+
+    //stats, reset whenever the last animation is released
+    QWORD peakBytesUsed;
+    QWORD framesDecoded, framesStored, framesCompressed, framesEvicted;
+    QWORD framesShown, framesNotReady;
+    UINT numShared;
+
+    static DWORD STDCALL WorkerThread(GifFrameCache *cache);
+
+    void UpdateReadAhead();
+    inline bool InReadAhead(GifAnimation *animation, UINT frame) const
+    {
+        UINT numFrames = animation->frames.Num();
+        return ((frame + numFrames - animation->playFrame) % numFrames) < animation->readAhead;
+    }
+
+    bool FindWork(GifAnimation *&animation, UINT &frame);
+    void DecodeFrames(GifAnimation *animation, UINT frame);
+    void StoreFrame(GifAnimation *animation, UINT frame, const DWORD *pixels, bool bForce);
+    void EvictFrames(DWORD sizeNeeded);
+    void FreeFrame(GifCachedFrame &frame);
+    LPBYTE GetFramePixels(GifAnimation *animation, UINT frame);
+
+    void LogStats();
+
+public:
+    GifFrameCache();
+    ~GifFrameCache();
+
+    GifAnimation* Acquire(CTSTR lpFile);
+    void Release(GifAnimation *animation);
+
+    Texture* CreateFrameTexture(GifAnimation *animation);
+    bool UploadFrame(GifAnimation *animation, UINT frame, Texture *texture);
+};
+
+static GifFrameCache *gifCache = NULL;
+
+
+GifFrameCache::GifFrameCache()
+{
+    bitmapCallbacks.bitmap_create = GFC_bitmap_create;
+    bitmapCallbacks.bitmap_destroy = GFC_bitmap_destroy;
+    bitmapCallbacks.bitmap_get_buffer = GFC_bitmap_get_buffer;
+    bitmapCallbacks.bitmap_modified = GFC_bitmap_modified;
+    bitmapCallbacks.bitmap_set_opaque = GFC_bitmap_set_opaque;
+    bitmapCallbacks.bitmap_test_opaque = GFC_bitmap_test_opaque;
+
+    budget = QWORD(MAX(GlobalConfig->GetInt(TEXT("General"), TEXT("GifCacheSizeMB"), 256), 16)) * 1024 * 1024;
+    bCompressFrames = GlobalConfig->GetInt(TEXT("General"), TEXT("GifFrameCompression"), 1) != 0;
+
+    hMutex = OSCreateMutex();
+    hWorkEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    hWorkerThread = OSCreateThread((XTHREAD)GifFrameCache::WorkerThread, this);
+}
+
+GifFrameCache::~GifFrameCache()
+{
+    bStopWorker = true;
+    SetEvent(hWorkEvent);
+
+    OSWaitForThread(hWorkerThread, NULL);
+    OSCloseThread(hWorkerThread);
+
+    //anything left here was never released by its source
+    for(UINT i=0; i<animations.Num(); i++)
+    {
+        GifAnimation *animation = animations[i];
+        for(UINT j=0; j<animation->frames.Num(); j++)
+            FreeFrame(animation->frames[j]);
+        delete animation;
+    }
+    animations.Clear();
+
+    expandBuffer.Clear();
+
+    CloseHandle(hWorkEvent);
+    OSCloseMutex(hMutex);
+}
+
+DWORD STDCALL GifFrameCache::WorkerThread(GifFrameCache *cache)
+{
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+
+    while(WaitForSingleObject(cache->hWorkEvent, INFINITE) == WAIT_OBJECT_0 && !cache->bStopWorker)
+    {
+        GifAnimation *animation;
+        UINT frame;
+
+        while(!cache->bStopWorker && cache->FindWork(animation, frame))
+        {
+            cache->DecodeFrames(animation, frame);
+            cache->Release(animation);
+        }
+    }
+
+    return 0;
+}
+
+//  splits the budget evenly between the open animations, so the frames each one wants decoded ahead can
+//always be held at the same time and the worker never ends up evicting frames it's about to need again.
+//must be called with the mutex held.
+
+void GifFrameCache::UpdateReadAhead()
+{
+    if(!animations.Num())
+        return;
+
+    QWORD share = budget/animations.Num();
+
+    for(UINT i=0; i<animations.Num(); i++)
+    {
+        GifAnimation *animation = animations[i];
+        QWORD frameSize = MAX(QWORD(animation->width)*QWORD(animation->height)*4, 1);
+
+        animation->readAhead = (UINT)MIN(MAX(share/frameSize, 2), animation->frames.Num());
+    }
+}
+
+//finds the first frame at or after the play position of an animation that still needs decoding
+bool GifFrameCache::FindWork(GifAnimation *&animation, UINT &frame)
+{
+    bool bFound = false;
+
+    OSEnterMutex(hMutex);
+
+    for(UINT i=0; i<animations.Num() && !bFound; i++)
+    {
+        GifAnimation *curAnimation = animations[i];
+        UINT numFrames = curAnimation->frames.Num();
+
+        for(UINT j=0; j<curAnimation->readAhead; j++)
+        {
+            UINT curFrame = (curAnimation->playFrame+j) % numFrames;
+            GifCachedFrame &cachedFrame = curAnimation->frames[curFrame];
+
+            if(!cachedFrame.data && !cachedFrame.bFailed)
+            {
+                //held until the worker is done with it, so the source can't free it mid-decode
+                curAnimation->refs++;
+
+                animation = curAnimation;
+                frame = curFrame;
+                bFound = true;
+                break;
+            }
+        }
+    }
+
+    OSLeaveMutex(hMutex);
+
+    return bFound;
+}
+
+//  frames are drawn on top of the ones before them, so decoding has to go in order from the last frame
+//decoded, or start over from the beginning if the one wanted is behind it.  only the worker (and Acquire,
+//before anyone else can see the animation) ever touches the gif decoder.
+
+void GifFrameCache::DecodeFrames(GifAnimation *animation, UINT frame)
+{
+    int lastFrame = animation->lastDecodedFrame;
+    UINT firstFrame = (lastFrame < 0 || frame <= UINT(lastFrame)) ? 0 : UINT(lastFrame)+1;
+
+    for(UINT i=firstFrame; i<=frame && !bStopWorker; i++)
+    {
+        gif_result result = gif_decode_frame(&animation->gif, i);
+        animation->lastDecodedFrame = i;
+
+        if(result != GIF_OK)
+        {
+            Log(TEXT("GifFrameCache: Warning, couldn't decode frame %d of %s"), i, animation->strFile.Array());
+
+            OSEnterMutex(hMutex);
+            animation->frames[i].bFailed = true;
+            OSLeaveMutex(hMutex);
+            continue;
+        }
+
+        StoreFrame(animation, i, (const DWORD*)animation->gif.frame_image, false);
+    }
+}
+
+//stores a copy of a decoded frame if it's within the read ahead (or bForce), compressing it if that saves enough
+void GifFrameCache::StoreFrame(GifAnimation *animation, UINT frame, const DWORD *pixels, bool bForce)
+{
+    OSEnterMutex(hMutex);
+    framesDecoded++;
+    bool bWanted = !animation->frames[frame].data && (bForce || InReadAhead(animation, frame));
+    OSLeaveMutex(hMutex);
+
+    if(!bWanted)
+        return;
+
+    UINT numPixels = animation->width*animation->height;
+    DWORD rawSize = numPixels*4;
+
+    LPBYTE data = NULL;
+    DWORD size = 0;
+    bool bCompressed = false;
+
+    //only worth keeping compressed if it's at least a quarter smaller
+    if(bCompressFrames)
+    {
+        DWORD maxOutput = numPixels*3/4;
+        DWORD *compressed = (DWORD*)Allocate(maxOutput*4);
+
+        DWORD compressedSize = CompressFrame(pixels, numPixels, compressed, maxOutput);
+        if(compressedSize)
+        {
+            size = compressedSize*4;
+            data = (LPBYTE)Allocate(size);
+            mcpy(data, compressed, size);
+            bCompressed = true;
+        }
+
+        Free(compressed);
+    }
+
+    if(!data)
+    {
+        size = rawSize;
+        data = (LPBYTE)Allocate(size);
+        mcpy(data, pixels, size);
+    }
+
+    OSEnterMutex(hMutex);
+
+    GifCachedFrame &cachedFrame = animation->frames[frame];
+    if(cachedFrame.data)
+        Free(data);
+    else
+    {
+        EvictFrames(size);
+
+        cachedFrame.data = data;
+        cachedFrame.size = size;
+        cachedFrame.bCompressed = bCompressed;
+        cachedFrame.lastUsed = useCounter;
+
+        bytesUsed += size;
+        if(bytesUsed > peakBytesUsed)
+            peakBytesUsed = bytesUsed;
+
+        framesStored++;
+        if(bCompressed)
+            framesCompressed++;
+    }
+
+    OSLeaveMutex(hMutex);
+}
+
+//throws out the least recently shown frames that aren't in anyone's read ahead, must be called with the mutex held
+void GifFrameCache::EvictFrames(DWORD sizeNeeded)
+{
+    while(bytesUsed+sizeNeeded > budget)
+    {
+        GifCachedFrame *oldestFrame = NULL;
+
+        for(UINT i=0; i<animations.Num(); i++)
+        {
+            GifAnimation *animation = animations[i];
+
+            for(UINT j=0; j<animation->frames.Num(); j++)
+            {
+                GifCachedFrame &cachedFrame = animation->frames[j];
+                if(!cachedFrame.data || InReadAhead(animation, j))
+                    continue;
+
+                if(!oldestFrame || cachedFrame.lastUsed < oldestFrame->lastUsed)
+                    oldestFrame = &cachedFrame;
+            }
+        }
+
+        if(!oldestFrame)
+            break;
+
+        FreeFrame(*oldestFrame);
+        framesEvicted++;
+    }
+}
+
+void GifFrameCache::FreeFrame(GifCachedFrame &frame)
+{
+    if(frame.data)
+    {
+        Free(frame.data);
+        bytesUsed -= frame.size;
+
+        frame.data = NULL;
+        frame.size = 0;
+    }
+}
+
+//returns the frame's pixels, expanding it into a shared buffer if it's compressed.  must be called with the mutex held
+LPBYTE GifFrameCache::GetFramePixels(GifAnimation *animation, UINT frame)
+{
+    GifCachedFrame &cachedFrame = animation->frames[frame];
+    if(!cachedFrame.data)
+        return NULL;
+
+    cachedFrame.lastUsed = ++useCounter;
+
+    if(!cachedFrame.bCompressed)
+        return cachedFrame.data;
+
+    UINT numPixels = animation->width*animation->height;
+    if(expandBuffer.Num() < numPixels)
+        expandBuffer.SetSize(numPixels);
+
+    ExpandFrame((const DWORD*)cachedFrame.data, cachedFrame.size/4, expandBuffer.Array());
+    return (LPBYTE)expandBuffer.Array();
+}
+
+void GifFrameCache::LogStats()
+{
+    Log(TEXT("GifFrameCache - [budget: %llu MB] [peak: %g MB] [decoded: %llu] [stored: %llu, %llu compressed] [evicted: %llu] [shown: %llu] [not ready in time: %llu] [shared opens: %u]"),
+        budget/(1024*1024), double(peakBytesUsed)/(1024.0*1024.0), framesDecoded, framesStored, framesCompressed,
+        framesEvicted, framesShown, framesNotReady, numShared);
+}
+
+GifAnimation* GifFrameCache::Acquire(CTSTR lpFile)
+{
+    QWORD fileTime = OSGetFileModificationTime(lpFile);
+
+    OSEnterMutex(hMutex);
+
+    for(UINT i=0; i<animations.Num(); i++)
+    {
+        GifAnimation *animation = animations[i];
+        if(animation->bStale || !animation->strFile.CompareI(lpFile))
+            continue;
+
+        //anyone still using the old version of a changed file keeps it, but nobody else gets it
+        if(animation->fileTime != fileTime)
+        {
+            animation->bStale = true;
+            continue;
+        }
+
+        animation->refs++;
+        numShared++;
+
+        OSLeaveMutex(hMutex);
+        return animation;
+    }
+
+    OSLeaveMutex(hMutex);
+
+    //------------------------------------
+
+    XFile gifFile;
+    if(!gifFile.Open(lpFile, XFILE_READ, XFILE_OPENEXISTING))
+    {
+        AppWarning(TEXT("GifFrameCache::Acquire: could not open gif file '%s'"), lpFile);
+        return NULL;
+    }
+
+    GifAnimation *animation = new GifAnimation;
+    animation->strFile = lpFile;
+    animation->fileTime = fileTime;
+    animation->refs = 1;
+
+    gif_create(&animation->gif, &bitmapCallbacks);
+
+    DWORD fileSize = (DWORD)gifFile.GetFileSize();
+    animation->lpGifData = (LPBYTE)Allocate(fileSize);
+    gifFile.Read(animation->lpGifData, fileSize);
+    gifFile.Close();
+
+    gif_result result;
+    do
+    {
+        result = gif_initialise(&animation->gif, fileSize, animation->lpGifData);
+    }while(result == GIF_WORKING);
+
+    if(result != GIF_OK || animation->gif.frame_count <= 1)
+    {
+        delete animation;
+        return NULL;
+    }
+
+    animation->width  = animation->gif.width;
+    animation->height = animation->gif.height;
+
+    for(UINT i=0; i<animation->gif.frame_count; i++)
+    {
+        float frameTime = float(animation->gif.frames[i].frame_delay)*0.01f;
+        if (frameTime == 0.0f)
+            frameTime = 0.1f;
+        animation->frameTimes << frameTime;
+    }
+
+    animation->frames.SetSize(animation->gif.frame_count);
+    animation->lastDecodedFrame = -1;
+
+    //the first frame is needed right away for the texture, everything else gets decoded in the background
+    if(gif_decode_frame(&animation->gif, 0) == GIF_OK)
+    {
+        animation->lastDecodedFrame = 0;
+        StoreFrame(animation, 0, (const DWORD*)animation->gif.frame_image, true);
+    }
+    else
+    {
+        Log(TEXT("GifFrameCache: Warning, couldn't decode frame 0 of %s"), lpFile);
+        animation->frames[0].bFailed = true;
+    }
+
+    OSEnterMutex(hMutex);
+    animations << animation;
+    UpdateReadAhead();
+    OSLeaveMutex(hMutex);
+
+    SetEvent(hWorkEvent);
+
+    return animation;
+}
+
+void GifFrameCache::Release(GifAnimation *animation)
+{
+    OSEnterMutex(hMutex);
+
+    bool bDelete = (--animation->refs == 0);
+    if(bDelete)
+    {
+        for(UINT i=0; i<animation->frames.Num(); i++)
+            FreeFrame(animation->frames[i]);
+
+        animations.RemoveItem(animation);
+        UpdateReadAhead();
+
+        if(!animations.Num() && framesDecoded)
+        {
+            LogStats();
+
+            peakBytesUsed = 0;
+            framesDecoded = framesStored = framesCompressed = framesEvicted = 0;
+            framesShown = framesNotReady = 0;
+            numShared = 0;
+        }
+    }
+
+    OSLeaveMutex(hMutex);
+
+    if(bDelete)
+        delete animation;
+}
+
+Texture* GifFrameCache::CreateFrameTexture(GifAnimation *animation)
+{
+    Texture *texture = NULL;
+
+    OSEnterMutex(hMutex);
+
+    LPBYTE pixels = GetFramePixels(animation, 0);
+    if(pixels)
+        texture = CreateTexture(animation->width, animation->height, GS_RGBA, pixels, FALSE, FALSE);
+
+    OSLeaveMutex(hMutex);
+
+    return texture;
+}
+
+bool GifFrameCache::UploadFrame(GifAnimation *animation, UINT frame, Texture *texture)
+{
+    OSEnterMutex(hMutex);
+
+    bool bMoved = (animation->playFrame != frame);
+    animation->playFrame = frame;
+
+    LPBYTE pixels = GetFramePixels(animation, frame);
+    if(pixels)
+    {
+        texture->SetImage(pixels, GS_IMAGEFORMAT_RGBA, animation->width*4);
+        framesShown++;
+    }
+    else
+        framesNotReady++;
+
+    OSLeaveMutex(hMutex);
+
+    if(bMoved)
+        SetEvent(hWorkEvent);
+
+    return pixels != NULL;
+}
+
+//----------------------------------------------------------------------------
+
+GifAnimation::~GifAnimation()
+{
+    gif_finalise(&gif);
+
+    if(lpGifData)
+        Free(lpGifData);
+}
+
+Texture* GifAnimation::CreateFrameTexture()
+{
+    return gifCache->CreateFrameTexture(this);
+}
+
+bool GifAnimation::UploadFrame(UINT frame, Texture *texture)
+{
+    return gifCache->UploadFrame(this, frame, texture);
+}
+
+void InitGifFrameCache()
+{
+    gifCache = new GifFrameCache;
+}
+
+GifAnimation* AcquireGifAnimation(CTSTR lpFile)
+{
+    return gifCache->Acquire(lpFile);
+}
+
+void ReleaseGifAnimation(GifAnimation *animation)
+{
+    if(animation)
+        gifCache->Release(animation);
+}
+
+void DestroyGifFrameCache()
+{
+    delete gifCache;
+    gifCache = NULL;
+}
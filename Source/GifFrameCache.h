@@ -0,0 +1,75 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#pragma once
+
+#include "Main.h"
+#include "libnsgif.h"
+
+
+struct GifCachedFrame;
+
+//  a decoded animated gif, shared by every source that has the same file open.  frames are decoded in
+//order on the cache's worker thread a little ahead of wherever it's being played, and are stored either
+//as plain RGBA or run-length encoded.  all decoded frames from every animation count against one memory
+//budget ([General] GifCacheSizeMB in the global config), the least recently shown ones get thrown out
+//first and are decoded again if they're needed later.
+
+class GifAnimation
+{
+    friend class GifFrameCache;
+
+    String strFile;
+    QWORD fileTime;
+    bool bStale;
+    UINT refs;
+
+    gif_animation gif;
+    LPBYTE lpGifData;
+    int lastDecodedFrame;
+
+    UINT width, height;
+    List<float> frameTimes;
+    List<GifCachedFrame> frames;
+
+    UINT playFrame, readAhead;
+
+    GifAnimation() {}
+    ~GifAnimation();
+
+public:
+    inline UINT Width() const               {return width;}
+    inline UINT Height() const              {return height;}
+    inline UINT NumFrames() const           {return frameTimes.Num();}
+    inline float GetFrameTime(UINT frame)   {return frameTimes[frame];}
+    inline UINT GetLoopCount() const        {return (UINT)gif.loop_count;}
+
+    //only ever returns NULL for frame 0 if the first frame couldn't be decoded
+    Texture* CreateFrameTexture();
+
+    //returns false if the frame hasn't been decoded yet, and moves the decode position up to it
+    bool UploadFrame(UINT frame, Texture *texture);
+};
+
+void InitGifFrameCache();
+void DestroyGifFrameCache();
+
+//returns NULL if the file isn't an animated gif
+GifAnimation* AcquireGifAnimation(CTSTR lpFile);
+void ReleaseGifAnimation(GifAnimation *animation);
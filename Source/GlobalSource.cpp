@@ -153,6 +153,9 @@ ImageSource* OBS::AddGlobalSourceToScene(CTSTR lpName)
                     info->element = globalSourceElement;
                     info->source = newGlobalSource;
 
+                    ClassInfo *classInfo = GetImageSourceClass(lpClass);
+                    info->classFlags = classInfo ? classInfo->flags : 0;
+
                     info->source->BeginScene();
 
                     App->LeaveSceneMutex();
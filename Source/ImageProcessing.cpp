@@ -17,15 +17,46 @@
 ********************************************************************************/
 
 #include "Main.h"
+#include <intrin.h>
 
 
-void Convert444toI420(LPBYTE input, int width, int pitch, int height, int startY, int endY, LPBYTE *output)
+//implemented in ImageProcessingAVX2.cpp, they return how many columns they converted
+int Convert444toI420_AVX2(unsigned char *input, int width, int pitch, int startY, int endY, unsigned char **output);
+int Convert444toNV12_AVX2(unsigned char *input, int width, int inPitch, int outPitch, int startY, int endY, unsigned char **output);
+
+static bool HasAVX2Support()
+{
+    int cpuInfo[4];
+
+    __cpuid(cpuInfo, 0);
+    if(cpuInfo[0] < 7)
+        return false;
+
+    //needs AVX, and OSXSAVE plus the OS actually saving the YMM registers
+    __cpuid(cpuInfo, 1);
+    if((cpuInfo[2] & (1<<27)) == 0 || (cpuInfo[2] & (1<<28)) == 0)
+        return false;
+    if((_xgetbv(0) & 6) != 6)
+        return false;
+
+    __cpuidex(cpuInfo, 7, 0);
+    return (cpuInfo[1] & (1<<5)) != 0;
+}
+
+//not static so the converter benchmark in Tests can time the SSE2 path on an AVX2 machine
+bool bConvertWithAVX2 = HasAVX2Support();
+
+//  these take 4:4:4 input in the form of 32bit pixels where the first byte is U, the second is Y and the
+//third is V.  width and height must be even, the input doesn't need to be aligned.  columns from startX
+//onward are converted 4 pixels at a time with SSE2, and anything left over is done one 2x2 block at a time.
+
+static void Convert444toI420_SSE2(LPBYTE input, int startX, int width, int pitch, int startY, int endY, LPBYTE *output)
 {
-    profileSegment("Convert444toI420");
     LPBYTE lumPlane     = output[0];
     LPBYTE uPlane       = output[1];
     LPBYTE vPlane       = output[2];
     int  chrPitch       = width>>1;
+    int  alignedWidth   = startX + ((width-startX) & 0xFFFFFFFC);
 
     __m128i lumMask = _mm_set1_epi32(0x0000FF00);
     __m128i uvMask = _mm_set1_epi16(0x00FF);
@@ -36,15 +67,16 @@ void Convert444toI420(LPBYTE input, int width, int pitch, int height, int startY
         int chrYPos = ((y>>1)*chrPitch);
         int lumYPos = y*width;
 
-        for(int x=0; x<width; x+=4)
+        int x = startX;
+        for(; x<alignedWidth; x+=4)
         {
             LPBYTE lpImagePos = input+yPos+(x*4);
             int chrPos  = chrYPos + (x>>1);
             int lumPos0 = lumYPos + x;
             int lumPos1 = lumPos0+width;
 
-            __m128i line1 = _mm_load_si128((__m128i*)lpImagePos);
-            __m128i line2 = _mm_load_si128((__m128i*)(lpImagePos+pitch));
+            __m128i line1 = _mm_loadu_si128((__m128i*)lpImagePos);
+            __m128i line2 = _mm_loadu_si128((__m128i*)(lpImagePos+pitch));
 
             //pack lum vals
             {
@@ -69,14 +101,31 @@ void Convert444toI420(LPBYTE input, int width, int pitch, int height, int startY
                 *(LPWORD)(vPlane+chrPos) = WORD(packedVals>>16);
             }
         }
+
+        for(; x<width; x+=2)
+        {
+            LPBYTE line1 = input+yPos+(x*4);
+            LPBYTE line2 = line1+pitch;
+            int chrPos  = chrYPos + (x>>1);
+            int lumPos0 = lumYPos + x;
+            int lumPos1 = lumPos0+width;
+
+            lumPlane[lumPos0]   = line1[1];
+            lumPlane[lumPos0+1] = line1[5];
+            lumPlane[lumPos1]   = line2[1];
+            lumPlane[lumPos1+1] = line2[5];
+
+            uPlane[chrPos] = BYTE((line1[0]+line1[4]+line2[0]+line2[4])>>2);
+            vPlane[chrPos] = BYTE((line1[2]+line1[6]+line2[2]+line2[6])>>2);
+        }
     }
 }
 
-void Convert444toNV12(LPBYTE input, int width, int inPitch, int outPitch, int height, int startY, int endY, LPBYTE *output)
+static void Convert444toNV12_SSE2(LPBYTE input, int startX, int width, int inPitch, int outPitch, int startY, int endY, LPBYTE *output)
 {
-    profileSegment("Convert444toNV12");
     LPBYTE lumPlane     = output[0];
     LPBYTE uvPlane		= output[1];
+    int  alignedWidth   = startX + ((width-startX) & 0xFFFFFFFC);
 
     __m128i lumMask = _mm_set1_epi32(0x0000FF00);
     __m128i uvMask = _mm_set1_epi16(0x00FF);
@@ -87,15 +136,16 @@ void Convert444toNV12(LPBYTE input, int width, int inPitch, int outPitch, int he
         int uvYPos = (y>>1)*outPitch;
         int lumYPos = y*outPitch;
 
-        for(int x=0; x<width; x+=4)
+        int x = startX;
+        for(; x<alignedWidth; x+=4)
         {
             LPBYTE lpImagePos = input+yPos+(x*4);
             int uvPos  = uvYPos + x;
             int lumPos0 = lumYPos + x;
             int lumPos1 = lumPos0 + outPitch;
 
-            __m128i line1 = _mm_load_si128((__m128i*)lpImagePos);
-            __m128i line2 = _mm_load_si128((__m128i*)(lpImagePos+inPitch));
+            __m128i line1 = _mm_loadu_si128((__m128i*)lpImagePos);
+            __m128i line2 = _mm_loadu_si128((__m128i*)(lpImagePos+inPitch));
 
             //pack lum vals
             {
@@ -115,5 +165,46 @@ void Convert444toNV12(LPBYTE input, int width, int inPitch, int outPitch, int he
                 *(LPUINT)(uvPlane+uvPos) = _mm_packus_epi16(avgVal, avgVal).m128i_u32[0];
             }
         }
+
+        for(; x<width; x+=2)
+        {
+            LPBYTE line1 = input+yPos+(x*4);
+            LPBYTE line2 = line1+inPitch;
+            int uvPos  = uvYPos + x;
+            int lumPos0 = lumYPos + x;
+            int lumPos1 = lumPos0 + outPitch;
+
+            lumPlane[lumPos0]   = line1[1];
+            lumPlane[lumPos0+1] = line1[5];
+            lumPlane[lumPos1]   = line2[1];
+            lumPlane[lumPos1+1] = line2[5];
+
+            uvPlane[uvPos]   = BYTE((line1[0]+line1[4]+line2[0]+line2[4])>>2);
+            uvPlane[uvPos+1] = BYTE((line1[2]+line1[6]+line2[2]+line2[6])>>2);
+        }
     }
 }
+
+void Convert444toI420(LPBYTE input, int width, int pitch, int height, int startY, int endY, LPBYTE *output)
+{
+    profileSegment("Convert444toI420");
+
+    int startX = 0;
+    if(bConvertWithAVX2)
+        startX = Convert444toI420_AVX2(input, width, pitch, startY, endY, output);
+
+    if(startX < width)
+        Convert444toI420_SSE2(input, startX, width, pitch, startY, endY, output);
+}
+
+void Convert444toNV12(LPBYTE input, int width, int inPitch, int outPitch, int height, int startY, int endY, LPBYTE *output)
+{
+    profileSegment("Convert444toNV12");
+
+    int startX = 0;
+    if(bConvertWithAVX2)
+        startX = Convert444toNV12_AVX2(input, width, inPitch, outPitch, startY, endY, output);
+
+    if(startX < width)
+        Convert444toNV12_SSE2(input, startX, width, inPitch, outPitch, startY, endY, output);
+}
@@ -0,0 +1,131 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+//  this file is compiled with /arch:AVX2, so it must only ever be called after checking the cpu supports
+//it (see Convert444toNV12 in ImageProcessing.cpp).  it also deliberately doesn't include Main.h, because
+//any inline functions from the headers compiled here could end up being the ones the linker keeps.
+
+#include <immintrin.h>
+
+
+//  same math as the SSE2 versions, done on 8 pixels at a time.  the 256bit pack/shuffle instructions work on
+//each 128bit lane separately, so the results get put back together with a cross-lane permute afterward.
+
+int Convert444toI420_AVX2(unsigned char *input, int width, int pitch, int startY, int endY, unsigned char **output)
+{
+    unsigned char *lumPlane = output[0];
+    unsigned char *uPlane   = output[1];
+    unsigned char *vPlane   = output[2];
+    int chrPitch            = width>>1;
+    int alignedWidth        = width & 0xFFFFFFF8;
+
+    __m256i lumMask   = _mm256_set1_epi32(0x0000FF00);
+    __m256i uvMask    = _mm256_set1_epi16(0x00FF);
+    __m256i laneOrder = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    __m256i uvOrder   = _mm256_setr_epi8(0, 1, 4, 5, 2, 3, 6, 7, 8, 9, 12, 13, 10, 11, 14, 15,
+                                         0, 1, 4, 5, 2, 3, 6, 7, 8, 9, 12, 13, 10, 11, 14, 15);
+
+    for(int y=startY; y<endY; y+=2)
+    {
+        unsigned char *lpLine   = input+(y*pitch);
+        unsigned char *lumLine0 = lumPlane+(y*width);
+        unsigned char *lumLine1 = lumLine0+width;
+        int chrYPos             = (y>>1)*chrPitch;
+
+        for(int x=0; x<alignedWidth; x+=8)
+        {
+            __m256i line1 = _mm256_loadu_si256((__m256i*)(lpLine+(x*4)));
+            __m256i line2 = _mm256_loadu_si256((__m256i*)(lpLine+(x*4)+pitch));
+
+            //pack lum vals
+            {
+                __m256i packVal = _mm256_packs_epi32(_mm256_srli_si256(_mm256_and_si256(line1, lumMask), 1), _mm256_srli_si256(_mm256_and_si256(line2, lumMask), 1));
+                packVal = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(packVal, packVal), laneOrder);
+
+                __m128i lumVals = _mm256_castsi256_si128(packVal);
+                _mm_storel_epi64((__m128i*)(lumLine0+x), lumVals);
+                _mm_storel_epi64((__m128i*)(lumLine1+x), _mm_srli_si128(lumVals, 8));
+            }
+
+            //do average, pack UV vals
+            {
+                __m256i addVal = _mm256_add_epi16(_mm256_and_si256(line1, uvMask), _mm256_and_si256(line2, uvMask));
+                __m256i avgVal = _mm256_srai_epi16(_mm256_add_epi16(addVal, _mm256_shuffle_epi32(addVal, _MM_SHUFFLE(2, 3, 0, 1))), 2);
+                avgVal = _mm256_shuffle_epi32(avgVal, _MM_SHUFFLE(3, 1, 2, 0));
+                avgVal = _mm256_shufflelo_epi16(avgVal, _MM_SHUFFLE(3, 1, 2, 0));
+                avgVal = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(avgVal, avgVal), laneOrder);
+                avgVal = _mm256_shuffle_epi8(avgVal, uvOrder);
+
+                __m128i uvVals = _mm256_castsi256_si128(avgVal);
+                int chrPos = chrYPos + (x>>1);
+
+                *(int*)(uPlane+chrPos) = _mm_cvtsi128_si32(uvVals);
+                *(int*)(vPlane+chrPos) = _mm_cvtsi128_si32(_mm_srli_si128(uvVals, 4));
+            }
+        }
+    }
+
+    return alignedWidth;
+}
+
+int Convert444toNV12_AVX2(unsigned char *input, int width, int inPitch, int outPitch, int startY, int endY, unsigned char **output)
+{
+    unsigned char *lumPlane = output[0];
+    unsigned char *uvPlane  = output[1];
+    int alignedWidth        = width & 0xFFFFFFF8;
+
+    __m256i lumMask   = _mm256_set1_epi32(0x0000FF00);
+    __m256i uvMask    = _mm256_set1_epi16(0x00FF);
+    __m256i laneOrder = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+    for(int y=startY; y<endY; y+=2)
+    {
+        unsigned char *lpLine   = input+(y*inPitch);
+        unsigned char *lumLine0 = lumPlane+(y*outPitch);
+        unsigned char *lumLine1 = lumLine0+outPitch;
+        unsigned char *uvLine   = uvPlane+((y>>1)*outPitch);
+
+        for(int x=0; x<alignedWidth; x+=8)
+        {
+            __m256i line1 = _mm256_loadu_si256((__m256i*)(lpLine+(x*4)));
+            __m256i line2 = _mm256_loadu_si256((__m256i*)(lpLine+(x*4)+inPitch));
+
+            //pack lum vals
+            {
+                __m256i packVal = _mm256_packs_epi32(_mm256_srli_si256(_mm256_and_si256(line1, lumMask), 1), _mm256_srli_si256(_mm256_and_si256(line2, lumMask), 1));
+                packVal = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(packVal, packVal), laneOrder);
+
+                __m128i lumVals = _mm256_castsi256_si128(packVal);
+                _mm_storel_epi64((__m128i*)(lumLine0+x), lumVals);
+                _mm_storel_epi64((__m128i*)(lumLine1+x), _mm_srli_si128(lumVals, 8));
+            }
+
+            //do average, pack UV vals
+            {
+                __m256i addVal = _mm256_add_epi16(_mm256_and_si256(line1, uvMask), _mm256_and_si256(line2, uvMask));
+                __m256i avgVal = _mm256_srai_epi16(_mm256_add_epi16(addVal, _mm256_shuffle_epi32(addVal, _MM_SHUFFLE(2, 3, 0, 1))), 2);
+                avgVal = _mm256_shuffle_epi32(avgVal, _MM_SHUFFLE(3, 1, 2, 0));
+                avgVal = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(avgVal, avgVal), laneOrder);
+
+                _mm_storel_epi64((__m128i*)(uvLine+x), _mm256_castsi256_si128(avgVal));
+            }
+        }
+    }
+
+    return alignedWidth;
+}
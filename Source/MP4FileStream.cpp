@@ -18,6 +18,7 @@
 
 
 #include "Main.h"
+#include "MP4FileStream.h"
 #include <time.h>
 
 
@@ -53,11 +54,20 @@ struct MP4AudioFrameInfo
     UINT    timestamp;
 };
 
+struct MP4FragmentSample
+{
+    UINT    dataOffset; //offset within the fragment's video or audio data
+    UINT    size;
+    UINT    duration;
+    INT     compositionOffset;
+    bool    bKeyframe;
+};
+
 #define USE_64BIT_MP4 1
 
-inline UINT64 ConvertToAudioTime(DWORD timestamp, UINT64 minVal)
+inline UINT64 ConvertToAudioTime(DWORD timestamp, UINT sampleRateHz, UINT64 minVal)
 {
-    UINT val = UINT64(timestamp)*App->GetSampleRateHz()/1000;
+    UINT val = UINT64(timestamp)*sampleRateHz/1000;
     return MAX(val, minVal);
 }
 
@@ -66,7 +76,7 @@ inline UINT64 ConvertToAudioTime(DWORD timestamp, UINT64 minVal)
 
 class MP4FileStream : public VideoFileStream
 {
-    XFileOutputSerializer fileOut;
+    XFileAsyncOutputSerializer fileOut;
     String strFile;
 
     List<MP4VideoFrameInfo> videoFrames;
@@ -101,6 +111,24 @@ class MP4FileStream : public VideoFileStream
 
     bool bSentSEI;
 
+    //taken from the MP4StreamInfo when the file is opened
+    UINT sampleRateHz, frameTime;
+    UINT outputWidth, outputHeight;
+    int audioBitRate;
+    List<BYTE> videoHeaders, audioHeaders;
+    VideoEncoder *videoEncoder;
+
+    //fragmented mode: samples are buffered for one fragment at a time and written out as moof+mdat
+    bool bFragmented;
+    bool bWroteInitSegment;
+    DWORD fragmentDuration;
+    UINT fragmentSequence;
+    List<MP4FragmentSample> fragmentVideo, fragmentAudio;
+    List<BYTE> fragmentVideoData, fragmentAudioData;
+    UINT64 fragmentVideoStart, fragmentAudioStart;
+    UINT64 lastAudioDecodeTime, nextAudioDecodeTime;
+    UINT numFragmentedAudioFrames;
+
     void PushBox(BufferOutputSerializer &output, DWORD boxName)
     {
         boxOffsets.Insert(0, (UINT)output.GetPos());
@@ -143,13 +171,25 @@ class MP4FileStream : public VideoFileStream
     }
 
 public:
-    bool Init(CTSTR lpFile)
+    bool Init(CTSTR lpFile, const MP4StreamInfo &info)
     {
         strFile = lpFile;
 
         initialTimeStamp = -1;
 
-        if(!fileOut.Open(lpFile, XFILE_CREATEALWAYS, 1024*1024))
+        bFragmented = info.bFragmented;
+        fragmentDuration = info.fragmentDuration;
+
+        sampleRateHz = info.sampleRateHz;
+        frameTime = info.frameTime;
+        outputWidth = info.width;
+        outputHeight = info.height;
+        audioBitRate = info.audioBitRate;
+        videoHeaders.CopyArray(info.videoHeaders.lpPacket, info.videoHeaders.size);
+        audioHeaders.CopyArray(info.audioHeaders.lpPacket, info.audioHeaders.size);
+        videoEncoder = info.videoEncoder;
+
+        if(!fileOut.Open(lpFile, XFILE_CREATEALWAYS, 1024*1024*2, 8, info.bUnbufferedWrites, info.fileSyncInterval))
             return false;
 
         fileOut.OutputDword(DWORD_BE(0x20));
@@ -157,23 +197,27 @@ public:
         fileOut.OutputDword(DWORD_BE('isom'));
         fileOut.OutputDword(DWORD_BE(0x200));
         fileOut.OutputDword(DWORD_BE('isom'));
-        fileOut.OutputDword(DWORD_BE('iso2'));
+        fileOut.OutputDword(bFragmented ? DWORD_BE('iso6') : DWORD_BE('iso2'));
         fileOut.OutputDword(DWORD_BE('avc1'));
         fileOut.OutputDword(DWORD_BE('mp41'));
 
-        fileOut.OutputDword(DWORD_BE(0x8));
-        fileOut.OutputDword(DWORD_BE('free'));
+        //in fragmented mode the moov is written once the first keyframe arrives, followed by a moof+mdat per fragment
+        if(!bFragmented)
+        {
+            fileOut.OutputDword(DWORD_BE(0x8));
+            fileOut.OutputDword(DWORD_BE('free'));
 
-        mdatStart = fileOut.GetPos();
-        fileOut.OutputDword(DWORD_BE(0x1));
-        fileOut.OutputDword(DWORD_BE('mdat'));
+            mdatStart = fileOut.GetPos();
+            fileOut.OutputDword(DWORD_BE(0x1));
+            fileOut.OutputDword(DWORD_BE('mdat'));
 #ifdef USE_64BIT_MP4
-        fileOut.OutputQword(0);
+            fileOut.OutputQword(0);
 #endif
+        }
 
-        bMP3 = scmp(App->GetAudioEncoder()->GetCodec(), TEXT("MP3")) == 0;
+        bMP3 = scmp(info.lpAudioCodec, TEXT("MP3")) == 0;
 
-        audioFrameSize = App->GetAudioEncoder()->GetFrameSize();
+        audioFrameSize = info.audioFrameSize;
 
         bStreamOpened = true;
 
@@ -262,7 +306,7 @@ public:
             UINT64 newTimeVal = lastAudioTimeVal+audioFrameSize;
             if(audioFrames.Num() > 1)
             {
-                UINT64 convertedTime = ConvertToAudioTime(audioFrame.timestamp, audioFrameSize*audioFrames.Num());
+                UINT64 convertedTime = ConvertToAudioTime(audioFrame.timestamp, sampleRateHz, audioFrameSize*audioFrames.Num());
                 if(convertedTime > newTimeVal)
                     newTimeVal = convertedTime;
             }
@@ -282,32 +326,16 @@ public:
             audioDecodeTimes.Last().count++;
     }
 
-    ~MP4FileStream()
+    void BuildMoov(BufferOutputSerializer &output)
     {
-        if(!bStreamOpened)
-            return;
-
-        App->EnableSceneSwitching(false);
-
-        //---------------------------------------------------
-
-        //HWND hwndProgressDialog = CreateDialog(hinstMain, MAKEINTRESOURCE(IDD_BUILDINGMP4), hwndMain, (DLGPROC)MP4ProgressDialogProc);
-        //SendMessage(GetDlgItem(hwndProgressDialog, IDC_PROGRESS1), PBM_SETRANGE32, 0, 100);
-
-        mdatStop = fileOut.GetPos();
-
-        BufferOutputSerializer output(endBuffer);
-
-        //set a reasonable initial buffer size
-        endBuffer.SetSize((videoFrames.Num() + audioFrames.Num()) * 20 + 131072);
-
-        UINT64 audioFrameSize = App->GetAudioEncoder()->GetFrameSize();
-
         DWORD macTime = fastHtonl(DWORD(GetMacTime()));
-        UINT videoDuration = fastHtonl(lastVideoTimestamp + App->GetFrameTime());
-        UINT audioDuration = fastHtonl(lastVideoTimestamp + DWORD(double(audioFrameSize)*1000.0/double(App->GetSampleRateHz())));
-        UINT width, height;
-        App->GetOutputSize(width, height);
+        UINT videoDuration = 0, audioDuration = 0;
+        if(!bFragmented) //fragments carry their own timing, so the durations are left at 0 when fragmented
+        {
+            videoDuration = fastHtonl(lastVideoTimestamp + frameTime);
+            audioDuration = fastHtonl(lastVideoTimestamp + DWORD(double(audioFrameSize)*1000.0/double(sampleRateHz)));
+        }
+        UINT width = outputWidth, height = outputHeight;
 
         LPCSTR lpVideoTrack = "Video Media Handler";
         LPCSTR lpAudioTrack = "Sound Media Handler";
@@ -316,11 +344,9 @@ public:
 
         //-------------------------------------------
         // get video headers
-        DataPacket videoHeaders;
-        App->GetVideoHeaders(videoHeaders);
         List<BYTE> SPS, PPS;
 
-        LPBYTE lpHeaderData = videoHeaders.lpPacket+11;
+        LPBYTE lpHeaderData = videoHeaders.Array()+11;
         SPS.CopyArray(lpHeaderData+2, fastHtons(*(WORD*)lpHeaderData));
 
         lpHeaderData += SPS.Num()+3;
@@ -331,29 +357,18 @@ public:
         List<BYTE> AACHeader;
         if(!bMP3)
         {
-            DataPacket data;
-            App->GetAudioHeaders(data);
-            AACHeader.CopyArray(data.lpPacket+2, data.size-2);
+            AACHeader.CopyArray(audioHeaders.Array()+2, audioHeaders.Num()-2);
         }
 
         //-------------------------------------------
 
-        EndChunkInfo(videoChunks, videoSampleToChunk, curVideoChunkOffset, numVideoSamples);
-        EndChunkInfo(audioChunks, audioSampleToChunk, curAudioChunkOffset, numAudioSamples);
-
-        if (numVideoSamples > 1)
-            GetVideoDecodeTime(videoFrames.Last(), true);
-
-        if (numAudioSamples > 1)
-            GetAudioDecodeTime(audioFrames.Last(), true);
-
-        UINT audioUnitDuration = fastHtonl(UINT(lastAudioTimeVal));
+        UINT audioUnitDuration = bFragmented ? 0 : fastHtonl(UINT(lastAudioTimeVal));
 
         //SendMessage(GetDlgItem(hwndProgressDialog, IDC_PROGRESS1), PBM_SETPOS, 25, 0);
 
         //-------------------------------------------
         // sound descriptor thingy.  this part made me die a little inside admittedly.
-        UINT maxBitRate = fastHtonl(App->GetAudioEncoder()->GetBitRate()*1000);
+        UINT maxBitRate = fastHtonl(audioBitRate*1000);
 
         List<BYTE> esDecoderDescriptor;
         BufferOutputSerializer esDecoderOut(esDecoderDescriptor);
@@ -455,7 +470,7 @@ public:
                 output.OutputDword(0); //version and flags (none)
                 output.OutputDword(macTime); //creation time
                 output.OutputDword(macTime); //modified time
-                output.OutputDword(DWORD_BE(App->GetSampleRateHz())); //time scale
+                output.OutputDword(DWORD_BE(sampleRateHz)); //time scale
                 output.OutputDword(audioUnitDuration);
                 output.OutputDword(bMP3 ? DWORD_BE(0x55c40000) : DWORD_BE(0x15c70000));
               PopBox(output); //mdhd
@@ -497,7 +512,7 @@ public:
                       output.OutputWord(WORD_BE(16)); //sample size
                       output.OutputWord(0); //quicktime audio compression id
                       output.OutputWord(0); //quicktime audio packet size
-                      output.OutputDword(DWORD_BE(App->GetSampleRateHz()<<16)); //sample rate (fixed point)
+                      output.OutputDword(DWORD_BE(sampleRateHz<<16)); //sample rate (fixed point)
                       PushBox(output, DWORD_BE('esds'));
                         output.OutputDword(0); //version and flags (none)
                         output.OutputByte(3); //ES descriptor type
@@ -694,17 +709,20 @@ public:
                         output.Serialize(IFrameIDs.Array(), IFrameIDs.Num()*sizeof(UINT));
                       PopBox(output); //stss
                   }
-                  PushBox(output, DWORD_BE('ctts')); //list of composition time offsets
-                    output.OutputDword(0); //version (0) and flags (none)
-                    //output.OutputDword(DWORD_BE(0x01000000)); //version (1) and flags (none)
+                  if (!bFragmented)
+                  {
+                      PushBox(output, DWORD_BE('ctts')); //list of composition time offsets
+                        output.OutputDword(0); //version (0) and flags (none)
+                        //output.OutputDword(DWORD_BE(0x01000000)); //version (1) and flags (none)
 
-                    output.OutputDword(fastHtonl(compositionOffsets.Num()));
-                    for(UINT i=0; i<compositionOffsets.Num(); i++)
-                    {
-                        output.OutputDword(fastHtonl(compositionOffsets[i].count));
-                        output.OutputDword(fastHtonl(compositionOffsets[i].val));
-                    }
-                  PopBox(output); //ctts
+                        output.OutputDword(fastHtonl(compositionOffsets.Num()));
+                        for(UINT i=0; i<compositionOffsets.Num(); i++)
+                        {
+                            output.OutputDword(fastHtonl(compositionOffsets[i].count));
+                            output.OutputDword(fastHtonl(compositionOffsets[i].val));
+                        }
+                      PopBox(output); //ctts
+                  }
 
                   //SendMessage(GetDlgItem(hwndProgressDialog, IDC_PROGRESS1), PBM_SETPOS, 70, 0);
                   //ProcessEvents();
@@ -754,6 +772,30 @@ public:
           //SendMessage(GetDlgItem(hwndProgressDialog, IDC_PROGRESS1), PBM_SETPOS, 80, 0);
           //ProcessEvents();
 
+          //------------------------------------------------------
+          // fragment defaults (the sample tables above are empty when fragmented)
+          if(bFragmented)
+          {
+              PushBox(output, DWORD_BE('mvex'));
+                PushBox(output, DWORD_BE('trex'));
+                  output.OutputDword(0); //version and flags (none)
+                  output.OutputDword(DWORD_BE(1)); //track ID
+                  output.OutputDword(DWORD_BE(1)); //default sample description index
+                  output.OutputDword(0); //default sample duration
+                  output.OutputDword(0); //default sample size
+                  output.OutputDword(0); //default sample flags
+                PopBox(output); //trex
+                PushBox(output, DWORD_BE('trex'));
+                  output.OutputDword(0); //version and flags (none)
+                  output.OutputDword(DWORD_BE(2)); //track ID
+                  output.OutputDword(DWORD_BE(1)); //default sample description index
+                  output.OutputDword(0); //default sample duration
+                  output.OutputDword(0); //default sample size
+                  output.OutputDword(DWORD_BE(0x01010000)); //default sample flags (depends on others, non-sync)
+                PopBox(output); //trex
+              PopBox(output); //mvex
+          }
+
           //------------------------------------------------------
           // info thingy
           PushBox(output, DWORD_BE('udta'));
@@ -782,9 +824,57 @@ public:
           PopBox(output); //udta
 
         PopBox(output); //moov
+    }
+
+    ~MP4FileStream()
+    {
+        if(!bStreamOpened)
+            return;
+
+        if(bFragmented)
+        {
+            //everything but the last fragment is already in the file, so there's no moov to build
+            if(bWroteInitSegment)
+            {
+                if(fragmentVideo.Num())
+                    fragmentVideo.Last().duration = (fragmentVideo.Num() > 1) ? fragmentVideo[fragmentVideo.Num()-2].duration : frameTime;
+
+                FlushFragment();
+            }
+
+            fileOut.Close();
+            fileOut.LogStats(TEXT("MP4 file writer"));
+            return;
+        }
+
+        App->EnableSceneSwitching(false);
+
+        //---------------------------------------------------
+
+        //HWND hwndProgressDialog = CreateDialog(hinstMain, MAKEINTRESOURCE(IDD_BUILDINGMP4), hwndMain, (DLGPROC)MP4ProgressDialogProc);
+        //SendMessage(GetDlgItem(hwndProgressDialog, IDC_PROGRESS1), PBM_SETRANGE32, 0, 100);
+
+        mdatStop = fileOut.GetPos();
+
+        BufferOutputSerializer output(endBuffer);
+
+        //set a reasonable initial buffer size
+        endBuffer.SetSize((videoFrames.Num() + audioFrames.Num()) * 20 + 131072);
+
+        EndChunkInfo(videoChunks, videoSampleToChunk, curVideoChunkOffset, numVideoSamples);
+        EndChunkInfo(audioChunks, audioSampleToChunk, curAudioChunkOffset, numAudioSamples);
+
+        if (numVideoSamples > 1)
+            GetVideoDecodeTime(videoFrames.Last(), true);
+
+        if (numAudioSamples > 1)
+            GetAudioDecodeTime(audioFrames.Last(), true);
+
+        BuildMoov(output);
 
         fileOut.Serialize(endBuffer.Array(), (DWORD)output.GetPos());
         fileOut.Close();
+        fileOut.LogStats(TEXT("MP4 file writer"));
 
         XFile file;
         if(file.Open(strFile, XFILE_WRITE, XFILE_OPENEXISTING))
@@ -807,6 +897,237 @@ public:
         //DestroyWindow(hwndProgressDialog);
     }
 
+    static INT GetCompositionOffset(BYTE *data)
+    {
+        INT timeOffset = 0;
+        mcpy(((BYTE*)&timeOffset)+1, data+2, 3);
+        if(data[2] >= 0x80)
+            timeOffset |= 0xFF;
+        return (INT)fastHtonl(DWORD(timeOffset));
+    }
+
+    //converts an flv video packet to length-prefixed NALs, returns the number of bytes written
+    UINT WriteVideoData(Serializer &out, BYTE *data, UINT size)
+    {
+        UINT totalCopied = 0;
+
+        if(data[0] == 0x17 && data[1] == 0) //if SPS/PPS
+        {
+            LPBYTE lpData = data+11;
+
+            UINT spsSize = fastHtons(*(WORD*)lpData);
+            out.OutputWord(0);
+            out.Serialize(lpData, spsSize+2);
+
+            lpData += spsSize+3;
+
+            UINT ppsSize = fastHtons(*(WORD*)lpData);
+            out.OutputWord(0);
+            out.Serialize(lpData, ppsSize+2);
+
+            totalCopied = spsSize+ppsSize+8;
+        }
+        else
+        {
+            if (!bSentSEI && videoEncoder) {
+                DataPacket sei;
+                videoEncoder->GetSEI(sei);
+
+                if (sei.size > 0)
+                {
+                    out.Serialize(sei.lpPacket, sei.size);
+                    totalCopied += sei.size;
+
+                    bSentSEI = true;
+                }
+            }
+
+            totalCopied += size-5;
+            out.Serialize(data+5, size-5);
+        }
+
+        return totalCopied;
+    }
+
+    //------------------------------------------------------
+    // fragmented mode
+
+    void WriteInitSegment()
+    {
+        BufferOutputSerializer output(endBuffer, FALSE);
+        BuildMoov(output);
+
+        fileOut.Serialize(endBuffer.Array(), (DWORD)output.GetPos());
+        fileOut.Flush();
+
+        bWroteInitSegment = true;
+    }
+
+    void FlushFragment()
+    {
+        if(!fragmentVideo.Num() && !fragmentAudio.Num())
+            return;
+
+        BufferOutputSerializer output(endBuffer, FALSE);
+        UINT videoDataOffsetPos = 0, audioDataOffsetPos = 0;
+
+        PushBox(output, DWORD_BE('moof'));
+          PushBox(output, DWORD_BE('mfhd'));
+            output.OutputDword(0); //version and flags (none)
+            output.OutputDword(fastHtonl(++fragmentSequence)); //sequence number
+          PopBox(output); //mfhd
+
+          if(fragmentVideo.Num())
+          {
+              PushBox(output, DWORD_BE('traf'));
+                PushBox(output, DWORD_BE('tfhd'));
+                  output.OutputDword(DWORD_BE(0x00020000)); //version (0) and flags (data offsets are relative to the moof)
+                  output.OutputDword(DWORD_BE(2)); //track ID
+                PopBox(output); //tfhd
+                PushBox(output, DWORD_BE('tfdt'));
+                  output.OutputDword(DWORD_BE(0x01000000)); //version (1) and flags (none)
+                  output.OutputQword(fastHtonll(fragmentVideoStart)); //decode time of the first sample
+                PopBox(output); //tfdt
+                PushBox(output, DWORD_BE('trun'));
+                  output.OutputDword(DWORD_BE(0x00000F01)); //version (0) and flags (data offset, sample durations, sizes, flags, composition offsets)
+                  output.OutputDword(fastHtonl(fragmentVideo.Num())); //sample count
+                  videoDataOffsetPos = (UINT)output.GetPos();
+                  output.OutputDword(0); //data offset, set once the size of the moof is known
+                  for(UINT i=0; i<fragmentVideo.Num(); i++)
+                  {
+                      MP4FragmentSample &sample = fragmentVideo[i];
+                      output.OutputDword(fastHtonl(sample.duration));
+                      output.OutputDword(fastHtonl(sample.size));
+                      output.OutputDword(sample.bKeyframe ? DWORD_BE(0x02000000) : DWORD_BE(0x01010000)); //sample flags
+                      output.OutputDword(fastHtonl((DWORD)sample.compositionOffset));
+                  }
+                PopBox(output); //trun
+              PopBox(output); //traf
+          }
+
+          if(fragmentAudio.Num())
+          {
+              PushBox(output, DWORD_BE('traf'));
+                PushBox(output, DWORD_BE('tfhd'));
+                  output.OutputDword(DWORD_BE(0x00020000)); //version (0) and flags (data offsets are relative to the moof)
+                  output.OutputDword(DWORD_BE(1)); //track ID
+                PopBox(output); //tfhd
+                PushBox(output, DWORD_BE('tfdt'));
+                  output.OutputDword(DWORD_BE(0x01000000)); //version (1) and flags (none)
+                  output.OutputQword(fastHtonll(fragmentAudioStart)); //decode time of the first sample
+                PopBox(output); //tfdt
+                PushBox(output, DWORD_BE('trun'));
+                  output.OutputDword(DWORD_BE(0x00000301)); //version (0) and flags (data offset, sample durations, sizes)
+                  output.OutputDword(fastHtonl(fragmentAudio.Num())); //sample count
+                  audioDataOffsetPos = (UINT)output.GetPos();
+                  output.OutputDword(0); //data offset, set once the size of the moof is known
+                  for(UINT i=0; i<fragmentAudio.Num(); i++)
+                  {
+                      MP4FragmentSample &sample = fragmentAudio[i];
+                      output.OutputDword(fastHtonl(sample.duration));
+                      output.OutputDword(fastHtonl(sample.size));
+                  }
+                PopBox(output); //trun
+              PopBox(output); //traf
+          }
+        PopBox(output); //moof
+
+        //video data goes first in the mdat, followed by the audio data
+        UINT moofSize = (UINT)output.GetPos();
+        if(fragmentVideo.Num())
+            *(DWORD*)(endBuffer.Array()+videoDataOffsetPos) = fastHtonl(moofSize+8);
+        if(fragmentAudio.Num())
+            *(DWORD*)(endBuffer.Array()+audioDataOffsetPos) = fastHtonl(moofSize+8+fragmentVideoData.Num());
+
+        output.OutputDword(fastHtonl(8+fragmentVideoData.Num()+fragmentAudioData.Num()));
+        output.OutputDword(DWORD_BE('mdat'));
+
+        fileOut.Serialize(endBuffer.Array(), (DWORD)output.GetPos());
+        if(fragmentVideoData.Num())
+            fileOut.Serialize(fragmentVideoData.Array(), fragmentVideoData.Num());
+        if(fragmentAudioData.Num())
+            fileOut.Serialize(fragmentAudioData.Array(), fragmentAudioData.Num());
+
+        //keep the file playable up to the last complete fragment
+        fileOut.Flush();
+
+        fragmentVideo.Clear();
+        fragmentAudio.Clear();
+        fragmentVideoData.Clear();
+        fragmentAudioData.Clear();
+    }
+
+    void AddFragmentedPacket(BYTE *data, UINT size, DWORD timestamp, PacketType type)
+    {
+        if(!bWroteInitSegment)
+            WriteInitSegment();
+
+        if(type == PacketType_Audio)
+        {
+            UINT headerSize = bMP3 ? 1 : 2;
+
+            //same as GetAudioDecodeTime: frames are back to back unless the timestamps say there's a gap
+            UINT64 decodeTime = nextAudioDecodeTime;
+            if(numFragmentedAudioFrames > 1)
+            {
+                UINT64 convertedTime = ConvertToAudioTime(timestamp, sampleRateHz, audioFrameSize*numFragmentedAudioFrames);
+                if(convertedTime > decodeTime)
+                    decodeTime = convertedTime;
+            }
+
+            if(fragmentAudio.Num())
+                fragmentAudio.Last().duration = UINT(decodeTime-lastAudioDecodeTime);
+            else
+                fragmentAudioStart = decodeTime;
+
+            MP4FragmentSample sample;
+            sample.size              = size-headerSize;
+            sample.duration          = (UINT)audioFrameSize;
+            sample.compositionOffset = 0;
+            sample.bKeyframe         = true;
+            fragmentAudio << sample;
+
+            fragmentAudioData.AppendArray(data+headerSize, size-headerSize);
+
+            lastAudioDecodeTime = decodeTime;
+            nextAudioDecodeTime = decodeTime+audioFrameSize;
+            numFragmentedAudioFrames++;
+        }
+        else
+        {
+            bool bNewFrame = !fragmentVideo.Num() || timestamp != lastVideoTimestamp;
+
+            if(bNewFrame && fragmentVideo.Num())
+            {
+                fragmentVideo.Last().duration = timestamp-lastVideoTimestamp;
+
+                //only start new fragments on keyframes so each one can be decoded on its own
+                if(data[0] == 0x17 && (timestamp-fragmentVideoStart) >= fragmentDuration)
+                    FlushFragment();
+            }
+
+            BufferOutputSerializer dataOut(fragmentVideoData);
+            UINT totalCopied = WriteVideoData(dataOut, data, size);
+
+            if(bNewFrame)
+            {
+                if(!fragmentVideo.Num())
+                    fragmentVideoStart = timestamp;
+
+                MP4FragmentSample sample;
+                sample.size              = totalCopied;
+                sample.duration          = frameTime;
+                sample.compositionOffset = GetCompositionOffset(data);
+                sample.bKeyframe         = (data[0] == 0x17);
+                fragmentVideo << sample;
+            }
+            else
+                fragmentVideo.Last().size += totalCopied;
+
+            lastVideoTimestamp = timestamp;
+        }
+    }
+
     virtual void AddPacket(BYTE *data, UINT size, DWORD timestamp, PacketType type)
     {
         UINT64 offset = fileOut.GetPos();
@@ -817,6 +1138,12 @@ public:
             initialTimeStamp = timestamp;
         }
 
+        if(bFragmented)
+        {
+            AddFragmentedPacket(data, size, timestamp-initialTimeStamp, type);
+            return;
+        }
+
         if(type == PacketType_Audio)
         {
             UINT copySize;
@@ -847,51 +1174,10 @@ public:
         }
         else
         {
-            UINT totalCopied = 0;
-
-            if(data[0] == 0x17 && data[1] == 0) //if SPS/PPS
-            {
-                LPBYTE lpData = data+11;
-
-                UINT spsSize = fastHtons(*(WORD*)lpData);
-                fileOut.OutputWord(0);
-                fileOut.Serialize(lpData, spsSize+2);
-
-                lpData += spsSize+3;
-
-                UINT ppsSize = fastHtons(*(WORD*)lpData);
-                fileOut.OutputWord(0);
-                fileOut.Serialize(lpData, ppsSize+2);
-
-                totalCopied = spsSize+ppsSize+8;
-            }
-            else
-            {
-                if (!bSentSEI) {
-                    DataPacket sei;
-                    App->GetVideoEncoder()->GetSEI(sei);
-
-                    if (sei.size > 0)
-                    {
-                        fileOut.Serialize(sei.lpPacket, sei.size);
-                        totalCopied += sei.size;
-
-                        bSentSEI = true;
-                    }
-                }
-
-                totalCopied += size-5;
-                fileOut.Serialize(data+5, size-5);
-            }
+            UINT totalCopied = WriteVideoData(fileOut, data, size);
 
             if(!videoFrames.Num() || (timestamp-initialTimeStamp) != lastVideoTimestamp)
             {
-                INT timeOffset = 0;
-                mcpy(((BYTE*)&timeOffset)+1, data+2, 3);
-                if(data[2] >= 0x80)
-                    timeOffset |= 0xFF;
-                timeOffset = (INT)fastHtonl(DWORD(timeOffset));
-
                 if(data[0] == 0x17) //i-frame
                     IFrameIDs << fastHtonl(videoFrames.Num()+1);
 
@@ -899,7 +1185,7 @@ public:
                 frameInfo.fileOffset        = offset;
                 frameInfo.size              = totalCopied;
                 frameInfo.timestamp         = timestamp-initialTimeStamp;
-                frameInfo.compositionOffset = timeOffset;
+                frameInfo.compositionOffset = GetCompositionOffset(data);
 
                 GetChunkInfo<MP4VideoFrameInfo>(frameInfo, videoFrames.Num(), videoChunks, videoSampleToChunk,
                                                 curVideoChunkOffset, connectedVideoSampleOffset, numVideoSamples);
@@ -918,12 +1204,38 @@ public:
 };
 
 
-VideoFileStream* CreateMP4FileStream(CTSTR lpFile)
+VideoFileStream* CreateMP4FileStream(CTSTR lpFile, const MP4StreamInfo &info)
 {
     MP4FileStream *fileStream = new MP4FileStream;
-    if(fileStream->Init(lpFile))
+    if(fileStream->Init(lpFile, info))
         return fileStream;
 
     delete fileStream;
     return NULL;
 }
+
+VideoFileStream* CreateMP4FileStream(CTSTR lpFile)
+{
+    MP4StreamInfo info;
+    zero(&info, sizeof(info));
+
+    info.sampleRateHz = App->GetSampleRateHz();
+    info.frameTime = App->GetFrameTime();
+    App->GetOutputSize(info.width, info.height);
+
+    info.lpAudioCodec = App->GetAudioEncoder()->GetCodec();
+    info.audioFrameSize = App->GetAudioEncoder()->GetFrameSize();
+    info.audioBitRate = App->GetAudioEncoder()->GetBitRate();
+
+    App->GetVideoHeaders(info.videoHeaders);
+    if(scmp(info.lpAudioCodec, TEXT("MP3")) != 0)
+        App->GetAudioHeaders(info.audioHeaders);
+    info.videoEncoder = App->GetVideoEncoder();
+
+    info.bFragmented = AppConfig->GetInt(TEXT("Publish"), TEXT("FragmentedMP4")) != 0;
+    info.fragmentDuration = (DWORD)AppConfig->GetInt(TEXT("Publish"), TEXT("MP4FragmentDuration"), 2000);
+    info.bUnbufferedWrites = AppConfig->GetInt(TEXT("Publish"), TEXT("UnbufferedFileWrites")) != 0;
+    info.fileSyncInterval = (DWORD)AppConfig->GetInt(TEXT("Publish"), TEXT("FileSyncInterval"));
+
+    return CreateMP4FileStream(lpFile, info);
+}
@@ -0,0 +1,47 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+//  what the MP4 muxer takes from the app and the encoders.  CreateMP4FileStream(lpFile)
+//fills it in from App and AppConfig, the muxer test fills it in with synthetic streams.
+//the header packets only need to stay valid until CreateMP4FileStream returns.
+
+struct MP4StreamInfo
+{
+    UINT    sampleRateHz;
+    UINT    frameTime;
+    UINT    width, height;
+
+    CTSTR   lpAudioCodec;
+    UINT    audioFrameSize;
+    int     audioBitRate;
+
+    DataPacket videoHeaders, audioHeaders;
+    VideoEncoder *videoEncoder;     //asked for the SEI that goes in front of the first frame
+
+    bool    bFragmented;
+    DWORD   fragmentDuration;
+    bool    bUnbufferedWrites;
+    DWORD   fileSyncInterval;
+};
+
+VideoFileStream* CreateMP4FileStream(CTSTR lpFile);
+VideoFileStream* CreateMP4FileStream(CTSTR lpFile, const MP4StreamInfo &info);
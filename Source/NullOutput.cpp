@@ -45,7 +45,7 @@ public:
 
 class NullNetwork : public NetworkStream
 {
-    virtual void SendPacket(BYTE *data, UINT size, DWORD timestamp, PacketType type) {bytesSent += size;framesRendered++;}
+    virtual void SendPacket(PacketBuffer *packet, DWORD timestamp, PacketType type) {bytesSent += packet->Size();framesRendered++;}
 
     double GetPacketStrain() const {return 0;}
     QWORD GetCurrentSentBytes() {return bytesSent;}
@@ -25,6 +25,7 @@
 
 typedef bool (*LOADPLUGINPROC)();
 typedef bool (*LOADPLUGINEXPROC)(UINT);
+typedef UINT (*GETPLUGINAPIVERSIONPROC)();
 typedef void (*UNLOADPLUGINPROC)();
 typedef CTSTR (*GETPLUGINNAMEPROC)();
 
@@ -39,6 +40,9 @@ bool STDCALL ConfigureBitmapSource(XElement *element, bool bCreating);
 ImageSource* STDCALL CreateBitmapTransitionSource(XElement *data);
 bool STDCALL ConfigureBitmapTransitionSource(XElement *element, bool bCreating);
 
+void InitGifFrameCache();
+void DestroyGifFrameCache();
+
 ImageSource* STDCALL CreateTextSource(XElement *data);
 bool STDCALL ConfigureTextSource(XElement *element, bool bCreating);
 
@@ -132,6 +136,7 @@ OBS::OBS()
     hSceneMutex = OSCreateMutex();
     hAuxAudioMutex = OSCreateMutex();
     hVideoEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    hAudioEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
 
     monitors.Clear();
     EnumDisplayMonitors(NULL, NULL, (MONITORENUMPROC)MonitorInfoEnumProc, (LPARAM)&monitors);
@@ -166,15 +171,17 @@ OBS::OBS()
     //-----------------------------------------------------
     // load classes
 
+    InitGifFrameCache();
+
     RegisterSceneClass(TEXT("Scene"), Str("Scene"), (OBSCREATEPROC)CreateNormalScene, NULL, false);
     RegisterImageSourceClass(TEXT("DesktopImageSource"), Str("Sources.SoftwareCaptureSource"), (OBSCREATEPROC)CreateDesktopSource, (OBSCONFIGPROC)ConfigureDesktopSource, true);
     RegisterImageSourceClass(TEXT("WindowCaptureSource"), Str("Sources.SoftwareCaptureSource.WindowCapture"), (OBSCREATEPROC)CreateDesktopSource, (OBSCONFIGPROC)ConfigureWindowCaptureSource, false);
     RegisterImageSourceClass(TEXT("MonitorCaptureSource"), Str("Sources.SoftwareCaptureSource.MonitorCapture"), (OBSCREATEPROC)CreateDesktopSource, (OBSCONFIGPROC)ConfigureMonitorCaptureSource, false);
-    RegisterImageSourceClass(TEXT("BitmapImageSource"), Str("Sources.BitmapSource"), (OBSCREATEPROC)CreateBitmapSource, (OBSCONFIGPROC)ConfigureBitmapSource, false);
+    RegisterImageSourceClass(TEXT("BitmapImageSource"), Str("Sources.BitmapSource"), (OBSCREATEPROC)CreateBitmapSource, (OBSCONFIGPROC)ConfigureBitmapSource, false, IMAGESOURCE_THREADSAFE_TICK);
     RegisterImageSourceClass(TEXT("BitmapTransitionSource"), Str("Sources.TransitionSource"), (OBSCREATEPROC)CreateBitmapTransitionSource, (OBSCONFIGPROC)ConfigureBitmapTransitionSource, false);
     RegisterImageSourceClass(TEXT("GlobalSource"), Str("Sources.GlobalSource"), (OBSCREATEPROC)CreateGlobalSource, (OBSCONFIGPROC)OBS::ConfigGlobalSource, false);
 
-    RegisterImageSourceClass(TEXT("TextSource"), Str("Sources.TextSource"), (OBSCREATEPROC)CreateTextSource, (OBSCONFIGPROC)ConfigureTextSource, false);
+    RegisterImageSourceClass(TEXT("TextSource"), Str("Sources.TextSource"), (OBSCREATEPROC)CreateTextSource, (OBSCONFIGPROC)ConfigureTextSource, false, IMAGESOURCE_THREADSAFE_TICK);
 
     //-----------------------------------------------------
     // render frame class
@@ -687,6 +694,18 @@ OBS::OBS()
                 HMODULE hPlugin = LoadLibrary(strLocation);
                 if(hPlugin)
                 {
+                    //a plugin built against another major API version has List and everything else it
+                    //compiles inline laid out differently, so it can't even be initialized
+                    GETPLUGINAPIVERSIONPROC getAPIVersion = (GETPLUGINAPIVERSIONPROC)GetProcAddress(hPlugin, "GetPluginAPIVersion");
+                    UINT pluginAPIVersion = getAPIVersion ? getAPIVersion() : 0;
+
+                    if ((pluginAPIVersion >> 8) != (OBSGetAPIVersion() >> 8)) {
+                        Log(TEXT("Not loading plugin %s, it was built against API version 0x%04x and OBS is at 0x%04x"),
+                            strLocation.Array(), pluginAPIVersion, OBSGetAPIVersion());
+                        FreeLibrary(hPlugin);
+                        continue;
+                    }
+
                     bool bLoaded = false;
 
                     //slightly redundant I suppose seeing as both these things are being added at the same time
@@ -784,6 +803,8 @@ OBS::~OBS()
         ZeroMemory(&pluginInfo, sizeof(pluginInfo));
     }
 
+    DestroyGifFrameCache();
+
     if (AppConfig->GetInt(TEXT("General"), TEXT("ShowNotificationAreaIcon"), 0) != 0)
     {
         App->HideNotificationAreaIcon();
@@ -844,6 +865,9 @@ OBS::~OBS()
     if (hVideoEvent)
         CloseHandle(hVideoEvent);
 
+    if (hAudioEvent)
+        CloseHandle(hAudioEvent);
+
     if(hSceneMutex)
         OSCloseMutex(hSceneMutex);
 
@@ -93,6 +93,44 @@ struct DataPacket
 
 //-------------------------------------------------------------------
 
+//bytes reserved in front of every packet payload, must be at least RTMP_MAX_HEADER_SIZE so that
+//librtmp can write the chunk header in place without the packet being copied into a padded buffer
+#define PACKET_HEADROOM 18
+
+//ref-counted encoded packet.  encoder output is copied into one of these exactly once, and the
+//same buffer is then handed to the publisher and the file stream.  note that librtmp writes its
+//chunk headers into the payload while sending, so nothing may read the data after it has been
+//handed to the network.
+class PacketBuffer
+{
+    volatile LONG refs;
+    UINT size;
+
+public:
+    static inline PacketBuffer* Create(UINT size)
+    {
+        PacketBuffer *buffer = (PacketBuffer*)Allocate(sizeof(PacketBuffer)+PACKET_HEADROOM+size);
+        buffer->refs = 1;
+        buffer->size = size;
+        return buffer;
+    }
+
+    static inline PacketBuffer* Create(const BYTE *data, UINT size)
+    {
+        PacketBuffer *buffer = Create(size);
+        mcpy(buffer->Data(), data, size);
+        return buffer;
+    }
+
+    inline void AddRef()  {InterlockedIncrement(&refs);}
+    inline void Release() {if(!InterlockedDecrement(&refs)) Free(this);}
+
+    inline LPBYTE Data()       {return ((LPBYTE)(this+1))+PACKET_HEADROOM;}
+    inline UINT   Size() const {return size;}
+};
+
+//-------------------------------------------------------------------
+
 enum PacketType
 {
     PacketType_VideoDisposable,
@@ -106,20 +144,49 @@ class NetworkStream
 {
 public:
     virtual ~NetworkStream() {}
-    virtual void SendPacket(BYTE *data, UINT size, DWORD timestamp, PacketType type)=0;
+    //the stream takes its own reference if it holds on to the packet
+    virtual void SendPacket(PacketBuffer *packet, DWORD timestamp, PacketType type)=0;
     virtual void BeginPublishing() {}
 
     virtual double GetPacketStrain() const=0;
     virtual QWORD GetCurrentSentBytes()=0;
+
+    //estimated throughput of the connection in kbps, or 0 if there's no estimate.  bLinkLimited is set if
+    //the estimate came from the connection pushing back, otherwise it's only a lower bound
+    virtual DWORD GetSendThroughput(bool &bLinkLimited) const {bLinkLimited = false; return 0;}
     virtual DWORD NumDroppedFrames() const=0;
     virtual DWORD NumTotalVideoFrames() const=0;
 };
 
 //-------------------------------------------------------------------
 
+//  what the publisher needs from whoever is feeding it: the encoders' headers and settings, and a way
+//to ask for a keyframe or for the stream to be stopped.  the app's forwards to OBS (OBSCapture.cpp), the
+//tests drive the publisher with a synthetic one.
+
+class PublisherHost
+{
+public:
+    virtual ~PublisherHost() {}
+
+    //video + audio, in kbps
+    virtual UINT GetStreamBitRate()=0;
+
+    virtual char* EncMetaData(char *enc, char *pend)=0;
+    virtual void GetAudioHeaders(DataPacket &packet)=0;
+    virtual void GetVideoHeaders(DataPacket &packet)=0;
+    virtual void GetSEI(DataPacket &packet)=0;
+
+    virtual void RequestKeyframe(int waitTime)=0;
+    virtual void RequestStop(bool bCanRetry)=0;
+    virtual void SetStreamReport(CTSTR lpStreamReport)=0;
+};
+
+//-------------------------------------------------------------------
+
 struct TimedPacket
 {
-    List<BYTE> data;
+    PacketBuffer *data;
     DWORD timestamp;
     PacketType type;
 };
@@ -257,7 +324,7 @@ struct FontInfo
 
 struct FrameAudio
 {
-    List<BYTE> audioData;
+    PacketBuffer *audioData;
     QWORD timestamp;
 };
 
@@ -271,6 +338,7 @@ struct ClassInfo
     OBSCREATEPROC createProc;
     OBSCONFIGPROC configProc;
     bool bDeprecated;
+    UINT flags;             //IMAGESOURCE_* flags, image source classes only
 
     inline void FreeData() {strClass.Clear(); strName.Clear();}
 };
@@ -351,6 +419,7 @@ struct GlobalSourceInfo
     String strName;
     XElement *element;
     ImageSource *source;
+    UINT classFlags;
 
     inline void FreeData() {strName.Clear(); delete source; source = NULL;}
 };
@@ -513,10 +582,10 @@ struct StatusBarDrawData
 
 struct VideoPacketData
 {
-    List<BYTE> data;
+    PacketBuffer *data;
     PacketType type;
 
-    inline void Clear() {data.Clear();}
+    inline void Clear() {if(data) {data->Release(); data = NULL;}}
 };
 
 struct VideoSegment
@@ -750,6 +819,7 @@ private:
 
     HANDLE  hEncodeThread;
     HANDLE  hVideoThread;
+    TaskPool *taskPool;
     HANDLE  hSceneMutex;
 
     List<VideoSegment> bufferedVideo;
@@ -792,6 +862,7 @@ private:
     CircularList<QWORD> bufferedAudioTimes;
 
     HANDLE  hSoundThread, hSoundDataMutex;//, hRequestAudioEvent;
+    HANDLE  hAudioEvent;
     QWORD   latestAudioTime;
 
     float   desktopVol, micVol, curMicVol, curDesktopVol;
@@ -1109,7 +1180,7 @@ public:
     //---------------------------------------------------------------------------
 
     virtual void RegisterSceneClass(CTSTR lpClassName, CTSTR lpDisplayName, OBSCREATEPROC createProc, OBSCONFIGPROC configProc, bool bDeprecated);
-    virtual void RegisterImageSourceClass(CTSTR lpClassName, CTSTR lpDisplayName, OBSCREATEPROC createProc, OBSCONFIGPROC configProc, bool bDeprecated);
+    virtual void RegisterImageSourceClass(CTSTR lpClassName, CTSTR lpDisplayName, OBSCREATEPROC createProc, OBSCONFIGPROC configProc, bool bDeprecated, UINT flags=0);
 
     virtual ImageSource* CreateImageSource(CTSTR lpClassName, XElement *data);
 
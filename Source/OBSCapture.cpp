@@ -20,6 +20,7 @@
 #include "Main.h"
 #include <time.h>
 #include <Avrt.h>
+#include "AudioMixClock.h"
 
 VideoEncoder* CreateX264Encoder(int fps, int width, int height, int quality, CTSTR preset, bool bUse444, ColorDescription &colorDesc, int maxBitRate, int bufferSize, bool bUseCFR);
 VideoEncoder* CreateQSVEncoder(int fps, int width, int height, int quality, CTSTR preset, bool bUse444, ColorDescription &colorDesc, int maxBitRate, int bufferSize, bool bUseCFR, String &errors);
@@ -30,8 +31,8 @@ AudioEncoder* CreateAACEncoder(UINT bitRate);
 AudioSource* CreateAudioSource(bool bMic, CTSTR lpID);
 
 //NetworkStream* CreateRTMPServer();
-NetworkStream* CreateRTMPPublisher();
-NetworkStream* CreateDelayedPublisher(DWORD delayTime);
+NetworkStream* CreateRTMPPublisher(PublisherHost *host);
+NetworkStream* CreateDelayedPublisher(DWORD delayTime, PublisherHost *host);
 NetworkStream* CreateBandwidthAnalyzer();
 
 void StartBlankSoundPlayback(CTSTR lpDevice);
@@ -49,6 +50,24 @@ VideoFileStream* CreateFLVFileStream(CTSTR lpFile);
 BOOL bLoggedSystemStats = FALSE;
 void LogSystemStats();
 
+//hands the publisher the current encoders and routes its requests back to the app
+class OBSPublisherHost : public PublisherHost
+{
+public:
+    virtual UINT GetStreamBitRate()                     {return App->GetVideoEncoder()->GetBitRate() + App->GetAudioEncoder()->GetBitRate();}
+
+    virtual char* EncMetaData(char *enc, char *pend)    {return App->EncMetaData(enc, pend);}
+    virtual void GetAudioHeaders(DataPacket &packet)    {App->GetAudioHeaders(packet);}
+    virtual void GetVideoHeaders(DataPacket &packet)    {App->GetVideoHeaders(packet);}
+    virtual void GetSEI(DataPacket &packet)             {App->GetVideoEncoder()->GetSEI(packet);}
+
+    virtual void RequestKeyframe(int waitTime)          {App->RequestKeyframe(waitTime);}
+    virtual void RequestStop(bool bCanRetry)            {if(hwndMain) PostMessage(hwndMain, OBS_REQUESTSTOP, bCanRetry ? 0 : 1, 0);}
+    virtual void SetStreamReport(CTSTR lpStreamReport)  {App->SetStreamReport(lpStreamReport);}
+};
+
+static OBSPublisherHost publisherHost;
+
 void OBS::ToggleRecording()
 {
     if (!bRecording)
@@ -201,7 +220,7 @@ void OBS::Start(bool recordingOnly)
             network = nullptr;
             delete net;
         }
-        network = CreateRTMPPublisher();
+        network = CreateRTMPPublisher(&publisherHost);
 
         Log(TEXT("=====Stream Start (while recording): %s============================="), CurrentDateTimeString().Array());
 
@@ -326,7 +345,7 @@ retryHookTest:
     {
         switch(networkMode)
         {
-        case 0: network = (delayTime > 0) ? CreateDelayedPublisher(delayTime) : CreateRTMPPublisher(); break;
+        case 0: network = (delayTime > 0) ? CreateDelayedPublisher(delayTime, &publisherHost) : CreateRTMPPublisher(&publisherHost); break;
         case 1: network = CreateNullNetwork(); break;
         }
     }
@@ -735,6 +754,20 @@ retryHookTestV2:
     bShutdownVideoThread = false;
     bShutdownEncodeThread = false;
     //ResetEvent(hVideoThread);
+
+    //  one pool for the main 4:2:0 conversion and whatever plugins (capture devices) submit through the API.
+    //MaxConversionThreads caps it when several busy sources would otherwise take over the machine.
+    if(bUseMultithreadedOptimizations && OSGetTotalCores() > 1)
+    {
+        UINT numThreads = MAX(OSGetTotalCores()-2, 1);
+        UINT maxThreads = AppConfig->GetInt(TEXT("General"), TEXT("MaxConversionThreads"), 0);
+        if(maxThreads)
+            numThreads = MIN(numThreads, maxThreads);
+
+        Log(TEXT("  Conversion threads: %u"), numThreads);
+        taskPool = new TaskPool(numThreads);
+    }
+
     hEncodeThread = OSCreateThread((XTHREAD)OBS::EncodeThread, NULL);
     hVideoThread = OSCreateThread((XTHREAD)OBS::MainCaptureThread, NULL);
 
@@ -828,6 +861,7 @@ void OBS::Stop(bool overrideKeepRecording)
     if(hSoundThread)
     {
         //ReleaseSemaphore(hRequestAudioEvent, 1, NULL);
+        SetEvent(hAudioEvent);
         OSTerminateThread(hSoundThread, 20000);
     }
 
@@ -868,7 +902,10 @@ void OBS::Stop(bool overrideKeepRecording)
     //-------------------------------------------------------------
 
     for(UINT i=0; i<pendingAudioFrames.Num(); i++)
-        pendingAudioFrames[i].audioData.Clear();
+    {
+        if(pendingAudioFrames[i].audioData)
+            pendingAudioFrames[i].audioData->Release();
+    }
     pendingAudioFrames.Clear();
 
     //-------------------------------------------------------------
@@ -956,7 +993,30 @@ void OBS::Stop(bool overrideKeepRecording)
     ClearStreamInfo();
 
     DumpProfileData();
+
+    if(GlobalConfig->GetInt(TEXT("General"), TEXT("DumpProfilerHistograms"), 0))
+    {
+        SYSTEMTIME st;
+        GetLocalTime(&st);
+
+        String strHistogramFile;
+        strHistogramFile << lpAppDataPath << FormattedString(TEXT("\\logs\\%u-%02u-%02u-%02u%02u-%02u"), st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond) << TEXT("-profile.csv");
+
+        if(DumpProfileHistograms(strHistogramFile))
+            Log(TEXT("Profiler latency histograms written to %s"), strHistogramFile.Array());
+    }
+
     FreeProfileData();
+
+    if(taskPool)
+    {
+        taskPool->LogStats(TEXT("Frame task pool"));
+        delete taskPool;
+        taskPool = NULL;
+    }
+
+    MainAllocator->LogStats();
+
     Log(TEXT("=====Stream End: %s================================================="), CurrentDateTimeString().Array());
 
     //update notification icon to reflect current status
@@ -1159,7 +1219,7 @@ void OBS::EncodeAudioSegment(float *buffer, UINT numFrames, QWORD timestamp)
         OSEnterMutex(hSoundDataMutex);
 
         FrameAudio *frameAudio = pendingAudioFrames.CreateNew();
-        frameAudio->audioData.CopyArray(packet.lpPacket, packet.size);
+        frameAudio->audioData = PacketBuffer::Create(packet.lpPacket, packet.size);
         frameAudio->timestamp = timestamp;
 
         OSLeaveMutex(hSoundDataMutex);
@@ -1185,17 +1245,26 @@ void OBS::MainAudioLoop()
     UINT audioFramesSinceMicMaxUpdate = 0;
     UINT audioFramesSinceDesktopMaxUpdate = 0;
 
-    List<float> mixBuffer, levelsBuffer;
+    //MixAudioInputs only takes its SSE path when the destination is 16 byte aligned like the sources' buffers
+    List<float, 16> mixBuffer, levelsBuffer;
     mixBuffer.SetSize(audioSampleSize*2);
     levelsBuffer.SetSize(audioSampleSize*2);
 
+    List<AudioMixInput> mixInputs, levelsInputs;
+
     latestAudioTime = 0;
 
     //---------------------------------------------
     // the audio loop of doom
+    //
+    // instead of polling, block on hAudioEvent until either a source pushes new data
+    // or the next mix tick comes due (see AudioMixClock)
+
+    AudioMixClock mixClock(hAudioEvent);
+    UINT numMixedSegments = 0;
 
     while (true) {
-        OSSleep(5); //screw it, just run it every 5ms
+        mixClock.Wait();
 
         if (!bRunning)
             break;
@@ -1220,9 +1289,6 @@ void OBS::MainAudioLoop()
             QWORD timestamp = bufferedAudioTimes[0];
             bufferedAudioTimes.Remove(0);
 
-            zero(mixBuffer.Array(),    audioSampleSize*2*sizeof(float));
-            zero(levelsBuffer.Array(), audioSampleSize*2*sizeof(float));
-
             //----------------------------------------------------------------------------
             // get latest sample for calculating the volume levels
 
@@ -1237,45 +1303,56 @@ void OBS::MainAudioLoop()
             }
 
             //----------------------------------------------------------------------------
-            // mix desktop samples
-
-            if (desktopBuffer)
-                MixAudio(mixBuffer.Array(), desktopBuffer, audioSampleSize*2, false);
+            // gather everything that goes into the output mix and into the desktop level meter,
+            // both get mixed in one pass each below
 
-            if (latestDesktopBuffer)
-                MixAudio(levelsBuffer.Array(), latestDesktopBuffer, audioSampleSize*2, false);
-
-            //----------------------------------------------------------------------------
-            // get latest aux volume level samples and mix
+            UINT numMixInputs = 0, numLevelsInputs = 0;
 
             OSEnterMutex(hAuxAudioMutex);
 
-            for (UINT i=0; i<auxAudioSources.Num(); i++) {
-                float *latestAuxBuffer;
+            mixInputs.SetSize(auxAudioSources.Num()+2);
+            levelsInputs.SetSize(auxAudioSources.Num()+1);
 
-                if(auxAudioSources[i]->GetNewestFrame(&latestAuxBuffer))
-                    MixAudio(levelsBuffer.Array(), latestAuxBuffer, audioSampleSize*2, false);
+            if (desktopBuffer) {
+                mixInputs[numMixInputs].buffer = desktopBuffer;
+                mixInputs[numMixInputs++].bForceMono = false;
             }
 
-            //----------------------------------------------------------------------------
-            // mix output aux sound samples with the desktop
+            if (latestDesktopBuffer) {
+                levelsInputs[numLevelsInputs].buffer = latestDesktopBuffer;
+                levelsInputs[numLevelsInputs++].bForceMono = false;
+            }
 
             for (UINT i=0; i<auxAudioSources.Num(); i++) {
-                float *auxBuffer;
+                float *latestAuxBuffer, *auxBuffer;
 
-                if(auxAudioSources[i]->GetBuffer(&auxBuffer, timestamp))
-                    MixAudio(mixBuffer.Array(), auxBuffer, audioSampleSize*2, false);
+                if(auxAudioSources[i]->GetNewestFrame(&latestAuxBuffer)) {
+                    levelsInputs[numLevelsInputs].buffer = latestAuxBuffer;
+                    levelsInputs[numLevelsInputs++].bForceMono = false;
+                }
+
+                if(auxAudioSources[i]->GetBuffer(&auxBuffer, timestamp)) {
+                    mixInputs[numMixInputs].buffer = auxBuffer;
+                    mixInputs[numMixInputs++].bForceMono = false;
+                }
             }
 
             OSLeaveMutex(hAuxAudioMutex);
 
+            if (bMicEnabled && micBuffer) {
+                mixInputs[numMixInputs].buffer = micBuffer;
+                mixInputs[numMixInputs++].bForceMono = bForceMicMono;
+            }
+
+            MixAudioInputs(mixBuffer.Array(), mixInputs.Array(), numMixInputs, audioSampleSize*2);
+
             //----------------------------------------------------------------------------
-            // multiply samples by volume and compute RMS and max of samples
+            // compute RMS and max of samples
             // Use 1.0f instead of curDesktopVol, since aux audio sources already have their volume set, and shouldn't be boosted anyway.
 
             float desktopRMS = 0, micRMS = 0, desktopMx = 0, micMx = 0;
             if (latestDesktopBuffer)
-                CalculateVolumeLevels(levelsBuffer.Array(), audioSampleSize*2, 1.0f, desktopRMS, desktopMx);
+                MixAudioInputs(levelsBuffer.Array(), levelsInputs.Array(), numLevelsInputs, audioSampleSize*2, &desktopRMS, &desktopMx);
             if (bMicEnabled && latestMicBuffer)
                 CalculateVolumeLevels(latestMicBuffer, audioSampleSize*2, curMicVol, micRMS, micMx);
 
@@ -1336,14 +1413,8 @@ void OBS::MainAudioLoop()
                 audioFramesSinceMeterUpdate = 0;
             }
 
-            //----------------------------------------------------------------------------
-            // mix mic and desktop sound
-            // also, it's perfectly fine to just mix into the returned buffer
-
-            if (bMicEnabled && micBuffer)
-                MixAudio(mixBuffer.Array(), micBuffer, audioSampleSize*2, bForceMicMono);
-
             EncodeAudioSegment(mixBuffer.Array(), audioSampleSize, timestamp);
+            numMixedSegments++;
         }
 
         //-----------------------------------------------
@@ -1352,13 +1423,21 @@ void OBS::MainAudioLoop()
             bRecievedFirstAudioFrame = true;
     }
 
+    Log(TEXT("Audio thread: %u wakeups (%u signaled by sources), %u segments mixed"), mixClock.NumWakeups(), mixClock.NumSignaledWakeups(), numMixedSegments);
+
     desktopMag = desktopMax = desktopPeak = VOL_MIN;
     micMag = micMax = micPeak = VOL_MIN;
 
     PostMessage(hwndMain, WM_COMMAND, MAKEWPARAM(ID_MICVOLUMEMETER, VOLN_METERED), 0);
 
     for (UINT i=0; i<pendingAudioFrames.Num(); i++)
-        pendingAudioFrames[i].audioData.Clear();
+    {
+        if(pendingAudioFrames[i].audioData)
+        {
+            pendingAudioFrames[i].audioData->Release();
+            pendingAudioFrames[i].audioData = NULL;
+        }
+    }
 
     AvRevertMmThreadCharacteristics(hTask);
 }
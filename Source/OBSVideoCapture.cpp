@@ -18,6 +18,7 @@
 
 
 #include "Main.h"
+#include "BitrateController.h"
 
 #include <inttypes.h>
 #include "mfxstructures.h"
@@ -51,28 +52,23 @@ struct Convert444Data
     LPBYTE input;
     LPBYTE output[3];
     bool bNV12;
-    bool bKillThread;
-    HANDLE hSignalConvert, hSignalComplete;
-    int width, height, inPitch, outPitch, startY, endY;
-    DWORD numThreads;
+    int width, height, inPitch, outPitch;
+    int tileHeight;
+    UINT numTiles;
 };
 
-DWORD STDCALL Convert444Thread(Convert444Data *data)
+//one task pool task, converts a band of tileHeight rows
+void STDCALL Convert444Tile(Convert444Data *data, UINT tile)
 {
-    do
-    {
-        WaitForSingleObject(data->hSignalConvert, INFINITE);
-        if(data->bKillThread) break;
-        profileParallelSegment("Convert444Thread", "Convert444Threads", data->numThreads);
-        if(data->bNV12)
-            Convert444toNV12(data->input, data->width, data->inPitch, data->outPitch, data->height, data->startY, data->endY, data->output);
-        else
-            Convert444toNV12(data->input, data->width, data->inPitch, data->width, data->height, data->startY, data->endY, data->output);
+    profileParallelSegment("Convert444Tile", "Convert444Tiles", data->numTiles);
 
-        SetEvent(data->hSignalComplete);
-    }while(!data->bKillThread);
+    int startY = int(tile)*data->tileHeight;
+    int endY   = MIN(startY+data->tileHeight, data->height);
 
-    return 0;
+    if(data->bNV12)
+        Convert444toNV12(data->input, data->width, data->inPitch, data->outPitch, data->height, startY, endY, data->output);
+    else
+        Convert444toNV12(data->input, data->width, data->inPitch, data->width, data->height, startY, endY, data->output);
 }
 
 bool OBS::BufferVideoData(const List<DataPacket> &inputPackets, const List<PacketType> &inputTypes, DWORD timestamp, VideoSegment &segmentOut)
@@ -83,7 +79,7 @@ bool OBS::BufferVideoData(const List<DataPacket> &inputPackets, const List<Packe
     segmentIn.packets.SetSize(inputPackets.Num());
     for(UINT i=0; i<inputPackets.Num(); i++)
     {
-        segmentIn.packets[i].data.CopyArray(inputPackets[i].lpPacket, inputPackets[i].size);
+        segmentIn.packets[i].data = PacketBuffer::Create(inputPackets[i].lpPacket, inputPackets[i].size);
         segmentIn.packets[i].type =  inputTypes[i];
     }
 
@@ -129,7 +125,7 @@ void OBS::SendFrame(VideoSegment &curSegment, QWORD firstFrameTime)
 {
     if(!bSentHeaders)
     {
-        if(network && curSegment.packets[0].data[0] == 0x17) {
+        if(network && curSegment.packets[0].data->Data()[0] == 0x17) {
             network->BeginPublishing();
             bSentHeaders = true;
         }
@@ -151,17 +147,16 @@ void OBS::SendFrame(VideoSegment &curSegment, QWORD firstFrameTime)
 
                 if(audioTimestamp == 0 || audioTimestamp > lastAudioTimestamp)
                 {
-                    List<BYTE> &audioData = pendingAudioFrames[0].audioData;
-                    if(audioData.Num())
+                    PacketBuffer *audioData = pendingAudioFrames[0].audioData;
+                    if(audioData)
                     {
                         //Log(TEXT("a:%u, %llu"), audioTimestamp, frameInfo.firstFrameTime+audioTimestamp);
 
-                        if(network)
-                            network->SendPacket(audioData.Array(), audioData.Num(), audioTimestamp, PacketType_Audio);
+                        //file stream first, the network may overwrite parts of the data while sending
                         if(fileStream)
-                            fileStream->AddPacket(audioData.Array(), audioData.Num(), audioTimestamp, PacketType_Audio);
-
-                        audioData.Clear();
+                            fileStream->AddPacket(audioData->Data(), audioData->Size(), audioTimestamp, PacketType_Audio);
+                        if(network)
+                            network->SendPacket(audioData, audioTimestamp, PacketType_Audio);
 
                         lastAudioTimestamp = audioTimestamp;
                     }
@@ -170,7 +165,8 @@ void OBS::SendFrame(VideoSegment &curSegment, QWORD firstFrameTime)
             else
                 nop();
 
-            pendingAudioFrames[0].audioData.Clear();
+            if(pendingAudioFrames[0].audioData)
+                pendingAudioFrames[0].audioData->Release();
             pendingAudioFrames.Remove(0);
         }
     }
@@ -186,10 +182,10 @@ void OBS::SendFrame(VideoSegment &curSegment, QWORD firstFrameTime)
 
         //Log(TEXT("v:%u, %llu"), curSegment.timestamp, frameInfo.firstFrameTime+curSegment.timestamp);
 
-        if(network)
-            network->SendPacket(packet.data.Array(), packet.data.Num(), curSegment.timestamp, packet.type);
         if(fileStream)
-            fileStream->AddPacket(packet.data.Array(), packet.data.Num(), curSegment.timestamp, packet.type);
+            fileStream->AddPacket(packet.data->Data(), packet.data->Size(), curSegment.timestamp, packet.type);
+        if(network)
+            network->SendPacket(packet.data, curSegment.timestamp, packet.type);
     }
 }
 
@@ -590,10 +586,14 @@ void OBS::MainCaptureLoop()
 
     int bCongestionControl = AppConfig->GetInt (TEXT("Video Encoding"), TEXT("CongestionControl"), 0);
     bool bDynamicBitrateSupported = App->GetVideoEncoder()->DynamicBitrateSupported();
-    int defaultBitRate = AppConfig->GetInt(TEXT("Video Encoding"), TEXT("MaxBitrate"), 1000);
-    int currentBitRate = defaultBitRate;
-    QWORD lastAdjustmentTime = 0;
-    UINT adjustmentStreamId = 0;
+
+    BitrateController *bitrateController = NULL;
+    if (bCongestionControl && bDynamicBitrateSupported && !bTestStream)
+    {
+        int maxBitRate = AppConfig->GetInt(TEXT("Video Encoding"), TEXT("MaxBitrate"), 1000);
+        int audioBitRate = AppConfig->GetInt(TEXT("Audio Encoding"), TEXT("Bitrate"), 96);
+        bitrateController = new BitrateController(maxBitRate, audioBitRate);
+    }
 
     //std::unique_ptr<ProfilerNode> encodeThreadProfiler;
 
@@ -632,53 +632,37 @@ void OBS::MainCaptureLoop()
     double lastStrain = 0.0f;
     DWORD numSecondsWaited = 0;
 
-    //----------------------------------------
-    // 444->420 thread data
-
-    int numThreads = MAX(OSGetTotalCores()-2, 1);
-    HANDLE *h420Threads = (HANDLE*)Allocate(sizeof(HANDLE)*numThreads);
-    Convert444Data *convertInfo = (Convert444Data*)Allocate(sizeof(Convert444Data)*numThreads);
-
-    zero(h420Threads, sizeof(HANDLE)*numThreads);
-    zero(convertInfo, sizeof(Convert444Data)*numThreads);
+    //reused every frame for ticking the global sources
+    List<ImageSource*> globalImageSources;
+    List<UINT> globalClassFlags;
 
-    for(int i=0; i<numThreads; i++)
-    {
-        convertInfo[i].width  = outputCX;
-        convertInfo[i].height = outputCY;
-        convertInfo[i].hSignalConvert  = CreateEvent(NULL, FALSE, FALSE, NULL);
-        convertInfo[i].hSignalComplete = CreateEvent(NULL, FALSE, FALSE, NULL);
-        convertInfo[i].bNV12 = bUsingQSV;
-        convertInfo[i].numThreads = numThreads;
-
-        if(i == 0)
-            convertInfo[i].startY = 0;
-        else
-            convertInfo[i].startY = convertInfo[i-1].endY;
-
-        if(i == (numThreads-1))
-            convertInfo[i].endY = outputCY;
-        else
-            convertInfo[i].endY = ((outputCY/numThreads)*(i+1)) & 0xFFFFFFFE;
-    }
+    //----------------------------------------
+    // 444->420 task data
 
     bool bEncode;
     bool bFirstFrame = true;
     bool bFirstImage = true;
     bool bFirstEncode = true;
-    bool bUseThreaded420 = bUseMultithreadedOptimizations && (OSGetTotalCores() > 1) && !bUsing444;
+    bool bUseThreaded420 = (taskPool != NULL) && !bUsing444;
 
-    List<HANDLE> completeEvents;
+    //  about four tiles per pool thread so the load can still balance out when some of the threads are
+    //busy with x264.  tiles have to be an even number of rows.
+    Convert444Data convertInfo;
+    zero(&convertInfo, sizeof(convertInfo));
+
+    convertInfo.width  = outputCX;
+    convertInfo.height = outputCY;
+    convertInfo.bNV12  = bUsingQSV;
 
     if(bUseThreaded420)
     {
-        for(int i=0; i<numThreads; i++)
-        {
-            h420Threads[i] = OSCreateThread((XTHREAD)Convert444Thread, convertInfo+i);
-            completeEvents << convertInfo[i].hSignalComplete;
-        }
+        UINT numTiles = taskPool->NumThreads()*4;
+        convertInfo.tileHeight = MAX(((outputCY+numTiles-1)/numTiles + 1) & 0xFFFFFFFE, 16);
+        convertInfo.numTiles   = (outputCY+convertInfo.tileHeight-1)/convertInfo.tileHeight;
     }
 
+    TaskBatch *convertBatch = NULL;
+
     //----------------------------------------
 
     QWORD streamTimeStart  = GetQPCTimeNS();
@@ -766,10 +750,19 @@ void OBS::MainCaptureLoop()
 
             profileOut;
 
+            profileIn("scene->Tick");
             scene->Tick(float(fSeconds));
 
+            globalImageSources.SetSize(globalSources.Num());
+            globalClassFlags.SetSize(globalSources.Num());
             for(UINT i=0; i<globalSources.Num(); i++)
-                globalSources[i].source->Tick(float(fSeconds));
+            {
+                globalImageSources[i] = globalSources[i].source;
+                globalClassFlags[i]   = globalSources[i].classFlags;
+            }
+
+            TickImageSources(globalImageSources.Array(), globalClassFlags.Array(), globalImageSources.Num(), float(fSeconds));
+            profileOut;
         }
 
         //------------------------------------
@@ -1035,7 +1028,8 @@ void OBS::MainCaptureLoop()
 
             if(!bFirstEncode && bUseThreaded420)
             {
-                WaitForMultipleObjects(completeEvents.Num(), completeEvents.Array(), TRUE, INFINITE);
+                taskPool->Wait(convertBatch);
+                convertBatch = NULL;
                 copyTexture->Unmap(0);
             }
 
@@ -1066,26 +1060,24 @@ void OBS::MainCaptureLoop()
 
                         if(bUseThreaded420)
                         {
-                            for(int i=0; i<numThreads; i++)
+                            convertInfo.input     = (LPBYTE)map.pData;
+                            convertInfo.inPitch   = map.RowPitch;
+                            if(bUsingQSV)
                             {
-                                convertInfo[i].input     = (LPBYTE)map.pData;
-                                convertInfo[i].inPitch   = map.RowPitch;
-                                if(bUsingQSV)
-                                {
-                                    mfxFrameData& data = nextPicOut.mfxOut->Data;
-                                    videoEncoder->RequestBuffers(&data);
-                                    convertInfo[i].outPitch  = data.Pitch;
-                                    convertInfo[i].output[0] = data.Y;
-                                    convertInfo[i].output[1] = data.UV;
-                                }
-                                else
-                                {
-                                    convertInfo[i].output[0] = nextPicOut.picOut->img.plane[0];
-                                    convertInfo[i].output[1] = nextPicOut.picOut->img.plane[1];
-                                    convertInfo[i].output[2] = nextPicOut.picOut->img.plane[2];
-								}
-                                SetEvent(convertInfo[i].hSignalConvert);
+                                mfxFrameData& data = nextPicOut.mfxOut->Data;
+                                videoEncoder->RequestBuffers(&data);
+                                convertInfo.outPitch  = data.Pitch;
+                                convertInfo.output[0] = data.Y;
+                                convertInfo.output[1] = data.UV;
                             }
+                            else
+                            {
+                                convertInfo.output[0] = nextPicOut.picOut->img.plane[0];
+                                convertInfo.output[1] = nextPicOut.picOut->img.plane[1];
+                                convertInfo.output[2] = nextPicOut.picOut->img.plane[2];
+                            }
+
+                            convertBatch = taskPool->Submit((TASKPROC)Convert444Tile, &convertInfo, convertInfo.numTiles);
 
                             if(bFirstEncode)
                                 bFirstEncode = bEncode = false;
@@ -1164,51 +1156,16 @@ void OBS::MainCaptureLoop()
             else
                 curYUVTexture++;
 
-            if (bCongestionControl && bDynamicBitrateSupported && !bTestStream && totalStreamTime > 15000)
+            if (bitrateController && network && totalStreamTime > 15000)
             {
-                if (curStrain > 25)
-                {
-                    if (renderStartTimeMS - lastAdjustmentTime > 1500)
-                    {
-                        if (currentBitRate > 100)
-                        {
-                            currentBitRate = (int)(currentBitRate * (1.0 - (curStrain / 400)));
-                            App->GetVideoEncoder()->SetBitRate(currentBitRate, -1);
-                            if (!adjustmentStreamId)
-                                adjustmentStreamId = App->AddStreamInfo (FormattedString(TEXT("Congestion detected, dropping bitrate to %d kbps"), currentBitRate).Array(), StreamInfoPriority_Low);
-                            else
-                                App->SetStreamInfo(adjustmentStreamId, FormattedString(TEXT("Congestion detected, dropping bitrate to %d kbps"), currentBitRate).Array());
-
-                            bUpdateBPS = true;
-                        }
-
-                        lastAdjustmentTime = renderStartTimeMS;
-                    }
-                }
-                else if (currentBitRate < defaultBitRate && curStrain < 5 && lastStrain < 5)
+                if (bitrateController->Update(network, GetVideoEncoder(), DWORD(renderStartTimeMS)))
                 {
-                    if (renderStartTimeMS - lastAdjustmentTime > 5000)
-                    {
-                        if (currentBitRate < defaultBitRate)
-                        {
-                            currentBitRate += (int)(defaultBitRate * 0.05);
-                            if (currentBitRate > defaultBitRate)
-                                currentBitRate = defaultBitRate;
-                        }
-
-                        App->GetVideoEncoder()->SetBitRate(currentBitRate, -1);
-                        /*if (!adjustmentStreamId)
-                            App->AddStreamInfo (FormattedString(TEXT("Congestion clearing, raising bitrate to %d kbps"), currentBitRate).Array(), StreamInfoPriority_Low);
-                        else
-                            App->SetStreamInfo(adjustmentStreamId, FormattedString(TEXT("Congestion clearing, raising bitrate to %d kbps"), currentBitRate).Array());*/
+                    bUpdateBPS = true;
 
-                        App->RemoveStreamInfo(adjustmentStreamId);
-                        adjustmentStreamId = 0;
-
-                        bUpdateBPS = true;
-
-                        lastAdjustmentTime = renderStartTimeMS;
-                    }
+                    //  big drops get a keyframe once the lower bitrate has had a second to drain the buffer.
+                    //this is the same request the publisher uses when it dumps frames, so the two don't stack up
+                    if (bitrateController->WantsKeyframe())
+                        RequestKeyframe(1000);
                 }
             }
         }
@@ -1257,33 +1214,14 @@ void OBS::MainCaptureLoop()
 
     //encodeThreadProfiler.reset();
 
+    delete bitrateController;
+
     if(!bUsing444)
     {
         if(bUseThreaded420)
         {
-            for(int i=0; i<numThreads; i++)
-            {
-                if(h420Threads[i])
-                {
-                    convertInfo[i].bKillThread = true;
-                    SetEvent(convertInfo[i].hSignalConvert);
-
-                    OSTerminateThread(h420Threads[i], 10000);
-                    h420Threads[i] = NULL;
-                }
-
-                if(convertInfo[i].hSignalConvert)
-                {
-                    CloseHandle(convertInfo[i].hSignalConvert);
-                    convertInfo[i].hSignalConvert = NULL;
-                }
-
-                if(convertInfo[i].hSignalComplete)
-                {
-                    CloseHandle(convertInfo[i].hSignalComplete);
-                    convertInfo[i].hSignalComplete = NULL;
-                }
-            }
+            taskPool->Wait(convertBatch);
+            convertBatch = NULL;
 
             if(!bFirstEncode)
             {
@@ -1303,8 +1241,5 @@ void OBS::MainCaptureLoop()
             }
     }
 
-    Free(h420Threads);
-    Free(convertInfo);
-
     Log(TEXT("Total frames rendered: %d, number of late frames: %d (%0.2f%%) (it's okay for some frames to be late)"), numTotalFrames, numLongFrames, (numTotalFrames > 0) ? (double(numLongFrames)/double(numTotalFrames))*100.0 : 0.0f);
 }
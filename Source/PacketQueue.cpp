@@ -0,0 +1,301 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "Main.h"
+#include "PacketQueue.h"
+
+#define INITIAL_QUEUE_SIZE 64
+
+//a candidate is better if it is further away from a dropped frame, or earlier on a tie
+static inline bool BetterCandidate(UINT distanceA, UINT serialA, UINT distanceB, UINT serialB)
+{
+    return (distanceA > distanceB) || (distanceA == distanceB && serialA < serialB);
+}
+
+PacketQueue::PacketQueue()
+{
+    capacity = INITIAL_QUEUE_SIZE;
+    packets = (NetworkPacket*)Allocate(sizeof(NetworkPacket)*capacity);
+    head = num = 0;
+    nextSerial = 0;
+    zero(typeCounts, sizeof(typeCounts));
+}
+
+PacketQueue::~PacketQueue()
+{
+    Clear();
+    Free(packets);
+}
+
+void PacketQueue::Grow()
+{
+    NetworkPacket *newPackets = (NetworkPacket*)Allocate(sizeof(NetworkPacket)*capacity*2);
+
+    for(UINT i=0; i<num; i++)
+        mcpy(newPackets+i, packets+Slot(i), sizeof(NetworkPacket));
+
+    Free(packets);
+    packets = newPackets;
+    capacity *= 2;
+    head = 0;
+}
+
+void PacketQueue::Insert(PacketBuffer *data, DWORD timestamp, PacketType type, UINT distanceFromDroppedFrame)
+{
+    if(num == capacity)
+        Grow();
+
+    UINT index = num;
+    while(index && packets[Slot(index-1)].timestamp > timestamp)
+        index--;
+
+    if(index >= num/2)
+    {
+        for(UINT i=num; i>index; i--)
+            packets[Slot(i)] = packets[Slot(i-1)];
+    }
+    else
+    {
+        head = (head-1) & (capacity-1);
+        for(UINT i=0; i<index; i++)
+            packets[Slot(i)] = packets[Slot(i+1)];
+    }
+
+    num++;
+
+    NetworkPacket &packet = packets[Slot(index)];
+    packet.data                     = data;
+    packet.timestamp                = timestamp;
+    packet.type                     = type;
+    packet.distanceFromDroppedFrame = distanceFromDroppedFrame;
+    packet.serial                   = nextSerial++;
+
+    typeCounts[type]++;
+
+    if(type <= PacketType_VideoLow)
+        PushCandidate(packet);
+}
+
+PacketBuffer* PacketQueue::PopFront()
+{
+    assert(num);
+
+    NetworkPacket &packet = packets[head];
+    PacketBuffer *data = packet.data;
+
+    typeCounts[packet.type]--;
+
+    head = (head+1) & (capacity-1);
+    if(!--num)
+        head = 0;
+
+    return data;
+}
+
+void PacketQueue::Remove(UINT index)
+{
+    assert(index < num);
+
+    NetworkPacket &packet = packets[Slot(index)];
+    if(packet.data)
+        packet.data->Release();
+
+    typeCounts[packet.type]--;
+
+    if(index >= num/2)
+    {
+        for(UINT i=index+1; i<num; i++)
+            packets[Slot(i-1)] = packets[Slot(i)];
+    }
+    else
+    {
+        for(UINT i=index; i>0; i--)
+            packets[Slot(i)] = packets[Slot(i-1)];
+        head = (head+1) & (capacity-1);
+    }
+
+    if(!--num)
+        head = 0;
+}
+
+void PacketQueue::Clear()
+{
+    for(UINT i=0; i<num; i++)
+    {
+        NetworkPacket &packet = packets[Slot(i)];
+        if(packet.data)
+            packet.data->Release();
+    }
+
+    head = num = 0;
+    zero(typeCounts, sizeof(typeCounts));
+
+    for(UINT i=0; i<=PacketType_VideoLow; i++)
+        dropHeaps[i].Clear();
+}
+
+void PacketQueue::SetDistanceFromDroppedFrame(UINT index, UINT distance)
+{
+    NetworkPacket &packet = (*this)[index];
+    packet.distanceFromDroppedFrame = distance;
+
+    //the old heap entry goes stale on its own since the distance no longer matches
+    if(packet.type <= PacketType_VideoLow)
+        PushCandidate(packet);
+}
+
+//-------------------------------------------------------------------
+
+UINT PacketQueue::FindSerial(DWORD timestamp, UINT serial) const
+{
+    UINT low = 0, high = num;
+
+    while(low < high)
+    {
+        UINT mid = (low+high)/2;
+        if(packets[Slot(mid)].timestamp < timestamp)
+            low = mid+1;
+        else
+            high = mid;
+    }
+
+    for(UINT i=low; i<num; i++)
+    {
+        const NetworkPacket &packet = packets[Slot(i)];
+        if(packet.timestamp != timestamp)
+            break;
+        if(packet.serial == serial)
+            return i;
+    }
+
+    return INVALID;
+}
+
+void PacketQueue::PushCandidate(const NetworkPacket &packet)
+{
+    List<DropCandidate> &heap = dropHeaps[packet.type];
+
+    //sent and superseded entries are only cleaned out as they surface, so rebuild the heap
+    //from the queue once they start to outnumber the live ones
+    if(heap.Num() >= typeCounts[packet.type]*2 + INITIAL_QUEUE_SIZE)
+    {
+        RebuildCandidates(packet.type);
+        return;
+    }
+
+    DropCandidate candidate;
+    candidate.distance  = packet.distanceFromDroppedFrame;
+    candidate.serial    = packet.serial;
+    candidate.timestamp = packet.timestamp;
+
+    UINT i = heap.Add(candidate);
+    while(i)
+    {
+        UINT parent = (i-1)/2;
+        if(!BetterCandidate(heap[i].distance, heap[i].serial, heap[parent].distance, heap[parent].serial))
+            break;
+
+        DropCandidate temp = heap[parent];
+        heap[parent] = heap[i];
+        heap[i] = temp;
+        i = parent;
+    }
+}
+
+void PacketQueue::RebuildCandidates(int type)
+{
+    dropHeaps[type].Clear();
+
+    for(UINT i=0; i<num; i++)
+    {
+        NetworkPacket &packet = packets[Slot(i)];
+        if(packet.type == type)
+        {
+            //the heap is empty so this can't recurse back into a rebuild
+            PushCandidate(packet);
+        }
+    }
+}
+
+UINT PacketQueue::TopCandidate(int type)
+{
+    List<DropCandidate> &heap = dropHeaps[type];
+
+    while(heap.Num())
+    {
+        DropCandidate &top = heap[0];
+
+        UINT index = FindSerial(top.timestamp, top.serial);
+        if(index != INVALID && packets[Slot(index)].distanceFromDroppedFrame == top.distance)
+            return index;
+
+        //stale, pop it
+        UINT last = heap.Num()-1;
+        heap[0] = heap[last];
+        heap.Remove(last);
+
+        UINT i = 0;
+        for(;;)
+        {
+            UINT left = i*2+1, right = left+1, best = i;
+
+            if(left < last && BetterCandidate(heap[left].distance, heap[left].serial, heap[best].distance, heap[best].serial))
+                best = left;
+            if(right < last && BetterCandidate(heap[right].distance, heap[right].serial, heap[best].distance, heap[best].serial))
+                best = right;
+
+            if(best == i)
+                break;
+
+            DropCandidate temp = heap[best];
+            heap[best] = heap[i];
+            heap[i] = temp;
+            i = best;
+        }
+    }
+
+    return INVALID;
+}
+
+UINT PacketQueue::FindDropCandidate(int maxType)
+{
+    assert(maxType <= PacketType_VideoLow);
+
+    UINT bestIndex = INVALID;
+
+    for(int type=PacketType_VideoDisposable; type<=maxType; type++)
+    {
+        UINT index = TopCandidate(type);
+        if(index == INVALID)
+            continue;
+
+        if(bestIndex == INVALID)
+            bestIndex = index;
+        else
+        {
+            NetworkPacket &packet = packets[Slot(index)];
+            NetworkPacket &best = packets[Slot(bestIndex)];
+
+            if(BetterCandidate(packet.distanceFromDroppedFrame, packet.serial, best.distanceFromDroppedFrame, best.serial))
+                bestIndex = index;
+        }
+    }
+
+    return bestIndex;
+}
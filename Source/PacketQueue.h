@@ -0,0 +1,97 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#pragma once
+
+struct NetworkPacket
+{
+    PacketBuffer *data;
+    DWORD timestamp;
+    PacketType type;
+    UINT distanceFromDroppedFrame;
+    UINT serial;
+};
+
+//-------------------------------------------------------------------
+// Timestamp-ordered queue of packets waiting for the send thread.
+//
+// Packets live in a power-of-two ring buffer, so taking a packet off the
+// front is O(1).  Packets arrive almost in order (only audio is interleaved
+// slightly back in time), so the insertion point is searched from the back
+// and the shorter side of the ring is shifted, which is amortized O(1).
+//
+// Disposable and low priority video frames are also tracked in one heap per
+// priority keyed on distanceFromDroppedFrame, which lets the frame dropper
+// find the next frame to drop in O(log n) instead of rescanning the queue.
+// Heap entries are invalidated lazily: an entry is only trusted if the
+// packet it refers to is still queued with the same distance.
+
+class PacketQueue
+{
+    struct DropCandidate
+    {
+        UINT distance;
+        UINT serial;
+        DWORD timestamp;
+    };
+
+    NetworkPacket *packets;
+    UINT capacity, head, num;
+    UINT nextSerial;
+    UINT typeCounts[PacketType_Audio+1];
+
+    List<DropCandidate> dropHeaps[PacketType_VideoLow+1];
+
+    inline UINT Slot(UINT index) const {return (head+index) & (capacity-1);}
+
+    void Grow();
+
+    UINT FindSerial(DWORD timestamp, UINT serial) const;
+    void PushCandidate(const NetworkPacket &packet);
+    void RebuildCandidates(int type);
+    UINT TopCandidate(int type);
+
+public:
+    PacketQueue();
+    ~PacketQueue();
+
+    inline UINT Num() const                {return num;}
+    inline UINT NumOfType(int type) const  {return typeCounts[type];}
+
+    inline NetworkPacket& operator[](UINT index) {assert(index < num); return packets[Slot(index)];}
+    inline NetworkPacket& Last()                 {assert(num); return packets[Slot(num-1)];}
+
+    //the queue takes over the caller's reference to data.  inserts after any packets with the
+    //same or an earlier timestamp.
+    void Insert(PacketBuffer *data, DWORD timestamp, PacketType type, UINT distanceFromDroppedFrame);
+
+    //removes the first packet and hands its reference over to the caller
+    PacketBuffer* PopFront();
+
+    //removes and releases a packet
+    void Remove(UINT index);
+
+    void SetDistanceFromDroppedFrame(UINT index, UINT distance);
+
+    //index of the queued frame with a priority up to maxType that is furthest from any dropped
+    //frame (earliest on ties), or INVALID if there is none.  maxType must be at most PacketType_VideoLow.
+    UINT FindDropCandidate(int maxType);
+
+    void Clear();
+};
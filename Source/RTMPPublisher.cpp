@@ -23,6 +23,8 @@
 
 #define MAX_BUFFERED_PACKETS 10
 
+static_assert(PACKET_HEADROOM >= RTMP_MAX_HEADER_SIZE, "PACKET_HEADROOM must fit an RTMP header");
+
 String RTMPPublisher::strRTMPErrors;
 
 //QWORD totalCalls = 0, totalTime = 0;
@@ -72,7 +74,7 @@ String RTMPPublisher::GetRTMPErrors()
     return strRTMPErrors;
 }
 
-RTMPPublisher::RTMPPublisher()
+RTMPPublisher::RTMPPublisher(PublisherHost *host) : host(host)
 {
     //bufferedPackets.SetBaseSize(MAX_BUFFERED_PACKETS);
 
@@ -131,6 +133,7 @@ bool RTMPPublisher::Init(UINT tcpBufferSize)
     //Log(TEXT("Using Send Buffer Size: %u"), sendBufferSize);
 
     rtmp->m_customSendFunc = (CUSTOMSEND)RTMPPublisher::BufferedSend;
+    rtmp->m_customSendVecFunc = (CUSTOMSENDV)RTMPPublisher::BufferedSendV;
     rtmp->m_customSendParam = this;
     rtmp->m_bCustomSend = TRUE;
 
@@ -167,7 +170,7 @@ bool RTMPPublisher::Init(UINT tcpBufferSize)
 
     hDataBufferMutex = OSCreateMutex();
 
-    dataBufferSize = (App->GetVideoEncoder()->GetBitRate() + App->GetAudioEncoder()->GetBitRate()) / 8 * 1024;
+    dataBufferSize = host->GetStreamBitRate() / 8 * 1024;
     if (dataBufferSize < 131072)
         dataBufferSize = 131072;
 
@@ -296,12 +299,8 @@ RTMPPublisher::~RTMPPublisher()
     if(hDataMutex)
         OSCloseMutex(hDataMutex);
 
-    while (bufferedPackets.Num())
-    {
-        //this should not happen any more...
-        bufferedPackets[0].data.Clear();
-        bufferedPackets.Remove(0);
-    }
+    //this should not happen any more...
+    ClearBufferedPackets();
 
     if (dataBuffer)
         Free(dataBuffer);
@@ -338,8 +337,6 @@ RTMPPublisher::~RTMPPublisher()
 
     //--------------------------
 
-    for(UINT i=0; i<queuedPackets.Num(); i++)
-        queuedPackets[i].data.Clear();
     queuedPackets.Clear();
 
     double dBFrameDropPercentage = double(numBFramesDumped)/max(1, NumTotalVideoFrames())*100.0;
@@ -349,6 +346,7 @@ RTMPPublisher::~RTMPPublisher()
         Log(TEXT("Average send payload: %d bytes, average send interval: %d ms"), (DWORD)(totalSendBytes / totalSendCount), totalSendPeriod / totalSendCount);
 
     Log(TEXT("Number of times waited to send: %d, Waited for a total of %d bytes"), totalTimesWaited, totalBytesWaited);
+    Log(TEXT("Peak send buffer usage: %d / %d bytes"), peakDataBufferLen, dataBufferSize);
 
     Log(TEXT("Number of b-frames dropped: %u (%0.2g%%), Number of p-frames dropped: %u (%0.2g%%), Total %u (%0.2g%%)"),
         numBFramesDumped, dBFrameDropPercentage,
@@ -366,17 +364,6 @@ RTMPPublisher::~RTMPPublisher()
     //--------------------------
 }
 
-UINT RTMPPublisher::FindClosestQueueIndex(DWORD timestamp)
-{
-    UINT index;
-    for (index=0; index<queuedPackets.Num(); index++) {
-        if (queuedPackets[index].timestamp > timestamp)
-            break;
-    }
-
-    return index;
-}
-
 UINT RTMPPublisher::FindClosestBufferIndex(DWORD timestamp)
 {
     UINT index;
@@ -415,6 +402,13 @@ void RTMPPublisher::InitializeBuffer()
     }
 }
 
+void RTMPPublisher::ClearBufferedPackets()
+{
+    for (UINT i=0; i<bufferedPackets.Num(); i++)
+        bufferedPackets[i].data->Release();
+    bufferedPackets.Clear();
+}
+
 void RTMPPublisher::FlushBufferedPackets()
 {
     if (!bufferedPackets.Num())
@@ -434,9 +428,7 @@ void RTMPPublisher::FlushBufferedPackets()
             OSSleep (1);
         } while (curTime - startTime < packet.timestamp - baseTimestamp);
 
-        SendPacketForReal(packet.data.Array(), packet.data.Num(), packet.timestamp, packet.type);
-
-        packet.data.Clear();
+        SendPacketForReal(packet.data, packet.timestamp, packet.type);
     }
 
     bufferedPackets.Clear();
@@ -486,7 +478,7 @@ void RTMPPublisher::ProcessPackets()
         ReleaseSemaphore(hSendSempahore, 1, NULL);
 }
 
-void RTMPPublisher::SendPacket(BYTE *data, UINT size, DWORD timestamp, PacketType type)
+void RTMPPublisher::SendPacket(PacketBuffer *data, DWORD timestamp, PacketType type)
 {
     if(!bConnected && !bConnecting && !bStopping)
     {
@@ -502,7 +494,7 @@ void RTMPPublisher::SendPacket(BYTE *data, UINT size, DWORD timestamp, PacketTyp
             if (type != PacketType_VideoHighest)
                 return;
         
-            bufferedPackets.Clear();
+            ClearBufferedPackets();
         }
 
         if (bConnected && bFirstKeyframe)
@@ -518,10 +510,10 @@ void RTMPPublisher::SendPacket(BYTE *data, UINT size, DWORD timestamp, PacketTyp
                 bufferedPackets.Remove(0);
                 packet.timestamp = 0;
 
-                SendPacketForReal(packet.data.Array(), packet.data.Num(), packet.timestamp, packet.type);
+                SendPacketForReal(packet.data, packet.timestamp, packet.type);
             }
             else
-                bufferedPackets.Clear();
+                ClearBufferedPackets();
         }
     }
     else
@@ -550,7 +542,7 @@ void RTMPPublisher::SendPacket(BYTE *data, UINT size, DWORD timestamp, PacketTyp
         mcpy(&packet, &bufferedPackets[0], sizeof(TimedPacket));
         bufferedPackets.Remove(0);
 
-        SendPacketForReal(packet.data.Array(), packet.data.Num(), packet.timestamp, packet.type);
+        SendPacketForReal(packet.data, packet.timestamp, packet.type);
     }
 
     timestamp -= firstTimestamp;
@@ -570,18 +562,21 @@ void RTMPPublisher::SendPacket(BYTE *data, UINT size, DWORD timestamp, PacketTyp
         packet = bufferedPackets.CreateNew();
     }
 
-    packet->data.CopyArray(data, size);
+    data->AddRef();
+
+    packet->data = data;
     packet->timestamp = timestamp;
     packet->type = type;
 
     /*for (UINT i=0; i<bufferedPackets.Num(); i++)
     {
-        if (bufferedPackets[i].data.Array() == 0)
+        if (bufferedPackets[i].data == NULL)
             nop();
     }*/
 }
 
-void RTMPPublisher::SendPacketForReal(BYTE *data, UINT size, DWORD timestamp, PacketType type)
+//takes over the caller's reference to data
+void RTMPPublisher::SendPacketForReal(PacketBuffer *data, DWORD timestamp, PacketType type)
 {
     //OSDebugOut (TEXT("%u: SendPacketForReal (%d bytes - %08x @ %u, type %d)\n"), OSGetTime(), size, quickHash(data,size), timestamp, type);
     //Log(TEXT("packet| timestamp: %u, type: %u, bytes: %u"), timestamp, (UINT)type, size);
@@ -627,30 +622,29 @@ void RTMPPublisher::SendPacketForReal(BYTE *data, UINT size, DWORD timestamp, Pa
 
             if(bAddPacket)
             {
-                List<BYTE> paddedData;
-                paddedData.SetSize(size+RTMP_MAX_HEADER_SIZE);
-                mcpy(paddedData.Array()+RTMP_MAX_HEADER_SIZE, data, size);
-
                 if(!bSentFirstKeyframe)
                 {
+                    //only time a packet gets copied, the SEI has to go in after the 5 byte FLV video header
                     DataPacket sei;
-                    App->GetVideoEncoder()->GetSEI(sei);
-                    paddedData.InsertArray(RTMP_MAX_HEADER_SIZE+5, sei.lpPacket, sei.size);
+                    host->GetSEI(sei);
+
+                    PacketBuffer *seiData = PacketBuffer::Create(data->Size()+sei.size);
+                    mcpy(seiData->Data(), data->Data(), 5);
+                    mcpy(seiData->Data()+5, sei.lpPacket, sei.size);
+                    mcpy(seiData->Data()+5+sei.size, data->Data()+5, data->Size()-5);
+
+                    data->Release();
+                    data = seiData;
 
                     bSentFirstKeyframe = true;
                 }
 
-                currentBufferSize += paddedData.Num();
+                currentBufferSize += data->Size()+RTMP_MAX_HEADER_SIZE;
 
                 UINT droppedFrameVal = queuedPackets.Num() ? queuedPackets.Last().distanceFromDroppedFrame+1 : 10000;
 
-                UINT id = FindClosestQueueIndex(timestamp);
-
-                NetworkPacket *queuedPacket = queuedPackets.InsertNew(id);
-                queuedPacket->distanceFromDroppedFrame = droppedFrameVal;
-                queuedPacket->data.TransferFrom(paddedData);
-                queuedPacket->timestamp = timestamp;
-                queuedPacket->type = type;
+                queuedPackets.Insert(data, timestamp, type, droppedFrameVal);
+                data = NULL;
             }
             else
             {
@@ -663,6 +657,9 @@ void RTMPPublisher::SendPacketForReal(BYTE *data, UINT size, DWORD timestamp, Pa
     }
 
     OSLeaveMutex(hDataMutex);
+
+    if(data)
+        data->Release();
 }
 
 void RTMPPublisher::BeginPublishingInternal()
@@ -682,12 +679,12 @@ void RTMPPublisher::BeginPublishingInternal()
     char *enc = packet.m_body;
     enc = AMF_EncodeString(enc, pend, &av_setDataFrame);
     enc = AMF_EncodeString(enc, pend, &av_onMetaData);
-    enc = App->EncMetaData(enc, pend);
+    enc = host->EncMetaData(enc, pend);
 
     packet.m_nBodySize = enc - packet.m_body;
     if(!RTMP_SendPacket(rtmp, &packet, FALSE))
     {
-        App->PostStopMessage();
+        host->RequestStop(true);
         return;
     }
 
@@ -701,7 +698,7 @@ void RTMPPublisher::BeginPublishingInternal()
     packet.m_nChannel = 0x05; // source channel
     packet.m_packetType = RTMP_PACKET_TYPE_AUDIO;
 
-    App->GetAudioHeaders(mediaHeaders);
+    host->GetAudioHeaders(mediaHeaders);
 
     packetPadding.SetSize(RTMP_MAX_HEADER_SIZE);
     packetPadding.AppendArray(mediaHeaders.lpPacket, mediaHeaders.size);
@@ -710,7 +707,7 @@ void RTMPPublisher::BeginPublishingInternal()
     packet.m_nBodySize = mediaHeaders.size;
     if(!RTMP_SendPacket(rtmp, &packet, FALSE))
     {
-        App->PostStopMessage();
+        host->RequestStop(true);
         return;
     }
 
@@ -720,7 +717,7 @@ void RTMPPublisher::BeginPublishingInternal()
     packet.m_headerType = RTMP_PACKET_SIZE_LARGE;
     packet.m_packetType = RTMP_PACKET_TYPE_VIDEO;
 
-    App->GetVideoHeaders(mediaHeaders);
+    host->GetVideoHeaders(mediaHeaders);
 
     packetPadding.SetSize(RTMP_MAX_HEADER_SIZE);
     packetPadding.AppendArray(mediaHeaders.lpPacket, mediaHeaders.size);
@@ -729,7 +726,7 @@ void RTMPPublisher::BeginPublishingInternal()
     packet.m_nBodySize = mediaHeaders.size;
     if(!RTMP_SendPacket(rtmp, &packet, FALSE))
     {
-        App->PostStopMessage();
+        host->RequestStop(true);
         return;
     }
 }
@@ -934,7 +931,14 @@ DWORD WINAPI RTMPPublisher::CreateConnectionThread(RTMPPublisher *publisher)
     else if(tcpBufferSize > 1024*1024)
         tcpBufferSize = 1024*1024;
 
-    rtmp->m_outChunkSize = 4096;//RTMP_DEFAULT_CHUNKSIZE;//
+    //with big chunks most frames go out as a single chunk, so there are fewer chunk headers and fewer buffer writes per frame
+    int chunkSize = AppConfig->GetInt(TEXT("Publish"), TEXT("ChunkSize"), 65536);
+    if(chunkSize < RTMP_DEFAULT_CHUNKSIZE)
+        chunkSize = RTMP_DEFAULT_CHUNKSIZE;
+    else if(chunkSize > 0xFFFFFF)
+        chunkSize = 0xFFFFFF;
+
+    rtmp->m_outChunkSize = chunkSize;
     rtmp->m_bSendChunkSizeInfo = TRUE;
 
     rtmp->m_bUseNagle = TRUE;
@@ -1006,10 +1010,10 @@ end:
         OSLeaveMutex(publisher->hRTMPMutex);
 
         if(failReason.IsValid())
-            App->SetStreamReport(failReason);
+            publisher->host->SetStreamReport(failReason);
 
         if(!publisher->bStopping)
-            PostMessage(hwndMain, OBS_REQUESTSTOP, bCanRetry ? 0 : 1, 0);
+            publisher->host->RequestStop(bCanRetry);
 
         Log(TEXT("Connection to %s failed: %s"), strURL.Array(), failReason.Array());
 
@@ -1041,6 +1045,11 @@ QWORD RTMPPublisher::GetCurrentSentBytes()
     return bytesSent;
 }
 
+DWORD RTMPPublisher::GetSendThroughput(bool &bLinkLimited) const
+{
+    return throughput.GetEstimate(bLinkLimited);
+}
+
 DWORD RTMPPublisher::NumDroppedFrames() const
 {
     return numBFramesDumped+numPFramesDumped;
@@ -1084,7 +1093,7 @@ void RTMPPublisher::FatalSocketShutdown()
     //anything buffered is invalid now
     curDataBufferLen = 0;
 
-    App->PostStopMessage();
+    host->RequestStop(true);
 }
 
 void RTMPPublisher::SocketLoop()
@@ -1158,7 +1167,7 @@ void RTMPPublisher::SocketLoop()
         if (status == WAIT_ABANDONED || status == WAIT_FAILED)
         {
             Log(TEXT("RTMPPublisher::SocketLoop: Aborting due to WaitForMultipleObjects failure"));
-            App->PostStopMessage();
+            host->RequestStop(true);
             return;
         }
 
@@ -1168,7 +1177,7 @@ void RTMPPublisher::SocketLoop()
             if (WSAEnumNetworkEvents (rtmp->m_sb.sb_socket, NULL, &networkEvents))
             {
                 Log(TEXT("RTMPPublisher::SocketLoop: Aborting due to WSAEnumNetworkEvents failure, %d"), WSAGetLastError());
-                App->PostStopMessage();
+                host->RequestStop(true);
                 return;
             }
 
@@ -1262,14 +1271,15 @@ void RTMPPublisher::SocketLoop()
                     break;
                 }
                 
-                int ret;
+                int ret, sendLength;
                 if (lowLatencyMode != LL_MODE_NONE)
                 {
-                    int sendLength = min (latencyPacketSize, curDataBufferLen);
+                    sendLength = min (latencyPacketSize, curDataBufferLen);
                     ret = send(rtmp->m_sb.sb_socket, (const char *)dataBuffer, sendLength, 0);
                 }
                 else
                 {
+                    sendLength = curDataBufferLen;
                     ret = send(rtmp->m_sb.sb_socket, (const char *)dataBuffer, curDataBufferLen, 0);
                 }
 
@@ -1281,6 +1291,8 @@ void RTMPPublisher::SocketLoop()
 
                     bytesSent += ret;
 
+                    throughput.Update(ret, curDataBufferLen, OSGetTime());
+
                     if (lastSendTime)
                     {
                         DWORD diff = OSGetTime() - lastSendTime;
@@ -1308,6 +1320,7 @@ void RTMPPublisher::SocketLoop()
 
                         if (errorCode == WSAEWOULDBLOCK)
                         {
+                            throughput.Update(0, curDataBufferLen, OSGetTime());
                             canWrite = false;
                             OSLeaveMutex(hDataBufferMutex);
                             break;
@@ -1360,14 +1373,11 @@ void RTMPPublisher::SendLoop()
                 break;
             }
 
-            List<BYTE> packetData;
             PacketType type       = queuedPackets[0].type;
             DWORD      timestamp  = queuedPackets[0].timestamp;
-            packetData.TransferFrom(queuedPackets[0].data);
-
-            currentBufferSize -= packetData.Num();
+            PacketBuffer *packetData = queuedPackets.PopFront();
 
-            queuedPackets.Remove(0);
+            currentBufferSize -= packetData->Size()+RTMP_MAX_HEADER_SIZE;
 
             OSLeaveMutex(hDataMutex);
 
@@ -1381,17 +1391,24 @@ void RTMPPublisher::SendLoop()
             packet.m_nInfoField2 = rtmp->m_stream_id;
             packet.m_hasAbsTimestamp = TRUE;
 
-            packet.m_nBodySize = packetData.Num()-RTMP_MAX_HEADER_SIZE;
-            packet.m_body = (char*)packetData.Array()+RTMP_MAX_HEADER_SIZE;
+            //the header gets written into the buffer's headroom
+            packet.m_nBodySize = packetData->Size();
+            packet.m_body = (char*)packetData->Data();
 
             //QWORD sendTimeStart = OSGetTimeMicroseconds();
-            if(!RTMP_SendPacket(rtmp, &packet, FALSE))
+            BOOL bSent;
+            profileIn("RTMP send");
+            bSent = RTMP_SendPacket(rtmp, &packet, FALSE);
+            profileOut;
+            packetData->Release();
+
+            if(!bSent)
             {
                 //should never reach here with the new shutdown sequence.
                 RUNONCE Log(TEXT("RTMP_SendPacket failure, should not happen!"));
                 if(!RTMP_IsConnected(rtmp))
                 {
-                    App->PostStopMessage();
+                    host->RequestStop(true);
                     break;
                 }
             }
@@ -1438,11 +1455,10 @@ DWORD RTMPPublisher::SocketThread(RTMPPublisher *publisher)
 void RTMPPublisher::DropFrame(UINT id)
 {
     NetworkPacket &dropPacket = queuedPackets[id];
-    currentBufferSize -= dropPacket.data.Num();
+    currentBufferSize -= dropPacket.data->Size()+RTMP_MAX_HEADER_SIZE;
     PacketType type = dropPacket.type;
-    dropPacket.data.Clear();
 
-    if(dropPacket.type < PacketType_VideoHigh)
+    if(type < PacketType_VideoHigh)
         numBFramesDumped++;
     else
         numPFramesDumped++;
@@ -1453,7 +1469,7 @@ void RTMPPublisher::DropFrame(UINT id)
         if(queuedPackets[i].distanceFromDroppedFrame <= distance)
             break;
 
-        queuedPackets[i].distanceFromDroppedFrame = distance;
+        queuedPackets.SetDistanceFromDroppedFrame(i, distance);
     }
 
     for(int i=int(id)-1; i>=0; i--)
@@ -1462,7 +1478,7 @@ void RTMPPublisher::DropFrame(UINT id)
         if(queuedPackets[i].distanceFromDroppedFrame <= distance)
             break;
 
-        queuedPackets[i].distanceFromDroppedFrame = distance;
+        queuedPackets.SetDistanceFromDroppedFrame(i, distance);
     }
 
     bool bSetPriority = true;
@@ -1475,14 +1491,13 @@ void RTMPPublisher::DropFrame(UINT id)
             {
                 if(packet.type < PacketType_VideoHighest)
                 {
-                    currentBufferSize -= packet.data.Num();
-                    packet.data.Clear();
-                    queuedPackets.Remove(i--);
-
                     if(packet.type < PacketType_VideoHigh)
                         numBFramesDumped++;
                     else
                         numPFramesDumped++;
+
+                    currentBufferSize -= packet.data->Size()+RTMP_MAX_HEADER_SIZE;
+                    queuedPackets.Remove(i--);
                 }
                 else
                 {
@@ -1522,13 +1537,12 @@ bool RTMPPublisher::DoIFrameDelay(bool bBFramesOnly)
            bBFramesOnly && curWaitType < PacketType_VideoHigh)
     {
         UINT bestPacket = INVALID;
-        UINT bestPacketDistance = 0;
 
         if(curWaitType == PacketType_VideoHigh)
         {
             bool bFoundIFrame = false;
 
-            for(int i=int(queuedPackets.Num())-1; i>=0; i--)
+            for(int i=int(queuedPackets.Num())-1; queuedPackets.NumOfType(PacketType_VideoHigh) && i>=0; i--)
             {
                 NetworkPacket &packet = queuedPackets[i];
                 if(packet.type == PacketType_Audio)
@@ -1549,20 +1563,7 @@ bool RTMPPublisher::DoIFrameDelay(bool bBFramesOnly)
             }
         }
         else
-        {
-            for(UINT i=0; i<queuedPackets.Num(); i++)
-            {
-                NetworkPacket &packet = queuedPackets[i];
-                if(packet.type <= curWaitType)
-                {
-                    if(packet.distanceFromDroppedFrame > bestPacketDistance)
-                    {
-                        bestPacket = i;
-                        bestPacketDistance = packet.distanceFromDroppedFrame;
-                    }
-                }
-            }
-        }
+            bestPacket = queuedPackets.FindDropCandidate(curWaitType);
 
         if(bestPacket != INVALID)
         {
@@ -1579,50 +1580,82 @@ bool RTMPPublisher::DoIFrameDelay(bool bBFramesOnly)
 
 void RTMPPublisher::RequestKeyframe(int waitTime)
 {
-    App->RequestKeyframe(waitTime);
+    host->RequestKeyframe(waitTime);
 }
 
 int RTMPPublisher::BufferedSend(RTMPSockBuf *sb, const char *buf, int len, RTMPPublisher *network)
 {
-    bool bComplete = false;
-    int fullLen = len;
+    RTMPIOVec vec;
+    vec.buf = buf;
+    vec.len = len;
 
-    //NOTE: This function is called from the SendLoop thread, be careful of race conditions.
+    return BufferedSendV(sb, &vec, 1, network);
+}
 
-retrySend:
+//  librtmp hands over every chunk of a packet at once, so the buffer is only locked and the socket loop
+//only signaled once per packet.  whatever fits is copied right away and the rest goes in as the socket
+//loop frees up space, so a packet bigger than the whole buffer can't block forever.
+int RTMPPublisher::BufferedSendV(RTMPSockBuf *sb, const RTMPIOVec *vec, int count, RTMPPublisher *network)
+{
+    int fullLen = 0;
+    for(int i=0; i<count; i++)
+        fullLen += vec[i].len;
 
-    //We may have been disconnected mid-shutdown or something, just pretend we wrote the data
-    //to avoid blocking if the socket loop exited.
-    if (!RTMP_IsConnected(network->rtmp))
-        return len;
+    int curVec = 0, curOffset = 0, bytesLeft = fullLen;
 
-    OSEnterMutex(network->hDataBufferMutex);
+    //NOTE: This function is called from the SendLoop thread, be careful of race conditions.
 
-    if (network->curDataBufferLen + len >= network->dataBufferSize)
+    while(true)
     {
-        //Log(TEXT("RTMPPublisher::BufferedSend: Socket buffer is full (%d / %d bytes), waiting to send %d bytes"), network->curDataBufferLen, network->dataBufferSize, len);
-        ++network->totalTimesWaited;
-        network->totalBytesWaited += len;
+        //We may have been disconnected mid-shutdown or something, just pretend we wrote the data
+        //to avoid blocking if the socket loop exited.
+        if (!RTMP_IsConnected(network->rtmp))
+            return fullLen;
+
+        OSEnterMutex(network->hDataBufferMutex);
+
+        int spaceLeft = network->dataBufferSize - network->curDataBufferLen - 1;
+        while(curVec < count && spaceLeft > 0)
+        {
+            int copySize = MIN(vec[curVec].len - curOffset, spaceLeft);
+
+            mcpy(network->dataBuffer + network->curDataBufferLen, vec[curVec].buf + curOffset, copySize);
+            network->curDataBufferLen += copySize;
+
+            spaceLeft -= copySize;
+            bytesLeft -= copySize;
+            curOffset += copySize;
+
+            if(curOffset == vec[curVec].len)
+            {
+                curVec++;
+                curOffset = 0;
+            }
+        }
+
+        if(network->curDataBufferLen > network->peakDataBufferLen)
+            network->peakDataBufferLen = network->curDataBufferLen;
 
         OSLeaveMutex(network->hDataBufferMutex);
 
+        SetEvent (network->hBufferEvent);
+
+        if(!bytesLeft)
+            break;
+
+        //Log(TEXT("RTMPPublisher::BufferedSendV: Socket buffer is full (%d / %d bytes), waiting to send %d bytes"), network->curDataBufferLen, network->dataBufferSize, bytesLeft);
+        ++network->totalTimesWaited;
+        network->totalBytesWaited += bytesLeft;
+
         int status = WaitForSingleObject(network->hBufferSpaceAvailableEvent, INFINITE);
         if (status == WAIT_ABANDONED || status == WAIT_FAILED)
             return 0;
-        goto retrySend;
     }
 
-    mcpy(network->dataBuffer + network->curDataBufferLen, buf, len);
-    network->curDataBufferLen += len;
-
-    OSLeaveMutex(network->hDataBufferMutex);
-
-    SetEvent (network->hBufferEvent);
-
-    return len;
+    return fullLen;
 }
 
-NetworkStream* CreateRTMPPublisher()
+NetworkStream* CreateRTMPPublisher(PublisherHost *host)
 {
-    return new RTMPPublisher;
+    return new RTMPPublisher(host);
 }
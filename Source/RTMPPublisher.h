@@ -17,14 +17,8 @@
 ********************************************************************************/
 
 #include <Iphlpapi.h>
-
-struct NetworkPacket
-{
-    List<BYTE> data;
-    DWORD timestamp;
-    PacketType type;
-    UINT distanceFromDroppedFrame;
-};
+#include "PacketQueue.h"
+#include "ThroughputEstimator.h"
 
 //max latency in milliseconds allowed when using the send buffer
 const DWORD maxBufferTime = 600;
@@ -58,6 +52,7 @@ class RTMPPublisher : public NetworkStream
     void BeginPublishingInternal();
 
     static int BufferedSend(RTMPSockBuf *sb, const char *buf, int len, RTMPPublisher *network);
+    static int BufferedSendV(RTMPSockBuf *sb, const RTMPIOVec *vec, int count, RTMPPublisher *network);
 
     static String strRTMPErrors;
 
@@ -81,22 +76,24 @@ protected:
     bool bBufferFull;
 
     bool bFirstKeyframe;
-    UINT FindClosestQueueIndex(DWORD timestamp);
     UINT FindClosestBufferIndex(DWORD timestamp);
     void InitializeBuffer();
-    void SendPacketForReal(BYTE *data, UINT size, DWORD timestamp, PacketType type);
+    void ClearBufferedPackets();
+    void SendPacketForReal(PacketBuffer *data, DWORD timestamp, PacketType type);
 
     //-----------------------------------------------
     // frame drop stuff
 
     DWORD minFramedropTimestsamp;
     DWORD dropThreshold, bframeDropThreshold;
-    List<NetworkPacket> queuedPackets;
+    PacketQueue queuedPackets;
     UINT currentBufferSize;//, outputRateWindowTime;
     UINT lastBFrameDropTime;
 
     //-----------------------------------------------
 
+    PublisherHost *host;
+
     RTMP *rtmp;
 
     HANDLE hSendSempahore;
@@ -131,6 +128,7 @@ protected:
     int dataBufferSize;
 
     int curDataBufferLen;
+    int peakDataBufferLen;
 
     latencymode_t lowLatencyMode;
     int latencyFactor;
@@ -141,6 +139,9 @@ protected:
     DWORD totalSendPeriod;
     DWORD totalSendCount;
 
+    //throughput estimate, written by the socket thread
+    ThroughputEstimator throughput;
+
     bool bFastInitialKeyframe;
 
     void SendLoop();
@@ -160,16 +161,17 @@ protected:
     virtual void RequestKeyframe(int waitTime);
 
 public:
-    RTMPPublisher();
+    RTMPPublisher(PublisherHost *host);
     bool Init(UINT tcpBufferSize);
     ~RTMPPublisher();
 
-    void SendPacket(BYTE *data, UINT size, DWORD timestamp, PacketType type);
+    void SendPacket(PacketBuffer *data, DWORD timestamp, PacketType type);
 
     void BeginPublishing();
 
     double GetPacketStrain() const;
     QWORD GetCurrentSentBytes();
+    DWORD GetSendThroughput(bool &bLinkLimited) const;
     DWORD NumDroppedFrames() const;
     DWORD NumTotalVideoFrames() const {return totalVideoFrames;}
 };
@@ -75,6 +75,10 @@ class TextOutputSource : public ImageSource
     SIZE        textureSize;
     bool        bUsePointFiltering;
 
+    List<BYTE>  textBits;
+    SIZE        textBitsSize;
+    bool        bTextBitsChanged;
+
     bool        bMonitoringFileChanges;
     OSFileChangeData *fileChangeMonitor;
 
@@ -255,6 +259,8 @@ class TextOutputSource : public ImageSource
         return offset;
     }
 
+    //  rasterizes the text into textBits.  doesn't touch the graphics system, so it's done from Tick,
+    //which can run on a worker thread alongside other sources.
     void UpdateTexture()
     {
         HFONT hFont;
@@ -386,24 +392,11 @@ class TextOutputSource : public ImageSource
         //----------------------------------------------------------------------
         // write image
 
-        {
-            HDC hTempDC = CreateCompatibleDC(NULL);
-
-            BITMAPINFO bi;
-            zero(&bi, sizeof(bi));
-
-            void* lpBits;
-
-            BITMAPINFOHEADER &bih = bi.bmiHeader;
-            bih.biSize = sizeof(bih);
-            bih.biBitCount = 32;
-            bih.biWidth  = textSize.cx;
-            bih.biHeight = textSize.cy;
-            bih.biPlanes = 1;
+        textBits.SetSize(textSize.cx*textSize.cy*4);
+        textBitsSize = textSize;
 
-            HBITMAP hBitmap = CreateDIBSection(hTempDC, &bi, DIB_RGB_COLORS, &lpBits, NULL, 0);
-
-            Gdiplus::Bitmap      bmp(textSize.cx, textSize.cy, 4*textSize.cx, PixelFormat32bppARGB, (BYTE*)lpBits);
+        {
+            Gdiplus::Bitmap      bmp(textSize.cx, textSize.cy, 4*textSize.cx, PixelFormat32bppARGB, textBits.Array());
 
             graphics = new Gdiplus::Graphics(&bmp); 
 
@@ -464,33 +457,30 @@ class TextOutputSource : public ImageSource
 
             delete brush;
             delete graphics;
+        }
 
-            //----------------------------------------------------------------------
-            // upload texture
-
-            if(textureSize.cx != textSize.cx || textureSize.cy != textSize.cy)
-            {
-                if(texture)
-                {
-                    delete texture;
-                    texture = NULL;
-                }
-
-                mcpy(&textureSize, &textSize, sizeof(textureSize));
-                texture = CreateTexture(textSize.cx, textSize.cy, GS_BGRA, lpBits, FALSE, FALSE);
-            }
-            else if(texture)
-                texture->SetImage(lpBits, GS_IMAGEFORMAT_BGRA, 4*textSize.cx);
+        bTextBitsChanged = true;
+    }
 
-            if(!texture)
+    //the graphics half of updating, done in Preprocess on the render thread
+    void UploadTexture()
+    {
+        if(textureSize.cx != textBitsSize.cx || textureSize.cy != textBitsSize.cy)
+        {
+            if(texture)
             {
-                AppWarning(TEXT("TextSource::UpdateTexture: could not create texture"));
-                DeleteObject(hFont);
+                delete texture;
+                texture = NULL;
             }
 
-            DeleteDC(hTempDC);
-            DeleteObject(hBitmap);
+            mcpy(&textureSize, &textBitsSize, sizeof(textureSize));
+            texture = CreateTexture(textBitsSize.cx, textBitsSize.cy, GS_BGRA, textBits.Array(), FALSE, FALSE);
         }
+        else if(texture)
+            texture->SetImage(textBits.Array(), GS_IMAGEFORMAT_BGRA, 4*textBitsSize.cx);
+
+        if(!texture)
+            AppWarning(TEXT("TextSource::UpdateTexture: could not create texture"));
     }
 
 public:
@@ -529,16 +519,10 @@ public:
 
     void Preprocess()
     {
-        if(bMonitoringFileChanges)
+        if(bTextBitsChanged)
         {
-            if (OSFileHasChanged(fileChangeMonitor))
-                bUpdateTexture = true;
-        }
-
-        if(bUpdateTexture)
-        {
-            bUpdateTexture = false;
-            UpdateTexture();
+            bTextBitsChanged = false;
+            UploadTexture();
         }
     }
 
@@ -561,6 +545,18 @@ public:
             bDoUpdate = false;
             bUpdateTexture = true;
         }
+
+        if(bMonitoringFileChanges)
+        {
+            if (OSFileHasChanged(fileChangeMonitor))
+                bUpdateTexture = true;
+        }
+
+        if(bUpdateTexture)
+        {
+            bUpdateTexture = false;
+            UpdateTexture();
+        }
     }
 
     void Render(const Vect2 &pos, const Vect2 &size)
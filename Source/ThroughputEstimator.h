@@ -0,0 +1,78 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+//  estimates what the connection can carry from the publisher's sends, in one second windows.
+//a window only measures the link if data was waiting in the send buffer for all of it, the
+//socket never caught up, so everything it sent was as much as it could take.  a window where the
+//buffer ran dry at any point (or only hit the socket buffer's limit on a burst, like a keyframe)
+//only says the link carries at least that much.
+//
+//  only depends on OBSApi so the test harness can drive it with a simulated link.
+
+class ThroughputEstimator
+{
+    DWORD windowStart, windowBytes;
+    bool  bWindowDrained;
+
+    volatile DWORD estimatedKbps;
+    volatile bool  bLinkLimited;
+
+public:
+    inline ThroughputEstimator() : windowStart(0), windowBytes(0), bWindowDrained(true), estimatedKbps(0), bLinkLimited(false) {}
+
+    //call after every send attempt with what was sent (0 if the socket was full) and what's still
+    //waiting to be sent afterwards
+    inline void Update(DWORD bytesSent, DWORD bytesQueued, DWORD curTime)
+    {
+        if(!windowStart)
+            windowStart = curTime;
+
+        windowBytes += bytesSent;
+        if(!bytesQueued)
+            bWindowDrained = true;
+
+        DWORD elapsed = curTime-windowStart;
+        if(elapsed < 1000)
+            return;
+
+        DWORD kbps = DWORD(QWORD(windowBytes)*8/elapsed);
+
+        if(!bWindowDrained)
+            estimatedKbps = estimatedKbps ? (estimatedKbps*2 + kbps)/3 : kbps;
+        else if(kbps > estimatedKbps)
+            estimatedKbps = kbps;
+
+        bLinkLimited = !bWindowDrained;
+
+        //the next window starts out backlogged if this send left anything behind
+        windowStart    = curTime;
+        windowBytes    = 0;
+        bWindowDrained = (bytesQueued == 0);
+    }
+
+    //in kbps, 0 if there's no estimate yet
+    inline DWORD GetEstimate(bool &bLimited) const
+    {
+        bLimited = bLinkLimited;
+        return estimatedKbps;
+    }
+};
@@ -0,0 +1,165 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "Tests.h"
+#include "../libfaac/include/faac.h"
+
+//-----------------------------------------------------------------------------
+//  drives libfaac the way Encoder_AAC does, a block of numReadSamples at a time.
+//the encoder used to scale its whole input buffer by 32767 and hand it over as
+//FAAC_INPUT_FLOAT, now it hands the -1..1 floats over as FAAC_INPUT_FLOAT_UNIT and
+//faac scales them while it deinterleaves.  both have to give exactly the same stream.
+
+//something with a bit of everything in it: tones, a sweep, noise, and a quiet stretch
+static void MakeEncoderInput(List<float> &samples, UINT sampleRate, UINT channels, UINT seconds)
+{
+    TestRandom random(25);
+    UINT numFrames = sampleRate*seconds;
+    samples.SetSize(numFrames*channels);
+
+    for(UINT i=0; i<numFrames; i++)
+    {
+        float t = float(i)/float(sampleRate);
+        float envelope = (fmodf(t, 2.0f) < 1.8f) ? 1.0f : 0.02f;
+
+        for(UINT ch=0; ch<channels; ch++)
+        {
+            float tone  = 0.3f*sinf(6.2831853f*(220.0f+110.0f*ch)*t) + 0.1f*sinf(6.2831853f*(2000.0f+1500.0f*t)*t);
+            float noise = 0.05f*random.NextFloat();
+
+            samples[i*channels+ch] = (tone+noise)*envelope;
+        }
+    }
+}
+
+static bool EncodeAAC(UINT sampleRate, UINT channels, UINT bitRate, UINT inputFormat, const List<float> &samples, List<BYTE> &output)
+{
+    unsigned long numReadSamples, outputSize;
+    faacEncHandle faac = faacEncOpen(sampleRate, channels, &numReadSamples, &outputSize);
+    if(!faac)
+        return false;
+
+    faacEncConfigurationPtr config = faacEncGetCurrentConfiguration(faac);
+    config->bitRate = (bitRate*1000)/channels;
+    config->quantqual = 100;
+    config->inputFormat = inputFormat;
+    config->mpegVersion = MPEG4;
+    config->aacObjectType = LOW;
+    config->useLfe = 0;
+    config->outputFormat = 0;
+
+    if(!faacEncSetConfiguration(faac, config))
+    {
+        faacEncClose(faac);
+        return false;
+    }
+
+    List<float> block;
+    List<BYTE> packet;
+    block.SetSize(numReadSamples);
+    packet.SetSize(outputSize);
+
+    output.Clear();
+
+    bool bSuccess = true;
+    for(UINT pos=0; pos+numReadSamples <= samples.Num(); pos += numReadSamples)
+    {
+        mcpy(block.Array(), samples.Array()+pos, numReadSamples*sizeof(float));
+
+        //the separate pass Encoder_AAC used to make before FAAC_INPUT_FLOAT_UNIT
+        if(inputFormat == FAAC_INPUT_FLOAT)
+        {
+            for(UINT i=0; i<numReadSamples; i++)
+                block[i] *= 32767.0f;
+        }
+
+        int ret = faacEncEncode(faac, (int32_t*)block.Array(), numReadSamples, packet.Array(), outputSize);
+        if(ret < 0)
+        {
+            bSuccess = false;
+            break;
+        }
+
+        output.AppendArray(packet.Array(), ret);
+    }
+
+    //flush out the frames faac is still holding on to
+    int ret;
+    while(bSuccess && (ret = faacEncEncode(faac, NULL, 0, packet.Array(), outputSize)) > 0)
+        output.AppendArray(packet.Array(), ret);
+
+    faacEncClose(faac);
+    return bSuccess;
+}
+
+//-----------------------------------------------------------------------------
+
+OBS_TEST(AACFloatUnitMatchesFloat)
+{
+    const UINT configs[][3] = {{44100, 2, 128}, {48000, 2, 160}, {48000, 1, 64}};
+
+    for(UINT i=0; i<_countof(configs); i++)
+    {
+        UINT sampleRate = configs[i][0], channels = configs[i][1], bitRate = configs[i][2];
+
+        List<float> samples;
+        MakeEncoderInput(samples, sampleRate, channels, 3);
+
+        List<BYTE> floatOut, unitOut;
+        TEST_CHECK(EncodeAAC(sampleRate, channels, bitRate, FAAC_INPUT_FLOAT, samples, floatOut));
+        TEST_CHECK(EncodeAAC(sampleRate, channels, bitRate, FAAC_INPUT_FLOAT_UNIT, samples, unitOut));
+
+        TEST_CHECK(floatOut.Num() > 0);
+        TEST_CHECK(floatOut.Num() == unitOut.Num());
+        TEST_CHECK(memcmp(floatOut.Array(), unitOut.Array(), floatOut.Num()) == 0);
+    }
+
+    return true;
+}
+
+#define AAC_BENCH_SECONDS 10
+
+OBS_BENCHMARK(AACEncodeThroughput)
+{
+    const UINT configs[][3] = {{44100, 2, 128}, {48000, 2, 160}, {48000, 2, 320}};
+
+    TestPrint(TEXT("  %u seconds of audio per encode:\n"), AAC_BENCH_SECONDS);
+    TestPrint(TEXT("    %-22s %14s %14s %10s\n"), TEXT("config"), TEXT("float"), TEXT("float unit"), TEXT("realtime"));
+
+    bool bSuccess = true;
+
+    for(UINT i=0; i<_countof(configs); i++)
+    {
+        UINT sampleRate = configs[i][0], channels = configs[i][1], bitRate = configs[i][2];
+
+        List<float> samples;
+        MakeEncoderInput(samples, sampleRate, channels, AAC_BENCH_SECONDS);
+
+        List<BYTE> output;
+        double floatNS = TimeCalls([&] {bSuccess &= EncodeAAC(sampleRate, channels, bitRate, FAAC_INPUT_FLOAT, samples, output);});
+        double unitNS  = TimeCalls([&] {bSuccess &= EncodeAAC(sampleRate, channels, bitRate, FAAC_INPUT_FLOAT_UNIT, samples, output);});
+
+        String strFormat = FormattedString(TEXT("%u Hz %uch %u kbps"), sampleRate, channels, bitRate);
+        TestPrint(TEXT("    %-22s %11.1f ms %11.1f ms %9.1fx\n"), strFormat.Array(),
+            floatNS/1000000.0, unitNS/1000000.0, double(AAC_BENCH_SECONDS)*1000000000.0/unitNS);
+    }
+
+    TEST_CHECK(bSuccess);
+    return true;
+}
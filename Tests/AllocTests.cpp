@@ -0,0 +1,285 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "Tests.h"
+
+//-----------------------------------------------------------------------------
+//  multi-threaded allocator churn.  every worker keeps a table of live blocks and
+//randomly allocates, frees and reallocates them with a size mix weighted towards the
+//small blocks the app actually churns (packets, strings, list growth).  in the
+//cross-thread mode the workers allocate a batch each, then free their neighbour's
+//batch, which is what happens to encoder packets handed off to the outputs.
+//
+//  every block gets a tag written at both ends that's checked before it's freed, so
+//blocks handed out twice or overlapping show up as failures.
+
+#define NUM_SLOTS   512
+
+struct SpinBarrier
+{
+    volatile LONG count, generation;
+    LONG numThreads;
+
+    void Wait()
+    {
+        LONG curGeneration = generation;
+        if(InterlockedIncrement(&count) == numThreads)
+        {
+            count = 0;
+            InterlockedIncrement(&generation);
+        }
+        else
+        {
+            while(generation == curGeneration)
+                Sleep(0);
+        }
+    }
+};
+
+struct AllocSlot
+{
+    LPBYTE lpData;
+    size_t size;
+    BYTE   tag;
+};
+
+struct AllocWorker
+{
+    Alloc        *allocator;
+    SpinBarrier  *startBarrier, *roundBarrier;
+    AllocWorker  *workers;
+    UINT         numWorkers, index;
+    UINT         numRounds;
+    bool         bCrossThread;
+
+    AllocSlot    slots[NUM_SLOTS];
+    QWORD        numOps;
+    bool         bCorrupted;
+};
+
+static size_t RandomBlockSize(TestRandom &random)
+{
+    UINT val = random.Next(100);
+
+    if(val < 80) return 8    + random.Next(256);
+    if(val < 95) return 256  + random.Next(4096);
+    if(val < 99) return 4096 + random.Next(32768-4096);
+    return 32768 + random.Next(256*1024);
+}
+
+static inline void TagBlock(AllocSlot &slot, BYTE tag)
+{
+    slot.tag = tag;
+    slot.lpData[0] = tag;
+    slot.lpData[slot.size-1] = tag;
+}
+
+static inline bool CheckTag(const AllocSlot &slot)
+{
+    return slot.lpData[0] == slot.tag && slot.lpData[slot.size-1] == slot.tag;
+}
+
+static void FreeSlot(AllocWorker *worker, AllocSlot &slot)
+{
+    if(!CheckTag(slot))
+        worker->bCorrupted = true;
+
+    worker->allocator->_Free(slot.lpData);
+    slot.lpData = NULL;
+}
+
+static DWORD STDCALL AllocWorkerThread(LPVOID lpParam)
+{
+    AllocWorker *worker = (AllocWorker*)lpParam;
+    Alloc *allocator = worker->allocator;
+    TestRandom random(worker->index*7919 + 1);
+
+    worker->startBarrier->Wait();
+
+    for(UINT round=0; round<worker->numRounds; round++)
+    {
+        if(worker->bCrossThread)
+        {
+            for(UINT i=0; i<NUM_SLOTS; i++)
+            {
+                AllocSlot &slot = worker->slots[i];
+                slot.size   = RandomBlockSize(random);
+                slot.lpData = (LPBYTE)allocator->_Allocate(slot.size);
+                TagBlock(slot, BYTE(random.Next(256)));
+            }
+
+            worker->numOps += NUM_SLOTS;
+            worker->roundBarrier->Wait();
+
+            //free the batch the next worker allocated
+            AllocWorker &neighbour = worker->workers[(worker->index+1) % worker->numWorkers];
+            for(UINT i=0; i<NUM_SLOTS; i++)
+                FreeSlot(worker, neighbour.slots[i]);
+
+            worker->numOps += NUM_SLOTS;
+            worker->roundBarrier->Wait();
+        }
+        else
+        {
+            for(UINT i=0; i<NUM_SLOTS*2; i++)
+            {
+                AllocSlot &slot = worker->slots[random.Next(NUM_SLOTS)];
+
+                if(!slot.lpData)
+                {
+                    slot.size   = RandomBlockSize(random);
+                    slot.lpData = (LPBYTE)allocator->_Allocate(slot.size);
+                    TagBlock(slot, BYTE(random.Next(256)));
+                }
+                else if(random.Next(8) == 0)
+                {
+                    //realloc keeps the start of the block, the end gets a new tag
+                    if(!CheckTag(slot))
+                        worker->bCorrupted = true;
+
+                    slot.size   = RandomBlockSize(random);
+                    slot.lpData = (LPBYTE)allocator->_ReAllocate(slot.lpData, slot.size);
+                    if(slot.lpData[0] != slot.tag)
+                        worker->bCorrupted = true;
+                    TagBlock(slot, BYTE(random.Next(256)));
+                }
+                else
+                    FreeSlot(worker, slot);
+            }
+
+            worker->numOps += NUM_SLOTS*2;
+        }
+    }
+
+    for(UINT i=0; i<NUM_SLOTS; i++)
+    {
+        if(worker->slots[i].lpData)
+            FreeSlot(worker, worker->slots[i]);
+    }
+
+    return 0;
+}
+
+//returns nanoseconds per allocator call across all threads, or a negative value if a block was corrupted
+static double RunAllocWorkers(Alloc *allocator, UINT numThreads, UINT numRounds, bool bCrossThread)
+{
+    //the main thread only joins the start barrier so the timing starts with every worker ready
+    SpinBarrier startBarrier = {0, 0, LONG(numThreads+1)};
+    SpinBarrier roundBarrier = {0, 0, LONG(numThreads)};
+
+    AllocWorker *workers = (AllocWorker*)malloc(sizeof(AllocWorker)*numThreads);
+    zero(workers, sizeof(AllocWorker)*numThreads);
+
+    List<HANDLE> threads;
+    for(UINT i=0; i<numThreads; i++)
+    {
+        AllocWorker &worker = workers[i];
+        worker.allocator    = allocator;
+        worker.startBarrier = &startBarrier;
+        worker.roundBarrier = &roundBarrier;
+        worker.workers      = workers;
+        worker.numWorkers   = numThreads;
+        worker.index        = i;
+        worker.numRounds    = numRounds;
+        worker.bCrossThread = bCrossThread;
+
+        threads << OSCreateThread(AllocWorkerThread, &worker);
+    }
+
+    QWORD startTime = GetQPCTimeNS();
+    startBarrier.Wait();
+
+    for(UINT i=0; i<numThreads; i++)
+    {
+        OSWaitForThread(threads[i], NULL);
+        OSCloseThread(threads[i]);
+    }
+
+    QWORD elapsed = GetQPCTimeNS()-startTime;
+
+    QWORD numOps = 0;
+    bool bCorrupted = false;
+    for(UINT i=0; i<numThreads; i++)
+    {
+        numOps += workers[i].numOps;
+        bCorrupted |= workers[i].bCorrupted;
+    }
+
+    free(workers);
+
+    if(bCorrupted)
+        return -1.0;
+
+    return double(elapsed)/double(numOps);
+}
+
+//-----------------------------------------------------------------------------
+
+OBS_TEST(FastAllocThreadedChurn)
+{
+    const UINT threadCounts[] = {1, 4, 8};
+
+    for(UINT i=0; i<_countof(threadCounts); i++)
+    {
+        for(int crossThread=0; crossThread<2; crossThread++)
+        {
+            //a fresh allocator each time, so deleting it also checks the thread caches were handed back
+            FastAlloc *allocator = new FastAlloc;
+            double result = RunAllocWorkers(allocator, threadCounts[i], 20, crossThread != 0);
+            delete allocator;
+
+            if(result < 0.0)
+                TestPrint(TEXT("    %u thread(s)%s: a block was corrupted\n"), threadCounts[i], crossThread ? TEXT(", cross-thread frees") : TEXT(""));
+            TEST_CHECK(result >= 0.0);
+        }
+    }
+
+    return true;
+}
+
+OBS_BENCHMARK(FastAllocThreaded)
+{
+    const UINT threadCounts[] = {1, 2, 4, 8};
+    bool bSuccess = true;
+
+    TestPrint(TEXT("    %-8s %-13s %16s %16s\n"), TEXT("threads"), TEXT("pattern"), TEXT("FastAlloc"), TEXT("DefaultAlloc"));
+
+    for(UINT i=0; i<_countof(threadCounts); i++)
+    {
+        for(int crossThread=0; crossThread<2; crossThread++)
+        {
+            double results[2];
+
+            for(int allocID=0; allocID<2; allocID++)
+            {
+                Alloc *allocator = allocID ? (Alloc*)new DefaultAlloc : (Alloc*)new FastAlloc;
+                results[allocID] = RunAllocWorkers(allocator, threadCounts[i], 400, crossThread != 0);
+                delete allocator;
+
+                bSuccess &= (results[allocID] >= 0.0);
+            }
+
+            TestPrint(TEXT("    %-8u %-13s %10.1f ns/op %10.1f ns/op\n"), threadCounts[i],
+                crossThread ? TEXT("cross-thread") : TEXT("same thread"), results[0], results[1]);
+        }
+    }
+
+    TEST_CHECK(bSuccess);
+    return true;
+}
@@ -0,0 +1,416 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "Tests.h"
+#include "TestAPI.h"
+#include <Audioclient.h>
+#include <limits.h>
+
+#define KSAUDIO_SPEAKER_4POINT1     (KSAUDIO_SPEAKER_QUAD|SPEAKER_LOW_FREQUENCY)
+#define KSAUDIO_SPEAKER_3POINT1     (KSAUDIO_SPEAKER_STEREO|SPEAKER_FRONT_CENTER|SPEAKER_LOW_FREQUENCY)
+#define KSAUDIO_SPEAKER_2POINT1     (KSAUDIO_SPEAKER_STEREO|SPEAKER_LOW_FREQUENCY)
+
+//-----------------------------------------------------------------------------
+//  checks the sample conversion and downmix kernels in AudioSource::QueryAudio2
+//against the scalar loops they replaced.  the kernels do the same math in the same
+//order, so the output has to match bit for bit, for every bit depth and speaker
+//layout, with odd frame counts (scalar tails) and unaligned input.
+
+const float dbMinus3    = 0.7071067811865476f;
+const float dbMinus6    = 0.5f;
+
+const float surroundMix = dbMinus3;
+const float centerMix   = dbMinus6;
+
+const float surroundMix4 = dbMinus6;
+
+const float attn5dot1 = 1.0f / (1.0f + centerMix + surroundMix);
+const float attn4dotX = 1.0f / (1.0f + surroundMix4);
+
+struct SpeakerLayout
+{
+    CTSTR lpName;
+    UINT  channels;
+    DWORD channelMask;
+};
+
+static const SpeakerLayout layouts[] =
+{
+    {TEXT("mono"),          1, KSAUDIO_SPEAKER_MONO},
+    {TEXT("stereo"),        2, KSAUDIO_SPEAKER_STEREO},
+    {TEXT("2.1"),           3, KSAUDIO_SPEAKER_2POINT1},
+    {TEXT("quad"),          4, KSAUDIO_SPEAKER_QUAD},
+    {TEXT("3.1"),           4, KSAUDIO_SPEAKER_3POINT1},
+    {TEXT("surround"),      4, KSAUDIO_SPEAKER_SURROUND},
+    {TEXT("4.1"),           5, KSAUDIO_SPEAKER_4POINT1},
+    {TEXT("5.1"),           6, KSAUDIO_SPEAKER_5POINT1},
+    {TEXT("5.1 surround"),  6, KSAUDIO_SPEAKER_5POINT1_SURROUND},
+    {TEXT("7.1"),           8, KSAUDIO_SPEAKER_7POINT1},
+    {TEXT("7.1 surround"),  8, KSAUDIO_SPEAKER_7POINT1_SURROUND},
+};
+
+//-----------------------------------------------------------------------------
+// the old scalar code
+
+static float RefSampleToFloat(const BYTE *in, bool bFloat, UINT bits, UINT index)
+{
+    if(bFloat)
+        return ((const float*)in)[index];
+
+    switch(bits)
+    {
+        case 8:  return float(((const char*)in)[index])/127.0f;
+        case 16: return float(((const short*)in)[index])/32767.0f;
+        case 24:
+            {
+                //the old loop meant to do this, but reinterpreted the pointer instead of the data
+                const BYTE *sample = in+index*3;
+                LONG val = LONG(UINT(sample[0]) << 8 | UINT(sample[1]) << 16 | UINT(sample[2]) << 24) >> 8;
+                return float(double(val)/8388607.0);
+            }
+        case 32: return float(double(((const long*)in)[index])/2147483647.0);
+    }
+
+    return 0.0f;
+}
+
+static void RefDownmixFrame(float *out, const float *in, const SpeakerLayout &layout)
+{
+    switch(layout.channelMask)
+    {
+        case KSAUDIO_SPEAKER_MONO:
+            out[0] = out[1] = in[0];
+            break;
+
+        case KSAUDIO_SPEAKER_STEREO:
+        case KSAUDIO_SPEAKER_2POINT1:
+        case KSAUDIO_SPEAKER_3POINT1:
+        case KSAUDIO_SPEAKER_SURROUND:
+            out[0] = in[0];
+            out[1] = in[1];
+            break;
+
+        case KSAUDIO_SPEAKER_QUAD:
+            {
+                float rearLeft  = in[2]*surroundMix4;
+                float rearRight = in[3]*surroundMix4;
+                out[0] = (in[0] + rearLeft)  * attn4dotX;
+                out[1] = (in[1] + rearRight) * attn4dotX;
+                break;
+            }
+
+        case KSAUDIO_SPEAKER_4POINT1:
+            {
+                float rearLeft  = in[3]*surroundMix4;
+                float rearRight = in[4]*surroundMix4;
+                out[0] = (in[0] + rearLeft)  * attn4dotX;
+                out[1] = (in[1] + rearRight) * attn4dotX;
+                break;
+            }
+
+        case KSAUDIO_SPEAKER_5POINT1:
+        case KSAUDIO_SPEAKER_5POINT1_SURROUND:
+        case KSAUDIO_SPEAKER_7POINT1:
+            {
+                float center    = in[2]*centerMix;
+                float rearLeft  = in[4]*surroundMix;
+                float rearRight = in[5]*surroundMix;
+                out[0] = (in[0] + center + rearLeft)  * attn5dot1;
+                out[1] = (in[1] + center + rearRight) * attn5dot1;
+                break;
+            }
+
+        case KSAUDIO_SPEAKER_7POINT1_SURROUND:
+            {
+                float center    = in[2] * centerMix;
+                float rearLeft  = (in[4] + in[6]) * 0.5f;
+                float rearRight = (in[5] + in[7]) * 0.5f;
+                out[0] = (in[0] + center + rearLeft  * surroundMix) * attn5dot1;
+                out[1] = (in[1] + center + rearRight * surroundMix) * attn5dot1;
+                break;
+            }
+    }
+}
+
+static void RefConvert(float *out, const BYTE *in, UINT numFrames, bool bFloat, UINT bits, const SpeakerLayout &layout)
+{
+    float frame[8];
+
+    for(UINT i=0; i<numFrames; i++)
+    {
+        for(UINT ch=0; ch<layout.channels; ch++)
+            frame[ch] = RefSampleToFloat(in, bFloat, bits, i*layout.channels + ch);
+
+        RefDownmixFrame(out+i*2, frame, layout);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+//hands QueryAudio2 one raw buffer at a time
+class RawAudioSource : public AudioSource
+{
+    const void *lpData;
+    UINT numFrames;
+    QWORD timestamp;
+    bool bPending;
+
+protected:
+    virtual CTSTR GetDeviceName() const {return TEXT("Raw");}
+
+    virtual bool GetNextBuffer(void **buffer, UINT *numFrames, QWORD *timestamp)
+    {
+        if(!bPending)
+            return false;
+
+        *buffer    = (void*)lpData;
+        *numFrames = this->numFrames;
+        *timestamp = this->timestamp;
+
+        bPending = false;
+        return true;
+    }
+
+    virtual void ReleaseBuffer() {}
+
+public:
+    RawAudioSource(bool bFloat, UINT bits, const SpeakerLayout &layout) : timestamp(0), bPending(false)
+    {
+        InitAudioData(bFloat, layout.channels, GetTestAPI()->GetSampleRateHz(), bits, layout.channels*bits/8, layout.channelMask);
+    }
+
+    //runs the buffer through QueryAudio2 and returns the stereo float result, valid until the next Flush
+    float* Process(const void *lpData, UINT numFrames)
+    {
+        this->lpData    = lpData;
+        this->numFrames = numFrames;
+        timestamp += 10;
+        bPending = true;
+
+        float *buffer;
+        if(QueryAudio2(1.0f, true) == NoAudioAvailable || !GetNewestFrame(&buffer))
+            return NULL;
+
+        return buffer;
+    }
+
+    void Flush()
+    {
+        QWORD segmentTime;
+        float *buffer;
+        while(GetEarliestTimestamp(segmentTime))
+            GetBuffer(&buffer, segmentTime);
+    }
+};
+
+static CTSTR FormatName(bool bFloat, UINT bits)
+{
+    if(bFloat)
+        return TEXT("float");
+
+    switch(bits)
+    {
+        case 8:  return TEXT("s8");
+        case 16: return TEXT("s16");
+        case 24: return TEXT("s24");
+        default: return TEXT("s32");
+    }
+}
+
+static void FillRandom(BYTE *data, UINT size, bool bFloat, TestRandom &random)
+{
+    if(bFloat)
+    {
+        for(UINT i=0; i<size/sizeof(float); i++)
+            ((float*)data)[i] = random.NextFloat();
+    }
+    else
+    {
+        for(UINT i=0; i<size; i++)
+            data[i] = BYTE(random.Next() >> 24);
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+OBS_TEST(AudioConvertMatchesScalar)
+{
+    const UINT bitDepths[] = {8, 16, 24, 32, 0}; //0 is float
+    const UINT frameCounts[] = {1, 2, 3, 4, 5, 7, 8, 17, 480, 481, 441};
+
+    TestRandom random;
+    List<BYTE> input;
+    List<float> expected;
+    bool bSuccess = true;
+
+    for(UINT layoutID=0; layoutID<_countof(layouts); layoutID++)
+    {
+        const SpeakerLayout &layout = layouts[layoutID];
+
+        for(UINT bitID=0; bitID<_countof(bitDepths); bitID++)
+        {
+            bool bFloat = (bitDepths[bitID] == 0);
+            UINT bits = bFloat ? 32 : bitDepths[bitID];
+            UINT frameSize = layout.channels*bits/8;
+
+            RawAudioSource *source = new RawAudioSource(bFloat, bits, layout);
+
+            for(UINT countID=0; countID<_countof(frameCounts); countID++)
+            {
+                UINT numFrames = frameCounts[countID];
+
+                //once from an aligned buffer, once starting one sample in
+                for(UINT offset=0; offset<=bits/8; offset += bits/8)
+                {
+                    input.SetSize(numFrames*frameSize + offset + 16);
+                    BYTE *lpInput = (BYTE*)((UPARAM(input.Array())+15) & ~UPARAM(15)) + offset;
+
+                    FillRandom(lpInput, numFrames*frameSize, bFloat, random);
+
+                    expected.SetSize(numFrames*2);
+                    RefConvert(expected.Array(), lpInput, numFrames, bFloat, bits, layout);
+
+                    float *output = source->Process(lpInput, numFrames);
+                    if(!output)
+                    {
+                        TestPrint(TEXT("    %s %s: no output for %u frames\n"), layout.lpName, FormatName(bFloat, bits), numFrames);
+                        bSuccess = false;
+                        continue;
+                    }
+
+                    for(UINT i=0; i<numFrames*2; i++)
+                    {
+                        if(output[i] != expected[i])
+                        {
+                            TestPrint(TEXT("    %s %s, %u frames, offset %u: sample %u is %.9g, expected %.9g\n"),
+                                layout.lpName, FormatName(bFloat, bits), numFrames, offset,
+                                i, output[i], expected[i]);
+                            bSuccess = false;
+                            break;
+                        }
+                    }
+
+                    source->Flush();
+                }
+            }
+
+            delete source;
+        }
+    }
+
+    TEST_CHECK(bSuccess);
+    return true;
+}
+
+//full scale and the clipping edges of each integer format
+OBS_TEST(AudioConvertExtremes)
+{
+    SpeakerLayout stereo = layouts[1];
+
+    short s16[] = {-32768, 32767, 0, -1, 1, -32767, 16384, -16384};
+    long  s32[] = {LONG_MIN, LONG_MAX, 0, -1, 1, -LONG_MAX, 0x40000000, -0x40000000};
+    char  s8[]  = {-128, 127, 0, -1, 1, -127, 64, -64, -128, 127, 0, -1, 1, -127, 64, -64};
+    BYTE  s24[] = {0x00,0x00,0x80, 0xFF,0xFF,0x7F, 0,0,0, 0xFF,0xFF,0xFF, 1,0,0, 1,0,0x80, 0,0,0x40, 0,0,0xC0};
+
+    struct {const void *data; UINT bits; UINT numFrames;} cases[] =
+    {
+        {s8,  8,  8},
+        {s16, 16, 4},
+        {s24, 24, 4},
+        {s32, 32, 4},
+    };
+
+    bool bSuccess = true;
+
+    for(UINT i=0; i<_countof(cases); i++)
+    {
+        RawAudioSource *source = new RawAudioSource(false, cases[i].bits, stereo);
+
+        float expected[16];
+        RefConvert(expected, (const BYTE*)cases[i].data, cases[i].numFrames, false, cases[i].bits, stereo);
+
+        float *output = source->Process(cases[i].data, cases[i].numFrames);
+        if(!output || memcmp(output, expected, cases[i].numFrames*2*sizeof(float)) != 0)
+        {
+            TestPrint(TEXT("    %u bit extremes don't match\n"), cases[i].bits);
+            bSuccess = false;
+        }
+
+        //and they all stay within [-1, 1], apart from the most negative value which lands
+        //just under (-128/127 at worst)
+        for(UINT j=0; output && j<cases[i].numFrames*2; j++)
+        {
+            if(output[j] > 1.0f || output[j] < -1.008f)
+            {
+                TestPrint(TEXT("    %u bit sample %u out of range: %g\n"), cases[i].bits, j, output[j]);
+                bSuccess = false;
+            }
+        }
+
+        delete source;
+    }
+
+    TEST_CHECK(bSuccess);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+//  time per 10ms segment through QueryAudio2 for each format, next to the old scalar
+//loops doing only the conversion and downmix.  the float stereo row is the fixed cost
+//of QueryAudio2 itself (segment allocation, volume, bookkeeping), so the kernel's cost
+//is roughly its row minus that one.
+OBS_BENCHMARK(AudioConvertKernels)
+{
+    const UINT numFrames = GetTestAPI()->GetSampleRateHz()/100;
+    const UINT bitDepths[] = {0, 16, 24, 32};
+
+    TestRandom random;
+    List<BYTE> input;
+    List<float> output;
+    output.SetSize(numFrames*2);
+
+    TestPrint(TEXT("    %-14s %-6s %14s %14s\n"), TEXT("layout"), TEXT("format"), TEXT("QueryAudio2"), TEXT("old scalar"));
+
+    for(UINT layoutID=0; layoutID<_countof(layouts); layoutID++)
+    {
+        const SpeakerLayout &layout = layouts[layoutID];
+
+        for(UINT bitID=0; bitID<_countof(bitDepths); bitID++)
+        {
+            bool bFloat = (bitDepths[bitID] == 0);
+            UINT bits = bFloat ? 32 : bitDepths[bitID];
+
+            input.SetSize(numFrames*layout.channels*bits/8);
+            FillRandom(input.Array(), input.Num(), bFloat, random);
+
+            RawAudioSource *source = new RawAudioSource(bFloat, bits, layout);
+            const BYTE *lpInput = input.Array();
+
+            double newNS = TimeCalls([&] {source->Process(lpInput, numFrames); source->Flush();});
+            double oldNS = TimeCalls([&] {RefConvert(output.Array(), lpInput, numFrames, bFloat, bits, layout);});
+
+            TestPrint(TEXT("    %-14s %-6s %11.0f ns %11.0f ns\n"), layout.lpName, FormatName(bFloat, bits), newNS, oldNS);
+
+            delete source;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,454 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "Tests.h"
+#include "TestAPI.h"
+#include "../Source/AudioMixClock.h"
+#include <mmsystem.h>
+
+//-----------------------------------------------------------------------------
+//  headless audio thread harness.  synthetic sources get 10ms segments pushed to them
+//from their own threads like capture devices do, and a mix loop pulls them through
+//AudioSource::QueryAudio2 either the old way (poll every 5ms) or the way
+//OBS::MainAudioLoop does now (AudioMixClock).  latency is measured from the push to
+//the moment the mix loop picks the segment up.
+
+struct SyntheticPacket
+{
+    QWORD timestamp;
+    QWORD pushTimeNS;
+};
+
+class SyntheticAudioSource : public AudioSource
+{
+    HANDLE hPacketMutex;
+    List<SyntheticPacket> packets;
+    List<float> samples;
+    bool bSignals;
+
+protected:
+    virtual CTSTR GetDeviceName() const {return TEXT("Synthetic");}
+
+    virtual bool GetNextBuffer(void **buffer, UINT *numFrames, QWORD *timestamp)
+    {
+        OSEnterMutex(hPacketMutex);
+
+        if(!packets.Num())
+        {
+            OSLeaveMutex(hPacketMutex);
+            return false;
+        }
+
+        SyntheticPacket packet = packets[0];
+        packets.Remove(0);
+
+        OSLeaveMutex(hPacketMutex);
+
+        QWORD latency = GetQPCTimeNS()-packet.pushTimeNS;
+        totalLatencyNS += latency;
+        if(latency > maxLatencyNS)
+            maxLatencyNS = latency;
+
+        if(numReceived && packet.timestamp != lastTimestamp+10)
+            bOutOfOrder = true;
+        lastTimestamp = packet.timestamp;
+        numReceived++;
+
+        *buffer    = samples.Array();
+        *numFrames = samples.Num()/2;
+        *timestamp = packet.timestamp;
+        return true;
+    }
+
+    virtual void ReleaseBuffer() {}
+
+public:
+    QWORD totalLatencyNS, maxLatencyNS;
+    QWORD lastTimestamp;
+    volatile UINT numPushed;
+    UINT numReceived;
+    bool bOutOfOrder;
+
+    SyntheticAudioSource(bool bSignals)
+        : bSignals(bSignals), totalLatencyNS(0), maxLatencyNS(0), lastTimestamp(0),
+          numPushed(0), numReceived(0), bOutOfOrder(false)
+    {
+        hPacketMutex = OSCreateMutex();
+        samples.SetSize(GetTestAPI()->GetSampleRateHz()/100*2);
+
+        InitAudioData(true, 2, GetTestAPI()->GetSampleRateHz(), 32, 8, 0);
+    }
+
+    ~SyntheticAudioSource()
+    {
+        OSCloseMutex(hPacketMutex);
+    }
+
+    inline bool SignalsData() const {return bSignals;}
+
+    void Push(QWORD timestamp)
+    {
+        SyntheticPacket packet = {timestamp, GetQPCTimeNS()};
+
+        OSEnterMutex(hPacketMutex);
+        packets << packet;
+        OSLeaveMutex(hPacketMutex);
+
+        numPushed++;
+
+        //pull-based sources (WASAPI) don't signal, the tick picks them up
+        if(bSignals)
+            OBSSignalAudioAvailable();
+    }
+
+    //pulls everything that's arrived and throws away the mixed segments
+    void Drain()
+    {
+        while(QueryAudio2(1.0f, true) != NoAudioAvailable);
+
+        QWORD timestamp;
+        float *buffer;
+        while(GetEarliestTimestamp(timestamp))
+            GetBuffer(&buffer, timestamp);
+    }
+};
+
+//-----------------------------------------------------------------------------
+
+struct ProducerInfo
+{
+    SyntheticAudioSource *source;
+    QWORD startTime;
+    UINT  seed;
+    volatile bool *lpStop;
+};
+
+static DWORD STDCALL ProducerThread(LPVOID lpParam)
+{
+    ProducerInfo *info = (ProducerInfo*)lpParam;
+    TestRandom random(info->seed);
+
+    //each device runs on its own phase, and is a ms or two late now and then
+    QWORD nextTime  = info->startTime + random.Next(10);
+    QWORD timestamp = nextTime;
+
+    while(!*info->lpStop)
+    {
+        QWORD dueTime = nextTime + random.Next(3);
+        QWORD curTime = GetQPCTimeMS();
+        if(dueTime > curTime)
+            OSSleep(DWORD(dueTime-curTime));
+
+        info->source->Push(timestamp);
+
+        timestamp += 10;
+        nextTime  += 10;
+    }
+
+    return 0;
+}
+
+enum MixWaitMode
+{
+    MixWait_Poll,
+    MixWait_Clock,
+};
+
+struct MixHarnessResults
+{
+    UINT   numWakeups;
+    UINT   numSignaledWakeups;
+    double wakeupsPerSec;
+    double avgSignaledLatencyMS, maxSignaledLatencyMS;
+    double avgPulledLatencyMS, maxPulledLatencyMS;
+};
+
+static bool RunMixHarness(MixWaitMode mode, UINT numSignaling, UINT numPulled, UINT durationMS, MixHarnessResults &results)
+{
+    TestAPI *testAPI = GetTestAPI();
+    HANDLE hAudioEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    testAPI->hAudioEvent = hAudioEvent;
+
+    UINT numSources = numSignaling+numPulled;
+
+    List<SyntheticAudioSource*> sources;
+    List<ProducerInfo> producerInfo;
+    List<HANDLE> producers;
+
+    for(UINT i=0; i<numSources; i++)
+        sources << new SyntheticAudioSource(i < numSignaling);
+
+    volatile bool bStop = false;
+    QWORD startTime = GetQPCTimeMS();
+
+    producerInfo.SetSize(numSources);
+    for(UINT i=0; i<numSources; i++)
+    {
+        ProducerInfo &info = producerInfo[i];
+        info.source    = sources[i];
+        info.startTime = startTime;
+        info.seed      = i+1;
+        info.lpStop    = &bStop;
+
+        producers << OSCreateThread(ProducerThread, &info);
+    }
+
+    //---------------------------------------------
+
+    AudioMixClock mixClock(hAudioEvent);
+    UINT numPolls = 0;
+
+    QWORD endTime = startTime+durationMS;
+    while(GetQPCTimeMS() < endTime)
+    {
+        if(mode == MixWait_Poll)
+        {
+            OSSleep(5);
+            numPolls++;
+        }
+        else
+            mixClock.Wait();
+
+        for(UINT i=0; i<numSources; i++)
+            sources[i]->Drain();
+    }
+
+    bStop = true;
+    for(UINT i=0; i<numSources; i++)
+    {
+        OSWaitForThread(producers[i], NULL);
+        OSCloseThread(producers[i]);
+    }
+
+    //anything pushed after the last pass
+    for(UINT i=0; i<numSources; i++)
+        sources[i]->Drain();
+
+    //---------------------------------------------
+
+    zero(&results, sizeof(results));
+
+    results.numWakeups         = (mode == MixWait_Poll) ? numPolls : mixClock.NumWakeups();
+    results.numSignaledWakeups = (mode == MixWait_Poll) ? 0 : mixClock.NumSignaledWakeups();
+    results.wakeupsPerSec      = double(results.numWakeups)*1000.0/double(durationMS);
+
+    bool bSuccess = true;
+    UINT numSignaledPackets = 0, numPulledPackets = 0;
+
+    for(UINT i=0; i<numSources; i++)
+    {
+        SyntheticAudioSource *source = sources[i];
+
+        if(source->numReceived != source->numPushed || source->bOutOfOrder)
+        {
+            TestPrint(TEXT("    source %u: pushed %u, received %u%s\n"), i, source->numPushed, source->numReceived,
+                source->bOutOfOrder ? TEXT(", out of order") : TEXT(""));
+            bSuccess = false;
+        }
+
+        double totalMS = double(source->totalLatencyNS)/1000000.0;
+        double maxMS   = double(source->maxLatencyNS)/1000000.0;
+
+        if(source->SignalsData())
+        {
+            results.avgSignaledLatencyMS += totalMS;
+            results.maxSignaledLatencyMS  = MAX(results.maxSignaledLatencyMS, maxMS);
+            numSignaledPackets += source->numReceived;
+        }
+        else
+        {
+            results.avgPulledLatencyMS += totalMS;
+            results.maxPulledLatencyMS  = MAX(results.maxPulledLatencyMS, maxMS);
+            numPulledPackets += source->numReceived;
+        }
+
+        delete source;
+    }
+
+    if(numSignaledPackets)
+        results.avgSignaledLatencyMS /= double(numSignaledPackets);
+    if(numPulledPackets)
+        results.avgPulledLatencyMS /= double(numPulledPackets);
+
+    testAPI->hAudioEvent = NULL;
+    CloseHandle(hAudioEvent);
+
+    return bSuccess;
+}
+
+static void PrintMixResults(CTSTR lpMode, const MixHarnessResults &results)
+{
+    TestPrint(TEXT("    %-6s %7.1f wakeups/s (%u signaled)   signaled latency avg %5.2f ms max %5.2f ms   pulled latency avg %5.2f ms max %5.2f ms\n"),
+        lpMode, results.wakeupsPerSec, results.numSignaledWakeups,
+        results.avgSignaledLatencyMS, results.maxSignaledLatencyMS,
+        results.avgPulledLatencyMS, results.maxPulledLatencyMS);
+}
+
+//-----------------------------------------------------------------------------
+
+OBS_TEST(AudioMixClockTicks)
+{
+    timeBeginPeriod(1);
+
+    HANDLE hEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+    AudioMixClock mixClock(hEvent);
+
+    //nothing signaling: the first wait is due right away, then one every 10ms
+    QWORD startTime = GetQPCTimeMS();
+    for(UINT i=0; i<20; i++)
+        mixClock.Wait();
+    QWORD elapsed = GetQPCTimeMS()-startTime;
+
+    bool bTickedOnTime = (elapsed >= 150 && elapsed < 1000);
+    bool bNoSignals    = (mixClock.NumSignaledWakeups() == 0);
+
+    //a signal ends the wait early and is reported as such
+    SetEvent(hEvent);
+    bool bSignaled = mixClock.Wait();
+
+    CloseHandle(hEvent);
+    timeEndPeriod(1);
+
+    TEST_CHECK(bTickedOnTime);
+    TEST_CHECK(bNoSignals);
+    TEST_CHECK(bSignaled);
+    TEST_CHECK(mixClock.NumWakeups() == 21);
+    return true;
+}
+
+OBS_TEST(AudioMixDeliversEverything)
+{
+    timeBeginPeriod(1);
+
+    MixHarnessResults results;
+    bool bSuccess = RunMixHarness(MixWait_Clock, 2, 2, 500, results);
+
+    timeEndPeriod(1);
+
+    TEST_CHECK(bSuccess);
+    return true;
+}
+
+OBS_BENCHMARK(AudioMixWakeups)
+{
+    timeBeginPeriod(1);
+
+    bool bSuccess = true;
+    const UINT configs[][2] = {{1, 0}, {0, 1}, {4, 0}, {2, 2}, {8, 0}};
+
+    for(UINT i=0; i<_countof(configs); i++)
+    {
+        MixHarnessResults pollResults, clockResults;
+
+        TestPrint(TEXT("  %u signaling source(s), %u pulled source(s), 3s each:\n"), configs[i][0], configs[i][1]);
+
+        bSuccess &= RunMixHarness(MixWait_Poll,  configs[i][0], configs[i][1], 3000, pollResults);
+        PrintMixResults(TEXT("poll"), pollResults);
+
+        bSuccess &= RunMixHarness(MixWait_Clock, configs[i][0], configs[i][1], 3000, clockResults);
+        PrintMixResults(TEXT("clock"), clockResults);
+    }
+
+    timeEndPeriod(1);
+
+    TEST_CHECK(bSuccess);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+//  MixAudioInputs has to give the same mix, rms and peak whether or not its buffers are 16 byte
+//aligned, against a plain scalar mix of the same inputs
+OBS_TEST(MixAudioInputsAlignment)
+{
+    const UINT numInputs = 3;
+    const UINT totalFloats = 970;   //not a multiple of 16, so the tail gets mixed too
+
+    TestRandom random;
+
+    //one extra float so the data can be moved off the 16 byte boundary
+    List<float, 16> inputData[numInputs];
+    for(UINT i=0; i<numInputs; i++)
+    {
+        inputData[i].SetSize(totalFloats+1);
+        for(UINT j=0; j<totalFloats+1; j++)
+            inputData[i][j] = random.NextFloat()*0.6f;
+    }
+
+    List<float> reference;
+    reference.SetSize(totalFloats);
+
+    bool bSuccess = true;
+
+    for(UINT offset=0; offset<2; offset++)
+    {
+        AudioMixInput inputs[numInputs];
+        for(UINT i=0; i<numInputs; i++)
+        {
+            inputs[i].buffer = inputData[i].Array()+offset;
+            inputs[i].bForceMono = (i == 1);
+        }
+
+        float referenceSum = 0.0f, referenceMax = 0.0f;
+
+        for(UINT i=0; i<totalFloats; i++)
+        {
+            float val = 0.0f;
+            for(UINT j=0; j<numInputs; j++)
+            {
+                const float *buffer = inputs[j].buffer;
+                val += inputs[j].bForceMono ? (buffer[i] + buffer[i^1]) * 0.5f : buffer[i];
+            }
+
+            if(val < -1.0f)     val = -1.0f;
+            else if(val > 1.0f) val = 1.0f;
+
+            reference[i] = val;
+            referenceSum += val*val;
+            referenceMax = MAX(referenceMax, fabsf(val));
+        }
+
+        float referenceRMS = sqrtf(referenceSum/totalFloats);
+
+        List<float, 16> dest;
+        dest.SetSize(totalFloats+1);
+
+        float rms, peak;
+        MixAudioInputs(dest.Array()+offset, inputs, numInputs, totalFloats, &rms, &peak);
+
+        for(UINT i=0; i<totalFloats; i++)
+        {
+            if(fabsf(dest[offset+i] - reference[i]) > 1e-6f)
+            {
+                TestPrint(TEXT("    offset %u: sample %u is %f, expected %f\n"), offset, i, dest[offset+i], reference[i]);
+                bSuccess = false;
+                break;
+            }
+        }
+
+        if(fabsf(rms - referenceRMS) > 1e-4f || fabsf(peak - referenceMax) > 1e-6f)
+        {
+            TestPrint(TEXT("    offset %u: rms %f peak %f, expected %f %f\n"), offset, rms, peak, referenceRMS, referenceMax);
+            bSuccess = false;
+        }
+    }
+
+    TEST_CHECK(bSuccess);
+    return true;
+}
@@ -0,0 +1,324 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "../Source/Main.h"
+#include "../Source/ThroughputEstimator.h"
+#include "../Source/BitrateController.h"
+#include "Tests.h"
+
+//-----------------------------------------------------------------------------
+//  runs BitrateController against a simulated link, a millisecond at a time.  the encoder
+//turns out I and P frames at whatever bitrate the controller set, they go into the
+//publisher's send buffer (sized like RTMPPublisher's), and from there into a socket buffer
+//that the link drains at its current capacity.  the send buffer's fill is the strain, the
+//sends feed a ThroughputEstimator like the socket loop does, and frames that don't fit in the
+//send buffer count as dropped.  nothing here sleeps, so minutes of stream take moments.
+
+#define SIM_FPS                 30
+#define SIM_KEYFRAME_INTERVAL   60      //frames
+#define SIM_AUDIO_KBPS          128
+#define SIM_SOCKET_BUFFER       (32*1024)
+
+struct LinkStep
+{
+    DWORD startTime;
+    UINT  kbps;
+};
+
+class SimulatedEncoder : public VideoEncoder
+{
+    int bitRate;
+
+protected:
+    virtual bool Encode(LPVOID picIn, List<DataPacket> &packets, List<PacketType> &packetTypes, DWORD timestamp) {return false;}
+
+public:
+    UINT numChanges;
+
+    SimulatedEncoder(int bitRate) : bitRate(bitRate), numChanges(0) {}
+
+    virtual int  GetBitRate() const                 {return bitRate;}
+    virtual bool DynamicBitrateSupported() const    {return true;}
+    virtual bool SetBitRate(DWORD maxBitrate, DWORD bufferSize) {bitRate = int(maxBitrate); numChanges++; return true;}
+
+    virtual void GetHeaders(DataPacket &packet)     {packet.lpPacket = NULL; packet.size = 0;}
+
+    virtual String GetInfoString() const            {return String(TEXT("simulated"));}
+};
+
+class SimulatedNetwork : public NetworkStream
+{
+    UINT dataBufferSize, dataBufferLen;
+    double socketQueued;
+    bool bBlocked;
+
+    ThroughputEstimator throughput;
+
+    QWORD bytesSent;
+    UINT numVideoFrames, numDropped;
+
+public:
+    SimulatedNetwork(UINT streamKbps)
+        : dataBufferLen(0), socketQueued(0.0), bBlocked(false), bytesSent(0), numVideoFrames(0), numDropped(0)
+    {
+        dataBufferSize = streamKbps/8*1024;
+    }
+
+    //the encoder's output, all at once like a frame coming out of the encoder
+    void AddFrame(UINT size, bool bVideo)
+    {
+        if(bVideo)
+            numVideoFrames++;
+
+        if(dataBufferLen+size > dataBufferSize)
+        {
+            if(bVideo)
+                numDropped++;
+            return;
+        }
+
+        dataBufferLen += size;
+    }
+
+    //a millisecond of the link draining the socket buffer, then the socket loop moving what fits into it
+    void Tick(UINT linkKbps, DWORD curTime)
+    {
+        socketQueued = MAX(socketQueued - double(linkKbps)/8.0, 0.0);
+
+        if(!dataBufferLen)
+            return;
+
+        UINT space = SIM_SOCKET_BUFFER - UINT(socketQueued+0.5);
+        if(!space)
+        {
+            //WSAEWOULDBLOCK once, then nothing until the socket says it's writable again
+            if(!bBlocked)
+                throughput.Update(0, dataBufferLen, curTime);
+            bBlocked = true;
+            return;
+        }
+
+        UINT sent = MIN(space, dataBufferLen);
+        dataBufferLen -= sent;
+        socketQueued  += double(sent);
+        bytesSent     += sent;
+        bBlocked = false;
+
+        throughput.Update(sent, dataBufferLen, curTime);
+    }
+
+    virtual void SendPacket(PacketBuffer *packet, DWORD timestamp, PacketType type) {}
+
+    virtual double GetPacketStrain() const          {return double(dataBufferLen)*100.0/double(dataBufferSize);}
+    virtual QWORD  GetCurrentSentBytes()            {return bytesSent;}
+    virtual DWORD  GetSendThroughput(bool &bLinkLimited) const {return throughput.GetEstimate(bLinkLimited);}
+    virtual DWORD  NumDroppedFrames() const         {return numDropped;}
+    virtual DWORD  NumTotalVideoFrames() const      {return numVideoFrames;}
+};
+
+struct SimulationResults
+{
+    int    minBitRate, finalBitRate;
+    double avgBitRate;
+    double sentKbps;
+    double avgStrain;
+    UINT   numChanges;
+    UINT   numDropped, numVideoFrames;
+    bool   bRecovered;          //back at the max bitrate after the last capacity change
+    DWORD  recoveryTime;        //how long that took
+};
+
+//the controller reads its settings from AppConfig, this points it at an empty one so it gets the defaults
+static ConfigFile* CreateDefaultConfig(String &strConfig)
+{
+    TCHAR lpTempPath[MAX_PATH];
+    GetTempPath(MAX_PATH, lpTempPath);
+    strConfig = FormattedString(TEXT("%sobs_congestion_%u.ini"), lpTempPath, GetCurrentProcessId());
+
+    ConfigFile *config = new ConfigFile;
+    config->Create(strConfig);
+    return config;
+}
+
+static void RunSimulation(const LinkStep *steps, UINT numSteps, int maxBitRate, DWORD durationMS, SimulationResults &results)
+{
+    zero(&results, sizeof(results));
+
+    String strConfig;
+    ConfigFile *config = CreateDefaultConfig(strConfig);
+    AppConfig = config;
+
+    SimulatedEncoder encoder(maxBitRate);
+    SimulatedNetwork network(UINT(maxBitRate+SIM_AUDIO_KBPS));
+    BitrateController *controller = new BitrateController(maxBitRate, SIM_AUDIO_KBPS);
+
+    TestRandom random;
+
+    results.minBitRate = maxBitRate;
+
+    QWORD totalBitRate = 0, totalBytes = 0;
+    double totalStrain = 0.0;
+    UINT numFrames = 0, curStep = 0, gopFrame = 0;
+    DWORD lastStepTime = steps[numSteps-1].startTime;
+
+    //the estimator takes 0 as "not started", so the clock starts at a second
+    const DWORD startTime = 1000;
+
+    for(DWORD ms=0; ms<durationMS; ms++)
+    {
+        DWORD curTime = startTime+ms;
+
+        while(curStep+1 < numSteps && ms >= steps[curStep+1].startTime)
+            curStep++;
+
+        if(ms*SIM_FPS/1000 >= numFrames)
+        {
+            //I frames are five times the size of a P frame, give or take a quarter like the rest
+            int bitRate = encoder.GetBitRate();
+            UINT unitSize = UINT(bitRate)*1000/8*SIM_KEYFRAME_INTERVAL/SIM_FPS/(5 + SIM_KEYFRAME_INTERVAL-1);
+            UINT size = unitSize*(gopFrame == 0 ? 5 : 1)*(750 + random.Next(500))/1000;
+
+            network.AddFrame(SIM_AUDIO_KBPS*1000/8/SIM_FPS, false);
+            network.AddFrame(size, true);
+
+            gopFrame = (gopFrame+1) % SIM_KEYFRAME_INTERVAL;
+            numFrames++;
+
+            if(controller->Update(&network, &encoder, curTime))
+            {
+                results.numChanges++;
+                results.minBitRate = MIN(results.minBitRate, controller->GetBitRate());
+            }
+
+            if(lastStepTime && ms >= lastStepTime && controller->GetBitRate() >= maxBitRate && !results.bRecovered)
+            {
+                results.bRecovered   = true;
+                results.recoveryTime = ms-lastStepTime;
+            }
+
+            totalBitRate += controller->GetBitRate();
+            totalStrain  += network.GetPacketStrain();
+        }
+
+        network.Tick(steps[curStep].kbps, curTime);
+    }
+
+    results.finalBitRate   = controller->GetBitRate();
+    results.avgBitRate     = double(totalBitRate)/double(numFrames);
+    results.avgStrain      = totalStrain/double(numFrames);
+    results.sentKbps       = double(network.GetCurrentSentBytes())*8.0/double(durationMS);
+    results.numDropped     = network.NumDroppedFrames();
+    results.numVideoFrames = network.NumTotalVideoFrames();
+
+    delete controller;
+
+    AppConfig = NULL;
+    delete config;
+    OSDeleteFile(strConfig);
+}
+
+//-----------------------------------------------------------------------------
+
+OBS_TEST(ThroughputEstimatorWindows)
+{
+    //keyframe bursts that fill the socket but drain before the next frame only give a lower bound
+    ThroughputEstimator bursty;
+    for(DWORD t=1; t<=5000; t++)
+    {
+        if(t%100 == 1)
+            bursty.Update(0, 50000, t);
+        else if(t%100 == 50)
+            bursty.Update(50000, 0, t);
+    }
+
+    bool bBurstyLimited;
+    DWORD burstyKbps = bursty.GetEstimate(bBurstyLimited);
+
+    //a backlog that never clears measures the link
+    ThroughputEstimator backlogged;
+    for(DWORD t=1; t<=5000; t++)
+        backlogged.Update(250, 100000, t);
+
+    bool bBackloggedLimited;
+    DWORD backloggedKbps = backlogged.GetEstimate(bBackloggedLimited);
+
+    TEST_CHECK(!bBurstyLimited);
+    TEST_CHECK(burstyKbps >= 3900 && burstyKbps <= 4100);
+    TEST_CHECK(bBackloggedLimited);
+    TEST_CHECK(backloggedKbps >= 1950 && backloggedKbps <= 2050);
+    return true;
+}
+
+OBS_TEST(BitrateControllerRecovers)
+{
+    //the link drops under half the stream for 40 seconds, then comes back with room to spare
+    const LinkStep steps[] = {{0, 6000}, {20000, 1500}, {60000, 6000}};
+
+    SimulationResults results;
+    RunSimulation(steps, _countof(steps), 4000, 200000, results);
+
+    TEST_CHECK(results.minBitRate < 1500);
+    TEST_CHECK(results.finalBitRate == 4000);
+    TEST_CHECK(results.bRecovered);
+    return true;
+}
+
+OBS_BENCHMARK(BitrateControllerLinks)
+{
+    struct Scenario
+    {
+        CTSTR lpName;
+        int maxBitRate;
+        DWORD durationMS;
+        LinkStep steps[4];
+        UINT numSteps;
+    };
+
+    const Scenario scenarios[] =
+    {
+        {TEXT("plenty of room"),            4000,   120000, {{0, 8000}},                                1},
+        {TEXT("just under the stream"),     4000,   120000, {{0, 3800}},                                1},
+        {TEXT("half the stream"),           4000,   120000, {{0, 2000}},                                1},
+        {TEXT("dip for 40s"),               4000,   200000, {{0, 6000}, {20000, 1500}, {60000, 6000}},  3},
+        {TEXT("dip, partial recovery"),     4000,   200000, {{0, 6000}, {20000, 1500}, {60000, 3000}},  3},
+        {TEXT("steps down"),                6000,   200000, {{0, 8000}, {30000, 5000}, {80000, 3000}, {130000, 1500}}, 4},
+    };
+
+    for(UINT i=0; i<_countof(scenarios); i++)
+    {
+        const Scenario &scenario = scenarios[i];
+
+        SimulationResults results;
+        RunSimulation(scenario.steps, scenario.numSteps, scenario.maxBitRate, scenario.durationMS, results);
+
+        String strRecovered;
+        if(scenario.numSteps == 1)
+            strRecovered = TEXT("-");
+        else if(results.bRecovered)
+            strRecovered = FormattedString(TEXT("after %u ms"), results.recoveryTime);
+        else
+            strRecovered = TEXT("never");
+
+        TestPrint(TEXT("  %-24s bitrate avg %5.0f min %5d final %5d kbps   sent %5.0f kbps   strain avg %5.1f%%   %3u changes   dropped %4u/%5u   back at max %s\n"),
+            scenario.lpName, results.avgBitRate, results.minBitRate, results.finalBitRate, results.sentKbps,
+            results.avgStrain, results.numChanges, results.numDropped, results.numVideoFrames, strRecovered.Array());
+    }
+
+    return true;
+}
@@ -0,0 +1,285 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "Tests.h"
+
+//-----------------------------------------------------------------------------
+//  ConfigFile lookups.  the test goes through the getters on a small hand written file
+//(case folding, repeated sections, typed values, values changed by SetKey), and checks
+//ConfigFile still has the layout plugins were built with.  the benchmark compares the
+//hashed index to the linear scan every getter used to do.
+
+static String GetTempConfigPath(CTSTR lpName)
+{
+    TCHAR lpTempPath[MAX_PATH];
+    GetTempPath(MAX_PATH, lpTempPath);
+    return FormattedString(TEXT("%sobs_%s_%u.ini"), lpTempPath, lpName, GetCurrentProcessId());
+}
+
+static bool WriteConfigText(CTSTR lpFile, const String &strText)
+{
+    XFile file;
+    if(!file.Open(lpFile, XFILE_WRITE, XFILE_CREATEALWAYS))
+        return false;
+
+    file.Write("\xEF\xBB\xBF", 3);
+    file.WriteAsUTF8(strText, strText.Length());
+    file.Close();
+    return true;
+}
+
+//the members ConfigFile had before it was indexed, plugins (NoiseGate, PSVPlugin) embed it
+struct OldConfigFileLayout
+{
+    List<ConfigSection> Sections;
+    BOOL   bOpen;
+    String strFileName;
+    TSTR   lpFileData;
+    DWORD  dwLength;
+};
+
+OBS_TEST(ConfigFileLookups)
+{
+    TEST_CHECK(sizeof(ConfigFile) == sizeof(OldConfigFileLayout));
+
+    String strFile = GetTempConfigPath(TEXT("config_test"));
+
+    String strText;
+    strText << TEXT("[General]\r\n")
+            << TEXT("Name=Test Profile\r\n")
+            << TEXT("//Commented=1\r\n")
+            << TEXT("Enabled=true\r\n")
+            << TEXT("Disabled=False\r\n")
+            << TEXT("Count=42\r\n")
+            << TEXT("Mask=0x10\r\n")
+            << TEXT("NotANumber=abc\r\n")
+            << TEXT("Scale=1.5\r\n")
+            << TEXT("List=1\r\n")
+            << TEXT("List=2\r\n")
+            << TEXT("[Video]\r\n")
+            << TEXT("Count=7\r\n")
+            << TEXT("[general]\r\n")
+            << TEXT("List=3\r\n")
+            << TEXT("Extra=5\r\n");
+    TEST_CHECK(WriteConfigText(strFile, strText));
+
+    ConfigFile config;
+    bool bOpened = config.Open(strFile) != 0;
+
+    bool bSuccess = bOpened;
+    if(bOpened)
+    {
+        //names are case insensitive, and the same key name in two sections is two keys
+        bSuccess &= scmp(config.GetString(TEXT("general"), TEXT("NAME")), TEXT("Test Profile")) == 0;
+        bSuccess &= config.GetInt(TEXT("General"), TEXT("Count")) == 42;
+        bSuccess &= config.GetInt(TEXT("Video"), TEXT("Count")) == 7;
+
+        //typed values
+        bSuccess &= config.GetInt(TEXT("General"), TEXT("Enabled")) == 1;
+        bSuccess &= config.GetInt(TEXT("General"), TEXT("Disabled"), 5) == 0;
+        bSuccess &= config.GetInt(TEXT("General"), TEXT("Mask")) == 16;
+        bSuccess &= config.GetInt(TEXT("General"), TEXT("NotANumber"), -3) == -3;
+        bSuccess &= config.GetFloat(TEXT("General"), TEXT("Scale")) == 1.5f;
+        bSuccess &= config.GetFloat(TEXT("General"), TEXT("Count")) == 42.0f;
+
+        //missing keys and sections, and commented out keys
+        bSuccess &= config.GetInt(TEXT("General"), TEXT("Missing"), 9) == 9;
+        bSuccess &= config.GetInt(TEXT("Missing"), TEXT("Count"), 9) == 9;
+        bSuccess &= config.GetStringPtr(TEXT("General"), TEXT("Commented")) == NULL;
+        bSuccess &= !config.HasKey(TEXT("Video"), TEXT("Name"));
+
+        //the repeated section adds to the first one, values in file order
+        List<int> values;
+        bSuccess &= config.GetIntList(TEXT("General"), TEXT("List"), values) != 0;
+        bSuccess &= values.Num() == 3 && values[0] == 1 && values[1] == 2 && values[2] == 3;
+        bSuccess &= config.GetInt(TEXT("General"), TEXT("Extra")) == 5;
+
+        //changes reload the file, the index has to follow
+        config.SetInt(TEXT("General"), TEXT("Count"), 43);
+        config.SetFloat(TEXT("Video"), TEXT("Added"), 2.5f);
+        config.Remove(TEXT("General"), TEXT("Name"));
+
+        bSuccess &= config.GetInt(TEXT("General"), TEXT("Count")) == 43;
+        bSuccess &= config.GetFloat(TEXT("Video"), TEXT("Added")) == 2.5f;
+        bSuccess &= !config.HasKey(TEXT("General"), TEXT("Name"));
+        bSuccess &= config.GetInt(TEXT("Video"), TEXT("Count")) == 7;
+
+        config.Close();
+        bSuccess &= !config.HasKey(TEXT("Video"), TEXT("Count"));
+    }
+
+    OSDeleteFile(strFile);
+
+    TEST_CHECK(bSuccess);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+#define CONFIG_NAME_SIZE 32
+
+struct LinearKey
+{
+    TCHAR name[CONFIG_NAME_SIZE];
+    TCHAR value[CONFIG_NAME_SIZE];
+};
+
+struct LinearSection
+{
+    TCHAR name[CONFIG_NAME_SIZE];
+    UINT  firstKey, numKeys;
+};
+
+struct LookupName
+{
+    TCHAR section[CONFIG_NAME_SIZE];
+    TCHAR key[CONFIG_NAME_SIZE];
+};
+
+//the way GetInt found a key before the index: every section, then every key in it
+static int LinearGetInt(const List<LinearSection> &sections, const List<LinearKey> &keys, CTSTR lpSection, CTSTR lpKey, int def)
+{
+    for(UINT i=0; i<sections.Num(); i++)
+    {
+        const LinearSection &section = sections[i];
+        if(scmpi(lpSection, section.name) != 0)
+            continue;
+
+        for(UINT j=0; j<section.numKeys; j++)
+        {
+            const LinearKey &key = keys[section.firstKey+j];
+            if(scmpi(lpKey, key.name) == 0)
+            {
+                if(ValidIntString((TSTR)key.value))
+                    return tstring_base_to_int((TSTR)key.value, NULL, 0);
+                return def;
+            }
+        }
+    }
+
+    return def;
+}
+
+OBS_BENCHMARK(ConfigFileLookup)
+{
+    const UINT configs[][2] = {{5, 10}, {40, 30}, {100, 100}};
+    const UINT numLookups = 1024;
+
+    String strFile = GetTempConfigPath(TEXT("config_bench"));
+    bool bSuccess = true;
+
+    TestPrint(TEXT("    %-18s %12s %12s %12s %12s %12s\n"), TEXT("sections x keys"), TEXT("linear"), TEXT("GetInt"),
+        TEXT("GetFloat"), TEXT("GetString"), TEXT("HasKey miss"));
+
+    for(UINT config=0; config<_countof(configs); config++)
+    {
+        UINT numSections = configs[config][0], numKeys = configs[config][1];
+        TestRandom random(config+1);
+
+        List<LinearSection> sections;
+        List<LinearKey> keys;
+        String strText;
+
+        sections.SetSize(numSections);
+        keys.SetSize(numSections*numKeys);
+
+        for(UINT i=0; i<numSections; i++)
+        {
+            LinearSection &section = sections[i];
+            tsprintf_s(section.name, CONFIG_NAME_SIZE-1, TEXT("Section%u"), i);
+            section.firstKey = i*numKeys;
+            section.numKeys  = numKeys;
+
+            strText << TEXT("[") << section.name << TEXT("]\r\n");
+
+            for(UINT j=0; j<numKeys; j++)
+            {
+                LinearKey &key = keys[i*numKeys+j];
+                tsprintf_s(key.name,  CONFIG_NAME_SIZE-1, TEXT("SettingName%u"), j);
+                tsprintf_s(key.value, CONFIG_NAME_SIZE-1, TEXT("%u"), random.Next(100000));
+
+                strText << key.name << TEXT("=") << key.value << TEXT("\r\n");
+            }
+        }
+
+        List<LookupName> lookups, misses;
+        lookups.SetSize(numLookups);
+        misses.SetSize(numLookups);
+
+        for(UINT i=0; i<numLookups; i++)
+        {
+            UINT section = random.Next(numSections), key = random.Next(numKeys);
+            scpy(lookups[i].section, sections[section].name);
+            scpy(lookups[i].key,     keys[section*numKeys+key].name);
+
+            scpy(misses[i].section, sections[section].name);
+            tsprintf_s(misses[i].key, CONFIG_NAME_SIZE-1, TEXT("MissingName%u"), key);
+        }
+
+        ConfigFile configFile;
+        if(!WriteConfigText(strFile, strText) || !configFile.Open(strFile))
+        {
+            bSuccess = false;
+            break;
+        }
+
+        //both have to find the same values
+        for(UINT i=0; i<numLookups; i++)
+        {
+            CTSTR lpSection = lookups[i].section, lpKey = lookups[i].key;
+            if(LinearGetInt(sections, keys, lpSection, lpKey, -1) != configFile.GetInt(lpSection, lpKey, -2))
+                bSuccess = false;
+        }
+
+        volatile int intSum = 0;
+        volatile float floatSum = 0.0f;
+        volatile UINT numFound = 0;
+
+        double linearTime = TimeCalls([&] {
+            for(UINT i=0; i<numLookups; i++)
+                intSum += LinearGetInt(sections, keys, lookups[i].section, lookups[i].key, 0);
+        });
+        double intTime = TimeCalls([&] {
+            for(UINT i=0; i<numLookups; i++)
+                intSum += configFile.GetInt(lookups[i].section, lookups[i].key);
+        });
+        double floatTime = TimeCalls([&] {
+            for(UINT i=0; i<numLookups; i++)
+                floatSum += configFile.GetFloat(lookups[i].section, lookups[i].key);
+        });
+        double stringTime = TimeCalls([&] {
+            for(UINT i=0; i<numLookups; i++)
+                numFound += configFile.GetStringPtr(lookups[i].section, lookups[i].key) != NULL;
+        });
+        double missTime = TimeCalls([&] {
+            for(UINT i=0; i<numLookups; i++)
+                numFound += configFile.HasKey(misses[i].section, misses[i].key);
+        });
+
+        configFile.Close();
+
+        TestPrint(TEXT("    %4u x %-11u %9.1f ns %9.1f ns %9.1f ns %9.1f ns %9.1f ns\n"), numSections, numKeys,
+            linearTime/numLookups, intTime/numLookups, floatTime/numLookups, stringTime/numLookups, missTime/numLookups);
+    }
+
+    OSDeleteFile(strFile);
+
+    TEST_CHECK(bSuccess);
+    return true;
+}
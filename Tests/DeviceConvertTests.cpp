@@ -0,0 +1,363 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "Tests.h"
+
+//-----------------------------------------------------------------------------
+//  the DShow plugin's capture format conversions (DShowPlugin/ImageMadness.cpp) checked
+//byte for byte against the scalar loops they replaced, on every path the cpu has (AVX2,
+//SSSE3, SSE2 only), for widths up to 140 pixels with lineShift 0 to 2.  odd widths used
+//to leave the last column unwritten, so that column is checked against the new rule
+//instead: luma from the source, chroma borrowed from the pixel to its left.
+
+void PackPlanar(LPBYTE convertBuffer, LPBYTE lpPlanar, UINT renderCX, UINT renderCY, UINT pitch, UINT startY, UINT endY, UINT linePitch, UINT lineShift);
+void Convert422To444(LPBYTE convertBuffer, LPBYTE lp422, UINT lineSize, UINT renderCY, UINT pitch, UINT linePitch, UINT lineShift, bool bLeadingY);
+
+extern bool bDeviceConvertWithAVX2;
+extern bool bDeviceConvertWithSSSE3;
+
+//the conversions as they were before they were vectorized
+static void RefPackPlanar(LPBYTE convertBuffer, LPBYTE lpPlanar, UINT renderCX, UINT renderCY, UINT pitch, UINT startY, UINT endY, UINT linePitch, UINT lineShift)
+{
+    LPBYTE output = convertBuffer;
+    LPBYTE input = lpPlanar + lineShift;
+    LPBYTE input2 = input+(renderCX*renderCY);
+    LPBYTE input3 = input2+(renderCX*renderCY/4);
+
+    UINT halfStartY = startY/2;
+    UINT halfX = renderCX/2;
+    UINT halfY = endY/2;
+
+    for(UINT y=halfStartY; y<halfY; y++)
+    {
+        LPBYTE lpLum1 = input + y*2*linePitch;
+        LPBYTE lpLum2 = lpLum1 + linePitch;
+        LPBYTE lpChroma1 = input2 + y*(linePitch/2);
+        LPBYTE lpChroma2 = input3 + y*(linePitch/2);
+        LPDWORD output1 = (LPDWORD)(output + (y*2)*pitch);
+        LPDWORD output2 = (LPDWORD)(((LPBYTE)output1)+pitch);
+
+        for(UINT x=0; x<halfX; x++)
+        {
+            DWORD out = (*(lpChroma1++) << 8) | (*(lpChroma2++) << 16);
+
+            *(output1++) = *(lpLum1++) | out;
+            *(output1++) = *(lpLum1++) | out;
+
+            *(output2++) = *(lpLum2++) | out;
+            *(output2++) = *(lpLum2++) | out;
+        }
+    }
+}
+
+static void RefConvert422To444(LPBYTE convertBuffer, LPBYTE lp422, UINT lineSize, UINT renderCY, UINT pitch, UINT linePitch, UINT lineShift, bool bLeadingY)
+{
+    DWORD dwDWSize = lineSize>>2;
+
+    for(UINT y=0; y<renderCY; y++)
+    {
+        LPDWORD output = (LPDWORD)(convertBuffer+(y*pitch));
+        LPDWORD inputDW = (LPDWORD)(lp422+(y*linePitch)+lineShift);
+        LPDWORD inputDWEnd = inputDW+dwDWSize;
+
+        while(inputDW < inputDWEnd)
+        {
+            DWORD dw = *inputDW;
+
+            output[0] = dw;
+            if(bLeadingY)
+            {
+                dw &= 0xFFFFFF00;
+                dw |= BYTE(dw>>16);
+            }
+            else
+            {
+                dw &= 0xFFFF00FF;
+                dw |= (dw>>16) & 0xFF00;
+            }
+            output[1] = dw;
+
+            output += 2;
+            inputDW++;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+enum DeviceConvertPath
+{
+    DeviceConvert_AVX2,
+    DeviceConvert_SSSE3,
+    DeviceConvert_SSE2,
+};
+
+static CTSTR pathNames[] = {TEXT("AVX2"), TEXT("SSSE3"), TEXT("SSE2")};
+
+static bool HasAVX2, HasSSSE3;
+
+static bool SelectPath(DeviceConvertPath path)
+{
+    if((path == DeviceConvert_AVX2 && !HasAVX2) || (path == DeviceConvert_SSSE3 && !HasSSSE3))
+        return false;
+
+    bDeviceConvertWithAVX2  = (path == DeviceConvert_AVX2);
+    bDeviceConvertWithSSSE3 = (path != DeviceConvert_SSE2);
+    return true;
+}
+
+static void RestorePaths()
+{
+    bDeviceConvertWithAVX2  = HasAVX2;
+    bDeviceConvertWithSSSE3 = HasSSSE3;
+}
+
+static void SavePaths()
+{
+    HasAVX2  = bDeviceConvertWithAVX2;
+    HasSSSE3 = bDeviceConvertWithSSSE3;
+}
+
+#define GUARD_BYTE  0xCD
+#define OUTPUT_PAD  12      //extra bytes at the end of each output row, like a mapped texture's pitch
+
+//compares the rows of both outputs, the last column of odd widths is checked separately
+static bool CompareOutput(LPBYTE refOut, LPBYTE testOut, UINT renderCX, UINT renderCY, UINT pitch)
+{
+    UINT evenCX = renderCX & ~1;
+
+    for(UINT y=0; y<renderCY; y++)
+    {
+        if(memcmp(refOut+y*pitch, testOut+y*pitch, evenCX*4) != 0)
+            return false;
+
+        //nothing past the image in a row may be touched
+        for(UINT i=renderCX*4; i<pitch; i++)
+        {
+            if(testOut[y*pitch+i] != GUARD_BYTE)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+static bool CheckPackPlanar(UINT renderCX, UINT renderCY, UINT lineShift, TestRandom &random)
+{
+    UINT linePitch = renderCX;
+    UINT pitch     = renderCX*4 + OUTPUT_PAD;
+
+    List<BYTE> input, refOut, testOut;
+    input.SetSize(lineShift + renderCX*renderCY*3/2 + 64);
+    for(UINT i=0; i<input.Num(); i++)
+        input[i] = BYTE(random.Next(256));
+
+    refOut.SetSize(pitch*renderCY);
+    testOut.SetSize(pitch*renderCY);
+    memset(refOut.Array(), GUARD_BYTE, refOut.Num());
+    memset(testOut.Array(), GUARD_BYTE, testOut.Num());
+
+    RefPackPlanar(refOut.Array(), input.Array(), renderCX, renderCY, pitch, 0, renderCY, linePitch, lineShift);
+
+    //two tiles, the way the task pool splits it
+    UINT splitY = (renderCY/4)*2;
+    PackPlanar(testOut.Array(), input.Array(), renderCX, renderCY, pitch, 0, splitY, linePitch, lineShift);
+    PackPlanar(testOut.Array(), input.Array(), renderCX, renderCY, pitch, splitY, renderCY, linePitch, lineShift);
+
+    if(!CompareOutput(refOut.Array(), testOut.Array(), renderCX, renderCY, pitch))
+        return false;
+
+    if(renderCX & 1)
+    {
+        LPBYTE lpLum = input.Array()+lineShift;
+
+        for(UINT y=0; y<renderCY; y++)
+        {
+            LPDWORD output = (LPDWORD)(testOut.Array()+y*pitch);
+            DWORD expected = (output[renderCX-2] & 0xFFFFFF00) | lpLum[y*linePitch + renderCX-1];
+
+            if(output[renderCX-1] != expected)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+static bool Check422To444(UINT renderCX, UINT renderCY, UINT lineShift, bool bLeadingY, TestRandom &random)
+{
+    UINT lineSize  = renderCX*2;
+    UINT linePitch = ((lineSize+3) & ~3) + 4;
+    UINT pitch     = renderCX*4 + OUTPUT_PAD;
+
+    List<BYTE> input, refOut, testOut;
+    input.SetSize(lineShift + linePitch*renderCY + 64);
+    for(UINT i=0; i<input.Num(); i++)
+        input[i] = BYTE(random.Next(256));
+
+    refOut.SetSize(pitch*renderCY);
+    testOut.SetSize(pitch*renderCY);
+    memset(refOut.Array(), GUARD_BYTE, refOut.Num());
+    memset(testOut.Array(), GUARD_BYTE, testOut.Num());
+
+    RefConvert422To444(refOut.Array(), input.Array(), lineSize, renderCY, pitch, linePitch, lineShift, bLeadingY);
+    Convert422To444(testOut.Array(), input.Array(), lineSize, renderCY, pitch, linePitch, lineShift, bLeadingY);
+
+    if(!CompareOutput(refOut.Array(), testOut.Array(), renderCX, renderCY, pitch))
+        return false;
+
+    if(renderCX & 1)
+    {
+        for(UINT y=0; y<renderCY; y++)
+        {
+            LPDWORD output = (LPDWORD)(testOut.Array()+y*pitch);
+            BYTE lum = input[lineShift + y*linePitch + (renderCX-1)*2 + (bLeadingY ? 0 : 1)];
+
+            DWORD expected;
+            if(bLeadingY)
+                expected = (output[renderCX-2] & 0xFFFFFF00) | lum;
+            else
+                expected = (output[renderCX-2] & 0xFFFF00FF) | (DWORD(lum) << 8);
+
+            if(output[renderCX-1] != expected)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+OBS_TEST(DeviceConvertMatchesScalar)
+{
+    SavePaths();
+
+    TestRandom random;
+    bool bSuccess = true;
+    UINT numPaths = 0;
+
+    for(int path=DeviceConvert_AVX2; path<=DeviceConvert_SSE2; path++)
+    {
+        if(!SelectPath((DeviceConvertPath)path))
+            continue;
+        numPaths++;
+
+        for(UINT renderCX=2; renderCX<=140; renderCX++)
+        {
+            for(UINT lineShift=0; lineShift<=2; lineShift++)
+            {
+                if(!CheckPackPlanar(renderCX, 6, lineShift, random))
+                {
+                    TestPrint(TEXT("    PackPlanar %s: width %u, lineShift %u differs\n"), pathNames[path], renderCX, lineShift);
+                    bSuccess = false;
+                }
+
+                for(int leadingY=0; leadingY<2; leadingY++)
+                {
+                    if(!Check422To444(renderCX, 3, lineShift, leadingY != 0, random))
+                    {
+                        TestPrint(TEXT("    Convert422To444 %s (%s): width %u, lineShift %u differs\n"), pathNames[path],
+                            leadingY ? TEXT("YUY2") : TEXT("UYVY"), renderCX, lineShift);
+                        bSuccess = false;
+                    }
+                }
+            }
+        }
+    }
+
+    RestorePaths();
+
+    if(numPaths < 3)
+        TestPrint(TEXT("    only %u of the 3 paths are supported by this cpu\n"), numPaths);
+
+    TEST_CHECK(bSuccess);
+    return true;
+}
+
+OBS_BENCHMARK(DeviceConvert1080p)
+{
+    const UINT renderCX = 1920, renderCY = 1080;
+    const UINT pitch = renderCX*4;
+
+    SavePaths();
+
+    TestRandom random;
+    List<BYTE> planar, packed, output;
+
+    planar.SetSize(renderCX*renderCY*3/2);
+    packed.SetSize(renderCX*renderCY*2);
+    output.SetSize(pitch*renderCY);
+
+    for(UINT i=0; i<planar.Num(); i++)
+        planar[i] = BYTE(random.Next(256));
+    for(UINT i=0; i<packed.Num(); i++)
+        packed[i] = BYTE(random.Next(256));
+
+    LPBYTE lpPlanar = planar.Array(), lpPacked = packed.Array(), lpOutput = output.Array();
+
+    TestPrint(TEXT("    %-16s %10s %10s %10s %10s\n"), TEXT(""), TEXT("scalar"), TEXT("SSE2"), TEXT("SSSE3"), TEXT("AVX2"));
+
+    for(int format=0; format<3; format++)
+    {
+        double times[4];    //scalar, then by path in reverse
+        CTSTR lpFormat;
+
+        if(format == 0)
+        {
+            lpFormat = TEXT("I420 (planar)");
+            times[0] = TimeCalls([&] {RefPackPlanar(lpOutput, lpPlanar, renderCX, renderCY, pitch, 0, renderCY, renderCX, 0);});
+        }
+        else
+        {
+            bool bLeadingY = (format == 1);
+            lpFormat = bLeadingY ? TEXT("YUY2 (4:2:2)") : TEXT("UYVY (4:2:2)");
+            times[0] = TimeCalls([&] {RefConvert422To444(lpOutput, lpPacked, renderCX*2, renderCY, pitch, renderCX*2, 0, bLeadingY);});
+        }
+
+        for(int path=DeviceConvert_SSE2; path>=DeviceConvert_AVX2; path--)
+        {
+            double &time = times[1 + DeviceConvert_SSE2-path];
+            time = 0.0;
+
+            //SSSE3 only has its own loop for 4:2:2
+            if(!SelectPath((DeviceConvertPath)path) || (format == 0 && path == DeviceConvert_SSSE3))
+                continue;
+
+            if(format == 0)
+                time = TimeCalls([&] {PackPlanar(lpOutput, lpPlanar, renderCX, renderCY, pitch, 0, renderCY, renderCX, 0);});
+            else
+            {
+                bool bLeadingY = (format == 1);
+                time = TimeCalls([&] {Convert422To444(lpOutput, lpPacked, renderCX*2, renderCY, pitch, renderCX*2, 0, bLeadingY);});
+            }
+        }
+
+        TestPrint(TEXT("    %-16s"), lpFormat);
+        for(int i=0; i<4; i++)
+        {
+            if(times[i] > 0.0)
+                TestPrint(TEXT(" %7.3f ms"), times[i]/1000000.0);
+            else
+                TestPrint(TEXT(" %10s"), TEXT("-"));
+        }
+        TestPrint(TEXT("\n"));
+    }
+
+    RestorePaths();
+    return true;
+}
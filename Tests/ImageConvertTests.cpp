@@ -0,0 +1,375 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "Tests.h"
+#include <emmintrin.h>
+
+//-----------------------------------------------------------------------------
+//  Convert444toI420/Convert444toNV12 (Source/ImageProcessing.cpp) against a plain
+//2x2 block reference, on both the AVX2 and SSE2 paths, with widths that leave
+//tails, unaligned input and padded pitches.  the benchmark times whole frames at
+//the usual output sizes against the old aligned-only SSE2 loops.
+
+void Convert444toI420(LPBYTE input, int width, int pitch, int height, int startY, int endY, LPBYTE *output);
+void Convert444toNV12(LPBYTE input, int width, int inPitch, int outPitch, int height, int startY, int endY, LPBYTE *output);
+
+extern bool bConvertWithAVX2;
+
+static void RefConvert444toI420(LPBYTE input, int width, int pitch, int height, LPBYTE *output)
+{
+    int chrPitch = width>>1;
+
+    for(int y=0; y<height; y+=2)
+    {
+        for(int x=0; x<width; x+=2)
+        {
+            LPBYTE line1 = input+(y*pitch)+(x*4);
+            LPBYTE line2 = line1+pitch;
+
+            output[0][y*width+x]         = line1[1];
+            output[0][y*width+x+1]       = line1[5];
+            output[0][(y+1)*width+x]     = line2[1];
+            output[0][(y+1)*width+x+1]   = line2[5];
+
+            int chrPos = (y>>1)*chrPitch + (x>>1);
+            output[1][chrPos] = BYTE((line1[0]+line1[4]+line2[0]+line2[4])>>2);
+            output[2][chrPos] = BYTE((line1[2]+line1[6]+line2[2]+line2[6])>>2);
+        }
+    }
+}
+
+static void RefConvert444toNV12(LPBYTE input, int width, int inPitch, int outPitch, int height, LPBYTE *output)
+{
+    for(int y=0; y<height; y+=2)
+    {
+        for(int x=0; x<width; x+=2)
+        {
+            LPBYTE line1 = input+(y*inPitch)+(x*4);
+            LPBYTE line2 = line1+inPitch;
+
+            output[0][y*outPitch+x]       = line1[1];
+            output[0][y*outPitch+x+1]     = line1[5];
+            output[0][(y+1)*outPitch+x]   = line2[1];
+            output[0][(y+1)*outPitch+x+1] = line2[5];
+
+            int uvPos = (y>>1)*outPitch + x;
+            output[1][uvPos]   = BYTE((line1[0]+line1[4]+line2[0]+line2[4])>>2);
+            output[1][uvPos+1] = BYTE((line1[2]+line1[6]+line2[2]+line2[6])>>2);
+        }
+    }
+}
+
+//the loops as they were before the AVX2/unaligned work, kept here so the benchmark has
+//something to compare against.  only valid for 16 byte aligned input and widths divisible by 4.
+static void OldConvert444toI420(LPBYTE input, int width, int pitch, int height, int startY, int endY, LPBYTE *output)
+{
+    LPBYTE lumPlane     = output[0];
+    LPBYTE uPlane       = output[1];
+    LPBYTE vPlane       = output[2];
+    int  chrPitch       = width>>1;
+
+    __m128i lumMask = _mm_set1_epi32(0x0000FF00);
+    __m128i uvMask = _mm_set1_epi16(0x00FF);
+
+    for(int y=startY; y<endY; y+=2)
+    {
+        int yPos    = y*pitch;
+        int chrYPos = ((y>>1)*chrPitch);
+        int lumYPos = y*width;
+
+        for(int x=0; x<width; x+=4)
+        {
+            LPBYTE lpImagePos = input+yPos+(x*4);
+            int chrPos  = chrYPos + (x>>1);
+            int lumPos0 = lumYPos + x;
+            int lumPos1 = lumPos0+width;
+
+            __m128i line1 = _mm_load_si128((__m128i*)lpImagePos);
+            __m128i line2 = _mm_load_si128((__m128i*)(lpImagePos+pitch));
+
+            {
+                __m128i packVal = _mm_packs_epi32(_mm_srli_si128(_mm_and_si128(line1, lumMask), 1), _mm_srli_si128(_mm_and_si128(line2, lumMask), 1));
+                packVal = _mm_packus_epi16(packVal, packVal);
+
+                *(LPUINT)(lumPlane+lumPos0) = packVal.m128i_u32[0];
+                *(LPUINT)(lumPlane+lumPos1) = packVal.m128i_u32[1];
+            }
+
+            {
+                __m128i addVal = _mm_add_epi64(_mm_and_si128(line1, uvMask), _mm_and_si128(line2, uvMask));
+                __m128i avgVal = _mm_srai_epi16(_mm_add_epi64(addVal, _mm_shuffle_epi32(addVal, _MM_SHUFFLE(2, 3, 0, 1))), 2);
+                avgVal = _mm_shuffle_epi32(avgVal, _MM_SHUFFLE(3, 1, 2, 0));
+                avgVal = _mm_shufflelo_epi16(avgVal, _MM_SHUFFLE(3, 1, 2, 0));
+                avgVal = _mm_packus_epi16(avgVal, avgVal);
+
+                DWORD packedVals = avgVal.m128i_u32[0];
+
+                *(LPWORD)(uPlane+chrPos) = WORD(packedVals);
+                *(LPWORD)(vPlane+chrPos) = WORD(packedVals>>16);
+            }
+        }
+    }
+}
+
+static void OldConvert444toNV12(LPBYTE input, int width, int inPitch, int outPitch, int height, int startY, int endY, LPBYTE *output)
+{
+    LPBYTE lumPlane     = output[0];
+    LPBYTE uvPlane      = output[1];
+
+    __m128i lumMask = _mm_set1_epi32(0x0000FF00);
+    __m128i uvMask = _mm_set1_epi16(0x00FF);
+
+    for(int y=startY; y<endY; y+=2)
+    {
+        int yPos    = y*inPitch;
+        int uvYPos  = (y>>1)*outPitch;
+        int lumYPos = y*outPitch;
+
+        for(int x=0; x<width; x+=4)
+        {
+            LPBYTE lpImagePos = input+yPos+(x*4);
+            int uvPos   = uvYPos + x;
+            int lumPos0 = lumYPos + x;
+            int lumPos1 = lumPos0 + outPitch;
+
+            __m128i line1 = _mm_load_si128((__m128i*)lpImagePos);
+            __m128i line2 = _mm_load_si128((__m128i*)(lpImagePos+inPitch));
+
+            {
+                __m128i packVal = _mm_packs_epi32(_mm_srli_si128(_mm_and_si128(line1, lumMask), 1), _mm_srli_si128(_mm_and_si128(line2, lumMask), 1));
+                packVal = _mm_packus_epi16(packVal, packVal);
+
+                *(LPUINT)(lumPlane+lumPos0) = packVal.m128i_u32[0];
+                *(LPUINT)(lumPlane+lumPos1) = packVal.m128i_u32[1];
+            }
+
+            {
+                __m128i addVal = _mm_add_epi64(_mm_and_si128(line1, uvMask), _mm_and_si128(line2, uvMask));
+                __m128i avgVal = _mm_srai_epi16(_mm_add_epi64(addVal, _mm_shuffle_epi32(addVal, _MM_SHUFFLE(2, 3, 0, 1))), 2);
+                avgVal = _mm_shuffle_epi32(avgVal, _MM_SHUFFLE(3, 1, 2, 0));
+
+                *(LPUINT)(uvPlane+uvPos) = _mm_packus_epi16(avgVal, avgVal).m128i_u32[0];
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+//the guard value the output buffers are filled with, so writes past the planes show up
+#define GUARD_BYTE 0xCD
+#define GUARD_SIZE 64
+
+static inline LPBYTE AlignPtr(List<BYTE> &buffer, UINT offset)
+{
+    return (LPBYTE)((UPARAM(buffer.Array())+31) & ~UPARAM(31)) + offset;
+}
+
+static bool GuardIntact(LPCBYTE lpGuard)
+{
+    for(UINT i=0; i<GUARD_SIZE; i++)
+    {
+        if(lpGuard[i] != GUARD_BYTE)
+            return false;
+    }
+
+    return true;
+}
+
+//converts the image in two slices the way the frame conversion threads do, and compares
+//every plane with the reference
+static bool CheckConversion(LPBYTE input, int width, int inPitch, int height, bool bNV12)
+{
+    int outPitch = bNV12 ? (width+12) : width;
+    int lumSize  = outPitch*height;
+    int chrSize  = bNV12 ? (outPitch*height/2) : (width/2*height/2);
+
+    List<BYTE> refOut, testOut;
+    refOut.SetSize(lumSize+chrSize*2);
+    testOut.SetSize(lumSize+chrSize*2+GUARD_SIZE*3);
+    memset(refOut.Array(), GUARD_BYTE, refOut.Num());
+    memset(testOut.Array(), GUARD_BYTE, testOut.Num());
+
+    LPBYTE refPlanes[3]  = {refOut.Array(), refOut.Array()+lumSize, refOut.Array()+lumSize+chrSize};
+    LPBYTE testPlanes[3] = {testOut.Array(), testOut.Array()+lumSize+GUARD_SIZE, testOut.Array()+lumSize+chrSize+GUARD_SIZE*2};
+
+    int splitY = (height/4)*2;
+
+    if(bNV12)
+    {
+        RefConvert444toNV12(input, width, inPitch, outPitch, height, refPlanes);
+        Convert444toNV12(input, width, inPitch, outPitch, height, 0, splitY, testPlanes);
+        Convert444toNV12(input, width, inPitch, outPitch, height, splitY, height, testPlanes);
+    }
+    else
+    {
+        RefConvert444toI420(input, width, inPitch, height, refPlanes);
+        Convert444toI420(input, width, inPitch, height, 0, splitY, testPlanes);
+        Convert444toI420(input, width, inPitch, height, splitY, height, testPlanes);
+    }
+
+    if(!GuardIntact(testPlanes[0]+lumSize) || !GuardIntact(testPlanes[1]+chrSize))
+        return false;
+    if(!bNV12 && !GuardIntact(testPlanes[2]+chrSize))
+        return false;
+
+    //NV12 rows have padding past the width that neither side writes, so compare row by row
+    int planeWidths[3]  = {width, bNV12 ? width : width/2, width/2};
+    int planePitches[3] = {outPitch, bNV12 ? outPitch : width/2, width/2};
+    int planeHeights[3] = {height, height/2, height/2};
+    int numPlanes = bNV12 ? 2 : 3;
+
+    for(int plane=0; plane<numPlanes; plane++)
+    {
+        for(int y=0; y<planeHeights[plane]; y++)
+        {
+            int pos = y*planePitches[plane];
+            if(memcmp(refPlanes[plane]+pos, testPlanes[plane]+pos, planeWidths[plane]) != 0)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+OBS_TEST(ImageConvertMatchesReference)
+{
+    //widths with 16, 8, 4 and 2 pixel tails for the AVX2 and SSE2 loops
+    const int widths[]      = {2, 4, 6, 8, 10, 14, 16, 18, 30, 34, 62, 66, 1278, 1282};
+    const int offsets[]     = {0, 4, 8, 12, 20};    //bytes from a 32 byte boundary
+    const int pitchPads[]   = {0, 4, 60};           //extra bytes at the end of each input row
+    const int height        = 10;
+
+    const bool bHasAVX2 = bConvertWithAVX2;
+    bool bSuccess = true;
+
+    TestRandom random;
+    List<BYTE> input;
+
+    for(int pathID=0; pathID<(bHasAVX2 ? 2 : 1); pathID++)
+    {
+        bConvertWithAVX2 = (pathID == 1);
+
+        for(UINT widthID=0; widthID<_countof(widths); widthID++)
+        {
+            for(UINT padID=0; padID<_countof(pitchPads); padID++)
+            {
+                for(UINT offsetID=0; offsetID<_countof(offsets); offsetID++)
+                {
+                    int width   = widths[widthID];
+                    int inPitch = width*4 + pitchPads[padID];
+
+                    input.SetSize(inPitch*height + 64);
+                    LPBYTE lpInput = AlignPtr(input, offsets[offsetID]);
+
+                    for(int i=0; i<inPitch*height; i++)
+                        lpInput[i] = BYTE(random.Next(256));
+
+                    for(int format=0; format<2; format++)
+                    {
+                        if(!CheckConversion(lpInput, width, inPitch, height, format == 1))
+                        {
+                            TestPrint(TEXT("    %s %s: width %d, pitch %d, offset %d differs from the reference\n"),
+                                format ? TEXT("NV12") : TEXT("I420"), bConvertWithAVX2 ? TEXT("AVX2") : TEXT("SSE2"),
+                                width, inPitch, offsets[offsetID]);
+                            bSuccess = false;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    bConvertWithAVX2 = bHasAVX2;
+
+    if(!bHasAVX2)
+        TestPrint(TEXT("    no AVX2 on this cpu, only the SSE2 path was checked\n"));
+
+    TEST_CHECK(bSuccess);
+    return true;
+}
+
+OBS_BENCHMARK(ImageConvertFrames)
+{
+    const int sizes[][2] = {{1280, 720}, {1920, 1080}, {2560, 1440}};
+    const bool bHasAVX2 = bConvertWithAVX2;
+
+    TestRandom random;
+    List<BYTE> input, output;
+
+    TestPrint(TEXT("    %-10s %-5s %12s %12s %12s\n"), TEXT("size"), TEXT(""), TEXT("old SSE2"), TEXT("SSE2"), TEXT("AVX2"));
+
+    for(UINT sizeID=0; sizeID<_countof(sizes); sizeID++)
+    {
+        int width  = sizes[sizeID][0];
+        int height = sizes[sizeID][1];
+        int pitch  = width*4;
+
+        input.SetSize(pitch*height + 32);
+        output.SetSize(width*height*2 + 32);
+
+        LPBYTE lpInput = AlignPtr(input, 0);
+        for(int i=0; i<pitch*height; i++)
+            lpInput[i] = BYTE(random.Next(256));
+
+        LPBYTE lpOutput = AlignPtr(output, 0);
+        LPBYTE planes[3] = {lpOutput, lpOutput+width*height, lpOutput+width*height*5/4};
+
+        for(int format=0; format<2; format++)
+        {
+            bool bNV12 = (format == 1);
+            double oldNS, sse2NS, avx2NS = 0.0;
+
+            if(bNV12)
+            {
+                oldNS = TimeCalls([&] {OldConvert444toNV12(lpInput, width, pitch, width, height, 0, height, planes);}, 500);
+
+                bConvertWithAVX2 = false;
+                sse2NS = TimeCalls([&] {Convert444toNV12(lpInput, width, pitch, width, height, 0, height, planes);}, 500);
+
+                bConvertWithAVX2 = true;
+                if(bHasAVX2)
+                    avx2NS = TimeCalls([&] {Convert444toNV12(lpInput, width, pitch, width, height, 0, height, planes);}, 500);
+            }
+            else
+            {
+                oldNS = TimeCalls([&] {OldConvert444toI420(lpInput, width, pitch, height, 0, height, planes);}, 500);
+
+                bConvertWithAVX2 = false;
+                sse2NS = TimeCalls([&] {Convert444toI420(lpInput, width, pitch, height, 0, height, planes);}, 500);
+
+                bConvertWithAVX2 = true;
+                if(bHasAVX2)
+                    avx2NS = TimeCalls([&] {Convert444toI420(lpInput, width, pitch, height, 0, height, planes);}, 500);
+            }
+
+            bConvertWithAVX2 = bHasAVX2;
+
+            String strSize = FormattedString(TEXT("%dx%d"), width, height);
+            if(bHasAVX2)
+                TestPrint(TEXT("    %-10s %-5s %9.3f ms %9.3f ms %9.3f ms\n"), strSize.Array(), bNV12 ? TEXT("NV12") : TEXT("I420"),
+                    oldNS/1000000.0, sse2NS/1000000.0, avx2NS/1000000.0);
+            else
+                TestPrint(TEXT("    %-10s %-5s %9.3f ms %9.3f ms %12s\n"), strSize.Array(), bNV12 ? TEXT("NV12") : TEXT("I420"),
+                    oldNS/1000000.0, sse2NS/1000000.0, TEXT("n/a"));
+        }
+    }
+
+    return true;
+}
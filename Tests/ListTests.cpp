@@ -0,0 +1,264 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "Tests.h"
+
+//-----------------------------------------------------------------------------
+//  List keeps a capacity and at least doubles it when it runs out.  OldList below is
+//the way it worked before: every Add, Remove and AppendArray reallocated the array to
+//the exact number of items.  the workloads are the ones the app actually does with
+//lists: building one up an item at a time, a packet queue that's filled and drained
+//every frame, and the AAC encoder's sample buffer that has 10ms segments appended and
+//1024 frame blocks taken off the front.
+
+template<typename T> struct OldList
+{
+    T *array;
+    UINT num;
+
+    inline OldList() : array(NULL), num(0) {}
+    inline ~OldList() {if(array) Free(array);}
+
+    inline void Add(const T &val)
+    {
+        array = (T*)ReAllocate(array, sizeof(T)*++num);
+        mcpy(&array[num-1], (void*)&val, sizeof(T));
+    }
+
+    inline void AppendArray(const T *new_array, UINT n)
+    {
+        array = (T*)ReAllocate(array, sizeof(T)*(num+n));
+        mcpy(&array[num], (void*)new_array, sizeof(T)*n);
+        num += n;
+    }
+
+    inline void Remove(UINT index)
+    {
+        if(!--num) {Free(array); array = NULL; return;}
+
+        mcpy(&array[index], &array[index+1], sizeof(T)*(num-index));
+        array = (T*)ReAllocate(array, sizeof(T)*num);
+    }
+
+    inline void RemoveRange(UINT start, UINT end)
+    {
+        UINT count = end-start;
+        if(count == num) {Free(array); array = NULL; num = 0; return;}
+
+        num -= count;
+        if(num-start)
+            mcpy(array+start, array+end, sizeof(T)*(num-start));
+        array = (T*)ReAllocate(array, sizeof(T)*num);
+    }
+
+    inline UINT Num() const {return num;}
+};
+
+//-----------------------------------------------------------------------------
+
+struct QueuedPacket
+{
+    QWORD timestamp;
+    UINT  size;
+    UINT  type;
+};
+
+#define AAC_BLOCK_FRAMES 1024
+
+//a list built up one item at a time, like the scene item and packet lists
+template<typename ListType> static UINT BuildList(ListType &list, UINT count)
+{
+    for(UINT i=0; i<count; i++)
+    {
+        QueuedPacket packet = {QWORD(i)*10, i*7, i%3};
+        list.Add(packet);
+    }
+
+    return list.Num();
+}
+
+//a frame's worth of packets queued and then sent off the front
+template<typename ListType> static void QueueFrames(UINT numFrames, UINT packetsPerFrame)
+{
+    ListType queue;
+
+    for(UINT frame=0; frame<numFrames; frame++)
+    {
+        for(UINT i=0; i<packetsPerFrame; i++)
+        {
+            QueuedPacket packet = {QWORD(frame)*33, 1000+i, i};
+            queue.Add(packet);
+        }
+
+        while(queue.Num())
+            queue.Remove(0);
+    }
+}
+
+//10ms stereo segments in, 1024 frame blocks out, the way Encoder_AAC buffers its input
+template<typename ListType> static UINT BufferSegments(const float *segment, UINT segmentFrames, UINT numSegments)
+{
+    ListType buffer;
+    UINT numBlocks = 0;
+
+    for(UINT i=0; i<numSegments; i++)
+    {
+        buffer.AppendArray(segment, segmentFrames*2);
+
+        while(buffer.Num() >= AAC_BLOCK_FRAMES*2)
+        {
+            buffer.RemoveRange(0, AAC_BLOCK_FRAMES*2);
+            numBlocks++;
+        }
+    }
+
+    return numBlocks;
+}
+
+//-----------------------------------------------------------------------------
+
+OBS_TEST(ListGrowth)
+{
+    //adding an item at a time ends up with the same items, without a reallocation per add
+    List<QueuedPacket> packets;
+    OldList<QueuedPacket> oldPackets;
+    UINT numMoves = 0;
+    QueuedPacket *lpLastArray = NULL;
+
+    for(UINT i=0; i<10000; i++)
+    {
+        QueuedPacket packet = {QWORD(i)*10, i*7, i%3};
+        packets.Add(packet);
+        oldPackets.Add(packet);
+
+        if(packets.Array() != lpLastArray)
+        {
+            lpLastArray = packets.Array();
+            numMoves++;
+        }
+    }
+
+    TEST_CHECK(packets.Num() == oldPackets.Num() && packets.Capacity() >= packets.Num());
+    TEST_CHECK(memcmp(packets.Array(), oldPackets.array, sizeof(QueuedPacket)*packets.Num()) == 0);
+    TEST_CHECK(numMoves < 32);
+
+    //removing from the middle keeps the memory, removing the last item gives it back
+    packets.RemoveRange(100, 9000);
+    oldPackets.RemoveRange(100, 9000);
+    packets.Remove(50);
+    oldPackets.Remove(50);
+
+    TEST_CHECK(packets.Num() == oldPackets.Num() && packets.Capacity() >= 10000);
+    TEST_CHECK(memcmp(packets.Array(), oldPackets.array, sizeof(QueuedPacket)*packets.Num()) == 0);
+
+    while(packets.Num())
+        packets.Remove(packets.Num()-1);
+
+    TEST_CHECK(packets.Array() == NULL && packets.Capacity() == 0);
+
+    //a RemoveRange over everything frees it too, like Clear
+    BuildList(packets, 100);
+    packets.RemoveRange(0, 100);
+    TEST_CHECK(packets.Array() == NULL && packets.Capacity() == 0);
+
+    //nothing moves once there's room reserved, and ShrinkToFit trims it back down
+    List<UINT> values;
+    values.Reserve(1000);
+    UINT *lpReserved = values.Array();
+
+    for(UINT i=0; i<1000; i++)
+        values << i;
+
+    TEST_CHECK(values.Array() == lpReserved && values.Capacity() == 1000);
+
+    values.SetSize(10);
+    TEST_CHECK(values.Array() == lpReserved && values.Num() == 10);
+
+    values.ShrinkToFit();
+    TEST_CHECK(values.Capacity() == 10 && values[9] == 9);
+
+    values.SetSize(0);
+    TEST_CHECK(values.Array() == NULL && values.Capacity() == 0);
+
+    //aligned lists stay aligned and keep their contents through every reallocation
+    TestRandom random(23);
+    List<float, 16> samples;
+    OldList<float> oldSamples;
+    float segment[1024];
+
+    for(UINT i=0; i<200; i++)
+    {
+        UINT count = random.Next(_countof(segment))+1;
+        for(UINT j=0; j<count; j++)
+            segment[j] = random.NextFloat();
+
+        samples.AppendArray(segment, count);
+        oldSamples.AppendArray(segment, count);
+
+        TEST_CHECK((UPARAM(samples.Array()) & 15) == 0);
+
+        if(samples.Num() > 4096)
+        {
+            samples.RemoveRange(0, 4096);
+            oldSamples.RemoveRange(0, 4096);
+            TEST_CHECK((UPARAM(samples.Array()) & 15) == 0);
+        }
+    }
+
+    TEST_CHECK(samples.Num() == oldSamples.Num());
+    TEST_CHECK(memcmp(samples.Array(), oldSamples.array, sizeof(float)*samples.Num()) == 0);
+
+    samples.ShrinkToFit();
+    TEST_CHECK((UPARAM(samples.Array()) & 15) == 0);
+    TEST_CHECK(memcmp(samples.Array(), oldSamples.array, sizeof(float)*samples.Num()) == 0);
+
+    return true;
+}
+
+OBS_BENCHMARK(ListBuilding)
+{
+    TestPrint(TEXT("    %-40s %12s %12s %12s\n"), TEXT("workload"), TEXT("List"), TEXT("List<,16>"), TEXT("exact growth"));
+
+    double newNS = TimeCalls([] {List<QueuedPacket> list; BuildList(list, 100);});
+    double oldNS = TimeCalls([] {OldList<QueuedPacket> list; BuildList(list, 100);});
+    TestPrint(TEXT("    %-40s %9.1f us %12s %9.1f us\n"), TEXT("100 adds"), newNS/1000.0, TEXT("-"), oldNS/1000.0);
+
+    newNS = TimeCalls([] {List<QueuedPacket> list; BuildList(list, 10000);});
+    oldNS = TimeCalls([] {OldList<QueuedPacket> list; BuildList(list, 10000);});
+    TestPrint(TEXT("    %-40s %9.1f us %12s %9.1f us\n"), TEXT("10000 adds"), newNS/1000.0, TEXT("-"), oldNS/1000.0);
+
+    //the queue empties every frame, so both free and reallocate every frame
+    newNS = TimeCalls([] {QueueFrames<List<QueuedPacket>>(100, 8);});
+    oldNS = TimeCalls([] {QueueFrames<OldList<QueuedPacket>>(100, 8);});
+    TestPrint(TEXT("    %-40s %9.1f us %12s %9.1f us\n"), TEXT("packet queue, 100 frames of 8"), newNS/1000.0, TEXT("-"), oldNS/1000.0);
+
+    TestRandom random(5);
+    static float segment[480*2];
+    for(UINT i=0; i<_countof(segment); i++)
+        segment[i] = random.NextFloat();
+
+    UINT newBlocks = 0, alignedBlocks = 0, oldBlocks = 0;
+    newNS          = TimeCalls([&] {newBlocks     = BufferSegments<List<float>>(segment, 480, 1000);});
+    double alignNS = TimeCalls([&] {alignedBlocks = BufferSegments<List<float, 16>>(segment, 480, 1000);});
+    oldNS          = TimeCalls([&] {oldBlocks     = BufferSegments<OldList<float>>(segment, 480, 1000);});
+    TestPrint(TEXT("    %-40s %9.1f us %9.1f us %9.1f us\n"), TEXT("AAC input buffer, 1000 10ms segments"), newNS/1000.0, alignNS/1000.0, oldNS/1000.0);
+
+    TEST_CHECK(newBlocks == oldBlocks && alignedBlocks == oldBlocks);
+    return true;
+}
@@ -0,0 +1,614 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "../Source/Main.h"
+#include "../Source/RTMPStuff.h"
+#include "Tests.h"
+#include "LocalRTMPServer.h"
+
+//how much the relay holds on to in each direction before it stops reading.  that's about what's in
+//flight on a real link, past it tcp pushes back on the sender
+#define RELAY_MAX_QUEUED    (1024*1024)
+#define RELAY_READ_SIZE     16384
+
+SAVC(publish);
+static const AVal av_NetStream_Publish_Start = AVC("NetStream.Publish.Start");
+static const AVal av_Started_publishing = AVC("Started publishing");
+
+struct RelayConnection
+{
+    SOCKET clientSocket, serverSocket;
+};
+
+struct RelayChunk
+{
+    QWORD sendTime;
+    BYTE *data;
+    UINT size;
+};
+
+struct RelayPump
+{
+    LocalRTMPServer *server;
+    SOCKET from, to;
+    DWORD delayMS;
+};
+
+//-----------------------------------------------------------------------------
+
+static int SendPublishStart(RTMP *r, double txn)
+{
+    RTMPPacket packet;
+    char pbuf[512], *pend = pbuf+sizeof(pbuf);
+
+    packet.m_nChannel = 0x03;     // control channel (invoke)
+    packet.m_headerType = RTMP_PACKET_SIZE_MEDIUM;
+    packet.m_packetType = RTMP_PACKET_TYPE_INVOKE;
+    packet.m_nTimeStamp = 0;
+    packet.m_nInfoField2 = 0;
+    packet.m_hasAbsTimestamp = 0;
+    packet.m_body = pbuf + RTMP_MAX_HEADER_SIZE;
+
+    char *enc = packet.m_body;
+    enc = AMF_EncodeString(enc, pend, &av_onStatus);
+    enc = AMF_EncodeNumber(enc, pend, txn);
+    *enc++ = AMF_NULL;
+    *enc++ = AMF_OBJECT;
+
+    enc = AMF_EncodeNamedString(enc, pend, &av_level, &av_status);
+    enc = AMF_EncodeNamedString(enc, pend, &av_code, &av_NetStream_Publish_Start);
+    enc = AMF_EncodeNamedString(enc, pend, &av_description, &av_Started_publishing);
+    enc = AMF_EncodeNamedString(enc, pend, &av_clientid, &av_clientid);
+    *enc++ = 0;
+    *enc++ = 0;
+    *enc++ = AMF_OBJECT_END;
+
+    packet.m_nBodySize = enc - packet.m_body;
+    return RTMP_SendPacket(r, &packet, FALSE);
+}
+
+static void HandleInvoke(RTMP *rtmp, RTMPPacket *packet)
+{
+    char *body = packet->m_body;
+    UINT size = packet->m_nBodySize;
+
+    //flex messages have an extra format byte in front
+    if(packet->m_packetType == RTMP_PACKET_TYPE_FLEX_MESSAGE)
+    {
+        if(!size)
+            return;
+        body++;
+        size--;
+    }
+
+    if(!size || body[0] != AMF_STRING)
+        return;
+
+    AMFObject obj;
+    if(AMF_Decode(&obj, body, size, FALSE) < 0)
+        return;
+
+    AVal method;
+    AMFProp_GetString(AMF_GetProp(&obj, NULL, 0), &method);
+    double txn = AMFProp_GetNumber(AMF_GetProp(&obj, NULL, 1));
+
+    if(AVMATCH(&method, &av_connect))
+        SendConnectResult(rtmp, txn);
+    else if(AVMATCH(&method, &av_createStream))
+        SendResultNumber(rtmp, txn, 1.0);
+    else if(AVMATCH(&method, &av_publish))
+        SendPublishStart(rtmp, txn);
+
+    AMF_Reset(&obj);
+}
+
+static SOCKET ListenOnLoopback(int port)
+{
+    SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if(sock == INVALID_SOCKET)
+        return INVALID_SOCKET;
+
+    sockaddr_in addr;
+    zero(&addr, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((u_short)port);
+
+    if(bind(sock, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR || listen(sock, 1) == SOCKET_ERROR)
+    {
+        closesocket(sock);
+        return INVALID_SOCKET;
+    }
+
+    return sock;
+}
+
+static bool SendAll(SOCKET sock, const BYTE *data, UINT size)
+{
+    while(size)
+    {
+        int ret = send(sock, (const char*)data, size, 0);
+        if(ret <= 0)
+            return false;
+
+        data += ret;
+        size -= ret;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+LocalRTMPServer::LocalRTMPServer()
+    : hStopEvent(NULL), hSocketMutex(NULL), listenSocket(INVALID_SOCKET), clientSocket(INVALID_SOCKET),
+      hServerThread(NULL), relayListenSocket(INVALID_SOCKET), hRelayThread(NULL), relayConnection(NULL),
+      serverPort(0), numConnectionsEnded(0)
+{
+    zero(&settings, sizeof(settings));
+    zero(&stats, sizeof(stats));
+}
+
+LocalRTMPServer::~LocalRTMPServer()
+{
+    Stop();
+}
+
+bool LocalRTMPServer::IsStopping() const
+{
+    return WaitForSingleObject(hStopEvent, 0) == WAIT_OBJECT_0;
+}
+
+//called after every packet, waits until the bytes read so far fit in the bandwidth cap and randomly
+//stops reading for a bit.  returns false if Stop was called in the meantime
+bool LocalRTMPServer::ShapeConnection(DWORD bytesIn, DWORD startTime, LocalServerStats &curStats)
+{
+    if(settings.maxKbps > 0)
+    {
+        DWORD elapsed = OSGetTime()-startTime;
+        DWORD allowedTime = DWORD(QWORD(bytesIn)*8/settings.maxKbps);
+
+        if(allowedTime > elapsed)
+        {
+            if(WaitForSingleObject(hStopEvent, allowedTime-elapsed) != WAIT_TIMEOUT)
+                return false;
+            curStats.totalThrottleTime += allowedTime-elapsed;
+        }
+    }
+
+    if(settings.stallChance > 0 && settings.stallMS > 0 && int(random.Next(1000)) < settings.stallChance)
+    {
+        if(WaitForSingleObject(hStopEvent, settings.stallMS) != WAIT_TIMEOUT)
+            return false;
+        curStats.numStalls++;
+        curStats.totalStallTime += settings.stallMS;
+    }
+
+    return true;
+}
+
+void LocalRTMPServer::ServeClient(SOCKET sock)
+{
+    LocalServerStats curStats;
+    zero(&curStats, sizeof(curStats));
+
+    RTMP *rtmp = RTMP_Alloc();
+    RTMP_Init(rtmp);
+    rtmp->m_sb.sb_socket = sock;
+
+    //keep the receive window small so the bandwidth cap reaches the publisher quickly instead of being
+    //soaked up by the socket buffers
+    if(settings.maxKbps > 0)
+    {
+        int recvBufSize = MAX(settings.maxKbps*1000/8/10, 8192);
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (const char*)&recvBufSize, sizeof(recvBufSize));
+    }
+
+    if(RTMP_Serve(rtmp))
+    {
+        DWORD startTime = OSGetTime();
+
+        RTMPPacket packet;
+        zero(&packet, sizeof(packet));
+
+        while(RTMP_IsConnected(rtmp) && RTMP_ReadPacket(rtmp, &packet))
+        {
+            if(!RTMPPacket_IsReady(&packet))
+                continue;
+
+            switch(packet.m_packetType)
+            {
+                case RTMP_PACKET_TYPE_CHUNK_SIZE:
+                    if(packet.m_nBodySize >= 4)
+                        rtmp->m_inChunkSize = AMF_DecodeInt32(packet.m_body);
+                    break;
+
+                case RTMP_PACKET_TYPE_INVOKE:
+                case RTMP_PACKET_TYPE_FLEX_MESSAGE:
+                    HandleInvoke(rtmp, &packet);
+                    break;
+
+                case RTMP_PACKET_TYPE_VIDEO:
+                    {
+                        QWORD arrivalOffset = GetQPCTimeMS()-packet.m_nTimeStamp;
+                        curStats.totalArrivalOffset += arrivalOffset;
+                        curStats.maxArrivalOffset = MAX(curStats.maxArrivalOffset, arrivalOffset);
+
+                        curStats.numVideoFrames++;
+                        if(packet.m_nBodySize && (BYTE(packet.m_body[0]) >> 4) == 1)
+                            curStats.numKeyframes++;
+                        break;
+                    }
+
+                case RTMP_PACKET_TYPE_AUDIO:
+                    curStats.numAudioFrames++;
+                    break;
+            }
+
+            RTMPPacket_Free(&packet);
+
+            //librtmp resets its count when a read fails and it closes the connection
+            curStats.bytesReceived = DWORD(rtmp->m_nBytesIn);
+
+            if(!ShapeConnection(rtmp->m_nBytesIn, startTime, curStats))
+                break;
+        }
+
+        RTMPPacket_Free(&packet);
+
+        curStats.totalTime = MAX(OSGetTime()-startTime, 1);
+    }
+
+    OSEnterMutex(hSocketMutex);
+    clientSocket = INVALID_SOCKET;
+    stats = curStats;
+    numConnectionsEnded++;
+    OSLeaveMutex(hSocketMutex);
+
+    RTMP_Close(rtmp);
+    RTMP_Free(rtmp);
+}
+
+DWORD STDCALL LocalRTMPServer::ServerThread(LPVOID param)
+{
+    LocalRTMPServer *server = (LocalRTMPServer*)param;
+
+    while(!server->IsStopping())
+    {
+        SOCKET sock = accept(server->listenSocket, NULL, NULL);
+        if(sock == INVALID_SOCKET)
+            break;
+
+        OSEnterMutex(server->hSocketMutex);
+        server->clientSocket = sock;
+        OSLeaveMutex(server->hSocketMutex);
+
+        //either Stop saw the socket and shut it down, or this sees the stop
+        if(server->IsStopping())
+        {
+            OSEnterMutex(server->hSocketMutex);
+            server->clientSocket = INVALID_SOCKET;
+            OSLeaveMutex(server->hSocketMutex);
+
+            closesocket(sock);
+            break;
+        }
+
+        server->ServeClient(sock);
+    }
+
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+
+//  forwards one direction of a relayed connection, holding everything it reads for delayMS.  when the
+//queue is full it stops reading, and send blocks while the other side isn't reading, so pushback
+//travels through the relay like it would through the network
+DWORD STDCALL LocalRTMPServer::PumpThread(LPVOID param)
+{
+    RelayPump *pump = (RelayPump*)param;
+    LocalRTMPServer *server = pump->server;
+
+    List<RelayChunk> chunks;
+    UINT queuedBytes = 0;
+    bool bReadClosed = false, bClean = false;
+
+    while(true)
+    {
+        bool bSendFailed = false;
+
+        while(chunks.Num() && chunks[0].sendTime <= GetQPCTimeMS())
+        {
+            RelayChunk &chunk = chunks[0];
+            if(!SendAll(pump->to, chunk.data, chunk.size))
+            {
+                bSendFailed = true;
+                break;
+            }
+
+            queuedBytes -= chunk.size;
+            Free(chunk.data);
+            chunks.Remove(0);
+        }
+
+        if(bSendFailed)
+            break;
+
+        //everything's through, pass the close on
+        if(bReadClosed && !chunks.Num())
+        {
+            shutdown(pump->to, SD_SEND);
+            bClean = true;
+            break;
+        }
+
+        //wake up when the next chunk is due, and every so often to check for Stop
+        DWORD timeout = 50;
+        if(chunks.Num())
+        {
+            QWORD curTime = GetQPCTimeMS();
+            timeout = (chunks[0].sendTime > curTime) ? DWORD(MIN(chunks[0].sendTime-curTime, 50)) : 0;
+        }
+
+        if(bReadClosed || queuedBytes >= RELAY_MAX_QUEUED)
+        {
+            if(WaitForSingleObject(server->hStopEvent, timeout) != WAIT_TIMEOUT)
+                break;
+            continue;
+        }
+
+        if(server->IsStopping())
+            break;
+
+        fd_set readSet;
+        FD_ZERO(&readSet);
+        FD_SET(pump->from, &readSet);
+
+        timeval tv;
+        tv.tv_sec  = timeout/1000;
+        tv.tv_usec = (timeout%1000)*1000;
+
+        int ret = select(0, &readSet, NULL, NULL, &tv);
+        if(ret == SOCKET_ERROR)
+            break;
+        if(ret == 0)
+            continue;
+
+        BYTE buffer[RELAY_READ_SIZE];
+        int size = recv(pump->from, (char*)buffer, RELAY_READ_SIZE, 0);
+        if(size == 0)
+        {
+            bReadClosed = true;
+            continue;
+        }
+        else if(size < 0)
+            break;
+
+        RelayChunk *chunk = chunks.CreateNew();
+        chunk->sendTime = GetQPCTimeMS()+pump->delayMS;
+        chunk->data     = (BYTE*)Allocate(size);
+        chunk->size     = size;
+        mcpy(chunk->data, buffer, size);
+
+        queuedBytes += size;
+    }
+
+    for(UINT i=0; i<chunks.Num(); i++)
+        Free(chunks[i].data);
+
+    //a broken direction takes the whole connection down so the other one doesn't wait forever
+    if(!bClean)
+    {
+        shutdown(pump->from, SD_BOTH);
+        shutdown(pump->to, SD_BOTH);
+    }
+
+    return 0;
+}
+
+void LocalRTMPServer::RelayClient(SOCKET sock)
+{
+    SOCKET serverSock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+    sockaddr_in addr;
+    zero(&addr, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((u_short)serverPort);
+
+    if(serverSock == INVALID_SOCKET || connect(serverSock, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR)
+    {
+        if(serverSock != INVALID_SOCKET)
+            closesocket(serverSock);
+        closesocket(sock);
+        return;
+    }
+
+    //the relay already sends in whole reads, nagle would only add to the delay
+    BOOL bNoDelay = TRUE;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&bNoDelay, sizeof(bNoDelay));
+    setsockopt(serverSock, IPPROTO_TCP, TCP_NODELAY, (const char*)&bNoDelay, sizeof(bNoDelay));
+
+    RelayConnection connection = {sock, serverSock};
+
+    OSEnterMutex(hSocketMutex);
+    relayConnection = &connection;
+    OSLeaveMutex(hSocketMutex);
+
+    if(IsStopping())
+    {
+        shutdown(sock, SD_BOTH);
+        shutdown(serverSock, SD_BOTH);
+    }
+
+    RelayPump upstream   = {this, sock, serverSock, DWORD(settings.delayMS)};
+    RelayPump downstream = {this, serverSock, sock, DWORD(settings.delayMS)};
+
+    HANDLE hUpstream   = OSCreateThread(PumpThread, &upstream);
+    HANDLE hDownstream = OSCreateThread(PumpThread, &downstream);
+
+    OSWaitForThread(hUpstream, NULL);
+    OSWaitForThread(hDownstream, NULL);
+    OSCloseThread(hUpstream);
+    OSCloseThread(hDownstream);
+
+    OSEnterMutex(hSocketMutex);
+    relayConnection = NULL;
+    OSLeaveMutex(hSocketMutex);
+
+    closesocket(sock);
+    closesocket(serverSock);
+}
+
+DWORD STDCALL LocalRTMPServer::RelayThread(LPVOID param)
+{
+    LocalRTMPServer *server = (LocalRTMPServer*)param;
+
+    while(!server->IsStopping())
+    {
+        SOCKET sock = accept(server->relayListenSocket, NULL, NULL);
+        if(sock == INVALID_SOCKET)
+            break;
+
+        server->RelayClient(sock);
+    }
+
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+
+bool LocalRTMPServer::Start(const LocalServerSettings &newSettings)
+{
+    Stop();
+
+    settings = newSettings;
+    zero(&stats, sizeof(stats));
+    numConnectionsEnded = 0;
+    random = TestRandom();
+
+    if(settings.port <= 0 || settings.port > 0xFFFF)
+        return false;
+
+    //with a delay the server goes on a port of its own and the relay takes the public one
+    listenSocket = ListenOnLoopback(settings.delayMS > 0 ? 0 : settings.port);
+    if(listenSocket == INVALID_SOCKET)
+        return false;
+
+    if(settings.delayMS > 0)
+    {
+        sockaddr_in addr;
+        int addrSize = sizeof(addr);
+        getsockname(listenSocket, (sockaddr*)&addr, &addrSize);
+        serverPort = ntohs(addr.sin_port);
+
+        relayListenSocket = ListenOnLoopback(settings.port);
+        if(relayListenSocket == INVALID_SOCKET)
+        {
+            closesocket(listenSocket);
+            listenSocket = INVALID_SOCKET;
+            return false;
+        }
+    }
+    else
+        serverPort = settings.port;
+
+    hStopEvent    = CreateEvent(NULL, TRUE, FALSE, NULL);
+    hSocketMutex  = OSCreateMutex();
+    hServerThread = OSCreateThread(ServerThread, this);
+
+    if(relayListenSocket != INVALID_SOCKET)
+        hRelayThread = OSCreateThread(RelayThread, this);
+
+    return true;
+}
+
+void LocalRTMPServer::Stop()
+{
+    if(!hServerThread)
+        return;
+
+    SetEvent(hStopEvent);
+
+    //closing the listening sockets and shutting down the connections kicks the threads out of
+    //accept/recv/send, everything else waits on the stop event
+    OSEnterMutex(hSocketMutex);
+
+    closesocket(listenSocket);
+    listenSocket = INVALID_SOCKET;
+
+    if(clientSocket != INVALID_SOCKET)
+        shutdown(clientSocket, SD_BOTH);
+
+    if(relayListenSocket != INVALID_SOCKET)
+    {
+        closesocket(relayListenSocket);
+        relayListenSocket = INVALID_SOCKET;
+    }
+
+    if(relayConnection)
+    {
+        shutdown(relayConnection->clientSocket, SD_BOTH);
+        shutdown(relayConnection->serverSocket, SD_BOTH);
+    }
+
+    OSLeaveMutex(hSocketMutex);
+
+    if(hRelayThread)
+    {
+        OSWaitForThread(hRelayThread, NULL);
+        OSCloseThread(hRelayThread);
+        hRelayThread = NULL;
+    }
+
+    OSWaitForThread(hServerThread, NULL);
+    OSCloseThread(hServerThread);
+    hServerThread = NULL;
+
+    CloseHandle(hStopEvent);
+    hStopEvent = NULL;
+
+    OSCloseMutex(hSocketMutex);
+    hSocketMutex = NULL;
+}
+
+LocalServerStats LocalRTMPServer::GetStats()
+{
+    if(!hSocketMutex)
+        return stats;
+
+    OSEnterMutex(hSocketMutex);
+    LocalServerStats curStats = stats;
+    OSLeaveMutex(hSocketMutex);
+
+    return curStats;
+}
+
+UINT LocalRTMPServer::NumConnectionsEnded()
+{
+    if(!hSocketMutex)
+        return numConnectionsEnded;
+
+    OSEnterMutex(hSocketMutex);
+    UINT num = numConnectionsEnded;
+    OSLeaveMutex(hSocketMutex);
+
+    return num;
+}
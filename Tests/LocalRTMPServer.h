@@ -0,0 +1,107 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+//  a bare-bones ingest server for driving RTMPPublisher against without a real one.  it
+//listens on 127.0.0.1, answers just enough of connect/createStream/publish to get the
+//stream going and throws the audio/video away after counting it.
+//
+//  the link can be made worse with:
+//    maxKbps     - caps how fast it reads from the socket, so tcp backs up into the publisher
+//    stallChance - chance per thousand packets that it stops reading for a while, roughly what
+//                  a retransmit timeout looks like from the sender's side
+//    stallMS     - how long those stalls last
+//    delayMS     - one way delay.  a relay sits on the public port and holds everything it
+//                  forwards (both ways) for this long before passing it on, so round trips take
+//                  twice that
+//
+//  none of the waits block shutdown, Stop wakes everything up and joins the threads.
+
+struct LocalServerSettings
+{
+    int port;
+    int maxKbps;
+    int stallChance;
+    int stallMS;
+    int delayMS;
+};
+
+struct LocalServerStats
+{
+    DWORD totalTime;
+    QWORD bytesReceived;
+
+    UINT numVideoFrames;
+    UINT numKeyframes;
+    UINT numAudioFrames;
+
+    //video arrival time (GetQPCTimeMS) minus the frame's timestamp.  whoever knows what the
+    //timestamps started at can turn these into latencies
+    QWORD totalArrivalOffset;
+    QWORD maxArrivalOffset;
+
+    UINT numStalls;
+    DWORD totalStallTime;
+    DWORD totalThrottleTime;
+};
+
+struct RelayConnection;
+
+class LocalRTMPServer
+{
+    LocalServerSettings settings;
+
+    HANDLE hStopEvent;
+    HANDLE hSocketMutex;
+
+    SOCKET listenSocket, clientSocket;
+    HANDLE hServerThread;
+
+    //the relay, when there's a delay
+    SOCKET relayListenSocket;
+    HANDLE hRelayThread;
+    RelayConnection *relayConnection;
+    int serverPort;
+
+    LocalServerStats stats;
+    UINT numConnectionsEnded;
+    TestRandom random;
+
+    static DWORD STDCALL ServerThread(LPVOID param);
+    static DWORD STDCALL RelayThread(LPVOID param);
+    static DWORD STDCALL PumpThread(LPVOID param);
+
+    bool IsStopping() const;
+    bool ShapeConnection(DWORD bytesIn, DWORD startTime, LocalServerStats &curStats);
+    void ServeClient(SOCKET sock);
+    void RelayClient(SOCKET sock);
+
+public:
+    LocalRTMPServer();
+    ~LocalRTMPServer();
+
+    bool Start(const LocalServerSettings &settings);
+    void Stop();
+
+    //stats of the last connection that ended
+    LocalServerStats GetStats();
+    UINT NumConnectionsEnded();
+};
@@ -0,0 +1,182 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "Tests.h"
+#include <stdlib.h>
+
+//-----------------------------------------------------------------------------
+//  how long a Log call keeps the calling thread busy when several threads log at once,
+//the way the encode, send and audio threads do during a stream.  Log queues the line
+//for the log writer thread, the "direct" numbers format the same line and write it to
+//a file right there, which is what Log used to do.  every line is different so none
+//of them get collapsed as repeats.
+
+#define LOG_BENCH_LINES 5000
+
+enum LogBenchMode
+{
+    LogBench_Queued,
+    LogBench_Direct,
+};
+
+struct LogBenchThread
+{
+    LogBenchMode mode;
+    UINT   index;
+    HANDLE hStartEvent;
+    XFile  *directFile;
+    QWORD  latencyNS[LOG_BENCH_LINES];
+};
+
+static void DirectLog(XFile *file, const TCHAR *format, ...)
+{
+    va_list arglist;
+    va_start(arglist, format);
+
+    String strCurTime = CurrentTimeString();
+    strCurTime << TEXT(": ");
+    String strOut = strCurTime;
+    strOut << FormattedStringva(format, arglist);
+
+    strOut.FindReplace(TEXT("\n"), String() << TEXT("\n") << strCurTime);
+
+    file->WriteAsUTF8(strOut, strOut.Length());
+    file->WriteAsUTF8(TEXT("\r\n"));
+
+    va_end(arglist);
+}
+
+static DWORD STDCALL LogBenchThreadProc(LPVOID lpParam)
+{
+    LogBenchThread *thread = (LogBenchThread*)lpParam;
+    WaitForSingleObject(thread->hStartEvent, INFINITE);
+
+    for(UINT i=0; i<LOG_BENCH_LINES; i++)
+    {
+        QWORD startTime = GetQPCTimeNS();
+
+        if(thread->mode == LogBench_Queued)
+            Log(TEXT("log benchmark: thread %u, line %u, some numbers %d %d"), thread->index, i, i*3, i*7);
+        else
+            DirectLog(thread->directFile, TEXT("log benchmark: thread %u, line %u, some numbers %d %d"), thread->index, i, i*3, i*7);
+
+        thread->latencyNS[i] = GetQPCTimeNS()-startTime;
+    }
+
+    return 0;
+}
+
+static int __cdecl CompareQWORD(const void *a, const void *b)
+{
+    QWORD valA = *(const QWORD*)a, valB = *(const QWORD*)b;
+    return (valA < valB) ? -1 : (valA > valB) ? 1 : 0;
+}
+
+struct LogBenchResults
+{
+    double avgNS, p99NS, maxNS;
+    double linesPerSec;
+};
+
+static void RunLogBench(LogBenchMode mode, UINT numThreads, XFile *directFile, LogBenchResults &results)
+{
+    HANDLE hStartEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+    List<LogBenchThread*> threads;
+    List<HANDLE> hThreads;
+
+    for(UINT i=0; i<numThreads; i++)
+    {
+        LogBenchThread *thread = new LogBenchThread;
+        thread->mode        = mode;
+        thread->index       = i;
+        thread->hStartEvent = hStartEvent;
+        thread->directFile  = directFile;
+
+        threads << thread;
+        hThreads << OSCreateThread(LogBenchThreadProc, thread);
+    }
+
+    QWORD startTime = GetQPCTimeNS();
+    SetEvent(hStartEvent);
+
+    for(UINT i=0; i<numThreads; i++)
+    {
+        OSWaitForThread(hThreads[i], NULL);
+        OSCloseThread(hThreads[i]);
+    }
+
+    QWORD totalTime = GetQPCTimeNS()-startTime;
+    CloseHandle(hStartEvent);
+
+    //---------------------------------------------
+
+    List<QWORD> latencies;
+    for(UINT i=0; i<numThreads; i++)
+    {
+        latencies.AppendArray(threads[i]->latencyNS, LOG_BENCH_LINES);
+        delete threads[i];
+    }
+
+    qsort(latencies.Array(), latencies.Num(), sizeof(QWORD), CompareQWORD);
+
+    QWORD totalNS = 0;
+    for(UINT i=0; i<latencies.Num(); i++)
+        totalNS += latencies[i];
+
+    results.avgNS       = double(totalNS)/double(latencies.Num());
+    results.p99NS       = double(latencies[latencies.Num()*99/100]);
+    results.maxNS       = double(latencies.Last());
+    results.linesPerSec = double(latencies.Num())*1000000000.0/double(totalTime);
+}
+
+//-----------------------------------------------------------------------------
+
+OBS_BENCHMARK(LogContention)
+{
+    TCHAR lpTempPath[MAX_PATH];
+    GetTempPath(MAX_PATH, lpTempPath);
+    String strDirectLog = FormattedString(TEXT("%sobs_logbench_%u.log"), lpTempPath, GetCurrentProcessId());
+
+    XFile directFile;
+    TEST_CHECK(directFile.Open(strDirectLog, XFILE_WRITE, XFILE_CREATEALWAYS));
+
+    const UINT threadCounts[] = {1, 2, 4, 8};
+
+    TestPrint(TEXT("    %u lines per thread, latency per call in us\n"), LOG_BENCH_LINES);
+    TestPrint(TEXT("    %-8s %-7s %8s %8s %9s %12s\n"), TEXT("threads"), TEXT("mode"), TEXT("avg"), TEXT("p99"), TEXT("max"), TEXT("lines/s"));
+
+    for(UINT i=0; i<_countof(threadCounts); i++)
+    {
+        for(int mode=0; mode<2; mode++)
+        {
+            LogBenchResults results;
+            RunLogBench(LogBenchMode(mode), threadCounts[i], &directFile, results);
+
+            TestPrint(TEXT("    %-8u %-7s %8.2f %8.2f %9.1f %12.0f\n"), threadCounts[i],
+                (mode == LogBench_Queued) ? TEXT("queued") : TEXT("direct"),
+                results.avgNS/1000.0, results.p99NS/1000.0, results.maxNS/1000.0, results.linesPerSec);
+        }
+    }
+
+    directFile.Close();
+    OSDeleteFile(strDirectLog);
+
+    return true;
+}
@@ -0,0 +1,526 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "../Source/Main.h"
+#include "../Source/MP4FileStream.h"
+#include "Tests.h"
+
+//-----------------------------------------------------------------------------
+//  muxes a synthetic H.264/AAC stream through MP4FileStream in fragmented mode and
+//walks the resulting box tree: the init segment, then moof+mdat pairs with increasing
+//sequence numbers, keyframes at the start of every video fragment, decode times that
+//line up with the packet timestamps (including an audio gap), data offsets that land
+//in the mdat that follows, and sample data that matches what went in NAL for NAL.
+
+#define TEST_FPS                30
+#define TEST_KEYFRAME_INTERVAL  60      //frames
+#define TEST_NUM_FRAMES         400
+#define TEST_AUDIO_FRAME_SIZE   1024
+#define TEST_SAMPLE_RATE        48000
+#define TEST_FRAGMENT_DURATION  2000
+
+static const BYTE videoHeaderPacket[] =
+{
+    0x17, 0x00, 0x00, 0x00, 0x00,                   //flv: keyframe, sequence header
+    0x01, 0x64, 0x00, 0x28, 0xFF, 0xE1,             //avcC version, profile, compat, level, nal size 4, one SPS
+    0x00, 0x04, 0x67, 0x64, 0x00, 0x28,             //SPS
+    0x01, 0x00, 0x03, 0x68, 0xEE, 0x3C              //one PPS
+};
+
+static const BYTE audioHeaderPacket[] = {0xAF, 0x00, 0x11, 0x90};   //AAC LC, 48khz, stereo
+
+//the SEI x264 puts in front of the first frame, already length prefixed
+static const BYTE seiNAL[] = {0x00, 0x00, 0x00, 0x05, 0x06, 0x05, 0x01, 0xAA, 0x80};
+
+class SEIVideoEncoder : public VideoEncoder
+{
+protected:
+    virtual bool Encode(LPVOID picIn, List<DataPacket> &packets, List<PacketType> &packetTypes, DWORD timestamp) {return false;}
+
+public:
+    virtual int  GetBitRate() const                             {return 2500;}
+    virtual bool DynamicBitrateSupported() const                {return false;}
+    virtual bool SetBitRate(DWORD maxBitrate, DWORD bufferSize) {return false;}
+
+    virtual void GetHeaders(DataPacket &packet)
+    {
+        packet.lpPacket = (LPBYTE)videoHeaderPacket;
+        packet.size     = sizeof(videoHeaderPacket);
+    }
+
+    virtual void GetSEI(DataPacket &packet)
+    {
+        packet.lpPacket = (LPBYTE)seiNAL;
+        packet.size     = sizeof(seiNAL);
+    }
+
+    virtual String GetInfoString() const {return String();}
+};
+
+//-----------------------------------------------------------------------------
+
+struct MuxPacket
+{
+    List<BYTE> data;
+    DWORD      timestamp;
+    PacketType type;
+};
+
+struct ExpectedSample
+{
+    List<BYTE> data;        //what should end up in the mdat
+    UINT64     decodeTime;  //in the track's timescale
+    INT        compositionOffset;
+    bool       bKeyframe;
+};
+
+static void AppendNAL(List<BYTE> &data, BYTE nalHeader, UINT size, UINT seed)
+{
+    data << BYTE(size>>24) << BYTE(size>>16) << BYTE(size>>8) << BYTE(size);
+    data << nalHeader;
+    for(UINT i=1; i<size; i++)
+        data << BYTE(seed*31 + i);
+}
+
+//builds the packet list in the order OBS would hand them to the file stream, and the samples the
+//muxer should produce from them
+static void BuildSyntheticStream(List<MuxPacket> &packets, List<ExpectedSample> &expectedVideo, List<ExpectedSample> &expectedAudio)
+{
+    const DWORD startTime = 5000;   //the muxer makes everything relative to the first keyframe
+
+    //audio frames, with a gap of about 300ms starting at 5 seconds in (a device dropping out)
+    List<DWORD> audioTimes;
+    DWORD videoEnd = TEST_NUM_FRAMES*1000/TEST_FPS;
+    for(UINT64 sample=0; ; sample += TEST_AUDIO_FRAME_SIZE)
+    {
+        DWORD time = DWORD(sample*1000/TEST_SAMPLE_RATE);
+        if(time >= videoEnd)
+            break;
+        if(time >= 5000 && time < 5300)
+            continue;
+
+        audioTimes << time;
+    }
+
+    //the muxer packs audio back to back unless a timestamp says there's a gap (see GetAudioDecodeTime)
+    UINT64 nextDecodeTime = 0;
+    for(UINT i=0; i<audioTimes.Num(); i++)
+    {
+        UINT64 decodeTime = nextDecodeTime;
+        if(i > 1)
+            decodeTime = MAX(decodeTime, MAX(UINT64(audioTimes[i])*TEST_SAMPLE_RATE/1000, UINT64(TEST_AUDIO_FRAME_SIZE)*i));
+
+        ExpectedSample *sample = expectedAudio.CreateNew();
+        sample->decodeTime = decodeTime;
+        sample->bKeyframe  = true;
+        for(UINT j=0; j<200+(i*13)%200; j++)
+            sample->data << BYTE(i*17 + j);
+
+        nextDecodeTime = decodeTime+TEST_AUDIO_FRAME_SIZE;
+    }
+
+    //video, with the occasional frame split across two packets and composition offsets like b-frames give.
+    //each frame is followed by the audio up to the next one
+    UINT audioID = 0;
+    for(UINT frame=0; frame<TEST_NUM_FRAMES; frame++)
+    {
+        DWORD time = frame*1000/TEST_FPS;
+        bool bKeyframe = (frame % TEST_KEYFRAME_INTERVAL) == 0;
+        INT  compositionOffset = bKeyframe ? 0 : INT(((frame % 3)+1)*1000/TEST_FPS);
+
+        ExpectedSample *sample = expectedVideo.CreateNew();
+        sample->decodeTime        = time;
+        sample->compositionOffset = compositionOffset;
+        sample->bKeyframe         = bKeyframe;
+
+        UINT numParts = (frame % 7 == 3) ? 2 : 1;
+        for(UINT part=0; part<numParts; part++)
+        {
+            MuxPacket *packet = packets.CreateNew();
+            packet->timestamp = startTime+time;
+            packet->type      = bKeyframe ? PacketType_VideoHighest : PacketType_VideoLow;
+            packet->data << (bKeyframe ? 0x17 : 0x27) << 0x01;
+            packet->data << BYTE(compositionOffset>>16) << BYTE(compositionOffset>>8) << BYTE(compositionOffset);
+
+            List<BYTE> nals;
+            AppendNAL(nals, bKeyframe ? 0x65 : 0x41, 100 + (frame*37 + part*11)%900, frame*2+part);
+            packet->data.AppendList(nals);
+
+            if(frame == 0 && part == 0)
+                sample->data.AppendArray(seiNAL, sizeof(seiNAL));
+            sample->data.AppendList(nals);
+        }
+
+        DWORD nextTime = (frame+1)*1000/TEST_FPS;
+        while(audioID < audioTimes.Num() && audioTimes[audioID] < nextTime)
+        {
+            MuxPacket *packet = packets.CreateNew();
+            packet->timestamp = startTime+audioTimes[audioID];
+            packet->type      = PacketType_Audio;
+            packet->data << 0xAF << 0x01;
+            packet->data.AppendList(expectedAudio[audioID].data);
+            audioID++;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+static inline DWORD ReadBE32(LPCBYTE lpData)
+{
+    return (DWORD(lpData[0])<<24) | (DWORD(lpData[1])<<16) | (DWORD(lpData[2])<<8) | DWORD(lpData[3]);
+}
+
+static inline QWORD ReadBE64(LPCBYTE lpData)
+{
+    return (QWORD(ReadBE32(lpData))<<32) | QWORD(ReadBE32(lpData+4));
+}
+
+struct MP4Box
+{
+    DWORD  type;
+    UINT   offset;      //of the box header in the file
+    UINT   size;
+    LPCBYTE lpData;     //payload, after the 8 byte header
+    UINT   dataSize;
+};
+
+//splits the payload of a box (or the whole file) into its child boxes, false if the sizes don't add up
+static bool ParseBoxes(LPCBYTE lpStart, LPCBYTE lpData, UINT size, List<MP4Box> &boxes)
+{
+    boxes.Clear();
+
+    UINT pos = 0;
+    while(pos < size)
+    {
+        if(size-pos < 8)
+            return false;
+
+        MP4Box box;
+        box.size = ReadBE32(lpData+pos);
+        box.type = ReadBE32(lpData+pos+4);
+        if(box.size < 8 || box.size > size-pos)
+            return false;
+
+        box.offset   = UINT((lpData+pos)-lpStart);
+        box.lpData   = lpData+pos+8;
+        box.dataSize = box.size-8;
+        boxes << box;
+
+        pos += box.size;
+    }
+
+    return true;
+}
+
+static const MP4Box* FindBox(const List<MP4Box> &boxes, DWORD type, UINT index=0)
+{
+    for(UINT i=0; i<boxes.Num(); i++)
+    {
+        if(boxes[i].type == type && index-- == 0)
+            return &boxes[i];
+    }
+
+    return NULL;
+}
+
+#define BOX_CHECK(expr) if(!(expr)) {TestFailed(TEXT(__FILE__), __LINE__, _CRT_WIDE(#expr)); return false;}
+
+//checks a fragment's traf against the expected samples starting at nextSample, and advances it
+static bool CheckTrackFragment(const MP4Box &traf, const MP4Box &moof, const MP4Box &mdat, DWORD trackID,
+                               UINT dataStart, const List<ExpectedSample> &expected, UINT &nextSample, UINT &dataSize)
+{
+    LPCBYTE lpFile = traf.lpData-8-traf.offset;
+
+    List<MP4Box> boxes;
+    BOX_CHECK(ParseBoxes(lpFile, traf.lpData, traf.dataSize, boxes));
+
+    const MP4Box *tfhd = FindBox(boxes, 'tfhd');
+    const MP4Box *tfdt = FindBox(boxes, 'tfdt');
+    const MP4Box *trun = FindBox(boxes, 'trun');
+    BOX_CHECK(tfhd && tfdt && trun);
+
+    BOX_CHECK(ReadBE32(tfhd->lpData) == 0x00020000);   //default-base-is-moof
+    BOX_CHECK(ReadBE32(tfhd->lpData+4) == trackID);
+
+    BOX_CHECK(ReadBE32(tfdt->lpData) == 0x01000000);   //version 1
+    UINT64 decodeTime = ReadBE64(tfdt->lpData+4);
+
+    DWORD trunFlags  = ReadBE32(trun->lpData) & 0xFFFFFF;
+    UINT numSamples  = ReadBE32(trun->lpData+4);
+    UINT dataOffset  = ReadBE32(trun->lpData+8);
+    bool bVideo      = (trunFlags & 0x400) != 0;
+
+    BOX_CHECK(trunFlags == (bVideo ? 0xF01UL : 0x301UL));
+    BOX_CHECK(numSamples > 0 && nextSample+numSamples <= expected.Num());
+    BOX_CHECK(trun->dataSize == 12 + numSamples*(bVideo ? 16 : 8));
+
+    //data offsets are from the start of the moof and have to land where this track's data starts in the mdat
+    BOX_CHECK(moof.offset+dataOffset == mdat.offset+8+dataStart);
+
+    LPCBYTE lpSample = mdat.lpData+dataStart;
+    LPCBYTE lpEntry  = trun->lpData+12;
+    dataSize = 0;
+
+    for(UINT i=0; i<numSamples; i++)
+    {
+        const ExpectedSample &sample = expected[nextSample+i];
+
+        DWORD duration = ReadBE32(lpEntry);
+        DWORD size     = ReadBE32(lpEntry+4);
+
+        BOX_CHECK(decodeTime == sample.decodeTime);
+        BOX_CHECK(size == sample.data.Num());
+        BOX_CHECK(dataStart+dataSize+size <= mdat.dataSize);
+        BOX_CHECK(memcmp(lpSample+dataSize, sample.data.Array(), size) == 0);
+
+        if(bVideo)
+        {
+            DWORD flags = ReadBE32(lpEntry+8);
+            INT compositionOffset = INT(ReadBE32(lpEntry+12));
+
+            BOX_CHECK(flags == (sample.bKeyframe ? 0x02000000UL : 0x01010000UL));
+            BOX_CHECK(compositionOffset == sample.compositionOffset);
+
+            //every video fragment has to start on a keyframe to be decodable on its own
+            if(i == 0)
+                BOX_CHECK(sample.bKeyframe);
+
+            //the sample has to be nothing but length prefixed NALs
+            UINT nalPos = 0;
+            while(nalPos+4 <= size)
+                nalPos += 4+ReadBE32(lpSample+dataSize+nalPos);
+            BOX_CHECK(nalPos == size);
+
+            lpEntry += 16;
+        }
+        else
+            lpEntry += 8;
+
+        //the next sample's decode time is this one's plus its duration, which is how players rebuild the timeline
+        decodeTime += duration;
+        dataSize += size;
+    }
+
+    nextSample += numSamples;
+    return true;
+}
+
+static bool CheckFragmentedFile(const List<BYTE> &fileData, const List<ExpectedSample> &expectedVideo, const List<ExpectedSample> &expectedAudio, UINT &numFragments)
+{
+    LPCBYTE lpFile = fileData.Array();
+
+    List<MP4Box> topBoxes;
+    BOX_CHECK(ParseBoxes(lpFile, lpFile, fileData.Num(), topBoxes));
+    BOX_CHECK(topBoxes.Num() >= 4);
+
+    //---------------------------------------------
+    // init segment
+
+    BOX_CHECK(topBoxes[0].type == 'ftyp');
+    BOX_CHECK(ReadBE32(topBoxes[0].lpData) == 'isom');
+    BOX_CHECK(ReadBE32(topBoxes[0].lpData+12) == 'iso6');
+
+    BOX_CHECK(topBoxes[1].type == 'moov');
+
+    List<MP4Box> moovBoxes;
+    BOX_CHECK(ParseBoxes(lpFile, topBoxes[1].lpData, topBoxes[1].dataSize, moovBoxes));
+    BOX_CHECK(FindBox(moovBoxes, 'mvhd'));
+
+    //track 1 is the audio, track 2 the video, and neither has samples in the moov
+    for(UINT i=0; i<2; i++)
+    {
+        const MP4Box *trak = FindBox(moovBoxes, 'trak', i);
+        BOX_CHECK(trak);
+
+        List<MP4Box> trakBoxes, mdiaBoxes, minfBoxes, stblBoxes;
+        BOX_CHECK(ParseBoxes(lpFile, trak->lpData, trak->dataSize, trakBoxes));
+
+        const MP4Box *tkhd = FindBox(trakBoxes, 'tkhd');
+        const MP4Box *mdia = FindBox(trakBoxes, 'mdia');
+        BOX_CHECK(tkhd && mdia);
+        BOX_CHECK(ParseBoxes(lpFile, mdia->lpData, mdia->dataSize, mdiaBoxes));
+
+        const MP4Box *hdlr = FindBox(mdiaBoxes, 'hdlr');
+        const MP4Box *minf = FindBox(mdiaBoxes, 'minf');
+        BOX_CHECK(hdlr && minf);
+
+        DWORD trackID = ReadBE32(tkhd->lpData+12);
+        DWORD handler = ReadBE32(hdlr->lpData+8);
+        BOX_CHECK((trackID == 1 && handler == 'soun') || (trackID == 2 && handler == 'vide'));
+
+        BOX_CHECK(ParseBoxes(lpFile, minf->lpData, minf->dataSize, minfBoxes));
+        const MP4Box *stbl = FindBox(minfBoxes, 'stbl');
+        BOX_CHECK(stbl);
+        BOX_CHECK(ParseBoxes(lpFile, stbl->lpData, stbl->dataSize, stblBoxes));
+
+        const MP4Box *stsz = FindBox(stblBoxes, 'stsz');
+        BOX_CHECK(stsz && ReadBE32(stsz->lpData+8) == 0);
+        BOX_CHECK(!FindBox(stblBoxes, 'ctts'));
+    }
+
+    const MP4Box *mvex = FindBox(moovBoxes, 'mvex');
+    BOX_CHECK(mvex);
+
+    List<MP4Box> mvexBoxes;
+    BOX_CHECK(ParseBoxes(lpFile, mvex->lpData, mvex->dataSize, mvexBoxes));
+    BOX_CHECK(mvexBoxes.Num() == 2);
+    for(UINT i=0; i<2; i++)
+    {
+        BOX_CHECK(mvexBoxes[i].type == 'trex');
+        BOX_CHECK(ReadBE32(mvexBoxes[i].lpData+4) == i+1);
+    }
+
+    //---------------------------------------------
+    // fragments
+
+    BOX_CHECK((topBoxes.Num() % 2) == 0);
+
+    UINT nextVideo = 0, nextAudio = 0;
+    numFragments = 0;
+
+    for(UINT i=2; i<topBoxes.Num(); i+=2)
+    {
+        const MP4Box &moof = topBoxes[i];
+        const MP4Box &mdat = topBoxes[i+1];
+        BOX_CHECK(moof.type == 'moof' && mdat.type == 'mdat');
+
+        List<MP4Box> moofBoxes;
+        BOX_CHECK(ParseBoxes(lpFile, moof.lpData, moof.dataSize, moofBoxes));
+
+        const MP4Box *mfhd = FindBox(moofBoxes, 'mfhd');
+        BOX_CHECK(mfhd && ReadBE32(mfhd->lpData+4) == numFragments+1);
+
+        //video data comes first in the mdat, then audio
+        UINT dataStart = 0;
+        for(UINT j=0; j<moofBoxes.Num(); j++)
+        {
+            const MP4Box &traf = moofBoxes[j];
+            if(traf.type != 'traf')
+                continue;
+
+            UINT trackID = ReadBE32(traf.lpData+8+4);   //tfhd is the first box in the traf
+            UINT dataSize;
+
+            if(trackID == 2)
+            {
+                BOX_CHECK(dataStart == 0);
+                if(!CheckTrackFragment(traf, moof, mdat, 2, dataStart, expectedVideo, nextVideo, dataSize))
+                    return false;
+            }
+            else
+            {
+                BOX_CHECK(trackID == 1);
+                if(!CheckTrackFragment(traf, moof, mdat, 1, dataStart, expectedAudio, nextAudio, dataSize))
+                    return false;
+            }
+
+            dataStart += dataSize;
+        }
+
+        BOX_CHECK(dataStart == mdat.dataSize);
+        numFragments++;
+    }
+
+    //nothing lost, nothing made up
+    BOX_CHECK(nextVideo == expectedVideo.Num());
+    BOX_CHECK(nextAudio == expectedAudio.Num());
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+//muxes the packets into a temporary file and reads it back
+static bool MuxPackets(const List<MuxPacket> &packets, List<BYTE> &fileData)
+{
+    TCHAR lpTempPath[MAX_PATH];
+    GetTempPath(MAX_PATH, lpTempPath);
+    String strFile = FormattedString(TEXT("%sobs_fmp4_test_%u.mp4"), lpTempPath, GetCurrentProcessId());
+
+    SEIVideoEncoder videoEncoder;
+
+    MP4StreamInfo info;
+    zero(&info, sizeof(info));
+    info.sampleRateHz     = TEST_SAMPLE_RATE;
+    info.frameTime        = 1000/TEST_FPS;
+    info.width            = 1280;
+    info.height           = 720;
+    info.lpAudioCodec     = TEXT("AAC");
+    info.audioFrameSize   = TEST_AUDIO_FRAME_SIZE;
+    info.audioBitRate     = 160;
+    info.videoHeaders.lpPacket = (LPBYTE)videoHeaderPacket;
+    info.videoHeaders.size     = sizeof(videoHeaderPacket);
+    info.audioHeaders.lpPacket = (LPBYTE)audioHeaderPacket;
+    info.audioHeaders.size     = sizeof(audioHeaderPacket);
+    info.videoEncoder     = &videoEncoder;
+    info.bFragmented      = true;
+    info.fragmentDuration = TEST_FRAGMENT_DURATION;
+
+    VideoFileStream *fileStream = CreateMP4FileStream(strFile, info);
+    TEST_CHECK(fileStream != NULL);
+
+    //audio that arrives before the first keyframe is dropped
+    BYTE earlyAudio[] = {0xAF, 0x01, 0x21, 0x10};
+    fileStream->AddPacket(earlyAudio, sizeof(earlyAudio), 4990, PacketType_Audio);
+
+    for(UINT i=0; i<packets.Num(); i++)
+        fileStream->AddPacket(packets[i].data.Array(), packets[i].data.Num(), packets[i].timestamp, packets[i].type);
+
+    delete fileStream;
+
+    XFile file;
+    bool bRead = false;
+    if(file.Open(strFile, XFILE_READ, XFILE_OPENEXISTING))
+    {
+        fileData.SetSize((UINT)file.GetFileSize());
+        bRead = (file.Read(fileData.Array(), fileData.Num()) == fileData.Num());
+        file.Close();
+    }
+
+    OSDeleteFile(strFile);
+
+    TEST_CHECK(bRead);
+    return true;
+}
+
+OBS_TEST(MP4FragmentedBoxTree)
+{
+    List<MuxPacket> packets;
+    List<ExpectedSample> expectedVideo, expectedAudio;
+    BuildSyntheticStream(packets, expectedVideo, expectedAudio);
+
+    List<BYTE> fileData;
+    UINT numFragments = 0;
+    bool bSuccess = MuxPackets(packets, fileData) && CheckFragmentedFile(fileData, expectedVideo, expectedAudio, numFragments);
+
+    //the lists inside the elements aren't freed with the lists
+    for(UINT i=0; i<packets.Num(); i++)
+        packets[i].data.Clear();
+    for(UINT i=0; i<expectedVideo.Num(); i++)
+        expectedVideo[i].data.Clear();
+    for(UINT i=0; i<expectedAudio.Num(); i++)
+        expectedAudio[i].data.Clear();
+
+    TEST_CHECK(bSuccess);
+
+    //a fragment per keyframe interval, since every interval is at least the fragment duration
+    TEST_CHECK(numFragments == (TEST_NUM_FRAMES+TEST_KEYFRAME_INTERVAL-1)/TEST_KEYFRAME_INTERVAL);
+    return true;
+}
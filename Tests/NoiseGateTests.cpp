@@ -0,0 +1,410 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "Tests.h"
+#include "TestAPI.h"
+#include "../NoiseGate/NoiseGate.h"
+
+//-----------------------------------------------------------------------------
+//  the noise gate used to do everything on every sample.  it still steps its open/close
+//state per sample but ramps the attenuation a 32 frame block at a time, so its output
+//is compared against a copy of the old per-sample loop on synthetic mic fixtures
+//(speech over a noise floor, clicks, slow fades), fed through in odd segment sizes
+//so the short blocks at the end of a segment get used too.  the gate is built from
+//a noisegate.ini the same way the plugin loads it.
+
+struct GateParams
+{
+    CTSTR lpName;
+    int   openDB, closeDB;
+    float attackTime, holdTime, releaseTime;
+};
+
+static const GateParams gateParams[] =
+{
+    {TEXT("default"), -26, -32, 0.025f, 0.2f, 0.15f},
+    {TEXT("fast"),    -30, -40, 0.005f, 0.02f, 0.01f},
+    {TEXT("slow"),    -20, -24, 0.1f,  0.5f, 0.5f},
+};
+
+//NoiseGateFilter::Process as it was before the block version, one sample at a time
+class ReferenceGate
+{
+    float openThreshold, closeThreshold, holdTime;
+    float dtPerSample, attackRate, releaseRate, decayRate;
+
+    float attenuation, level, heldTime;
+    bool  isOpen;
+
+public:
+    UINT numOpenFrames, numClosedFrames;
+
+    ReferenceGate(const GateParams &params, UINT sampleRate)
+        : attenuation(0.0f), level(0.0f), heldTime(0.0f), isOpen(false), numOpenFrames(0), numClosedFrames(0)
+    {
+        const float SAMPLE_RATE_F = float(sampleRate);
+
+        openThreshold  = pow(10.0f, float(params.openDB) / 20.0f);
+        closeThreshold = pow(10.0f, float(params.closeDB) / 20.0f);
+        holdTime       = params.holdTime;
+
+        dtPerSample = 1.0f / SAMPLE_RATE_F;
+        attackRate  = 1.0f / (params.attackTime * SAMPLE_RATE_F);
+        releaseRate = 1.0f / (params.releaseTime * SAMPLE_RATE_F);
+        decayRate   = (openThreshold - closeThreshold) / ((1.0f / 75.0f) * SAMPLE_RATE_F);
+    }
+
+    void Process(float *buffer, UINT numFrames)
+    {
+        for(UINT i=0; i<numFrames; i++)
+        {
+            float *frame = buffer + i*2;
+            float curLvl = abs(frame[0] + frame[1]) * 0.5f;
+
+            if(curLvl > openThreshold && !isOpen)
+                isOpen = true;
+            if(level < closeThreshold && isOpen)
+            {
+                heldTime = 0.0f;
+                isOpen = false;
+            }
+
+            level = max(level, curLvl) - decayRate;
+
+            if(isOpen)
+                attenuation = min(1.0f, attenuation + attackRate);
+            else
+            {
+                heldTime += dtPerSample;
+                if(heldTime > holdTime)
+                    attenuation = max(0.0f, attenuation - releaseRate);
+            }
+
+            if(attenuation == 1.0f)
+                numOpenFrames++;
+            else if(attenuation == 0.0f)
+                numClosedFrames++;
+
+            frame[0] *= attenuation;
+            frame[1] *= attenuation;
+        }
+    }
+};
+
+//-----------------------------------------------------------------------------
+
+enum GateFixture
+{
+    GateFixture_Speech,
+    GateFixture_Clicks,
+    GateFixture_Fades,
+};
+
+static CTSTR gateFixtureNames[] = {TEXT("speech"), TEXT("clicks"), TEXT("fades")};
+
+//voiced sound: a fundamental in the 100-250Hz range with a few falling harmonics
+static inline float Voice(float phase)
+{
+    return sin(phase) + 0.5f*sin(phase*2.0f) + 0.3f*sin(phase*3.0f) + 0.15f*sin(phase*5.0f);
+}
+
+static void MakeGateFixture(GateFixture fixture, UINT sampleRate, UINT numFrames, List<float> &samples)
+{
+    TestRandom random(fixture+1);
+    samples.SetSize(numFrames*2);
+
+    //room noise around -50dB, slightly different on each side
+    for(UINT i=0; i<numFrames*2; i++)
+        samples[i] = random.NextFloat()*0.003f;
+
+    const float PI2 = 6.2831853f;
+    UINT pos = sampleRate/4;
+
+    while(pos < numFrames)
+    {
+        if(fixture == GateFixture_Speech)
+        {
+            //a word or two with 10ms edges, then a pause long enough for every preset to close
+            UINT length = sampleRate*(200 + random.Next(700))/1000;
+            UINT edge   = sampleRate/100;
+            float amplitude = 0.05f + float(random.Next(400))/1000.0f;
+            float step = PI2*float(100 + random.Next(150))/float(sampleRate);
+            float phase = 0.0f;
+
+            for(UINT i=0; i<length && pos+i<numFrames; i++)
+            {
+                float envelope = min(1.0f, float(min(i, length-1-i))/float(edge));
+                float value = Voice(phase)*amplitude*envelope;
+                samples[(pos+i)*2]   += value;
+                samples[(pos+i)*2+1] += value*0.9f;
+                phase += step*(1.0f + 0.1f*float(i)/float(length));
+            }
+
+            pos += length + sampleRate*(1200 + random.Next(800))/1000;
+        }
+        else if(fixture == GateFixture_Clicks)
+        {
+            //a few samples of a keyboard click or a bump of the desk, louder than any voice
+            UINT length = 1 + random.Next(40);
+            float amplitude = 0.2f + float(random.Next(600))/1000.0f;
+
+            for(UINT i=0; i<length && pos+i<numFrames; i++)
+            {
+                float value = amplitude*random.NextFloat();
+                samples[(pos+i)*2]   += value;
+                samples[(pos+i)*2+1] += value;
+            }
+
+            pos += sampleRate*(100 + random.Next(2000))/1000;
+        }
+        else
+        {
+            //a tone that slowly rises through both thresholds and falls back down
+            UINT length = sampleRate*(1000 + random.Next(1500))/1000;
+            float step = PI2*float(120 + random.Next(100))/float(sampleRate);
+
+            for(UINT i=0; i<length && pos+i<numFrames; i++)
+            {
+                float envelope = 1.0f - abs(float(i)*2.0f/float(length) - 1.0f);
+                float value = sin(step*float(i))*0.12f*envelope;
+                samples[(pos+i)*2]   += value;
+                samples[(pos+i)*2+1] += value;
+            }
+
+            pos += length + sampleRate*(1200 + random.Next(600))/1000;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+//an empty mic for the plugin to hook its filter into
+class GateMicSource : public AudioSource
+{
+protected:
+    virtual CTSTR GetDeviceName() const {return TEXT("Gate test mic");}
+    virtual bool GetNextBuffer(void **buffer, UINT *numFrames, QWORD *timestamp) {return false;}
+    virtual void ReleaseBuffer() {}
+};
+
+//writes noisegate.ini to a temporary plugin data directory and loads the plugin from it
+static NoiseGate* CreateNoiseGate(const GateParams &params, String &strPluginDataPath)
+{
+    TCHAR lpTempPath[MAX_PATH];
+    GetTempPath(MAX_PATH, lpTempPath);
+    strPluginDataPath = FormattedString(TEXT("%sobs_noisegate_%u"), lpTempPath, GetCurrentProcessId());
+    OSCreateDirectory(strPluginDataPath);
+
+    ConfigFile config;
+    config.Create(strPluginDataPath + CONFIG_FILENAME);
+    config.SetInt(TEXT("General"), TEXT("IsEnabled"), 1);
+    config.SetInt(TEXT("General"), TEXT("OpenThreshold"), params.openDB);
+    config.SetInt(TEXT("General"), TEXT("CloseThreshold"), params.closeDB);
+    config.SetFloat(TEXT("General"), TEXT("AttackTime"), params.attackTime);
+    config.SetFloat(TEXT("General"), TEXT("HoldTime"), params.holdTime);
+    config.SetFloat(TEXT("General"), TEXT("ReleaseTime"), params.releaseTime);
+    config.Close();
+
+    GetTestAPI()->strPluginDataPath = strPluginDataPath;
+    NoiseGate *gate = new NoiseGate;
+    GetTestAPI()->strPluginDataPath = TEXT(".");
+
+    return gate;
+}
+
+static void DestroyNoiseGate(NoiseGate *gate, CTSTR lpPluginDataPath)
+{
+    delete gate;
+
+    OSDeleteFile(String(lpPluginDataPath) + CONFIG_FILENAME);
+    RemoveDirectory(lpPluginDataPath);
+}
+
+struct GateComparison
+{
+    double errorRatio;      //energy of the difference relative to the energy of the old output
+    float  maxDiff;
+    float  openRatio, closedRatio;  //share of frames the old gate spent fully open and fully closed
+};
+
+static bool CompareGates(const GateParams &params, const List<float> &input, GateComparison &results)
+{
+    UINT sampleRate = GetTestAPI()->GetSampleRateHz();
+    UINT numFrames = input.Num()/2;
+
+    List<float> reference;
+    reference.CopyList(input);
+
+    ReferenceGate referenceGate(params, sampleRate);
+    referenceGate.Process(reference.Array(), numFrames);
+
+    //---------------------------------------------
+
+    GateMicSource mic;
+    GetTestAPI()->micSource = &mic;
+
+    String strPluginDataPath;
+    NoiseGate *gate = CreateNoiseGate(params, strPluginDataPath);
+    gate->StreamStarted();
+
+    bool bHooked = (mic.NumAudioFilters() == 1);
+    List<float> output;
+
+    if(bHooked)
+    {
+        AudioFilter *filter = mic.GetAudioFilter(0);
+
+        //device segments usually are 10ms, but not always
+        const UINT segmentFrames[] = {sampleRate/100, 441, 100, 7, 512, 33};
+        UINT frame = 0, segment = 0;
+
+        while(frame < numFrames)
+        {
+            UINT numSegmentFrames = min(segmentFrames[segment++ % _countof(segmentFrames)], numFrames-frame);
+
+            AudioSegment audioSegment(const_cast<float*>(input.Array()) + frame*2, numSegmentFrames*2, QWORD(frame)*1000/sampleRate);
+            filter->Process(&audioSegment);
+            output.AppendList(audioSegment.audioData);
+
+            frame += numSegmentFrames;
+        }
+    }
+
+    gate->StreamStopped();
+    DestroyNoiseGate(gate, strPluginDataPath);
+    GetTestAPI()->micSource = NULL;
+
+    if(!bHooked || output.Num() != reference.Num())
+        return false;
+
+    //---------------------------------------------
+
+    double errorEnergy = 0.0, referenceEnergy = 0.0;
+    results.maxDiff = 0.0f;
+
+    for(UINT i=0; i<output.Num(); i++)
+    {
+        float diff = output[i]-reference[i];
+        errorEnergy     += double(diff)*double(diff);
+        referenceEnergy += double(reference[i])*double(reference[i]);
+        results.maxDiff  = max(results.maxDiff, abs(diff));
+    }
+
+    results.errorRatio  = (referenceEnergy > 0.0) ? errorEnergy/referenceEnergy : 1.0;
+    results.openRatio   = float(referenceGate.numOpenFrames)/float(numFrames);
+    results.closedRatio = float(referenceGate.numClosedFrames)/float(numFrames);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+OBS_TEST(NoiseGateMatchesPerSampleGate)
+{
+    const UINT sampleRate = GetTestAPI()->GetSampleRateHz();
+    bool bSuccess = true;
+
+    for(UINT fixture=0; fixture<_countof(gateFixtureNames); fixture++)
+    {
+        List<float> input;
+        MakeGateFixture(GateFixture(fixture), sampleRate, sampleRate*20, input);
+
+        for(UINT i=0; i<_countof(gateParams); i++)
+        {
+            GateComparison results;
+            if(!CompareGates(gateParams[i], input, results))
+            {
+                TestPrint(TEXT("    %s/%s: the filter didn't run\n"), gateFixtureNames[fixture], gateParams[i].lpName);
+                bSuccess = false;
+                continue;
+            }
+
+            //the gate opens and closes on the same frames as before.  the one thing that differs is a
+            //release that's still running when the gate reopens partway through a block, the block
+            //version holds it until the frame the gate opens on.  the fixture also has to actually
+            //exercise the gate for any of this to mean something
+            bool bMatches   = (results.errorRatio < 1e-4 && results.maxDiff < 0.01f);
+            bool bExercised = (results.openRatio > 0.1f && results.closedRatio > 0.1f);
+
+            if(!bMatches || !bExercised)
+            {
+                TestPrint(TEXT("    %s/%s: error %.2e, max diff %.4f, open %.1f%%, closed %.1f%%\n"),
+                    gateFixtureNames[fixture], gateParams[i].lpName, results.errorRatio, results.maxDiff,
+                    results.openRatio*100.0f, results.closedRatio*100.0f);
+                bSuccess = false;
+            }
+        }
+    }
+
+    TEST_CHECK(bSuccess);
+    return true;
+}
+
+OBS_BENCHMARK(NoiseGateFilter)
+{
+    const UINT sampleRate = GetTestAPI()->GetSampleRateHz();
+    const UINT segmentFloats = sampleRate/100*2;
+    const GateParams &params = gateParams[0];
+
+    List<float> input;
+    MakeGateFixture(GateFixture_Speech, sampleRate, sampleRate*20, input);
+
+    GateMicSource mic;
+    GetTestAPI()->micSource = &mic;
+
+    String strPluginDataPath;
+    NoiseGate *gate = CreateNoiseGate(params, strPluginDataPath);
+    gate->StreamStarted();
+
+    bool bHooked = (mic.NumAudioFilters() == 1);
+
+    if(bHooked)
+    {
+        AudioFilter *filter = mic.GetAudioFilter(0);
+
+        //both run through the whole fixture a 10ms segment at a time, copying the input in first so
+        //the gate keeps seeing speech instead of its own output fading away
+        ReferenceGate referenceGate(params, sampleRate);
+        AudioSegment segment(input.Array(), segmentFloats, 0);
+        UINT refPos = 0, filterPos = 0;
+
+        double refNS = TimeCalls([&]()
+        {
+            mcpy(segment.audioData.Array(), input.Array()+refPos, segmentFloats*sizeof(float));
+            referenceGate.Process(segment.audioData.Array(), segmentFloats/2);
+            refPos = (refPos+segmentFloats) % input.Num();
+        }, 500);
+
+        double filterNS = TimeCalls([&]()
+        {
+            mcpy(segment.audioData.Array(), input.Array()+filterPos, segmentFloats*sizeof(float));
+            filter->Process(&segment);
+            filterPos = (filterPos+segmentFloats) % input.Num();
+        }, 500);
+
+        TestPrint(TEXT("    10ms stereo segment at %u Hz: per-sample %.2f us, block %.2f us (%.2fx)\n"),
+            sampleRate, refNS/1000.0, filterNS/1000.0, refNS/filterNS);
+    }
+
+    gate->StreamStopped();
+    DestroyNoiseGate(gate, strPluginDataPath);
+    GetTestAPI()->micSource = NULL;
+
+    TEST_CHECK(bHooked);
+    return true;
+}
@@ -0,0 +1,727 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "../Source/Main.h"
+#include "../Source/RTMPStuff.h"
+#include "../Source/RTMPPublisher.h"
+#include "Tests.h"
+#include "LocalRTMPServer.h"
+
+//-----------------------------------------------------------------------------
+//  drives RTMPPublisher with a synthetic H.264/AAC stream, in real time, against the
+//local server (LocalRTMPServer.h) over links of different quality.  the publisher reads
+//its settings from AppConfig like it does in the app, so each run points a temporary
+//config at the server.  reported per link: the bitrate that arrived, dropped b/p frames,
+//how deep the publisher's queue and send buffer got, and how long frames took from being
+//handed to the publisher to arriving at the server.
+
+#define BENCH_FPS               30
+#define BENCH_KEYFRAME_INTERVAL 60      //frames
+#define BENCH_VIDEO_KBPS        2500
+#define BENCH_AUDIO_KBPS        128
+#define BENCH_AUDIO_FRAME_SIZE  1024
+#define BENCH_SAMPLE_RATE       48000
+#define BENCH_PORT              19350
+
+static const BYTE videoHeaderPacket[] =
+{
+    0x17, 0x00, 0x00, 0x00, 0x00,                   //flv: keyframe, sequence header
+    0x01, 0x64, 0x00, 0x28, 0xFF, 0xE1,             //avcC version, profile, compat, level, nal size 4, one SPS
+    0x00, 0x04, 0x67, 0x64, 0x00, 0x28,             //SPS
+    0x01, 0x00, 0x03, 0x68, 0xEE, 0x3C              //one PPS
+};
+
+static const BYTE audioHeaderPacket[] = {0xAF, 0x00, 0x11, 0x90};   //AAC LC, 48khz, stereo
+
+static const BYTE seiNAL[] = {0x00, 0x00, 0x00, 0x05, 0x06, 0x05, 0x01, 0xAA, 0x80};
+
+class SyntheticPublisherHost : public PublisherHost
+{
+public:
+    volatile LONG bKeyframeRequested;
+    volatile bool bStopRequested;
+
+    SyntheticPublisherHost() : bKeyframeRequested(0), bStopRequested(false) {}
+
+    virtual UINT GetStreamBitRate() {return BENCH_VIDEO_KBPS+BENCH_AUDIO_KBPS;}
+
+    virtual char* EncMetaData(char *enc, char *pend)
+    {
+        *enc++ = AMF_OBJECT;
+        enc = AMF_EncodeNamedNumber(enc, pend, &av_width,           1280.0);
+        enc = AMF_EncodeNamedNumber(enc, pend, &av_height,          720.0);
+        enc = AMF_EncodeNamedString(enc, pend, &av_videocodecid,    &av_avc1);
+        enc = AMF_EncodeNamedNumber(enc, pend, &av_videodatarate,   double(BENCH_VIDEO_KBPS));
+        enc = AMF_EncodeNamedNumber(enc, pend, &av_framerate,       double(BENCH_FPS));
+        enc = AMF_EncodeNamedString(enc, pend, &av_audiocodecid,    &av_mp4a);
+        enc = AMF_EncodeNamedNumber(enc, pend, &av_audiodatarate,   double(BENCH_AUDIO_KBPS));
+        enc = AMF_EncodeNamedNumber(enc, pend, &av_audiosamplerate, double(BENCH_SAMPLE_RATE));
+        *enc++ = 0;
+        *enc++ = 0;
+        *enc++ = AMF_OBJECT_END;
+        return enc;
+    }
+
+    virtual void GetAudioHeaders(DataPacket &packet)
+    {
+        packet.lpPacket = (LPBYTE)audioHeaderPacket;
+        packet.size     = sizeof(audioHeaderPacket);
+    }
+
+    virtual void GetVideoHeaders(DataPacket &packet)
+    {
+        packet.lpPacket = (LPBYTE)videoHeaderPacket;
+        packet.size     = sizeof(videoHeaderPacket);
+    }
+
+    virtual void GetSEI(DataPacket &packet)
+    {
+        packet.lpPacket = (LPBYTE)seiNAL;
+        packet.size     = sizeof(seiNAL);
+    }
+
+    virtual void RequestKeyframe(int waitTime)          {InterlockedExchange(&bKeyframeRequested, 1);}
+    virtual void RequestStop(bool bCanRetry)            {bStopRequested = true;}
+    virtual void SetStreamReport(CTSTR lpStreamReport)  {TestPrint(TEXT("    stream report: %s\n"), lpStreamReport);}
+};
+
+//lets the benchmark look at the publisher's queues and counters
+class BenchPublisher : public RTMPPublisher
+{
+public:
+    BenchPublisher(PublisherHost *host) : RTMPPublisher(host) {}
+
+    inline bool  IsConnected() const        {return bConnected;}
+    inline DWORD FirstTimestamp() const     {return firstTimestamp;}
+    inline UINT  NumBFramesDropped() const  {return numBFramesDumped;}
+    inline UINT  NumPFramesDropped() const  {return numPFramesDumped;}
+    inline int   PeakSendBufferSize() const {return peakDataBufferLen;}
+
+    //bytes and milliseconds of packets waiting for the send thread
+    void GetQueueDepth(UINT &queuedBytes, DWORD &queuedMS)
+    {
+        OSEnterMutex(hDataMutex);
+        queuedBytes = currentBufferSize;
+        queuedMS    = queuedPackets.Num() ? queuedPackets.Last().timestamp-queuedPackets[0].timestamp : 0;
+        OSLeaveMutex(hDataMutex);
+    }
+};
+
+//-----------------------------------------------------------------------------
+
+static String GetTempConfigPath()
+{
+    TCHAR lpTempPath[MAX_PATH];
+    GetTempPath(MAX_PATH, lpTempPath);
+    return FormattedString(TEXT("%sobs_publisher_%u.ini"), lpTempPath, GetCurrentProcessId());
+}
+
+//FLV video tag body: frame type/codec, AVC NALU, composition time, then one length prefixed NAL
+static PacketBuffer* CreateVideoPacket(bool bKeyframe, BYTE nalHeader, UINT size, UINT seed)
+{
+    size = MAX(size, 16);
+
+    PacketBuffer *packet = PacketBuffer::Create(size);
+    LPBYTE data = packet->Data();
+
+    UINT nalSize = size-9;
+    data[0] = bKeyframe ? 0x17 : 0x27;
+    data[1] = 0x01;
+    data[2] = data[3] = data[4] = 0;
+    data[5] = BYTE(nalSize>>24);
+    data[6] = BYTE(nalSize>>16);
+    data[7] = BYTE(nalSize>>8);
+    data[8] = BYTE(nalSize);
+    data[9] = nalHeader;
+    for(UINT i=10; i<size; i++)
+        data[i] = BYTE(seed*31 + i);
+
+    return packet;
+}
+
+static PacketBuffer* CreateAudioPacket(UINT size, UINT seed)
+{
+    PacketBuffer *packet = PacketBuffer::Create(size);
+    LPBYTE data = packet->Data();
+
+    data[0] = 0xAF;
+    data[1] = 0x01;
+    for(UINT i=2; i<size; i++)
+        data[i] = BYTE(seed*17 + i);
+
+    return packet;
+}
+
+struct PublisherRunResults
+{
+    bool   bConnected, bStopRequested;
+    UINT   numVideoFramesSent, numVideoFramesReceived;
+    UINT   numBFramesDropped, numPFramesDropped;
+    double receivedKbps;
+    UINT   avgQueueBytes, maxQueueBytes;
+    DWORD  maxQueueMS;
+    int    peakSendBufferSize;
+    double avgLatencyMS, maxLatencyMS;
+    DWORD  serverStopMS;
+};
+
+//  feeds the publisher for durationMS.  the gop is I B P B P ..., I frames ten times the size of a
+//P frame and B frames half, each give or take a quarter, and a keyframe goes out early whenever the
+//publisher asks for one (it does right after connecting and after dropping P frames).  if
+//stopServerTime isn't 0 the server is stopped that far into the run, and how long Stop took is
+//reported in serverStopMS.
+static bool RunPublisher(const LocalServerSettings &link, UINT durationMS, PublisherRunResults &results, UINT stopServerTime=0)
+{
+    zero(&results, sizeof(results));
+
+    LocalRTMPServer server;
+    if(!server.Start(link))
+    {
+        TestPrint(TEXT("    could not listen on port %d\n"), link.port);
+        return false;
+    }
+
+    String strConfig = GetTempConfigPath();
+    ConfigFile *config = new ConfigFile;
+    config->Create(strConfig);
+    config->SetInt(TEXT("Publish"), TEXT("Service"), 0);
+    config->SetString(TEXT("Publish"), TEXT("URL"), FormattedString(TEXT("rtmp://127.0.0.1:%d/live"), link.port));
+    config->SetString(TEXT("Publish"), TEXT("PlayPath"), TEXT("bench"));
+    AppConfig = config;
+
+    SyntheticPublisherHost host;
+    BenchPublisher *publisher = new BenchPublisher(&host);
+
+    TestRandom random;
+
+    const UINT bytesPerGOP = BENCH_VIDEO_KBPS*1000/8*BENCH_KEYFRAME_INTERVAL/BENCH_FPS;
+    const UINT unitSize    = bytesPerGOP*2/(20 + BENCH_KEYFRAME_INTERVAL/2 + (BENCH_KEYFRAME_INTERVAL-2));
+    const UINT audioSize   = BENCH_AUDIO_KBPS*1000/8*BENCH_AUDIO_FRAME_SIZE/BENCH_SAMPLE_RATE;
+
+    QWORD totalQueueBytes = 0;
+    UINT numSamples = 0;
+
+    QWORD startTime = GetQPCTimeMS();
+    UINT64 audioSample = 0;
+    UINT gopFrame = 0;
+
+    for(UINT frame=0; ; frame++)
+    {
+        DWORD videoTime = DWORD(UINT64(frame)*1000/BENCH_FPS);
+        if(videoTime >= durationMS)
+            break;
+
+        if(stopServerTime && videoTime >= stopServerTime && !results.serverStopMS)
+        {
+            QWORD stopStartTime = GetQPCTimeMS();
+            server.Stop();
+            results.serverStopMS = MAX(DWORD(GetQPCTimeMS()-stopStartTime), 1);
+        }
+
+        QWORD curTime = GetQPCTimeMS();
+        if(startTime+videoTime > curTime)
+            OSSleep(DWORD(startTime+videoTime-curTime));
+
+        //audio up to this frame
+        while(true)
+        {
+            DWORD audioTime = DWORD(audioSample*1000/BENCH_SAMPLE_RATE);
+            if(audioTime > videoTime)
+                break;
+
+            PacketBuffer *packet = CreateAudioPacket(audioSize, UINT(audioSample));
+            publisher->SendPacket(packet, audioTime, PacketType_Audio);
+            packet->Release();
+
+            audioSample += BENCH_AUDIO_FRAME_SIZE;
+        }
+
+        if(InterlockedExchange(&host.bKeyframeRequested, 0))
+            gopFrame = 0;
+
+        PacketType type;
+        BYTE nalHeader;
+        UINT size;
+        UINT jitter = 750 + random.Next(500);
+
+        if(gopFrame == 0)
+        {
+            type = PacketType_VideoHighest;
+            nalHeader = 0x65;
+            size = unitSize*10*jitter/1000;
+        }
+        else if(gopFrame & 1)
+        {
+            type = PacketType_VideoDisposable;
+            nalHeader = 0x01;
+            size = unitSize/2*jitter/1000;
+        }
+        else
+        {
+            type = PacketType_VideoHigh;
+            nalHeader = 0x41;
+            size = unitSize*jitter/1000;
+        }
+
+        PacketBuffer *packet = CreateVideoPacket(gopFrame == 0, nalHeader, size, frame);
+        publisher->SendPacket(packet, videoTime, type);
+        packet->Release();
+
+        gopFrame = (gopFrame+1) % BENCH_KEYFRAME_INTERVAL;
+
+        UINT queuedBytes;
+        DWORD queuedMS;
+        publisher->GetQueueDepth(queuedBytes, queuedMS);
+
+        totalQueueBytes += queuedBytes;
+        numSamples++;
+        results.maxQueueBytes = MAX(results.maxQueueBytes, queuedBytes);
+        results.maxQueueMS    = MAX(results.maxQueueMS, queuedMS);
+    }
+
+    results.bConnected          = publisher->IsConnected();
+    results.numVideoFramesSent  = publisher->NumTotalVideoFrames();
+    results.numBFramesDropped   = publisher->NumBFramesDropped();
+    results.numPFramesDropped   = publisher->NumPFramesDropped();
+    results.peakSendBufferSize  = publisher->PeakSendBufferSize();
+    results.avgQueueBytes       = numSamples ? UINT(totalQueueBytes/numSamples) : 0;
+
+    DWORD firstTimestamp = publisher->FirstTimestamp();
+
+    //sends what's left and closes the stream, the server records its stats once the close gets to it
+    delete publisher;
+
+    QWORD closeTime = GetQPCTimeMS();
+    while(!results.serverStopMS && !server.NumConnectionsEnded() && GetQPCTimeMS()-closeTime < QWORD(link.delayMS*2 + 5000))
+        OSSleep(10);
+
+    results.bStopRequested = host.bStopRequested;
+
+    LocalServerStats stats = server.GetStats();
+    server.Stop();
+
+    AppConfig = NULL;
+    delete config;
+    OSDeleteFile(strConfig);
+
+    results.numVideoFramesReceived = stats.numVideoFrames;
+    results.receivedKbps = stats.totalTime ? double(stats.bytesReceived)*8.0/double(stats.totalTime) : 0.0;
+
+    //a frame stamped t was handed over at startTime+firstTimestamp+t
+    if(stats.numVideoFrames)
+    {
+        double base = double(startTime+firstTimestamp);
+        results.avgLatencyMS = double(stats.totalArrivalOffset)/double(stats.numVideoFrames) - base;
+        results.maxLatencyMS = double(stats.maxArrivalOffset) - base;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+OBS_TEST(LocalRTMPServerStopsDuringStall)
+{
+    InitSockets();
+    timeBeginPeriod(1);
+
+    //the server stalls for a minute on the first packet it gets, with the relay holding data in
+    //both directions.  stopping it a second in has to wake all of that up
+    LocalServerSettings link = {BENCH_PORT+20, 0, 1000, 60000, 50};
+
+    PublisherRunResults results;
+    bool bRan = RunPublisher(link, 2000, results, 1000);
+
+    timeEndPeriod(1);
+    TerminateSockets();
+
+    TEST_CHECK(bRan);
+    TEST_CHECK(results.serverStopMS != 0 && results.serverStopMS < 1000);
+    return true;
+}
+
+OBS_BENCHMARK(PublisherLinks)
+{
+    InitSockets();
+    timeBeginPeriod(1);
+
+    struct LinkProfile
+    {
+        CTSTR lpName;
+        int maxKbps, stallChance, stallMS, delayMS;
+    };
+
+    //the stream is BENCH_VIDEO_KBPS+BENCH_AUDIO_KBPS
+    const LinkProfile profiles[] =
+    {
+        {TEXT("unlimited"),                 0,      0,  0,      0},
+        {TEXT("4000 kbps"),                 4000,   0,  0,      0},
+        {TEXT("2000 kbps"),                 2000,   0,  0,      0},
+        {TEXT("4000 kbps, 100ms delay"),    4000,   0,  0,      100},
+        {TEXT("2000 kbps, 100ms delay"),    2000,   0,  0,      100},
+        {TEXT("unlimited, 300ms delay"),    0,      0,  0,      300},
+        {TEXT("6000 kbps, stalls"),         6000,   5,  500,    0},
+        {TEXT("4000 kbps, 50ms, stalls"),   4000,   5,  500,    50},
+    };
+
+    bool bSuccess = true;
+
+    for(UINT i=0; i<_countof(profiles); i++)
+    {
+        const LinkProfile &profile = profiles[i];
+
+        //a port per run, so nothing left in TIME_WAIT from the last one gets in the way
+        LocalServerSettings link = {BENCH_PORT+int(i), profile.maxKbps, profile.stallChance, profile.stallMS, profile.delayMS};
+
+        PublisherRunResults results;
+        if(!RunPublisher(link, 15000, results))
+        {
+            bSuccess = false;
+            continue;
+        }
+
+        TestPrint(TEXT("  %-26s %5.0f kbps   frames %4u/%4u   dropped b %3u p %3u   queue avg %4u KB max %4u KB (%4u ms)   send buffer %4d KB   latency avg %5.0f ms max %5.0f ms\n"),
+            profile.lpName, results.receivedKbps,
+            results.numVideoFramesReceived, results.numVideoFramesSent,
+            results.numBFramesDropped, results.numPFramesDropped,
+            results.avgQueueBytes/1024, results.maxQueueBytes/1024, results.maxQueueMS, results.peakSendBufferSize/1024,
+            results.avgLatencyMS, results.maxLatencyMS);
+
+        if(!results.bConnected || results.bStopRequested || !results.numVideoFramesReceived)
+        {
+            TestPrint(TEXT("    %s\n"), results.bConnected ? TEXT("stream stopped") : TEXT("never connected"));
+            bSuccess = false;
+        }
+    }
+
+    timeEndPeriod(1);
+    TerminateSockets();
+
+    TEST_CHECK(bSuccess);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//  pushes the same stream straight through RTMP_SendPacket, as fast as the local server takes it,
+//once with every chunk written on its own and once with each packet's chunks gathered into one
+//WriteV, at the old 128 byte chunk size and at the 64k the publisher uses now.  the sends go
+//through librtmp's custom send hooks so they can be counted.
+
+struct SendCounts
+{
+    UINT numSends;
+    UINT numVecSends;
+};
+
+static int BenchSend(RTMPSockBuf *sb, const char *buf, int len, void *param)
+{
+    ((SendCounts*)param)->numSends++;
+    return send(sb->sb_socket, buf, len, 0);
+}
+
+//same as librtmp's own WriteSocketV, which can't be used while the custom send is on
+static int BenchSendV(RTMPSockBuf *sb, const RTMPIOVec *vec, int count, void *param)
+{
+    SendCounts *counts = (SendCounts*)param;
+
+    WSABUF bufs[64];
+    if(count > int(_countof(bufs)))
+        return -1;
+
+    int total = 0;
+    for(int i=0; i<count; i++)
+    {
+        bufs[i].buf = (CHAR*)vec[i].buf;
+        bufs[i].len = (ULONG)vec[i].len;
+        total += vec[i].len;
+    }
+
+    int first = 0;
+    while(first < count)
+    {
+        DWORD sent = 0;
+        counts->numVecSends++;
+        if(WSASend(sb->sb_socket, bufs+first, count-first, &sent, 0, NULL, NULL) != 0)
+            return -1;
+        if(!sent)
+            return -1;
+
+        while(first < count)
+        {
+            if(sent < bufs[first].len)
+            {
+                bufs[first].buf += sent;
+                bufs[first].len -= sent;
+                break;
+            }
+
+            sent -= bufs[first].len;
+            first++;
+        }
+    }
+
+    return total;
+}
+
+static QWORD GetThreadCPUTime100ns()
+{
+    FILETIME createTime, exitTime, kernelTime, userTime;
+    GetThreadTimes(GetCurrentThread(), &createTime, &exitTime, &kernelTime, &userTime);
+
+    ULARGE_INTEGER kernel, user;
+    kernel.LowPart = kernelTime.dwLowDateTime;
+    kernel.HighPart = kernelTime.dwHighDateTime;
+    user.LowPart = userTime.dwLowDateTime;
+    user.HighPart = userTime.dwHighDateTime;
+    return kernel.QuadPart + user.QuadPart;
+}
+
+struct BenchPacket
+{
+    PacketBuffer *data;
+    DWORD timestamp;
+    bool bAudio;
+};
+
+//durationMS of the synthetic stream, built up front.  it's rebuilt for every run since the per
+//chunk path lays its chunk headers over the body it has already sent
+static void BuildSendStream(UINT durationMS, List<BenchPacket> &packets)
+{
+    TestRandom random;
+
+    const UINT bytesPerGOP = BENCH_VIDEO_KBPS*1000/8*BENCH_KEYFRAME_INTERVAL/BENCH_FPS;
+    const UINT unitSize    = bytesPerGOP*2/(20 + BENCH_KEYFRAME_INTERVAL/2 + (BENCH_KEYFRAME_INTERVAL-2));
+    const UINT audioSize   = BENCH_AUDIO_KBPS*1000/8*BENCH_AUDIO_FRAME_SIZE/BENCH_SAMPLE_RATE;
+
+    UINT64 audioSample = 0;
+
+    for(UINT frame=0; ; frame++)
+    {
+        DWORD videoTime = DWORD(UINT64(frame)*1000/BENCH_FPS);
+        if(videoTime >= durationMS)
+            break;
+
+        while(true)
+        {
+            DWORD audioTime = DWORD(audioSample*1000/BENCH_SAMPLE_RATE);
+            if(audioTime > videoTime)
+                break;
+
+            BenchPacket &packet = *packets.CreateNew();
+            packet.data = CreateAudioPacket(audioSize, UINT(audioSample));
+            packet.timestamp = audioTime;
+            packet.bAudio = true;
+
+            audioSample += BENCH_AUDIO_FRAME_SIZE;
+        }
+
+        UINT gopFrame = frame % BENCH_KEYFRAME_INTERVAL;
+        UINT jitter = 750 + random.Next(500);
+        UINT size;
+        BYTE nalHeader;
+
+        if(gopFrame == 0)
+        {
+            nalHeader = 0x65;
+            size = unitSize*10*jitter/1000;
+        }
+        else if(gopFrame & 1)
+        {
+            nalHeader = 0x01;
+            size = unitSize/2*jitter/1000;
+        }
+        else
+        {
+            nalHeader = 0x41;
+            size = unitSize*jitter/1000;
+        }
+
+        BenchPacket &packet = *packets.CreateNew();
+        packet.data = CreateVideoPacket(gopFrame == 0, nalHeader, size, frame);
+        packet.timestamp = videoTime;
+        packet.bAudio = false;
+    }
+}
+
+static void FreeSendStream(List<BenchPacket> &packets)
+{
+    for(UINT i=0; i<packets.Num(); i++)
+        packets[i].data->Release();
+    packets.Clear();
+}
+
+struct SendRunResults
+{
+    UINT   numPackets, numVideoFrames, numVideoFramesReceived;
+    UINT   numSends, numVecSends;
+    double mbitSent;
+    double cpuMS, wallMS;
+};
+
+static bool RunSendPath(int port, int chunkSize, bool bVectored, SendRunResults &results)
+{
+    zero(&results, sizeof(results));
+
+    LocalServerSettings link = {port, 0, 0, 0, 0};
+    LocalRTMPServer server;
+    if(!server.Start(link))
+    {
+        TestPrint(TEXT("    could not listen on port %d\n"), port);
+        return false;
+    }
+
+    String strURL = FormattedString(TEXT("rtmp://127.0.0.1:%d/live/bench"), port);
+    LPSTR lpAnsiURL = strURL.CreateUTF8String();
+
+    RTMP *rtmp = RTMP_Alloc();
+    RTMP_Init(rtmp);
+
+    bool bSuccess = false;
+
+    if(RTMP_SetupURL(rtmp, lpAnsiURL))
+    {
+        RTMP_EnableWrite(rtmp);
+
+        rtmp->m_outChunkSize = chunkSize;
+        rtmp->m_bSendChunkSizeInfo = TRUE;
+        rtmp->m_bUseNagle = TRUE;
+
+        if(RTMP_Connect(rtmp, NULL) && RTMP_ConnectStream(rtmp, 0))
+            bSuccess = true;
+        else
+            TestPrint(TEXT("    could not connect to %s\n"), strURL.Array());
+    }
+
+    if(bSuccess)
+    {
+        List<BenchPacket> packets;
+        BuildSendStream(10000, packets);
+
+        //only count what the stream itself takes, not the handshake
+        SendCounts counts = {0, 0};
+        rtmp->m_bCustomSend = TRUE;
+        rtmp->m_customSendParam = &counts;
+        rtmp->m_customSendFunc = BenchSend;
+        rtmp->m_customSendVecFunc = bVectored ? BenchSendV : NULL;
+        rtmp->m_bVectoredSend = bVectored;
+
+        QWORD totalBytes = 0;
+        QWORD startCPUTime = GetThreadCPUTime100ns();
+        QWORD startTime = GetQPCTimeNS();
+
+        for(UINT i=0; i<packets.Num(); i++)
+        {
+            BenchPacket &benchPacket = packets[i];
+
+            RTMPPacket packet;
+            zero(&packet, sizeof(packet));
+            packet.m_nChannel = benchPacket.bAudio ? 0x5 : 0x4;
+            packet.m_headerType = RTMP_PACKET_SIZE_MEDIUM;
+            packet.m_packetType = benchPacket.bAudio ? RTMP_PACKET_TYPE_AUDIO : RTMP_PACKET_TYPE_VIDEO;
+            packet.m_nTimeStamp = benchPacket.timestamp;
+            packet.m_nInfoField2 = rtmp->m_stream_id;
+            packet.m_hasAbsTimestamp = TRUE;
+            packet.m_nBodySize = benchPacket.data->Size();
+            packet.m_body = (char*)benchPacket.data->Data();
+
+            if(!RTMP_SendPacket(rtmp, &packet, FALSE))
+            {
+                TestPrint(TEXT("    send failed at packet %u\n"), i);
+                bSuccess = false;
+                break;
+            }
+
+            totalBytes += benchPacket.data->Size();
+            if(!benchPacket.bAudio)
+                results.numVideoFrames++;
+        }
+
+        results.wallMS = double(GetQPCTimeNS()-startTime)/1000000.0;
+        results.cpuMS = double(GetThreadCPUTime100ns()-startCPUTime)/10000.0;
+
+        results.numPackets  = packets.Num();
+        results.numSends    = counts.numSends;
+        results.numVecSends = counts.numVecSends;
+        results.mbitSent    = double(totalBytes)*8.0/1000000.0;
+
+        FreeSendStream(packets);
+    }
+
+    RTMP_Close(rtmp);
+    RTMP_Free(rtmp);
+    Free(lpAnsiURL);
+
+    QWORD closeTime = GetQPCTimeMS();
+    while(!server.NumConnectionsEnded() && GetQPCTimeMS()-closeTime < 5000)
+        OSSleep(10);
+
+    results.numVideoFramesReceived = server.GetStats().numVideoFrames;
+    server.Stop();
+
+    return bSuccess;
+}
+
+OBS_BENCHMARK(RTMPSendPaths)
+{
+    InitSockets();
+
+    struct SendPath
+    {
+        CTSTR lpName;
+        int chunkSize;
+        bool bVectored;
+    };
+
+    const SendPath paths[] =
+    {
+        {TEXT("128 byte chunks, per chunk"),    RTMP_DEFAULT_CHUNKSIZE, false},
+        {TEXT("128 byte chunks, WriteV"),       RTMP_DEFAULT_CHUNKSIZE, true},
+        {TEXT("64k chunks, per chunk"),         65536,                  false},
+        {TEXT("64k chunks, WriteV"),            65536,                  true},
+    };
+
+    bool bSuccess = true;
+
+    for(UINT i=0; i<_countof(paths); i++)
+    {
+        const SendPath &path = paths[i];
+
+        SendRunResults results;
+        if(!RunSendPath(BENCH_PORT+30+int(i), path.chunkSize, path.bVectored, results))
+        {
+            bSuccess = false;
+            continue;
+        }
+
+        UINT numCalls = results.numSends+results.numVecSends;
+
+        TestPrint(TEXT("  %-28s send %6u  WSASend %5u  calls/packet %6.2f   cpu %6.2f ms/Mbit   %7.1f Mbit/s   frames %u/%u\n"),
+            path.lpName, results.numSends, results.numVecSends, double(numCalls)/double(results.numPackets),
+            results.cpuMS/results.mbitSent, results.mbitSent*1000.0/results.wallMS,
+            results.numVideoFramesReceived, results.numVideoFrames);
+
+        if(results.numVideoFramesReceived != results.numVideoFrames)
+            bSuccess = false;
+    }
+
+    TerminateSockets();
+
+    TEST_CHECK(bSuccess);
+    return true;
+}
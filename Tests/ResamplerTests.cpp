@@ -0,0 +1,290 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "Tests.h"
+#include "../libsamplerate/samplerate.h"
+
+//-----------------------------------------------------------------------------
+//  AudioSource resamples every device that isn't at the output rate, 10ms at a time.
+//libsamplerate's stereo sinc converter works out the coefficients for fixed ratios
+//like 44100 <-> 48000 once (the phase table) and runs each output frame as an SSE
+//dot product.
+//
+//  the mono converter still runs the stock per-sample convolution, so two of them on
+//the split channels are the reference at exactly the same ratio.  for throughput the
+//reference is the stereo converter at a rate one hertz off, which has far too many
+//phases for a table and goes through the stock stereo loop.
+
+//M_PI from XMath.h is only a float
+#define RESAMPLE_TWO_PI     6.283185307179586
+
+#define RESAMPLE_LEFT_HZ    997.0
+#define RESAMPLE_RIGHT_HZ   3001.0
+#define RESAMPLE_LEFT_AMP   0.5
+#define RESAMPLE_RIGHT_AMP  0.4
+
+struct ResampleConverter
+{
+    int   type;
+    CTSTR lpName;
+};
+
+static const ResampleConverter resampleConverters[] =
+{
+    {SRC_SINC_FASTEST,        TEXT("fastest")},
+    {SRC_SINC_MEDIUM_QUALITY, TEXT("medium")},
+};
+
+static const UINT resampleRates[][2] =
+{
+    {44100, 48000},
+    {48000, 44100},
+};
+
+//a different sine on each channel, so a swapped or mixed up channel shows
+static void MakeResampleInput(List<float> &samples, UINT sampleRate, UINT seconds)
+{
+    UINT numFrames = sampleRate*seconds;
+    samples.SetSize(numFrames*2);
+
+    for(UINT i=0; i<numFrames; i++)
+    {
+        double t = double(i)/double(sampleRate);
+        samples[i*2]   = float(RESAMPLE_LEFT_AMP  * sin(RESAMPLE_TWO_PI*RESAMPLE_LEFT_HZ*t));
+        samples[i*2+1] = float(RESAMPLE_RIGHT_AMP * sin(RESAMPLE_TWO_PI*RESAMPLE_RIGHT_HZ*t));
+    }
+}
+
+//feeds the input through in 10ms chunks like AudioSource::QueryAudio does
+static bool ResampleChunks(SRC_STATE *state, UINT channels, UINT inRate, double outRate, const float *input, UINT numFrames, List<float> &output)
+{
+    UINT chunkFrames = inRate/100;
+    double ratio = outRate/double(inRate);
+
+    List<float> chunkOut;
+    chunkOut.SetSize((UINT(double(chunkFrames)*ratio)+16)*channels);
+
+    output.Clear();
+    output.Reserve(UINT(double(numFrames)*ratio+16.0)*channels);
+
+    UINT pos = 0;
+    while(pos < numFrames)
+    {
+        SRC_DATA data;
+        data.data_in       = input+pos*channels;
+        data.input_frames  = MIN(chunkFrames, numFrames-pos);
+        data.data_out      = chunkOut.Array();
+        data.output_frames = chunkOut.Num()/channels;
+        data.src_ratio     = ratio;
+        data.end_of_input  = 0;
+
+        if(src_process(state, &data) != 0)
+            return false;
+
+        output.AppendArray(chunkOut.Array(), data.output_frames_gen*channels);
+        pos += data.input_frames_used;
+    }
+
+    return true;
+}
+
+static bool ResampleStereo(int type, UINT inRate, double outRate, const List<float> &input, List<float> &output)
+{
+    int err;
+    SRC_STATE *state = src_new(type, 2, &err);
+    if(!state)
+        return false;
+
+    bool bSuccess = ResampleChunks(state, 2, inRate, outRate, input.Array(), input.Num()/2, output);
+    src_delete(state);
+    return bSuccess;
+}
+
+//each channel through its own mono converter, then interleaved again
+static bool ResampleSplit(int type, UINT inRate, double outRate, const List<float> &input, List<float> &output)
+{
+    UINT numFrames = input.Num()/2;
+    List<float> channelIn, channelOut[2];
+
+    channelIn.SetSize(numFrames);
+
+    for(UINT ch=0; ch<2; ch++)
+    {
+        for(UINT i=0; i<numFrames; i++)
+            channelIn[i] = input[i*2+ch];
+
+        int err;
+        SRC_STATE *state = src_new(type, 1, &err);
+        if(!state)
+            return false;
+
+        bool bSuccess = ResampleChunks(state, 1, inRate, outRate, channelIn.Array(), numFrames, channelOut[ch]);
+        src_delete(state);
+
+        if(!bSuccess)
+            return false;
+    }
+
+    if(channelOut[0].Num() != channelOut[1].Num())
+        return false;
+
+    output.SetSize(channelOut[0].Num()*2);
+    for(UINT i=0; i<channelOut[0].Num(); i++)
+    {
+        output[i*2]   = channelOut[0][i];
+        output[i*2+1] = channelOut[1][i];
+    }
+
+    return true;
+}
+
+//signal to noise of one channel against the ideal sine, leaving out the start and end
+static double ResampleSNR(const List<float> &output, UINT channel, double freq, double amplitude, double outRate)
+{
+    UINT numFrames = output.Num()/2;
+    double signal = 0.0, noise = 0.0;
+
+    for(UINT i=numFrames/10; i<numFrames*9/10; i++)
+    {
+        double ideal = amplitude * sin(RESAMPLE_TWO_PI*freq*double(i)/outRate);
+        double diff  = double(output[i*2+channel])-ideal;
+
+        signal += ideal*ideal;
+        noise  += diff*diff;
+    }
+
+    return 10.0*log10(signal/MAX(noise, 1e-30));
+}
+
+static double ResampleStereoSNR(const List<float> &output, double outRate)
+{
+    return MIN(ResampleSNR(output, 0, RESAMPLE_LEFT_HZ,  RESAMPLE_LEFT_AMP,  outRate),
+               ResampleSNR(output, 1, RESAMPLE_RIGHT_HZ, RESAMPLE_RIGHT_AMP, outRate));
+}
+
+static float ResampleMaxDiff(const List<float> &a, const List<float> &b)
+{
+    float maxDiff = 0.0f;
+    for(UINT i=0; i<a.Num(); i++)
+        maxDiff = MAX(maxDiff, fabsf(a[i]-b[i]));
+
+    return maxDiff;
+}
+
+//-----------------------------------------------------------------------------
+
+OBS_TEST(ResamplerPhaseTableMatchesStock)
+{
+    for(UINT conv=0; conv<_countof(resampleConverters); conv++)
+    {
+        int type = resampleConverters[conv].type;
+
+        for(UINT rate=0; rate<_countof(resampleRates); rate++)
+        {
+            UINT   inRate  = resampleRates[rate][0];
+            double outRate = double(resampleRates[rate][1]);
+
+            List<float> input, tableOut, stockOut;
+            MakeResampleInput(input, inRate, 2);
+
+            TEST_CHECK(ResampleStereo(type, inRate, outRate, input, tableOut));
+            TEST_CHECK(ResampleSplit(type, inRate, outRate, input, stockOut));
+
+            TEST_CHECK(tableOut.Num() == stockOut.Num());
+            TEST_CHECK(ResampleMaxDiff(tableOut, stockOut) < 1e-5f);
+            TEST_CHECK(ResampleStereoSNR(tableOut, outRate) > 90.0);
+        }
+
+        //a ratio with no table takes the stock stereo loop, which has to agree with mono as well
+        List<float> input, stereoOut, splitOut;
+        MakeResampleInput(input, 44100, 1);
+
+        TEST_CHECK(ResampleStereo(type, 44100, 44100.7, input, stereoOut));
+        TEST_CHECK(ResampleSplit(type, 44100, 44100.7, input, splitOut));
+
+        TEST_CHECK(stereoOut.Num() == splitOut.Num());
+        TEST_CHECK(ResampleMaxDiff(stereoOut, splitOut) < 1e-5f);
+    }
+
+    return true;
+}
+
+OBS_BENCHMARK(ResamplerThroughput)
+{
+    TestPrint(TEXT("    %-8s %-14s %14s %14s %10s %10s %10s\n"), TEXT("type"), TEXT("rates"),
+        TEXT("phase table"), TEXT("stock (+1 Hz)"), TEXT("table SNR"), TEXT("stock SNR"), TEXT("max diff"));
+
+    bool bSuccess = true;
+
+    for(UINT conv=0; conv<_countof(resampleConverters); conv++)
+    {
+        int type = resampleConverters[conv].type;
+
+        for(UINT rate=0; rate<_countof(resampleRates); rate++)
+        {
+            UINT   inRate  = resampleRates[rate][0];
+            double outRate = double(resampleRates[rate][1]);
+
+            List<float> input, tableOut, stockOut;
+            MakeResampleInput(input, inRate, 1);
+
+            int err;
+            SRC_STATE *tableState = src_new(type, 2, &err);
+            SRC_STATE *stockState = src_new(type, 2, &err);
+            if(!tableState || !stockState)
+            {
+                bSuccess = false;
+                if(tableState) src_delete(tableState);
+                if(stockState) src_delete(stockState);
+                continue;
+            }
+
+            //one second of audio per call, so ns per call/1e6 is ms of audio thread per second
+            double tableNS = TimeCalls([&]
+            {
+                src_reset(tableState);
+                bSuccess &= ResampleChunks(tableState, 2, inRate, outRate, input.Array(), inRate, tableOut);
+            });
+
+            double stockNS = TimeCalls([&]
+            {
+                src_reset(stockState);
+                bSuccess &= ResampleChunks(stockState, 2, inRate, outRate+1.0, input.Array(), inRate, stockOut);
+            });
+
+            src_delete(tableState);
+            src_delete(stockState);
+
+            //quality is compared at the same ratio, against the stock mono converters
+            List<float> splitOut;
+            bSuccess &= ResampleSplit(type, inRate, outRate, input, splitOut);
+            bSuccess &= (splitOut.Num() == tableOut.Num());
+
+            float maxDiff = (splitOut.Num() == tableOut.Num()) ? ResampleMaxDiff(tableOut, splitOut) : 1.0f;
+
+            String strRates = FormattedString(TEXT("%u -> %u"), inRate, resampleRates[rate][1]);
+            TestPrint(TEXT("    %-8s %-14s %9.2f ms/s %9.2f ms/s %7.1f dB %7.1f dB %10.2g\n"),
+                resampleConverters[conv].lpName, strRates.Array(), tableNS/1000000.0, stockNS/1000000.0,
+                ResampleStereoSNR(tableOut, outRate), ResampleStereoSNR(splitOut, outRate), maxDiff);
+        }
+    }
+
+    TEST_CHECK(bSuccess);
+    return true;
+}
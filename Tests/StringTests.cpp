@@ -0,0 +1,215 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "Tests.h"
+
+//-----------------------------------------------------------------------------
+//  String keeps a capacity in front of its characters and at least doubles it when
+//an append runs out of room.  OldString below is the way appends worked before: the
+//buffer reallocated to the exact new length every time, and scat finding the end of
+//the text again.  the workloads are the ones that build strings piece by piece: the
+//log writer's batches, config keys, and escaping text a character at a time.
+
+struct OldString
+{
+    TSTR lpString;
+    UINT curLength;
+
+    inline OldString() : lpString(NULL), curLength(0) {}
+    inline ~OldString() {if(lpString) Free(lpString);}
+
+    inline UINT Length() const {return curLength;}
+
+    OldString& operator<<(CTSTR str)
+    {
+        UINT strLength = str ? slen(str) : 0;
+        if(!strLength)
+            return *this;
+
+        curLength += strLength;
+
+        if(lpString)
+        {
+            lpString = (TSTR)ReAllocate(lpString, (curLength+1)*sizeof(TCHAR));
+            scat(lpString, str);
+        }
+        else
+        {
+            lpString = (TSTR)Allocate((curLength+1)*sizeof(TCHAR));
+            scpy(lpString, str);
+        }
+
+        return *this;
+    }
+
+    OldString& operator<<(TCHAR ch)
+    {
+        ++curLength;
+        lpString = (TSTR)ReAllocate(lpString, (curLength+1)*sizeof(TCHAR));
+        lpString[curLength-1] = ch;
+        lpString[curLength]   = 0;
+
+        return *this;
+    }
+};
+
+//-----------------------------------------------------------------------------
+
+#define LOG_BATCH_LINES 500
+
+static CTSTR logLines[] =
+{
+    TEXT("12:00:01: RTMPPublisher::SendLoop: sent 1048576 bytes, 0 dropped frames"),
+    TEXT("12:00:01: Last message repeated 12 times"),
+    TEXT("12:00:02: x264 [info]: frame I:1 Avg QP:20.00 size: 40210"),
+    TEXT("12:00:02: Warning -- audio timestamp for device 'Microphone' jumped by 23 ms"),
+};
+
+static CTSTR configKeys[][2] =
+{
+    {TEXT("Video"),    TEXT("BaseWidth")},
+    {TEXT("Audio"),    TEXT("Device")},
+    {TEXT("Publish"),  TEXT("URL")},
+    {TEXT("Hotkeys"),  TEXT("PushToTalkHotkey")},
+};
+
+//a log writer batch: every line plus a line break
+template<typename T> static void BuildLogBatch(T &batch)
+{
+    for(UINT i=0; i<LOG_BATCH_LINES; i++)
+        batch << logLines[i%_countof(logLines)] << TEXT("\r\n");
+}
+
+//section.key lookups, all short strings
+template<typename T> static UINT BuildConfigKeys()
+{
+    UINT totalLength = 0;
+
+    for(UINT i=0; i<200; i++)
+    {
+        T key;
+        key << configKeys[i%_countof(configKeys)][0] << TEXT(".") << configKeys[i%_countof(configKeys)][1];
+        totalLength += key.Length();
+    }
+
+    return totalLength;
+}
+
+//escaping a stream key a character at a time, the way URL and AMF strings get put together
+template<typename T> static void EscapeText(T &out, CTSTR lpText, UINT repeat)
+{
+    for(UINT n=0; n<repeat; n++)
+    {
+        for(CTSTR lpChar = lpText; *lpChar; lpChar++)
+        {
+            if(*lpChar == ' ' || *lpChar == '&' || *lpChar == '=')
+                out << TCHAR('%') << TCHAR('2') << TCHAR('0');
+            else
+                out << *lpChar;
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+OBS_TEST(StringGrowth)
+{
+    //appending a piece at a time ends up with the same text as the old way
+    String batch;
+    OldString oldBatch;
+    BuildLogBatch(batch);
+    BuildLogBatch(oldBatch);
+
+    TEST_CHECK(batch.Length() == oldBatch.curLength);
+    TEST_CHECK(scmp(batch, oldBatch.lpString) == 0);
+
+    String escaped;
+    OldString oldEscaped;
+    EscapeText(escaped, TEXT("live_1234 & key=value"), 50);
+    EscapeText(oldEscaped, TEXT("live_1234 & key=value"), 50);
+
+    TEST_CHECK(escaped.Length() == oldEscaped.curLength);
+    TEST_CHECK(scmp(escaped, oldEscaped.lpString) == 0);
+
+    //nothing moves once there's room reserved
+    String str;
+    str.Reserve(100);
+    TSTR lpReserved = str.Array();
+    TEST_CHECK(lpReserved && str.Length() == 0 && *lpReserved == 0);
+
+    for(UINT i=0; i<10; i++)
+        str << TEXT("0123456789");
+
+    TEST_CHECK(str.Array() == lpReserved && str.Length() == 100);
+
+    //a SetLength buffer filled in by something else is appended to after its actual text
+    String filled;
+    filled.SetLength(32);
+    scpy(filled.Array(), TEXT("abc"));
+    filled << TEXT("def");
+    TEST_CHECK(filled == TEXT("abcdef") && filled.Length() == 6);
+
+    //FindReplace growing the string, like Logva putting the timestamp after every line break
+    String lines(TEXT("one\ntwo\nthree"));
+    lines.FindReplace(TEXT("\n"), TEXT("\n12:00:00: "));
+    TEST_CHECK(lines == TEXT("one\n12:00:00: two\n12:00:00: three"));
+
+    //moves hand the buffer over and leave the source empty
+    String source(TEXT("moved text"));
+    TSTR lpSource = source.Array();
+    String moved(std::move(source));
+    TEST_CHECK(moved.Array() == lpSource && source.Array() == NULL && source.Length() == 0);
+
+    String assigned;
+    assigned = std::move(moved);
+    TEST_CHECK(assigned.Array() == lpSource && moved.Array() == NULL);
+    TEST_CHECK(assigned == TEXT("moved text"));
+
+    return true;
+}
+
+OBS_BENCHMARK(StringBuilding)
+{
+    TestPrint(TEXT("    %-36s %12s %12s\n"), TEXT("workload"), TEXT("String"), TEXT("exact growth"));
+
+    double newNS = TimeCalls([] {String batch; BuildLogBatch(batch);});
+    double oldNS = TimeCalls([] {OldString batch; BuildLogBatch(batch);});
+    TestPrint(TEXT("    %-36s %9.1f us %9.1f us\n"), TEXT("log batch, 500 lines"), newNS/1000.0, oldNS/1000.0);
+
+    newNS = TimeCalls([] {BuildConfigKeys<String>();});
+    oldNS = TimeCalls([] {BuildConfigKeys<OldString>();});
+    TestPrint(TEXT("    %-36s %9.1f us %9.1f us\n"), TEXT("config keys, 200 section.key"), newNS/1000.0, oldNS/1000.0);
+
+    newNS = TimeCalls([] {String out; EscapeText(out, TEXT("live_1234 & key=value"), 100);});
+    oldNS = TimeCalls([] {OldString out; EscapeText(out, TEXT("live_1234 & key=value"), 100);});
+    TestPrint(TEXT("    %-36s %9.1f us %9.1f us\n"), TEXT("escaping, 2100 single characters"), newNS/1000.0, oldNS/1000.0);
+
+    //a whole Logva line, there's no old version to compare this one with but it shows what a log call costs
+    newNS = TimeCalls([]
+    {
+        String strCurTime = CurrentTimeString();
+        strCurTime << TEXT(": ");
+        String strOut = strCurTime;
+        strOut << FormattedString(TEXT("RTMPPublisher: %u bytes sent, %u frames dropped\nbuffer %u ms"), 1048576, 0, 250);
+        strOut.FindReplace(TEXT("\n"), String() << TEXT("\n") << strCurTime);
+    });
+    TestPrint(TEXT("    %-36s %9.1f us %12s\n"), TEXT("Logva line"), newNS/1000.0, TEXT("-"));
+
+    return true;
+}
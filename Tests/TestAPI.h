@@ -0,0 +1,163 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#pragma once
+
+//-----------------------------------------------------------------------------
+//  headless stand-in for the app's APIInterface, so OBSApi code that calls back into
+//the app (AudioSource asking for the sample rate, sources signaling new audio, etc)
+//can run without a window, a device or a scene.  everything else is a no-op.
+
+class TestAPI : public APIInterface
+{
+public:
+    UINT   sampleRateHz;
+    HANDLE hAudioEvent;     //set by SignalAudioAvailable if not NULL
+    TaskPool *taskPool;
+    String strPluginDataPath;
+    AudioSource *micSource;
+
+    TestAPI() : sampleRateHz(48000), hAudioEvent(NULL), taskPool(NULL), strPluginDataPath(TEXT(".")), micSource(NULL) {}
+
+    virtual void EnterSceneMutex() {}
+    virtual void LeaveSceneMutex() {}
+
+    virtual void RegisterSceneClass(CTSTR lpClassName, CTSTR lpDisplayName, OBSCREATEPROC createProc, OBSCONFIGPROC configProc) {}
+    virtual void RegisterImageSourceClass(CTSTR lpClassName, CTSTR lpDisplayName, OBSCREATEPROC createProc, OBSCONFIGPROC configProc) {}
+
+    virtual ImageSource* CreateImageSource(CTSTR lpClassName, XElement *data) {return NULL;}
+
+    virtual XElement* GetSceneListElement()         {return NULL;}
+    virtual XElement* GetGlobalSourceListElement()  {return NULL;}
+
+    virtual bool SetScene(CTSTR lpScene, bool bPost) {return false;}
+    virtual Scene* GetScene() const                 {return NULL;}
+
+    virtual CTSTR GetSceneName() const              {return TEXT("");}
+    virtual XElement* GetSceneElement()             {return NULL;}
+
+    virtual UINT CreateHotkey(DWORD hotkey, OBSHOTKEYPROC hotkeyProc, UPARAM param) {return 0;}
+    virtual void DeleteHotkey(UINT hotkeyID) {}
+
+    virtual Vect2 GetBaseSize() const               {return Vect2(1920.0f, 1080.0f);}
+    virtual Vect2 GetRenderFrameSize() const        {return Vect2(1920.0f, 1080.0f);}
+    virtual Vect2 GetOutputSize() const             {return Vect2(1920.0f, 1080.0f);}
+
+    virtual void GetBaseSize(UINT &width, UINT &height) const           {width = 1920; height = 1080;}
+    virtual void GetRenderFrameSize(UINT &width, UINT &height) const    {width = 1920; height = 1080;}
+    virtual void GetOutputSize(UINT &width, UINT &height) const         {width = 1920; height = 1080;}
+    virtual UINT GetMaxFPS() const                  {return 30;}
+
+    virtual CTSTR GetLanguage() const               {return TEXT("en");}
+
+    virtual HWND GetMainWindow() const              {return NULL;}
+
+    virtual CTSTR GetAppDataPath() const            {return TEXT(".");}
+    virtual String GetPluginDataPath() const        {return strPluginDataPath;}
+
+    virtual UINT AddStreamInfo(CTSTR lpInfo, StreamInfoPriority priority) {return 0;}
+    virtual void SetStreamInfo(UINT infoID, CTSTR lpInfo) {}
+    virtual void SetStreamInfoPriority(UINT infoID, StreamInfoPriority priority) {}
+    virtual void RemoveStreamInfo(UINT infoID) {}
+
+    virtual bool UseMultithreadedOptimizations() const {return true;}
+
+    virtual void AddAudioSource(AudioSource *source) {}
+    virtual void RemoveAudioSource(AudioSource *source) {}
+
+    virtual QWORD GetAudioTime() const              {return GetQPCTimeMS();}
+
+    virtual CTSTR GetAppPath() const                {return TEXT(".");}
+
+    virtual void StartStopStream() {}
+    virtual void StartStopPreview() {}
+    virtual bool GetStreaming()                     {return false;}
+    virtual bool GetPreviewOnly()                   {return false;}
+
+    virtual void SetSourceOrder(StringList &sourceNames) {}
+    virtual void SetSourceRender(CTSTR lpSource, bool render) {}
+
+    virtual void SetDesktopVolume(float val, bool finalValue) {}
+    virtual float GetDesktopVolume()                {return 1.0f;}
+    virtual void ToggleDesktopMute() {}
+    virtual bool GetDesktopMuted()                  {return false;}
+
+    virtual void SetMicVolume(float val, bool finalValue) {}
+    virtual float GetMicVolume()                    {return 1.0f;}
+    virtual void ToggleMicMute() {}
+    virtual bool GetMicMuted()                      {return false;}
+
+    virtual DWORD GetOBSVersion() const             {return 0;}
+    virtual bool IsTestVersion() const              {return true;}
+
+    virtual UINT NumAuxAudioSources() const         {return 0;}
+    virtual AudioSource* GetAuxAudioSource(UINT id) {return NULL;}
+
+    virtual AudioSource* GetDesktopAudioSource()    {return NULL;}
+    virtual AudioSource* GetMicAudioSource()        {return micSource;}
+
+    virtual void GetCurDesktopVolumeStats(float *rms, float *max, float *peak) const {*rms = *max = *peak = VOL_MIN;}
+    virtual void GetCurMicVolumeStats(float *rms, float *max, float *peak) const     {*rms = *max = *peak = VOL_MIN;}
+
+    virtual void AddSettingsPane(SettingsPane *pane) {}
+    virtual void RemoveSettingsPane(SettingsPane *pane) {}
+
+    virtual void SetChangedSettings(bool isModified) {}
+
+    virtual Vect2 GetRenderFrameOffset() const      {return Vect2(0.0f, 0.0f);}
+    virtual Vect2 GetRenderFrameControlSize() const {return Vect2(1920.0f, 1080.0f);}
+
+    virtual void GetRenderFrameOffset(UINT &x, UINT &y) const                       {x = y = 0;}
+    virtual void GetRenderFrameControlSize(UINT &width, UINT &height) const         {width = 1920; height = 1080;}
+
+    virtual bool GetRenderFrameIn1To1Mode() const   {return true;}
+
+    virtual Vect2 MapWindowToFramePos(Vect2 mousePos) const     {return mousePos;}
+    virtual Vect2 MapFrameToWindowPos(Vect2 framePos) const     {return framePos;}
+    virtual Vect2 MapWindowToFrameSize(Vect2 windowSize) const  {return windowSize;}
+    virtual Vect2 MapFrameToWindowSize(Vect2 frameSize) const   {return frameSize;}
+    virtual Vect2 GetWindowToFrameScale() const     {return Vect2(1.0f, 1.0f);}
+    virtual Vect2 GetFrameToWindowScale() const     {return Vect2(1.0f, 1.0f);}
+
+    virtual UINT GetSampleRateHz() const            {return sampleRateHz;}
+
+    virtual void SetAbortApplySettings(bool abort) {}
+
+    virtual void StartStopRecording() {}
+    virtual bool GetRecording() const               {return false;}
+
+    virtual bool GetKeepRecording() const           {return false;}
+
+    virtual UINT GetCaptureFPS() const              {return 30;}
+    virtual UINT GetTotalFrames() const             {return 0;}
+    virtual UINT GetFramesDropped() const           {return 0;}
+    virtual UINT GetTotalStreamTime() const         {return 0;}
+    virtual UINT GetBytesPerSec() const             {return 0;}
+
+    virtual void SetCanOptimizeSettings(bool canOptimize) {}
+
+    virtual void SignalAudioAvailable()             {if(hAudioEvent) SetEvent(hAudioEvent);}
+
+    virtual TaskPool* GetTaskPool()                 {return taskPool;}
+
+    virtual void RegisterImageSourceClassEx(CTSTR lpClassName, CTSTR lpDisplayName, OBSCREATEPROC createProc, OBSCONFIGPROC configProc, UINT flags) {}
+    virtual UINT GetImageSourceClassFlags(CTSTR lpClassName) {return 0;}
+};
+
+inline TestAPI* GetTestAPI() {return static_cast<TestAPI*>(API);}
@@ -0,0 +1,26 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "../Source/Main.h"
+
+//the app's globals, for the Source files the tests compile directly.  tests hand those
+//files everything they need explicitly, so App stays NULL.  RTMPPublisher and BitrateController
+//read their settings from AppConfig, so their tests point it at a temporary config for each run.
+OBS        *App         = NULL;
+ConfigFile *AppConfig   = NULL;
@@ -0,0 +1,138 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "Tests.h"
+#include "TestAPI.h"
+
+//  usage: Tests [-bench] [-list] [name ...]
+//
+//  with no names, every test runs (and every benchmark too with -bench).  names match
+//case-insensitively against the start of the test name, so "Audio" runs all the audio
+//tests.  the exit code is the number of failures.
+
+//zero-initialized before any of the static TestInfo constructors run
+static TestInfo *firstTest = NULL;
+
+TestInfo::TestInfo(CTSTR lpName, TESTPROC testProc, TestKind kind)
+    : lpName(lpName), testProc(testProc), kind(kind)
+{
+    //keep the list sorted by name so the run order doesn't depend on link order
+    TestInfo **link = &firstTest;
+    while(*link && scmpi((*link)->lpName, lpName) < 0)
+        link = &(*link)->next;
+
+    next  = *link;
+    *link = this;
+}
+
+void TestFailed(CTSTR lpFile, UINT line, CTSTR lpExpression)
+{
+    TestPrint(TEXT("    FAILED: %s (%s:%u)\n"), lpExpression, lpFile, line);
+}
+
+void __cdecl TestPrint(CTSTR lpFormat, ...)
+{
+    va_list arglist;
+    va_start(arglist, lpFormat);
+    vwprintf(lpFormat, arglist);
+    va_end(arglist);
+
+    fflush(stdout);
+}
+
+static bool MatchesFilters(const TestInfo *test, const List<CTSTR> &filters)
+{
+    if(!filters.Num())
+        return true;
+
+    for(UINT i=0; i<filters.Num(); i++)
+    {
+        if(scmpi_n(test->lpName, filters[i], slen(filters[i])) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+static int RunTests(int argc, wchar_t *argv[])
+{
+    bool bBenchmarks = false, bList = false;
+    List<CTSTR> filters;
+
+    for(int i=1; i<argc; i++)
+    {
+        if(scmpi(argv[i], TEXT("-bench")) == 0)
+            bBenchmarks = true;
+        else if(scmpi(argv[i], TEXT("-list")) == 0)
+            bList = true;
+        else
+            filters << argv[i];
+    }
+
+    UINT numRun = 0, numFailed = 0;
+
+    for(TestInfo *test = firstTest; test; test = test->next)
+    {
+        if(!MatchesFilters(test, filters))
+            continue;
+
+        if(bList)
+        {
+            TestPrint(TEXT("%s%s\n"), test->lpName, (test->kind == TestKind_Benchmark) ? TEXT(" (benchmark)") : TEXT(""));
+            continue;
+        }
+
+        //benchmarks named explicitly run without -bench
+        if(test->kind == TestKind_Benchmark && !bBenchmarks && !filters.Num())
+            continue;
+
+        TestPrint(TEXT("%s\n"), test->lpName);
+
+        QWORD startTime = GetQPCTimeMS();
+        bool bPassed = test->testProc();
+
+        TestPrint(TEXT("    %s (%llu ms)\n"), bPassed ? TEXT("ok") : TEXT("FAILED"), GetQPCTimeMS()-startTime);
+
+        numRun++;
+        if(!bPassed)
+            numFailed++;
+    }
+
+    if(!bList)
+        TestPrint(TEXT("\n%u run, %u failed\n"), numRun, numFailed);
+
+    return int(numFailed);
+}
+
+int wmain(int argc, wchar_t *argv[])
+{
+    if(!InitXT(NULL, TEXT("FastAlloc")))
+        return -1;
+
+    API = new TestAPI;
+
+    int numFailed = RunTests(argc, argv);
+
+    delete API;
+    API = NULL;
+
+    TerminateXT();
+
+    return numFailed;
+}
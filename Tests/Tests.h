@@ -0,0 +1,99 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#pragma once
+
+#include "OBSApi.h"
+#include <stdio.h>
+
+//-----------------------------------------------------------------------------
+//  tests and benchmarks register themselves statically, the runner in TestMain.cpp
+//runs tests by default and benchmarks only when asked to (-bench), since they take
+//a while and their numbers only mean something on a quiet release build.
+
+typedef bool (*TESTPROC)();
+
+enum TestKind
+{
+    TestKind_Test,
+    TestKind_Benchmark,
+};
+
+struct TestInfo
+{
+    CTSTR    lpName;
+    TESTPROC testProc;
+    TestKind kind;
+    TestInfo *next;
+
+    TestInfo(CTSTR lpName, TESTPROC testProc, TestKind kind);
+};
+
+#define OBS_TEST(name) \
+    static bool Test_##name(); \
+    static TestInfo testInfo_##name(_CRT_WIDE(#name), Test_##name, TestKind_Test); \
+    static bool Test_##name()
+
+#define OBS_BENCHMARK(name) \
+    static bool Bench_##name(); \
+    static TestInfo benchInfo_##name(_CRT_WIDE(#name), Bench_##name, TestKind_Benchmark); \
+    static bool Bench_##name()
+
+void TestFailed(CTSTR lpFile, UINT line, CTSTR lpExpression);
+void __cdecl TestPrint(CTSTR lpFormat, ...);
+
+#define TEST_CHECK(expr) if(!(expr)) {TestFailed(TEXT(__FILE__), __LINE__, _CRT_WIDE(#expr)); return false;}
+
+//-----------------------------------------------------------------------------
+// helpers shared by the tests
+
+//small deterministic generator so every run sees the same synthetic data
+class TestRandom
+{
+    UINT seed;
+
+public:
+    inline TestRandom(UINT seed=1) : seed(seed) {}
+
+    inline UINT Next()              {seed = seed*1664525 + 1013904223; return seed;}
+    inline UINT Next(UINT range)    {return (Next() >> 8) % range;}
+
+    //uniform in [-1, 1)
+    inline float NextFloat()        {return float(int(Next() >> 8) - 0x800000) / float(0x800000);}
+};
+
+//runs the given proc until at least minMS milliseconds have passed and returns nanoseconds per call
+template<typename T> double TimeCalls(const T &proc, UINT minMS=200)
+{
+    proc(); //warm up caches and any lazily created state
+
+    QWORD startTime = GetQPCTimeNS();
+    QWORD endTime   = startTime + QWORD(minMS)*1000000;
+    QWORD curTime;
+    UINT  numCalls = 0;
+
+    do
+    {
+        proc();
+        numCalls++;
+        curTime = GetQPCTimeNS();
+    } while(curTime < endTime);
+
+    return double(curTime-startTime) / double(numCalls);
+}
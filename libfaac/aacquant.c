@@ -55,6 +55,10 @@ void AACQuantizeInit(CoderInfo *coderInfo, unsigned int numChannels,
 
     aacquantCfg->pow43 = (double*)AllocMemory(PRECALC_SIZE*sizeof(double));
     aacquantCfg->adj43 = (double*)AllocMemory(PRECALC_SIZE*sizeof(double));
+    aacquantCfg->qfac = (double*)AllocMemory(2*QFAC_RANGE*sizeof(double));
+
+    for (i = 0; i < 2*QFAC_RANGE; i++)
+        aacquantCfg->qfac[i] = pow(2.0, -0.25*((int)i - QFAC_RANGE));
 
     aacquantCfg->pow43[0] = 0.0;
     for(i=1;i<PRECALC_SIZE;i++)
@@ -90,15 +94,28 @@ void AACQuantizeEnd(CoderInfo *coderInfo, unsigned int numChannels,
       FreeMemory(aacquantCfg->adj43);
       aacquantCfg->adj43 = NULL;
 	}
+    if (aacquantCfg->qfac)
+	{
+      FreeMemory(aacquantCfg->qfac);
+      aacquantCfg->qfac = NULL;
+	}
 
     for (channel = 0; channel < numChannels; channel++) {
         if (coderInfo[channel].requantFreq) FreeMemory(coderInfo[channel].requantFreq);
     }
 }
 
+/* pow(2.0, -0.25*diff), from the table for the usual scalefactor range */
+static double QuantFac(int diff, double *qfac)
+{
+  if (diff >= -QFAC_RANGE && diff < QFAC_RANGE)
+    return qfac[diff + QFAC_RANGE];
+  return pow(2.0, -0.25*diff);
+}
+
 static void BalanceEnergy(CoderInfo *coderInfo,
 			  const double *xr, const int *xi,
-			  double *pow43)
+			  double *pow43, double *qfac)
 {
   const double ifqstep = pow(2.0, 0.25);
   const double logstep_1 = 1.0 / log(ifqstep);
@@ -116,7 +133,7 @@ static void BalanceEnergy(CoderInfo *coderInfo,
     start = coderInfo->sfb_offset[sb];
     end   = coderInfo->sfb_offset[sb+1];
 
-    qfac_1 = pow(2.0, -0.25*(coderInfo->scale_factor[sb] - coderInfo->global_gain));
+    qfac_1 = QuantFac(coderInfo->scale_factor[sb] - coderInfo->global_gain, qfac);
 
     en0 = 0.0;
     enq = 0.0;
@@ -147,7 +164,7 @@ static void BalanceEnergy(CoderInfo *coderInfo,
 }
 
 static void UpdateRequant(CoderInfo *coderInfo, int *xi,
-			  double *pow43)
+			  double *pow43, double *qfac)
 {
   double *requant_xr = coderInfo->requantFreq;
   int sb;
@@ -156,7 +173,7 @@ static void UpdateRequant(CoderInfo *coderInfo, int *xi,
   for (sb = 0; sb < coderInfo->nr_of_sfb; sb++)
   {
     double invQuantFac =
-      pow(2.0, -0.25*(coderInfo->scale_factor[sb] - coderInfo->global_gain));
+      QuantFac(coderInfo->scale_factor[sb] - coderInfo->global_gain, qfac);
     int start = coderInfo->sfb_offset[sb];
     int end = coderInfo->sfb_offset[sb + 1];
 
@@ -188,19 +205,34 @@ int AACQuantize(CoderInfo *coderInfo,
         scale_factor[sb] = 0;
 
     /* Compute xr_pow */
+#ifdef FAAC_USE_SSE2
+    {
+        const __m128d absmask = _mm_castsi128_pd(_mm_set_epi32(0x7fffffff, -1, 0x7fffffff, -1));
+        const __m128d minval = _mm_set1_pd(1E-20);
+
+        for (i = 0; i < FRAME_LEN; i += 2) {
+            __m128d temp = _mm_and_pd(_mm_loadu_pd(xr + i), absmask);
+            int mask = _mm_movemask_pd(_mm_cmpgt_pd(temp, minval));
+
+            _mm_storeu_pd(xr_pow + i, _mm_sqrt_pd(_mm_mul_pd(temp, _mm_sqrt_pd(temp))));
+            do_q += (mask & 1) + (mask >> 1);
+        }
+    }
+#else
     for (i = 0; i < FRAME_LEN; i++) {
         double temp = fabs(xr[i]);
         xr_pow[i] = sqrt(temp * sqrt(temp));
         do_q += (temp > 1E-20);
     }
+#endif
 
     if (do_q) {
         CalcAllowedDist(coderInfo, psyInfo, xr, xmin, aacquantCfg->quality);
 	coderInfo->global_gain = 0;
 	FixNoise(coderInfo, xr, xr_pow, xi, xmin,
 		 aacquantCfg->pow43, aacquantCfg->adj43);
-	BalanceEnergy(coderInfo, xr, xi, aacquantCfg->pow43);
-	UpdateRequant(coderInfo, xi, aacquantCfg->pow43);
+	BalanceEnergy(coderInfo, xr, xi, aacquantCfg->pow43, aacquantCfg->qfac);
+	UpdateRequant(coderInfo, xi, aacquantCfg->pow43, aacquantCfg->qfac);
 
         for ( i = 0; i < FRAME_LEN; i++ )  {
             sign = (xr[i] < 0) ? -1 : 1;
@@ -328,6 +360,28 @@ static void QuantizeBand(const double *xp, int *pi, double istep,
   int j;
   fi_union *fi;
 
+#ifdef FAAC_USE_SSE2
+  /* the same steps as below on two values at a time, with only the adj43
+     lookup done one by one */
+  {
+    const __m128d vistep = _mm_set1_pd(istep);
+    const __m128d vmagic = _mm_set1_pd(MAGIC_FLOAT);
+    const __m128i vmagicint = _mm_set1_epi32(MAGIC_INT);
+
+    for (j = offset; j + 1 < end; j += 2)
+    {
+      __m128d x = _mm_add_pd(_mm_mul_pd(vistep, _mm_loadu_pd(xp + j)), vmagic);
+      __m128i ix = _mm_sub_epi32(_mm_castps_si128(_mm_cvtpd_ps(x)), vmagicint);
+      __m128d adj = _mm_set_pd(adj43[_mm_cvtsi128_si32(_mm_srli_si128(ix, 4))],
+			       adj43[_mm_cvtsi128_si32(ix)]);
+
+      ix = _mm_sub_epi32(_mm_castps_si128(_mm_cvtpd_ps(_mm_add_pd(x, adj))), vmagicint);
+      _mm_storel_epi64((__m128i *)(pi + j), ix);
+    }
+    offset = j;
+  }
+#endif
+
   fi = (fi_union *)pi;
   for (j = offset; j < end; j++)
   {
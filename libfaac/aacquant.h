@@ -37,11 +37,15 @@ extern "C" {
 #define POW20(x)  pow(2.0,((double)x)*.25)
 #define IPOW20(x)  pow(2.0,-((double)x)*.1875)
 
+/* range of scalefactor differences that QuantFac looks up instead of calling pow */
+#define QFAC_RANGE 256
+
 #pragma pack(push, 1)
 typedef struct
   {
     double *pow43;
     double *adj43;
+    double *qfac;
     double quality;
   } AACQuantCfg;
 #pragma pack(pop)
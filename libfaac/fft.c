@@ -47,10 +47,19 @@ static const int logm_to_nfft[] =
 void fft_initialize( FFT_Tables *fft_tables )
 {
     memset( fft_tables->cfg, 0, sizeof( fft_tables->cfg ) );
+    memset( fft_tables->mdcttbl, 0, sizeof( fft_tables->mdcttbl ) );
 }
 void fft_terminate( FFT_Tables *fft_tables )
 {
     unsigned int i;
+    for ( i = 0; i < 2; i++ )
+    {
+        if ( fft_tables->mdcttbl[i] )
+        {
+            FreeMemory( fft_tables->mdcttbl[i] );
+            fft_tables->mdcttbl[i] = NULL;
+        }
+    }
     for ( i = 0; i < sizeof( fft_tables->cfg ) / sizeof( fft_tables->cfg[0] ); i++ )
     {
         if ( fft_tables->cfg[i][0] )
@@ -475,13 +484,18 @@ void fft_initialize( FFT_Tables *fft_tables )
 	fft_tables->costbl		= AllocMemory( (MAXLOGM+1) * sizeof( fft_tables->costbl[0] ) );
 	fft_tables->negsintbl	= AllocMemory( (MAXLOGM+1) * sizeof( fft_tables->negsintbl[0] ) );
 	fft_tables->reordertbl	= AllocMemory( (MAXLOGM+1) * sizeof( fft_tables->reordertbl[0] ) );
+	fft_tables->twiddletbl	= AllocMemory( (MAXLOGM+1) * sizeof( fft_tables->twiddletbl[0] ) );
 	
 	for( i = 0; i< MAXLOGM+1; i++ )
 	{
 		fft_tables->costbl[i]		= NULL;
 		fft_tables->negsintbl[i]	= NULL;
 		fft_tables->reordertbl[i]	= NULL;
+		fft_tables->twiddletbl[i]	= NULL;
 	}
+
+	fft_tables->mdcttbl[0] = NULL;
+	fft_tables->mdcttbl[1] = NULL;
 }
 
 void fft_terminate( FFT_Tables *fft_tables )
@@ -498,15 +512,27 @@ void fft_terminate( FFT_Tables *fft_tables )
 			
 		if( fft_tables->reordertbl[i] != NULL )
 			FreeMemory( fft_tables->reordertbl[i] );
+
+		if( fft_tables->twiddletbl[i] != NULL )
+			FreeMemory( fft_tables->twiddletbl[i] );
+	}
+
+	for( i = 0; i < 2; i++ )
+	{
+		if( fft_tables->mdcttbl[i] != NULL )
+			FreeMemory( fft_tables->mdcttbl[i] );
+		fft_tables->mdcttbl[i] = NULL;
 	}
 
 	FreeMemory( fft_tables->costbl );
 	FreeMemory( fft_tables->negsintbl );
 	FreeMemory( fft_tables->reordertbl );
+	FreeMemory( fft_tables->twiddletbl );
 
 	fft_tables->costbl		= NULL;
 	fft_tables->negsintbl	= NULL;
 	fft_tables->reordertbl	= NULL;
+	fft_tables->twiddletbl	= NULL;
 }
 
 static void reorder( FFT_Tables *fft_tables, double *x, int logm)
@@ -595,6 +621,95 @@ static void fft_proc(
 	}
 }
 
+#ifdef FAAC_USE_SSE2
+
+/* Same butterflies as fft_proc, two at a time.  The twiddles of each pass are
+   copied out of refac/imfac into twr/twi at [step, 2*step) so they can be
+   loaded directly; the values and the order of operations are unchanged, so
+   the output is identical. */
+static void fft_proc_sse2(
+		double *xr, 
+		double *xi,
+		double *twr, 
+		double *twi, 
+		int size)	
+{
+	int step, shift, pos;
+
+	/* the first pass only has one twiddle, so it stays scalar */
+	for (pos = 0; pos < size; pos += 2)
+	{
+		double v2r, v2i;
+
+		v2r = xr[pos + 1] * twr[1] - xi[pos + 1] * twi[1];
+		v2i = xr[pos + 1] * twi[1] + xi[pos + 1] * twr[1];
+
+		xr[pos + 1] = xr[pos] - v2r;
+		xr[pos] += v2r;
+
+		xi[pos + 1] = xi[pos] - v2i;
+		xi[pos] += v2i;
+	}
+
+	for (step = 2; step < size; step *= 2)
+	{
+		for (pos = 0; pos < size; pos += (2 * step))
+		{
+			double *x1r = xr + pos, *x1i = xi + pos;
+			double *x2r = x1r + step, *x2i = x1i + step;
+
+			for (shift = 0; shift < step; shift += 2)
+			{
+				__m128d wr = _mm_loadu_pd(twr + step + shift);
+				__m128d wi = _mm_loadu_pd(twi + step + shift);
+				__m128d ar = _mm_loadu_pd(x1r + shift);
+				__m128d ai = _mm_loadu_pd(x1i + shift);
+				__m128d br = _mm_loadu_pd(x2r + shift);
+				__m128d bi = _mm_loadu_pd(x2i + shift);
+				__m128d v2r, v2i;
+
+				v2r = _mm_sub_pd(_mm_mul_pd(br, wr), _mm_mul_pd(bi, wi));
+				v2i = _mm_add_pd(_mm_mul_pd(br, wi), _mm_mul_pd(bi, wr));
+
+				_mm_storeu_pd(x2r + shift, _mm_sub_pd(ar, v2r));
+				_mm_storeu_pd(x1r + shift, _mm_add_pd(ar, v2r));
+
+				_mm_storeu_pd(x2i + shift, _mm_sub_pd(ai, v2i));
+				_mm_storeu_pd(x1i + shift, _mm_add_pd(ai, v2i));
+			}
+		}
+	}
+}
+
+static void check_twiddles( FFT_Tables *fft_tables, int logm)
+{
+	if( fft_tables->twiddletbl[logm] == NULL )
+	{
+		int size = 1 << logm;
+		int step, estep, shift;
+		double *tw;
+
+		tw = AllocMemory(2 * size * sizeof(*tw));
+
+		tw[0] = tw[size] = 0.0;
+
+		estep = size;
+		for (step = 1; step < size; step *= 2)
+		{
+			estep >>= 1;
+			for (shift = 0; shift < step; shift++)
+			{
+				tw[step + shift]		= fft_tables->costbl[logm][shift * estep];
+				tw[size + step + shift]	= fft_tables->negsintbl[logm][shift * estep];
+			}
+		}
+
+		fft_tables->twiddletbl[logm] = tw;
+	}
+}
+
+#endif /* FAAC_USE_SSE2 */
+
 static void check_tables( FFT_Tables *fft_tables, int logm)
 {
 	if( fft_tables->costbl[logm] == NULL )
@@ -636,6 +751,16 @@ void fft( FFT_Tables *fft_tables, double *xr, double *xi, int logm)
 	reorder( fft_tables, xr, logm);
 	reorder( fft_tables, xi, logm);
 
+#ifdef FAAC_USE_SSE2
+	if (logm >= 2)
+	{
+		check_twiddles( fft_tables, logm);
+		fft_proc_sse2( xr, xi, fft_tables->twiddletbl[logm],
+			fft_tables->twiddletbl[logm] + (1 << logm), 1 << logm );
+		return;
+	}
+#endif
+
 	fft_proc( xr, xi, fft_tables->costbl[logm], fft_tables->negsintbl[logm], 1 << logm );
 }
 
@@ -32,6 +32,8 @@ typedef struct
 {
     /*      cfg[Max FFT][FFT and inverse FFT] */
     void*   cfg[MAX_FFT][2];
+    /*      mdcttbl[short/long]: MDCT twiddles, see filtbank.c */
+    double* mdcttbl[2];
 } FFT_Tables;
 
 #else  /* use own FFT */
@@ -41,6 +43,8 @@ typedef struct
     fftfloat **costbl;
     fftfloat **negsintbl;
     unsigned short **reordertbl;
+    double **twiddletbl;	/* per-pass twiddles as doubles for the SSE2 fft */
+    double *mdcttbl[2];		/* MDCT twiddles for short/long blocks, see filtbank.c */
 } FFT_Tables;
 
 #endif /* defined DRM && !defined DRM_1024 */
@@ -418,24 +418,49 @@ static void CalculateKBDWindow(double* win, double alpha, int length)
     }
 }
 
-static void MDCT( FFT_Tables *fft_tables, double *data, int N )
+/* The pre- and post-twiddle both step the same cosine/sine recurrence, so
+   the values are worked out once per block size, in the same order, and
+   kept in fft_tables: cos at [0, N/4), sin at [N/4, N/2). */
+static double *MDCTTwiddles( FFT_Tables *fft_tables, int N )
 {
-    double *xi, *xr;
-    double tempr, tempi, c, s, cold, cfreq, sfreq; /* temps for pre and post twiddle */
+    double *tbl;
+    double c, s, cold, cfreq, sfreq;
     double freq = TWOPI / N;
-    double cosfreq8, sinfreq8;
-    int i, n;
+    int i, idx = (N == BLOCK_LEN_SHORT * 2) ? 0 : 1;
 
-    xi = (double*)AllocMemory((N >> 2)*sizeof(double));
-    xr = (double*)AllocMemory((N >> 2)*sizeof(double));
+    tbl = fft_tables->mdcttbl[idx];
+    if (tbl)
+        return tbl;
+
+    tbl = (double*)AllocMemory((N >> 1)*sizeof(double));
 
-    /* prepare for recurrence relation in pre-twiddle */
     cfreq = cos (freq);
     sfreq = sin (freq);
-    cosfreq8 = cos (freq * 0.125);
-    sinfreq8 = sin (freq * 0.125);
-    c = cosfreq8;
-    s = sinfreq8;
+    c = cos (freq * 0.125);
+    s = sin (freq * 0.125);
+
+    for (i = 0; i < (N >> 2); i++) {
+        tbl[i] = c;
+        tbl[(N >> 2) + i] = s;
+
+        cold = c;
+        c = c * cfreq - s * sfreq;
+        s = s * cfreq + cold * sfreq;
+    }
+
+    fft_tables->mdcttbl[idx] = tbl;
+    return tbl;
+}
+
+static void MDCT( FFT_Tables *fft_tables, double *data, int N )
+{
+    double xi[BLOCK_LEN_LONG >> 1], xr[BLOCK_LEN_LONG >> 1];
+    double tempr, tempi, c, s; /* temps for pre and post twiddle */
+    double *costbl, *sintbl;
+    int i, n;
+
+    costbl = MDCTTwiddles(fft_tables, N);
+    sintbl = costbl + (N >> 2);
 
     for (i = 0; i < (N >> 2); i++) {
         /* calculate real and imaginary parts of g(n) or G(p) */
@@ -453,13 +478,10 @@ static void MDCT( FFT_Tables *fft_tables, double *data, int N )
             tempi = data [(N >> 2) + n] + data [N + (N >> 2) - 1 - n]; /* use second form of e(n) for n=2i*/
 
         /* calculate pre-twiddled FFT input */
+        c = costbl[i];
+        s = sintbl[i];
         xr[i] = tempr * c + tempi * s;
         xi[i] = tempi * c - tempr * s;
-
-        /* use recurrence to prepare cosine and sine for next value of i */
-        cold = c;
-        c = c * cfreq - s * sfreq;
-        s = s * cfreq + cold * sfreq;
     }
 
     /* Perform in-place complex FFT of length N/4 */
@@ -471,13 +493,38 @@ static void MDCT( FFT_Tables *fft_tables, double *data, int N )
         fft( fft_tables, xr, xi, 9);
     }
 
-    /* prepare for recurrence relations in post-twiddle */
-    c = cosfreq8;
-    s = sinfreq8;
-
     /* post-twiddle FFT output and then get output data */
+#ifdef FAAC_USE_SSE2
+    for (i = 0; i < (N >> 2); i += 2) {
+        __m128d vc = _mm_loadu_pd(costbl + i);
+        __m128d vs = _mm_loadu_pd(sintbl + i);
+        __m128d vr = _mm_loadu_pd(xr + i);
+        __m128d vi = _mm_loadu_pd(xi + i);
+        __m128d two = _mm_set1_pd(2.);
+        __m128d negzero = _mm_set1_pd(-0.);
+        __m128d vtempr, vtempi, vnegr, vnegi;
+
+        /* get post-twiddled FFT output  */
+        vtempr = _mm_mul_pd(two, _mm_add_pd(_mm_mul_pd(vr, vc), _mm_mul_pd(vi, vs)));
+        vtempi = _mm_mul_pd(two, _mm_sub_pd(_mm_mul_pd(vi, vc), _mm_mul_pd(vr, vs)));
+        vnegr = _mm_xor_pd(vtempr, negzero);
+        vnegi = _mm_xor_pd(vtempi, negzero);
+
+        /* fill in output values, the odd ones run backwards */
+        _mm_storel_pd(data + 2 * i, vnegr);                         /* first half even */
+        _mm_storeh_pd(data + 2 * i + 2, vnegr);
+        _mm_storel_pd(data + (N >> 1) - 1 - 2 * i, vtempi);         /* first half odd */
+        _mm_storeh_pd(data + (N >> 1) - 3 - 2 * i, vtempi);
+        _mm_storel_pd(data + (N >> 1) + 2 * i, vnegi);              /* second half even */
+        _mm_storeh_pd(data + (N >> 1) + 2 * i + 2, vnegi);
+        _mm_storel_pd(data + N - 1 - 2 * i, vtempr);                /* second half odd */
+        _mm_storeh_pd(data + N - 3 - 2 * i, vtempr);
+    }
+#else
     for (i = 0; i < (N >> 2); i++) {
         /* get post-twiddled FFT output  */
+        c = costbl[i];
+        s = sintbl[i];
         tempr = 2. * (xr[i] * c + xi[i] * s);
         tempi = 2. * (xi[i] * c - xr[i] * s);
 
@@ -486,15 +533,8 @@ static void MDCT( FFT_Tables *fft_tables, double *data, int N )
         data [(N >> 1) - 1 - 2 * i] = tempi;  /* first half odd */
         data [(N >> 1) + 2 * i] = -tempi;  /* second half even */
         data [N - 1 - 2 * i] = tempr;  /* second half odd */
-
-        /* use recurrence to prepare cosine and sine for next value of i */
-        cold = c;
-        c = c * cfreq - s * sfreq;
-        s = s * cfreq + cold * sfreq;
     }
-
-    if (xr) FreeMemory(xr);
-    if (xi) FreeMemory(xi);
+#endif
 }
 
 static void IMDCT( FFT_Tables *fft_tables, double *data, int N)
@@ -147,6 +147,7 @@ int FAACAPI faacEncSetConfiguration(faacEncHandle hEncoder,
         //case FAAC_INPUT_24BIT:
         case FAAC_INPUT_32BIT:
         case FAAC_INPUT_FLOAT:
+        case FAAC_INPUT_FLOAT_UNIT:
             break;
 
         default:
@@ -562,6 +563,22 @@ int FAACAPI faacEncEncode(faacEncHandle hEncoder,
 					}
                     break;
 
+                case FAAC_INPUT_FLOAT_UNIT:
+					{
+						float *input_channel = (float*)inputBuffer + hEncoder->config.channel_map[channel];
+						float sample;
+
+						/* scaled in float, the same as scaling the buffer before handing it over.  the
+						   product goes through a float variable so x87 builds round it to float too */
+						for (i = 0; i < samples_per_channel; i++)
+						{
+							sample = *input_channel * 32767.0f;
+							hEncoder->next3SampleBuff[channel][i] = (double)sample;
+							input_channel += numChannels;
+						}
+					}
+                    break;
+
                 default:
                     return -1; /* invalid input format */
                     break;
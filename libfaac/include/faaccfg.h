@@ -40,6 +40,7 @@
 #define FAAC_INPUT_24BIT   2
 #define FAAC_INPUT_32BIT   3
 #define FAAC_INPUT_FLOAT   4
+#define FAAC_INPUT_FLOAT_UNIT 5
 
 #define SHORTCTL_NORMAL    0
 #define SHORTCTL_NOSHORT   1
@@ -97,6 +98,7 @@ typedef struct faacEncConfiguration
 		2	FAAC_INPUT_24BIT		native endian 24bit in 24 bits		(not implemented)
 		3	FAAC_INPUT_32BIT		native endian 24bit in 32 bits		(DEFAULT)
 		4	FAAC_INPUT_FLOAT		32bit floating point
+		5	FAAC_INPUT_FLOAT_UNIT	32bit floating point from -1.0 to 1.0
     */
     unsigned int inputFormat;
 
@@ -36,6 +36,13 @@ extern "C" {
 #define min(a, b) (((a) < (b)) ? (a) : (b))
 #endif
 
+/* SSE2 paths for the transforms and the quantizer, which give the same
+   results as the plain C ones */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FAAC_USE_SSE2
+#include <emmintrin.h>
+#endif
+
 #ifndef M_PI
 #define M_PI        3.14159265358979323846
 #endif
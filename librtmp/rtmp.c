@@ -135,6 +135,10 @@ static void HandleClientBW(RTMP *r, const RTMPPacket *packet);
 
 static int ReadN(RTMP *r, char *buffer, int n);
 static int WriteN(RTMP *r, const char *buffer, int n);
+static int WriteV(RTMP *r, const RTMPIOVec *vec, int count);
+
+/* most buffers RTMP_SendPacket gathers into one write */
+#define RTMP_MAX_SEND_VECS 64
 
 static void DecodeTEA(AVal *key, AVal *text);
 
@@ -143,6 +147,7 @@ static int HTTP_read(RTMP *r, int fill);
 
 #ifndef _WIN32
 static int clk_tck;
+#include <sys/uio.h>
 #endif
 
 #ifdef CRYPTO
@@ -363,6 +368,7 @@ RTMP_Init(RTMP *r)
     r->m_inChunkSize = RTMP_DEFAULT_CHUNKSIZE;
     r->m_outChunkSize = RTMP_DEFAULT_CHUNKSIZE;
     r->m_bSendChunkSizeInfo = 1;
+    r->m_bVectoredSend = 1;
     r->m_nBufferMS = 30000;
     r->m_nClientBW = 2500000;
     r->m_nClientBW2 = 2;
@@ -1806,6 +1812,121 @@ WriteN(RTMP *r, const char *buffer, int n)
     return n == 0;
 }
 
+/* writes straight to a plain socket with WSASend/writev, picking up after partial writes */
+static int
+WriteSocketV(RTMP *r, const RTMPIOVec *vec, int count)
+{
+#ifdef _WIN32
+    WSABUF bufs[RTMP_MAX_SEND_VECS];
+#else
+    struct iovec bufs[RTMP_MAX_SEND_VECS];
+#endif
+    int i, first = 0;
+
+    for (i = 0; i < count; i++)
+    {
+#ifdef _WIN32
+        bufs[i].buf = (CHAR *)vec[i].buf;
+        bufs[i].len = (ULONG)vec[i].len;
+#else
+        bufs[i].iov_base = (void *)vec[i].buf;
+        bufs[i].iov_len = (size_t)vec[i].len;
+#endif
+    }
+
+    while (first < count)
+    {
+        int nBytes;
+#ifdef _WIN32
+        DWORD sent = 0;
+        nBytes = (WSASend(r->m_sb.sb_socket, bufs + first, count - first, &sent, 0, NULL, NULL) == 0) ? (int)sent : -1;
+#else
+        nBytes = (int)writev(r->m_sb.sb_socket, bufs + first, count - first);
+#endif
+
+        if (nBytes < 0)
+        {
+            int sockerr = GetSockError();
+            RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error %d", __FUNCTION__, sockerr);
+
+            if (sockerr == EINTR && !RTMP_ctrlC)
+                continue;
+
+            RTMP_Close(r);
+            return FALSE;
+        }
+
+        if (nBytes == 0)
+            return FALSE;
+
+        while (first < count)
+        {
+#ifdef _WIN32
+            int len = (int)bufs[first].len;
+#else
+            int len = (int)bufs[first].iov_len;
+#endif
+            if (nBytes < len)
+            {
+#ifdef _WIN32
+                bufs[first].buf += nBytes;
+                bufs[first].len -= nBytes;
+#else
+                bufs[first].iov_base = (char *)bufs[first].iov_base + nBytes;
+                bufs[first].iov_len -= nBytes;
+#endif
+                break;
+            }
+
+            nBytes -= len;
+            first++;
+        }
+    }
+
+    return TRUE;
+}
+
+/* count must be RTMP_MAX_SEND_VECS or less */
+static int
+WriteV(RTMP *r, const RTMPIOVec *vec, int count)
+{
+    int i;
+
+#ifdef CRYPTO
+    /* the rc4 stream has to be encrypted in order, one buffer at a time */
+    if (!r->Link.rc4keyOut)
+#endif
+    {
+        if (r->m_bCustomSend && r->m_customSendVecFunc)
+        {
+            int nBytes, total = 0;
+            for (i = 0; i < count; i++)
+                total += vec[i].len;
+
+            nBytes = r->m_customSendVecFunc(&r->m_sb, vec, count, r->m_customSendParam);
+            if (nBytes < 0)
+            {
+                RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error (%d bytes)", __FUNCTION__, total);
+                RTMP_Close(r);
+                return FALSE;
+            }
+
+            return nBytes == total;
+        }
+
+        if (!r->m_bCustomSend && !r->m_sb.sb_ssl && !(r->Link.protocol & RTMP_FEATURE_HTTP))
+            return WriteSocketV(r, vec, count);
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        if (!WriteN(r, vec[i].buf, vec[i].len))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
 #define SAVC(x)	static const AVal av_##x = AVC(#x)
 
 SAVC(app);
@@ -4363,7 +4484,73 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
             toff = tbuf;
         }
     }
-    while (nSize + hSize)
+    if (!tbuf && r->m_bVectoredSend)
+    {
+        /* gather every chunk into as few writes as possible.  continuation headers get their own
+         * storage rather than being written over the end of the previous chunk, since that chunk
+         * hasn't been sent yet */
+        RTMPIOVec vec[RTMP_MAX_SEND_VECS];
+        char chunkHeaders[RTMP_MAX_SEND_VECS/2][3];
+        int numVecs = 0;
+
+        if (nSize < nChunkSize)
+            nChunkSize = nSize;
+
+        RTMP_LogHexString(RTMP_LOGDEBUG2, (uint8_t *)header, hSize);
+        RTMP_LogHexString(RTMP_LOGDEBUG2, (uint8_t *)buffer, nChunkSize);
+
+        /* the first header was built right in front of the body */
+        vec[numVecs].buf = header;
+        vec[numVecs].len = hSize + nChunkSize;
+        numVecs++;
+
+        nSize -= nChunkSize;
+        buffer += nChunkSize;
+
+        while (nSize > 0)
+        {
+            char *chunkHeader;
+
+            if (numVecs + 2 > RTMP_MAX_SEND_VECS)
+            {
+                if (!WriteV(r, vec, numVecs))
+                    return FALSE;
+                numVecs = 0;
+            }
+
+            if (nSize < nChunkSize)
+                nChunkSize = nSize;
+
+            chunkHeader = chunkHeaders[numVecs/2];
+            chunkHeader[0] = (0xc0 | c);
+            hSize = 1;
+            if (cSize)
+            {
+                int tmp = packet->m_nChannel - 64;
+                chunkHeader[1] = tmp & 0xff;
+                if (cSize == 2)
+                    chunkHeader[2] = tmp >> 8;
+                hSize += cSize;
+            }
+
+            RTMP_LogHexString(RTMP_LOGDEBUG2, (uint8_t *)chunkHeader, hSize);
+            RTMP_LogHexString(RTMP_LOGDEBUG2, (uint8_t *)buffer, nChunkSize);
+
+            vec[numVecs].buf = chunkHeader;
+            vec[numVecs].len = hSize;
+            numVecs++;
+            vec[numVecs].buf = buffer;
+            vec[numVecs].len = nChunkSize;
+            numVecs++;
+
+            nSize -= nChunkSize;
+            buffer += nChunkSize;
+        }
+
+        if (!WriteV(r, vec, numVecs))
+            return FALSE;
+    }
+    else while (nSize + hSize)
     {
         int wrote;
 
@@ -249,6 +249,16 @@ extern "C"
 
     typedef int (*CUSTOMSEND)(RTMPSockBuf*, const char *, int, void*);
 
+    typedef struct RTMPIOVec
+    {
+        const char *buf;
+        int len;
+    } RTMPIOVec;
+
+    /* vectored version of CUSTOMSEND, used by RTMP_SendPacket to hand over every chunk of a packet in
+     * one call.  must take all of the data; returns the total number of bytes, or < 0 on error */
+    typedef int (*CUSTOMSENDV)(RTMPSockBuf*, const RTMPIOVec *, int, void*);
+
     typedef struct RTMP
     {
         int m_inChunkSize;
@@ -273,6 +283,9 @@ extern "C"
         uint8_t m_bCustomSend;
         void*   m_customSendParam;
         CUSTOMSEND m_customSendFunc;
+        CUSTOMSENDV m_customSendVecFunc;	/* optional, m_customSendFunc is used if NULL */
+        uint8_t m_bVectoredSend;	/* gather a packet's chunks into one write, on by default.  when off
+                                 * every chunk is written on its own, headers laid over the body */
 
         RTMP_BINDINFO m_bindIP;
 
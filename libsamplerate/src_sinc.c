@@ -41,6 +41,19 @@
 #define	FP_ONE					((double) (((increment_t) 1) << SHIFT_BITS))
 #define	INV_FP_ONE				(1.0 / FP_ONE)
 
+/* Enough phases for 44100 <-> 48000, which need 160 and 147. */
+#define	SINC_MAX_PHASES			160
+
+/* Zeroed floats between the buffer and the phase table, for the padded tail of each row. */
+#define	SINC_PHASE_SLACK		16
+
+#if (defined (__SSE__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 1))
+#define	SINC_USE_SSE			1
+#include <xmmintrin.h>
+#else
+#define	SINC_USE_SSE			0
+#endif
+
 /*========================================================================================
 */
 
@@ -69,6 +82,15 @@ typedef struct
 	/* Sure hope noone does more than 128 channels at once. */
 	double left_calc [128], right_calc [128] ;
 
+	/* Stereo polyphase table, see stereo_phase_setup (). The coefficients
+	** live in the same allocation, after the buffer.
+	*/
+	double	phase_ratio ;
+	int		phase_count, phase_len, phase_capacity ;
+	float	*phase_coeffs ;
+	increment_t	phase_start [SINC_MAX_PHASES] ;
+	int		phase_left [SINC_MAX_PHASES] ;
+
 	/* C99 struct flexible array. */
 	float	buffer [] ;
 } SINC_FILTER ;
@@ -230,12 +252,19 @@ sinc_set_converter (SRC_PRIVATE *psrc, int src_enum)
 	temp_filter.b_len = MAX (temp_filter.b_len, 4096) ;
 	temp_filter.b_len *= temp_filter.channels ;
 
-	if ((filter = calloc (1, sizeof (SINC_FILTER) + sizeof (filter->buffer [0]) * (temp_filter.b_len + temp_filter.channels))) == NULL)
+	/* Room for the widest rows down to a ratio of 0.9, which covers 48000 -> 44100. */
+	if (temp_filter.channels == 2)
+		temp_filter.phase_capacity = SINC_MAX_PHASES * (2 * lrint (temp_filter.coeff_half_len / (temp_filter.index_inc * 0.9)) + 8) ;
+
+	if ((filter = calloc (1, sizeof (SINC_FILTER) + sizeof (filter->buffer [0]) *
+				(temp_filter.b_len + temp_filter.channels + SINC_PHASE_SLACK + temp_filter.phase_capacity))) == NULL)
 		return SRC_ERR_MALLOC_FAILED ;
 
 	*filter = temp_filter ;
 	memset (&temp_filter, 0xEE, sizeof (temp_filter)) ;
 
+	filter->phase_coeffs = filter->buffer + filter->b_len + filter->channels + SINC_PHASE_SLACK ;
+
 	psrc->private_data = filter ;
 
 	sinc_reset (psrc) ;
@@ -474,12 +503,149 @@ calc_output_stereo (SINC_FILTER *filter, increment_t increment, increment_t star
 	output [1] = scale * (left [1] + right [1]) ;
 } /* calc_output_stereo */
 
+/*
+** At a fixed ratio like 44100 <-> 48000 the input position only ever lands on
+** a handful of fractions, so the interpolated coefficients for each of them
+** can be worked out once. A row holds the scaled coefficient for every input
+** frame from the oldest tap of the left half up to the newest of the right,
+** zero padded to a multiple of four for the SSE loop.
+*/
+
+static void
+stereo_phase_setup (SINC_FILTER *filter, double src_ratio)
+{	double		float_increment, scale, step, fraction, icoeff ;
+	increment_t	increment, start_filter_index, filter_index, max_filter_index ;
+	int			phases, phase, left_count, right_count, len, indx, k ;
+	float		*row ;
+
+	filter->phase_ratio = src_ratio ;
+	filter->phase_count = 0 ;
+
+	if (filter->phase_capacity <= 0)
+		return ;
+
+	/* The input position steps by 1 / src_ratio, so it needs that to be a
+	** fraction with at most SINC_MAX_PHASES as the denominator.
+	*/
+	step = 1.0 / src_ratio ;
+	for (phases = 1 ; phases <= SINC_MAX_PHASES ; phases++)
+		if (fabs (phases * step - lrint (phases * step)) < 1e-9)
+			break ;
+
+	if (phases > SINC_MAX_PHASES)
+		return ;
+
+	float_increment = filter->index_inc * 1.0 ;
+	if (src_ratio < 1.0)
+		float_increment = filter->index_inc * src_ratio ;
+
+	increment = double_to_fp (float_increment) ;
+	scale = float_increment / filter->index_inc ;
+	max_filter_index = int_to_fp (filter->coeff_half_len) ;
+
+	len = 0 ;
+	for (phase = 0 ; phase < phases ; phase++)
+	{	start_filter_index = double_to_fp (((double) phase / phases) * float_increment) ;
+
+		left_count = (max_filter_index - start_filter_index) / increment ;
+		right_count = (max_filter_index - (increment - start_filter_index)) / increment ;
+
+		filter->phase_start [phase] = start_filter_index ;
+		filter->phase_left [phase] = left_count ;
+		len = MAX (len, left_count + right_count + 2) ;
+		} ;
+
+	len = (len + 3) & ~3 ;
+	if (phases * len > filter->phase_capacity)
+		return ;
+
+	memset (filter->phase_coeffs, 0, phases * len * sizeof (filter->phase_coeffs [0])) ;
+
+	/* Same walk over the coefficients as calc_output_stereo (). */
+	for (phase = 0 ; phase < phases ; phase++)
+	{	row = filter->phase_coeffs + phase * len ;
+		start_filter_index = filter->phase_start [phase] ;
+		left_count = filter->phase_left [phase] ;
+
+		filter_index = start_filter_index + left_count * increment ;
+		k = 0 ;
+		do
+		{	fraction = fp_to_double (filter_index) ;
+			indx = fp_to_int (filter_index) ;
+
+			icoeff = filter->coeffs [indx] + fraction * (filter->coeffs [indx + 1] - filter->coeffs [indx]) ;
+			row [k] = (float) (scale * icoeff) ;
+
+			filter_index -= increment ;
+			k ++ ;
+			}
+		while (filter_index >= MAKE_INCREMENT_T (0)) ;
+
+		filter_index = increment - start_filter_index ;
+		right_count = (max_filter_index - filter_index) / increment ;
+		filter_index = filter_index + right_count * increment ;
+		k = left_count + 1 + right_count ;
+		do
+		{	fraction = fp_to_double (filter_index) ;
+			indx = fp_to_int (filter_index) ;
+
+			icoeff = filter->coeffs [indx] + fraction * (filter->coeffs [indx + 1] - filter->coeffs [indx]) ;
+			row [k] = (float) (scale * icoeff) ;
+
+			filter_index -= increment ;
+			k -- ;
+			}
+		while (filter_index > MAKE_INCREMENT_T (0)) ;
+		} ;
+
+	filter->phase_len = len ;
+	filter->phase_count = phases ;
+} /* stereo_phase_setup */
+
+static inline void
+calc_output_stereo_phase (SINC_FILTER *filter, int phase, float * output)
+{	const float	*coeffs, *data ;
+	int			k ;
+
+	coeffs = filter->phase_coeffs + phase * filter->phase_len ;
+	data = filter->buffer + filter->b_current - 2 * filter->phase_left [phase] ;
+
+#if SINC_USE_SSE
+	{	__m128	c, sum0, sum1 ;
+
+		/* Each coefficient covers a left/right pair, so four of them take two loads. */
+		sum0 = sum1 = _mm_setzero_ps () ;
+		for (k = 0 ; k < filter->phase_len ; k += 4)
+		{	c = _mm_loadu_ps (coeffs + k) ;
+			sum0 = _mm_add_ps (sum0, _mm_mul_ps (_mm_unpacklo_ps (c, c), _mm_loadu_ps (data + 2 * k))) ;
+			sum1 = _mm_add_ps (sum1, _mm_mul_ps (_mm_unpackhi_ps (c, c), _mm_loadu_ps (data + 2 * k + 4))) ;
+			} ;
+
+		sum0 = _mm_add_ps (sum0, sum1) ;
+		sum0 = _mm_add_ps (sum0, _mm_movehl_ps (sum0, sum0)) ;
+		_mm_storel_pi ((__m64*) output, sum0) ;
+		}
+#else
+	{	float	left, right ;
+
+		left = right = 0.0f ;
+		for (k = 0 ; k < filter->phase_len ; k++)
+		{	left += coeffs [k] * data [2 * k] ;
+			right += coeffs [k] * data [2 * k + 1] ;
+			} ;
+
+		output [0] = left ;
+		output [1] = right ;
+		}
+#endif
+} /* calc_output_stereo_phase */
+
 static int
 sinc_stereo_vari_process (SRC_PRIVATE *psrc, SRC_DATA *data)
 {	SINC_FILTER *filter ;
 	double		input_index, src_ratio, count, float_increment, terminate, rem ;
 	increment_t	increment, start_filter_index ;
-	int			half_filter_chan_len, samples_in_hand ;
+	int			half_filter_chan_len, samples_in_hand, phase_count, phase ;
 
 	if (psrc->private_data == NULL)
 		return SRC_ERR_NO_PRIVATE ;
@@ -496,6 +662,14 @@ sinc_stereo_vari_process (SRC_PRIVATE *psrc, SRC_DATA *data)
 
 	src_ratio = psrc->last_ratio ;
 
+	/* The phase table is only any use while the ratio holds still. */
+	phase_count = 0 ;
+	if (fabs (psrc->last_ratio - data->src_ratio) <= 1e-10)
+	{	if (filter->phase_ratio != src_ratio)
+			stereo_phase_setup (filter, src_ratio) ;
+		phase_count = filter->phase_count ;
+		} ;
+
 	/* Check the sample rate ratio wrt the buffer len. */
 	count = (filter->coeff_half_len + 2.0) / filter->index_inc ;
 	if (MIN (psrc->last_ratio, data->src_ratio) < 1.0)
@@ -545,7 +719,12 @@ sinc_stereo_vari_process (SRC_PRIVATE *psrc, SRC_DATA *data)
 
 		start_filter_index = double_to_fp (input_index * float_increment) ;
 
-		calc_output_stereo (filter, increment, start_filter_index, float_increment / filter->index_inc, data->data_out + filter->out_gen) ;
+		/* Positions that have drifted off the table's fractions take the slow path. */
+		phase = phase_count ? lrint (input_index * phase_count) : 0 ;
+		if (phase_count && phase < phase_count && filter->phase_start [phase] == start_filter_index)
+			calc_output_stereo_phase (filter, phase, data->data_out + filter->out_gen) ;
+		else
+			calc_output_stereo (filter, increment, start_filter_index, float_increment / filter->index_inc, data->data_out + filter->out_gen) ;
 		filter->out_gen += 2 ;
 
 		/* Figure out the next index. */